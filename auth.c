@@ -0,0 +1,152 @@
+#include "auth.h"
+#include "sha256.h"
+#include <string.h>
+
+#define HEADER_SIZE ((uint32_t)sizeof(tinybft_msg_header_t))
+#define BLOCK_SIZE 64
+#define HMAC_INPUT (BLOCK_SIZE + TINYBFT_SHA256_SIZE)  // Padded key block, then a digest
+
+_Static_assert(TINYBFT_AUTH_SIZE <= TINYBFT_SHA256_SIZE, "Authenticator entries are truncated HMAC-SHA256");
+_Static_assert(TINYBFT_AUTH_KEY_SIZE <= BLOCK_SIZE, "Session keys fit in one HMAC block");
+_Static_assert(TINYBFT_MAX_REPLICAS <= TINYBFT_AUTH_BATCH, "Signing computes every entry in one batch");
+
+static void expand_key(tinybft_auth_key_t* key, const uint8_t raw[TINYBFT_AUTH_KEY_SIZE]) {
+    memset(key->ipad, 0x36, BLOCK_SIZE);
+    memset(key->opad, 0x5c, BLOCK_SIZE);
+    for (uint32_t i = 0; i < TINYBFT_AUTH_KEY_SIZE; i++) {
+        key->ipad[i] ^= raw[i];
+        key->opad[i] ^= raw[i];
+    }
+}
+
+void tinybft_auth_init(tinybft_auth_t* auth, uint32_t id) {
+    static const uint8_t zero[TINYBFT_AUTH_KEY_SIZE];
+
+    auth->id = id;
+    for (uint32_t j = 0; j < TINYBFT_MAX_REPLICAS; j++) {
+        expand_key(&auth->out[j], zero);
+        expand_key(&auth->in[j], zero);
+    }
+}
+
+void tinybft_auth_set_keys(tinybft_auth_t* auth, uint32_t peer, const uint8_t out_key[TINYBFT_AUTH_KEY_SIZE],
+                           const uint8_t in_key[TINYBFT_AUTH_KEY_SIZE]) {
+    if (peer < TINYBFT_MAX_REPLICAS) {
+        expand_key(&auth->out[peer], out_key);
+        expand_key(&auth->in[peer], in_key);
+    }
+}
+
+// HMAC-SHA256 of count digests, each under its own key. Both passes hash
+// equal-length inputs, so every lane of the multi-buffer hash is used.
+static void hmac_batch(const tinybft_auth_key_t* const keys[], uint8_t (*digests)[TINYBFT_SHA256_SIZE],
+                       uint32_t count, uint8_t (*macs)[TINYBFT_SHA256_SIZE]) {
+    uint8_t inputs[TINYBFT_AUTH_BATCH][HMAC_INPUT];
+    const uint8_t* data[TINYBFT_AUTH_BATCH] = { NULL };
+    uint8_t* out[TINYBFT_AUTH_BATCH] = { NULL };
+
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(inputs[i], keys[i]->ipad, BLOCK_SIZE);
+        memcpy(inputs[i] + BLOCK_SIZE, digests[i], TINYBFT_SHA256_SIZE);
+        data[i] = inputs[i];
+        out[i] = macs[i];
+    }
+    tinybft_sha256_multi(data, HMAC_INPUT, out, count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(inputs[i], keys[i]->opad, BLOCK_SIZE);
+        memcpy(inputs[i] + BLOCK_SIZE, macs[i], TINYBFT_SHA256_SIZE);
+    }
+    tinybft_sha256_multi(data, HMAC_INPUT, out, count);
+}
+
+void tinybft_auth_sign(const tinybft_auth_t* auth, const tinybft_msg_header_t* hdr, const void* payload,
+                       uint32_t receivers, uint8_t authenticator[TINYBFT_AUTHENTICATOR_SIZE]) {
+    const tinybft_auth_key_t* keys[TINYBFT_MAX_REPLICAS];
+    uint8_t digests[TINYBFT_MAX_REPLICAS][TINYBFT_SHA256_SIZE];
+    uint8_t macs[TINYBFT_MAX_REPLICAS][TINYBFT_SHA256_SIZE];
+    uint32_t receiver[TINYBFT_MAX_REPLICAS];
+    uint32_t count = 0;
+
+    // Header and payload are usually contiguous; otherwise hash a copy
+    if ((const uint8_t*)payload == (const uint8_t*)(hdr + 1)) {
+        tinybft_sha256(hdr, HEADER_SIZE + hdr->data_len, digests[0]);
+    } else {
+        uint8_t msg[TINYBFT_MAX_MSG_SIZE];
+        uint32_t len = hdr->data_len <= TINYBFT_MAX_MSG_SIZE - HEADER_SIZE ? hdr->data_len : TINYBFT_MAX_MSG_SIZE - HEADER_SIZE;
+        memcpy(msg, hdr, HEADER_SIZE);
+        memcpy(msg + HEADER_SIZE, payload, len);
+        tinybft_sha256(msg, HEADER_SIZE + len, digests[0]);
+    }
+
+    for (uint32_t j = 0; j < TINYBFT_MAX_REPLICAS; j++) {
+        if (receivers & (1u << j)) {
+            memcpy(digests[count], digests[0], TINYBFT_SHA256_SIZE);
+            keys[count] = &auth->out[j];
+            receiver[count++] = j;
+        }
+    }
+    hmac_batch(keys, digests, count, macs);
+
+    memset(authenticator, 0, TINYBFT_AUTHENTICATOR_SIZE);
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(authenticator + receiver[i] * TINYBFT_AUTH_SIZE, macs[i], TINYBFT_AUTH_SIZE);
+    }
+}
+
+// Comparison time does not depend on where the entries differ
+static bool same_mac(const uint8_t* a, const uint8_t* b) {
+    uint8_t diff = 0;
+    for (uint32_t i = 0; i < TINYBFT_AUTH_SIZE; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+// Verify up to TINYBFT_AUTH_BATCH messages
+static void verify_batch(const tinybft_auth_t* auth, const tinybft_msg_header_t* const msgs[], uint32_t count,
+                         bool valid[]) {
+    const tinybft_auth_key_t* keys[TINYBFT_AUTH_BATCH];
+    uint8_t digests[TINYBFT_AUTH_BATCH][TINYBFT_SHA256_SIZE];
+    uint8_t macs[TINYBFT_AUTH_BATCH][TINYBFT_SHA256_SIZE];
+    bool digested[TINYBFT_AUTH_BATCH] = { false };
+
+    // Messages of the same length (votes, mostly) are digested together
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* data[TINYBFT_AUTH_BATCH];
+        uint8_t* out[TINYBFT_AUTH_BATCH];
+        uint32_t len = HEADER_SIZE + msgs[i]->data_len;
+        uint32_t n = 0;
+
+        for (uint32_t j = i; j < count; j++) {
+            if (!digested[j] && HEADER_SIZE + msgs[j]->data_len == len) {
+                data[n] = (const uint8_t*)msgs[j];
+                out[n++] = digests[j];
+                digested[j] = true;
+            }
+        }
+        if (n > 0) {
+            tinybft_sha256_multi(data, len, out, n);
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        // A message claiming to come from no replica is checked under a
+        // placeholder key and rejected afterwards
+        keys[i] = &auth->in[msgs[i]->sender_id < TINYBFT_MAX_REPLICAS ? msgs[i]->sender_id : 0];
+    }
+    hmac_batch(keys, digests, count, macs);
+
+    for (uint32_t i = 0; i < count; i++) {
+        valid[i] = msgs[i]->sender_id < TINYBFT_MAX_REPLICAS && msgs[i]->sender_id != auth->id &&
+                   same_mac(macs[i], tinybft_msg_authenticator(msgs[i]) + auth->id * TINYBFT_AUTH_SIZE);
+    }
+}
+
+void tinybft_auth_verify(const tinybft_auth_t* auth, const tinybft_msg_header_t* const msgs[], uint32_t count,
+                         bool valid[]) {
+    for (uint32_t i = 0; i < count; i += TINYBFT_AUTH_BATCH) {
+        uint32_t n = count - i < TINYBFT_AUTH_BATCH ? count - i : TINYBFT_AUTH_BATCH;
+        verify_batch(auth, msgs + i, n, valid + i);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef TINYBFT_AUTH_H
+#define TINYBFT_AUTH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory_layout.h"
+
+// MAC-vector authenticators. A message between replicas is followed by one
+// truncated HMAC-SHA256 per replica, each under the session key the sender
+// shares with that receiver, over the SHA-256 digest of header and payload.
+// A multicast message is authenticated once for every receiver, and each
+// receiver checks only its own entry. Verification takes a batch of
+// messages so that the equal-length HMAC inputs share the multi-buffer hash.
+
+#define TINYBFT_AUTH_KEY_SIZE 32
+#define TINYBFT_AUTHENTICATOR_SIZE (TINYBFT_MAX_REPLICAS * TINYBFT_AUTH_SIZE)
+
+#ifndef TINYBFT_AUTH_BATCH
+#define TINYBFT_AUTH_BATCH 32  // Messages verified together by the receive path
+#endif
+
+// HMAC key of one direction of a replica pair, kept as its padded blocks
+typedef struct {
+    uint8_t ipad[64];
+    uint8_t opad[64];
+} tinybft_auth_key_t;
+
+typedef struct {
+    uint32_t id;
+    tinybft_auth_key_t out[TINYBFT_MAX_REPLICAS];  // From this replica to replica j
+    tinybft_auth_key_t in[TINYBFT_MAX_REPLICAS];   // From replica j to this replica
+} tinybft_auth_t;
+
+// Every session key starts out all zeros until set
+void tinybft_auth_init(tinybft_auth_t* auth, uint32_t id);
+
+// Install the keys this replica shares with a peer, one per direction
+void tinybft_auth_set_keys(tinybft_auth_t* auth, uint32_t peer, const uint8_t out_key[TINYBFT_AUTH_KEY_SIZE],
+                           const uint8_t in_key[TINYBFT_AUTH_KEY_SIZE]);
+
+// Fill the entries of the replicas in `receivers` (a bitmap) for a message
+// made of hdr and hdr->data_len payload bytes; the other entries are zeroed
+void tinybft_auth_sign(const tinybft_auth_t* auth, const tinybft_msg_header_t* hdr, const void* payload,
+                       uint32_t receivers, uint8_t authenticator[TINYBFT_AUTHENTICATOR_SIZE]);
+
+// Check this replica's entry of `count` messages from replicas, each laid out
+// as header, payload and authenticator; valid[i] receives the outcome
+void tinybft_auth_verify(const tinybft_auth_t* auth, const tinybft_msg_header_t* const msgs[], uint32_t count,
+                         bool valid[]);
+
+// Authenticator following a message's payload
+static inline const uint8_t* tinybft_msg_authenticator(const tinybft_msg_header_t* msg) {
+    return (const uint8_t*)(msg + 1) + msg->data_len;
+}
+
+#endif // TINYBFT_AUTH_H
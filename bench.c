@@ -0,0 +1,1496 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "replica.h"
+#include "engine.h"
+#include "sim.h"
+#include "udp.h"
+#include "partition_tree.h"
+#include "sha256.h"
+#include "bench_util.h"
+#include "worker_pool.h"
+
+// Headless benchmark driver for the PUT/GET replica pipeline
+
+typedef enum {
+    BENCH_MODE_PIPELINE = 0,  // Simulated protocol phases in replica.c
+    BENCH_MODE_ENGINE,        // Message-passing engine, one thread per replica
+    BENCH_MODE_SIM,           // Replica cores in the discrete-event simulator, virtual time
+    BENCH_MODE_UDP            // One process per replica, talking over loopback UDP
+} bench_mode_t;
+
+typedef struct {
+    bench_mode_t mode;
+    int faulty;
+    int forger;              // Engine mode: replica whose authenticators are garbled (-1 = none)
+    uint64_t recover_after;  // Engine mode: the faulty replica recovers after this many ops (0 = never)
+    uint64_t crash_after;    // The faulty replica crashes after this many ops (0 = faulty from the start)
+    uint64_t ops;
+    uint64_t keys;
+    bench_dist_t dist;
+    double theta;
+    uint32_t read_pct;
+    uint64_t seed;
+    uint32_t clients;
+    uint32_t window;         // Engine mode: operations each client keeps in flight
+    uint32_t batch;
+    uint32_t depth;
+    uint32_t delay_us;
+    bool ordered_reads;      // Engine mode: order GETs like PUTs instead of the read-only path
+    bool tentative;          // Replicas execute prepared batches ahead of their commit
+    uint32_t exec_threads;   // Worker threads per replica executing non-conflicting requests in parallel
+    uint32_t groups;         // Engine mode: replica groups the keys are sharded over
+    bool batch_sweep;
+    bool depth_sweep;
+    bool kv_sweep;
+    bool tree_sweep;
+    bool sha_sweep;
+    const char* nvm_dir;      // Engine mode: persist replicas there
+    const char* startup_path; // Compare cold start with remapping this NVM file
+    tinybft_sim_link_t link;  // Sim mode: every link (latency_us comes from delay_us)
+    tinybft_sim_faults_t faults;
+    uint32_t service_ns;      // Sim mode: processing time per message
+    uint16_t udp_port;        // UDP mode: port of endpoint 0
+    int udp_replica;          // UDP mode: only run this replica, in the foreground (-1 = run the benchmark)
+} bench_config_t;
+
+typedef struct {
+    uint64_t elapsed_ns;
+    uint64_t misses;
+    uint64_t failures;
+    uint64_t fast_reads;     // GETs accepted on 2f+1 read-only replies
+    uint64_t read_fallbacks; // GETs ordered after the read-only replies disagreed
+    uint64_t group_ops[TINYBFT_ENGINE_GROUPS];       // Engine mode: operations each group completed
+    uint64_t group_committed[TINYBFT_ENGINE_GROUPS]; // and the instances its replicas committed, at most
+    uint64_t committed[NUM_REPLICAS];
+    uint64_t executed[NUM_REPLICAS];
+    uint64_t tentative[NUM_REPLICAS];
+    uint64_t rollbacks[NUM_REPLICAS];
+    uint64_t parallel_runs[NUM_REPLICAS];
+    uint64_t parallel_tasks[NUM_REPLICAS];
+    uint64_t checkpoints[NUM_REPLICAS];
+    uint64_t checkpoint_blocks[NUM_REPLICAS];
+    uint64_t stable_checkpoints[NUM_REPLICAS];
+    uint64_t transfers[NUM_REPLICAS];
+    uint64_t transfer_blocks[NUM_REPLICAS];
+    uint64_t forged[NUM_REPLICAS];
+    uint32_t scratch_high_water[NUM_REPLICAS][TINYBFT_SCRATCH_CLASSES];
+    tinybft_memory_usage_t high_water[NUM_REPLICAS];
+    uint64_t received[TINYBFT_MSG_TYPES];     // Summed over the replicas
+    uint64_t copied_bytes[TINYBFT_MSG_TYPES];
+    uint32_t behind_by;      // Sequence numbers the faulty replica missed before recovering
+    uint64_t recovery_ns;    // Until it kept pace with the others again (0 = did not)
+    uint64_t recovery_transfers; // State transfers it took to get there
+    uint64_t recovery_blocks; // State blocks it fetched to get there
+    uint64_t crash_ns;       // When the faulty replica crashed, on the replicas' clock
+    uint32_t crash_view;     // The view the others were in then
+    uint32_t view[NUM_REPLICAS];
+    uint64_t view_changes[NUM_REPLICAS];
+    uint64_t view_commit_ms[NUM_REPLICAS];
+    uint32_t view_timeout[NUM_REPLICAS];
+    uint64_t wall_ns;        // Sim mode: real time the simulation took
+    uint64_t trace_hash;
+    tinybft_sim_stats_t sim;
+    tinybft_udp_stats_t udp[NUM_REPLICAS];  // UDP mode
+    uint64_t udp_client_syscalls;
+} bench_result_t;
+
+static bench_hist_t put_hist;
+static bench_hist_t get_hist;
+static bench_hist_t all_hist;
+
+// Operation outstanding on each client session
+typedef struct {
+    bool busy;
+    bool is_read;
+    uint32_t group;  // Engine mode: the group serving its key
+    uint64_t start_ns;
+} bench_client_t;
+
+static bench_client_t clients[TINYBFT_MAX_CLIENTS];
+
+// UDP mode: the replica processes and the counters they share with the driver
+static pid_t udp_pids[NUM_REPLICAS];
+static tinybft_udp_stats_t* udp_stats;
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  --mode NAME      pipeline | engine | sim | udp (default pipeline)\n");
+    printf("  --faulty ID      Mark replica ID faulty for the whole run\n");
+    printf("  --forger ID      Engine mode: replica ID sends messages with wrong authenticators\n");
+    printf("  --recover-after N  Engine mode: the faulty replica recovers after N ops and catches up by state transfer\n");
+    printf("  --crash-after N  The faulty replica crashes after N ops instead of at the start\n");
+    printf("  --ops N          Number of operations (default 1000000)\n");
+    printf("  --keys N         Size of the key space (default %d)\n", MAX_KEYS);
+    printf("  --dist NAME      Key distribution: uniform | zipfian (default uniform)\n");
+    printf("  --theta X        Zipfian skew (default 0.99)\n");
+    printf("  --reads PCT      Percentage of GET operations (default 50)\n");
+    printf("  --seed N         Workload seed (default 1)\n");
+    printf("  --clients N      Concurrent clients (default 1, max %d)\n", TINYBFT_MAX_CLIENTS);
+    printf("  --window N       Operations each client keeps in flight, engine mode (default 1; clients x N <= %d)\n",
+           TINYBFT_MAX_CLIENTS);
+    printf("  --batch N        Requests per PRE-PREPARE, engine mode (default %d)\n", TINYBFT_MAX_BATCH);
+    printf("  --depth N        Agreement instances in flight, engine mode (default %d)\n", TINYBFT_WINDOW_SIZE);
+    printf("  --delay-us N     One-way link delay in microseconds, engine mode (default 0)\n");
+    printf("  --ordered-reads  Engine mode: order GETs instead of answering them read-only\n");
+    printf("  --tentative      Execute prepared batches before they commit; clients accept 2f+1 tentative replies\n");
+    printf("  --exec-threads N Worker threads per replica executing requests on different keys in parallel (default 0, max %d)\n",
+           TINYBFT_POOL_MAX_WORKERS);
+    printf("  --groups N       Engine mode: shard keys over N replica groups, each on its own CPUs (default 1, max %d)\n",
+           TINYBFT_ENGINE_GROUPS);
+    printf("  --batch-sweep    Engine mode: report throughput/latency for batch sizes 1..%d\n", TINYBFT_MAX_BATCH);
+    printf("  --depth-sweep    Engine mode: report throughput/latency for depths 1..%d\n", TINYBFT_WINDOW_SIZE);
+    printf("  --kv-sweep       Report key-value store lookup cost as the table fills (%d keys max)\n", MAX_KEYS);
+    printf("  --tree-sweep     Report checkpoint cost against the number of dirty state blocks\n");
+    printf("  --sha-sweep      Report SHA-256 throughput of every path the CPU supports\n");
+    printf("  --nvm DIR        Engine mode: keep replicas in NVM files under DIR and resume from them\n");
+    printf("  --nvm-startup FILE  Report cold start (replay) against remapping an NVM file of --keys keys\n");
+    printf("Sim mode (virtual time; --delay-us is the link latency, --faulty silences a replica):\n");
+    printf("  --jitter-us N    Per-message delay spread (default 0)\n");
+    printf("  --jitter-dist NAME  fixed | uniform | exp (default uniform when --jitter-us is set)\n");
+    printf("  --bandwidth-mbps N  Link bandwidth (default unlimited)\n");
+    printf("  --loss P         Probability that a transmission is lost (default 0)\n");
+    printf("  --rto-us N       Resend lost messages after N us (default 0: lost for good)\n");
+    printf("  --reorder P      Probability that a message is held back by --reorder-us (default 0)\n");
+    printf("  --reorder-us N   Hold-back time for reordered messages (default 500)\n");
+    printf("  --service-ns N   Processing time per message (default 2000)\n");
+    printf("  --equivocate ID  The primary sends backup ID a conflicting PRE-PREPARE (repeatable)\n");
+    printf("  --corrupt-votes ID  Replica ID votes for wrong digests (repeatable)\n");
+    printf("UDP mode (a process per replica; --faulty leaves one out or, with --crash-after, kills it):\n");
+    printf("  --udp-port N     Port of replica 0; endpoint e listens on N + e (default %d)\n", TINYBFT_UDP_PORT);
+    printf("  --udp-replica ID Run only replica ID in the foreground until interrupted\n");
+}
+
+static bool parse_args(int argc, char** argv, bench_config_t* cfg) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            return false;
+        }
+        if (strcmp(arg, "--batch-sweep") == 0) {
+            cfg->batch_sweep = true;
+            continue;
+        }
+        if (strcmp(arg, "--depth-sweep") == 0) {
+            cfg->depth_sweep = true;
+            continue;
+        }
+        if (strcmp(arg, "--kv-sweep") == 0) {
+            cfg->kv_sweep = true;
+            continue;
+        }
+        if (strcmp(arg, "--tree-sweep") == 0) {
+            cfg->tree_sweep = true;
+            continue;
+        }
+        if (strcmp(arg, "--sha-sweep") == 0) {
+            cfg->sha_sweep = true;
+            continue;
+        }
+        if (strcmp(arg, "--ordered-reads") == 0) {
+            cfg->ordered_reads = true;
+            continue;
+        }
+        if (strcmp(arg, "--tentative") == 0) {
+            cfg->tentative = true;
+            continue;
+        }
+        if (val == NULL) {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        if (strcmp(arg, "--mode") == 0) {
+            if (strcmp(val, "pipeline") == 0) {
+                cfg->mode = BENCH_MODE_PIPELINE;
+            } else if (strcmp(val, "engine") == 0) {
+                cfg->mode = BENCH_MODE_ENGINE;
+            } else if (strcmp(val, "sim") == 0) {
+                cfg->mode = BENCH_MODE_SIM;
+            } else if (strcmp(val, "udp") == 0) {
+                cfg->mode = BENCH_MODE_UDP;
+            } else {
+                fprintf(stderr, "Unknown mode '%s'\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--faulty") == 0) {
+            cfg->faulty = atoi(val);
+        } else if (strcmp(arg, "--forger") == 0) {
+            cfg->forger = atoi(val);
+        } else if (strcmp(arg, "--recover-after") == 0) {
+            cfg->recover_after = strtoull(val, NULL, 10);
+        } else if (strcmp(arg, "--crash-after") == 0) {
+            cfg->crash_after = strtoull(val, NULL, 10);
+        } else if (strcmp(arg, "--ops") == 0) {
+            cfg->ops = strtoull(val, NULL, 10);
+        } else if (strcmp(arg, "--keys") == 0) {
+            cfg->keys = strtoull(val, NULL, 10);
+        } else if (strcmp(arg, "--dist") == 0) {
+            if (strcmp(val, "uniform") == 0) {
+                cfg->dist = BENCH_DIST_UNIFORM;
+            } else if (strcmp(val, "zipfian") == 0 || strcmp(val, "zipf") == 0) {
+                cfg->dist = BENCH_DIST_ZIPFIAN;
+            } else {
+                fprintf(stderr, "Unknown distribution '%s'\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--theta") == 0) {
+            cfg->theta = strtod(val, NULL);
+        } else if (strcmp(arg, "--reads") == 0) {
+            cfg->read_pct = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--seed") == 0) {
+            cfg->seed = strtoull(val, NULL, 10);
+        } else if (strcmp(arg, "--clients") == 0) {
+            cfg->clients = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--window") == 0) {
+            cfg->window = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--exec-threads") == 0) {
+            cfg->exec_threads = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--groups") == 0) {
+            cfg->groups = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--batch") == 0) {
+            cfg->batch = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--depth") == 0) {
+            cfg->depth = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--delay-us") == 0) {
+            cfg->delay_us = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--nvm") == 0) {
+            cfg->nvm_dir = val;
+        } else if (strcmp(arg, "--nvm-startup") == 0) {
+            cfg->startup_path = val;
+        } else if (strcmp(arg, "--jitter-us") == 0) {
+            cfg->link.jitter_us = (uint32_t)strtoul(val, NULL, 10);
+            if (cfg->link.dist == TINYBFT_SIM_FIXED) {
+                cfg->link.dist = TINYBFT_SIM_UNIFORM;
+            }
+        } else if (strcmp(arg, "--jitter-dist") == 0) {
+            if (strcmp(val, "fixed") == 0) {
+                cfg->link.dist = TINYBFT_SIM_FIXED;
+            } else if (strcmp(val, "uniform") == 0) {
+                cfg->link.dist = TINYBFT_SIM_UNIFORM;
+            } else if (strcmp(val, "exp") == 0) {
+                cfg->link.dist = TINYBFT_SIM_EXPONENTIAL;
+            } else {
+                fprintf(stderr, "Unknown jitter distribution '%s'\n", val);
+                return false;
+            }
+        } else if (strcmp(arg, "--bandwidth-mbps") == 0) {
+            cfg->link.bandwidth_mbps = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--loss") == 0) {
+            cfg->link.loss = strtod(val, NULL);
+        } else if (strcmp(arg, "--rto-us") == 0) {
+            cfg->link.rto_us = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--reorder") == 0) {
+            cfg->link.reorder = strtod(val, NULL);
+        } else if (strcmp(arg, "--reorder-us") == 0) {
+            cfg->link.reorder_us = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--service-ns") == 0) {
+            cfg->service_ns = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--equivocate") == 0) {
+            cfg->faults.equivocate |= 1u << ((uint32_t)atoi(val) % NUM_REPLICAS);
+        } else if (strcmp(arg, "--corrupt-votes") == 0) {
+            cfg->faults.corrupt_votes |= 1u << ((uint32_t)atoi(val) % NUM_REPLICAS);
+        } else if (strcmp(arg, "--udp-port") == 0) {
+            cfg->udp_port = (uint16_t)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--udp-replica") == 0) {
+            cfg->udp_replica = atoi(val);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return false;
+        }
+        i++;
+    }
+
+    if (cfg->window > 1 && cfg->mode != BENCH_MODE_ENGINE) {
+        fprintf(stderr, "--window is only supported in engine mode\n");
+        return false;
+    }
+    if (cfg->clients > 0 && cfg->clients <= TINYBFT_MAX_CLIENTS && cfg->window > TINYBFT_MAX_CLIENTS / cfg->clients) {
+        fprintf(stderr, "--clients x --window exceeds %d operations in flight\n", TINYBFT_MAX_CLIENTS);
+        return false;
+    }
+
+    if (cfg->keys == 0 || cfg->read_pct > 100 || cfg->theta <= 0.0 || cfg->theta >= 1.0 ||
+        cfg->faulty >= NUM_REPLICAS || cfg->forger >= NUM_REPLICAS || cfg->udp_replica >= NUM_REPLICAS || (cfg->recover_after > 0 && cfg->faulty < 0) ||
+        (cfg->crash_after > 0 && (cfg->faulty < 0 || (cfg->recover_after > 0 && cfg->recover_after <= cfg->crash_after))) || cfg->clients == 0 || cfg->clients > TINYBFT_MAX_CLIENTS ||
+        cfg->window == 0 || cfg->window > TINYBFT_MAX_CLIENTS / cfg->clients ||
+        cfg->groups == 0 || cfg->groups > TINYBFT_ENGINE_GROUPS || (cfg->groups > 1 && cfg->mode != BENCH_MODE_ENGINE) ||
+        cfg->batch == 0 || cfg->batch > TINYBFT_MAX_BATCH || cfg->exec_threads > TINYBFT_POOL_MAX_WORKERS ||
+        cfg->depth == 0 || cfg->depth > TINYBFT_WINDOW_SIZE ||
+        cfg->link.loss < 0.0 || cfg->link.loss >= 1.0 || cfg->link.reorder < 0.0 || cfg->link.reorder > 1.0) {
+        fprintf(stderr, "Invalid configuration\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void report(const char* label, const bench_hist_t* hist, uint64_t elapsed_ns) {
+    if (hist->total == 0) {
+        return;
+    }
+
+    double seconds = elapsed_ns / 1e9;
+    printf("%-6s ops=%-10llu ops/sec=%-12.0f mean=%-8.0f p50=%-8llu p99=%-8llu p999=%-8llu max=%llu (ns)\n",
+           label,
+           (unsigned long long)hist->total,
+           hist->total / seconds,
+           (double)hist->sum / hist->total,
+           (unsigned long long)bench_hist_percentile(hist, 50.0),
+           (unsigned long long)bench_hist_percentile(hist, 99.0),
+           (unsigned long long)bench_hist_percentile(hist, 99.9),
+           (unsigned long long)hist->max);
+}
+
+static void record(bool is_read, uint64_t latency) {
+    bench_hist_record(is_read ? &get_hist : &put_hist, latency);
+    bench_hist_record(&all_hist, latency);
+}
+
+// Build the next operation of the workload
+static bool next_operation(const bench_config_t* cfg, bench_keygen_t* keygen, bench_rng_t* rng,
+                           uint64_t index, char* key, char* value) {
+    uint64_t k = bench_keygen_next(keygen, rng);
+    bool is_read = (bench_rng_next(rng) % 100) < cfg->read_pct;
+
+    snprintf(key, MAX_KEY_SIZE, "key-%llu", (unsigned long long)k);
+    if (!is_read) {
+        snprintf(value, MAX_VALUE_SIZE, "value-%llu", (unsigned long long)index);
+    }
+    return is_read;
+}
+
+static void run_pipeline(const bench_config_t* cfg, bench_keygen_t* keygen, bench_rng_t* rng,
+                         bench_result_t* res) {
+    char key[MAX_KEY_SIZE];
+    char value[MAX_VALUE_SIZE];
+    const char* values[NUM_REPLICAS];
+
+    for (uint64_t i = 0; i < cfg->ops; i++) {
+        bool is_read = next_operation(cfg, keygen, rng, i, key, value);
+
+        uint64_t t0 = bench_now_ns();
+        if (is_read) {
+            if (run_get_operation(key, values) == 0) {
+                res->misses++;
+            }
+        } else {
+            run_put_operation(key, value);
+        }
+        record(is_read, bench_now_ns() - t0);
+    }
+}
+
+// The faulty replica stops; failover is measured from here
+static void crash_replica(const bench_config_t* cfg, bench_result_t* res, uint64_t now_ns) {
+    res->crash_ns = now_ns;
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        uint32_t view = cfg->mode == BENCH_MODE_SIM ? tinybft_sim_replica(r)->view :
+                        cfg->mode == BENCH_MODE_UDP ? __atomic_load_n(&udp_stats[r].view, __ATOMIC_RELAXED) :
+                        tinybft_engine_view(r);
+        res->crash_view = view > res->crash_view ? view : res->crash_view;
+    }
+    set_replica_faulty(cfg->faulty, true);
+    if (cfg->mode == BENCH_MODE_UDP && udp_pids[cfg->faulty] > 0) {
+        kill(udp_pids[cfg->faulty], SIGKILL);
+        waitpid(udp_pids[cfg->faulty], NULL, 0);
+        udp_pids[cfg->faulty] = 0;
+    }
+}
+
+// Closed loop: every client keeps `window` operations outstanding
+
+static void run_engine(const bench_config_t* cfg, bench_keygen_t* keygen, bench_rng_t* rng,
+                       bench_result_t* res) {
+    char key[MAX_KEY_SIZE];
+    char value[MAX_VALUE_SIZE];
+    char result[MAX_VALUE_SIZE];
+    uint64_t issued = 0;
+    uint64_t completed = 0;
+    uint64_t recovered_at = 0;
+    uint32_t catch_up_seq = 0;
+    uint32_t pace_from = 0;       // The others' progress when the faulty replica last resumed agreement
+    uint64_t pace_transfers = 0;  // Its state transfers by then
+    bool crashed = false;
+
+    memset(clients, 0, sizeof(clients));
+    res->crash_ns = bench_now_ns();
+
+    while (completed < cfg->ops) {
+        if (cfg->crash_after > 0 && completed >= cfg->crash_after && !crashed) {
+            crash_replica(cfg, res, bench_now_ns());
+            crashed = true;
+        }
+        // Bring the faulty replica back; it must fetch whatever it missed
+        if (cfg->recover_after > 0 && recovered_at == 0 && completed >= cfg->recover_after) {
+            for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+                uint32_t seq = tinybft_engine_last_executed(r);
+                catch_up_seq = seq > catch_up_seq ? seq : catch_up_seq;
+            }
+            pace_from = catch_up_seq;
+            pace_transfers = tinybft_engine_transfers((uint32_t)cfg->faulty);
+            res->behind_by = catch_up_seq - tinybft_engine_last_executed((uint32_t)cfg->faulty);
+            res->recovery_transfers = pace_transfers;
+            recovered_at = bench_now_ns();
+            set_replica_faulty(cfg->faulty, false);
+        }
+        // Recovered once it executes through agreement again: a checkpoint
+        // interval past where the others were when it last resumed, without
+        // another transfer, and within a window of them
+        if (recovered_at != 0 && res->recovery_ns == 0) {
+            uint32_t seq = tinybft_engine_last_executed((uint32_t)cfg->faulty);
+            uint64_t transfers = tinybft_engine_transfers((uint32_t)cfg->faulty);
+            uint32_t lead = 0;
+            for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+                uint32_t other = tinybft_engine_last_executed(r);
+                lead = other > lead ? other : lead;
+            }
+            if (transfers != pace_transfers) {
+                pace_from = lead;
+                pace_transfers = transfers;
+            } else if (seq >= pace_from + TINYBFT_CHECKPOINT_INTERVAL && seq + TINYBFT_WINDOW_SIZE >= lead) {
+                res->recovery_ns = bench_now_ns() - recovered_at;
+                res->recovery_transfers = transfers - res->recovery_transfers;
+                res->recovery_blocks = tinybft_engine_transfer_blocks((uint32_t)cfg->faulty);
+            }
+        }
+
+        // Operation k of client c is tagged with its slot c * window + k
+        for (uint32_t slot = 0; slot < cfg->clients * cfg->window && issued < cfg->ops; slot++) {
+            if (clients[slot].busy) {
+                continue;
+            }
+
+            bool is_read = next_operation(cfg, keygen, rng, issued, key, value);
+            clients[slot].start_ns = bench_now_ns();
+            if (tinybft_engine_issue(slot / cfg->window, is_read ? TINYBFT_OP_GET : TINYBFT_OP_PUT, key, value, slot)) {
+                clients[slot].busy = true;
+                clients[slot].is_read = is_read;
+                clients[slot].group = tinybft_engine_group(key);
+                issued++;
+            }
+        }
+
+        bool progress = false;
+        for (uint32_t c = 0; c < cfg->clients; c++) {
+            uint64_t slot;
+            int len;
+
+            while ((len = tinybft_engine_complete(c, &slot, result, sizeof(result))) != TINYBFT_ENGINE_PENDING) {
+                clients[slot].busy = false;
+                completed++;
+                progress = true;
+
+                if (len == TINYBFT_ENGINE_TIMEOUT) {
+                    res->failures++;
+                    continue;
+                }
+                if (clients[slot].is_read && len == 0) {
+                    res->misses++;
+                }
+                res->group_ops[clients[slot].group]++;
+                record(clients[slot].is_read, bench_now_ns() - clients[slot].start_ns);
+            }
+        }
+
+        if (!progress) {
+            sched_yield();  // Let the replica threads run
+        }
+    }
+}
+
+// Closed loop in virtual time: the same clients as run_engine, with
+// latencies taken on the simulator's clock
+static void run_sim(const bench_config_t* cfg, bench_keygen_t* keygen, bench_rng_t* rng, bench_result_t* res) {
+    char key[MAX_KEY_SIZE];
+    char value[MAX_VALUE_SIZE];
+    char result[MAX_VALUE_SIZE];
+    uint64_t issued = 0;
+    uint64_t completed = 0;
+    bool crashed = false;
+
+    memset(clients, 0, sizeof(clients));
+
+    while (completed < cfg->ops) {
+        if (cfg->crash_after > 0 && completed >= cfg->crash_after && !crashed) {
+            tinybft_sim_faults_t faults = cfg->faults;
+            faults.silent |= 1u << cfg->faulty;
+            tinybft_sim_set_faults(&faults);
+            crash_replica(cfg, res, tinybft_sim_now_ns());
+            crashed = true;
+        }
+        for (uint32_t c = 0; c < cfg->clients && issued < cfg->ops; c++) {
+            if (clients[c].busy) {
+                continue;
+            }
+
+            bool is_read = next_operation(cfg, keygen, rng, issued, key, value);
+            clients[c].start_ns = tinybft_sim_now_ns();
+            if (tinybft_sim_submit(c, is_read ? TINYBFT_OP_GET : TINYBFT_OP_PUT, key, value)) {
+                clients[c].busy = true;
+                clients[c].is_read = is_read;
+                issued++;
+            }
+        }
+
+        if (!tinybft_sim_step()) {
+            break;
+        }
+
+        for (uint32_t c = 0; c < cfg->clients; c++) {
+            if (!clients[c].busy) {
+                continue;
+            }
+
+            int len = tinybft_sim_poll(c, result, sizeof(result));
+            if (len == TINYBFT_SIM_PENDING) {
+                continue;
+            }
+
+            clients[c].busy = false;
+            completed++;
+            if (len == TINYBFT_SIM_TIMEOUT) {
+                res->failures++;
+                continue;
+            }
+            if (clients[c].is_read && len == 0) {
+                res->misses++;
+            }
+            record(clients[c].is_read, tinybft_sim_now_ns() - clients[c].start_ns);
+        }
+    }
+}
+
+static bool start_sim(const bench_config_t* cfg) {
+    tinybft_sim_config_t sim_cfg;
+    tinybft_sim_default_config(&sim_cfg);
+    sim_cfg.seed = cfg->seed;
+    sim_cfg.batch_size = cfg->batch;
+    sim_cfg.pipeline_depth = cfg->depth;
+    sim_cfg.read_only_gets = !cfg->ordered_reads;
+    sim_cfg.tentative = cfg->tentative;
+    sim_cfg.exec_threads = cfg->exec_threads;
+    sim_cfg.service_ns = cfg->service_ns;
+    sim_cfg.link = cfg->link;
+    sim_cfg.link.latency_us = cfg->delay_us;
+    sim_cfg.faults = cfg->faults;
+    if (cfg->faulty >= 0 && cfg->crash_after == 0) {
+        sim_cfg.faults.silent |= 1u << cfg->faulty;
+    }
+    return tinybft_sim_start(&sim_cfg);
+}
+
+static void collect_sim(bench_result_t* res) {
+    tinybft_sim_get_stats(&res->sim);
+    res->trace_hash = tinybft_sim_trace_hash();
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        const tinybft_replica_t* node = tinybft_sim_replica(r);
+        res->committed[r] = node->committed;
+        res->executed[r] = node->executed;
+        res->tentative[r] = node->tentative;
+        res->rollbacks[r] = node->rollbacks;
+        res->parallel_runs[r] = node->parallel_runs;
+        res->parallel_tasks[r] = node->parallel_tasks;
+        res->checkpoints[r] = node->checkpoints;
+        res->checkpoint_blocks[r] = node->checkpoint_blocks;
+        res->stable_checkpoints[r] = node->stable_checkpoints;
+        res->transfers[r] = node->transfers;
+        res->transfer_blocks[r] = node->transfer_blocks;
+        res->forged[r] = node->forged;
+        res->view[r] = node->view;
+        res->view_changes[r] = node->view_changes;
+        res->view_commit_ms[r] = node->view_commit_ms;
+        res->view_timeout[r] = tinybft_view_timeout(node);
+        res->high_water[r] = node->memory.high_water;
+        for (uint32_t c = 0; c < TINYBFT_SCRATCH_CLASSES; c++) {
+            res->scratch_high_water[r][c] = node->memory.scratch_region.high_water[c];
+        }
+        for (uint32_t t = 0; t < TINYBFT_MSG_TYPES; t++) {
+            res->received[t] += node->received[t];
+            res->copied_bytes[t] += node->copied_bytes[t];
+        }
+    }
+}
+
+// Closed loop against the replica processes: the clients' requests leave
+// together and the driver sleeps in epoll until replies arrive
+static void run_udp(const bench_config_t* cfg, bench_keygen_t* keygen, bench_rng_t* rng, bench_result_t* res) {
+    char key[MAX_KEY_SIZE];
+    char value[MAX_VALUE_SIZE];
+    char result[MAX_VALUE_SIZE];
+    uint64_t issued = 0;
+    uint64_t completed = 0;
+    bool crashed = false;
+
+    memset(clients, 0, sizeof(clients));
+    res->crash_ns = bench_now_ns();
+
+    while (completed < cfg->ops) {
+        if (cfg->crash_after > 0 && completed >= cfg->crash_after && !crashed) {
+            crash_replica(cfg, res, bench_now_ns());
+            crashed = true;
+        }
+        for (uint32_t c = 0; c < cfg->clients && issued < cfg->ops; c++) {
+            if (clients[c].busy) {
+                continue;
+            }
+
+            bool is_read = next_operation(cfg, keygen, rng, issued, key, value);
+            clients[c].start_ns = bench_now_ns();
+            if (tinybft_udp_submit(c, is_read ? TINYBFT_OP_GET : TINYBFT_OP_PUT, key, value)) {
+                clients[c].busy = true;
+                clients[c].is_read = is_read;
+                issued++;
+            }
+        }
+
+        tinybft_udp_clients_wait(1);
+
+        for (uint32_t c = 0; c < cfg->clients; c++) {
+            if (!clients[c].busy) {
+                continue;
+            }
+
+            int len = tinybft_udp_poll(c, result, sizeof(result));
+            if (len == TINYBFT_ENGINE_PENDING) {
+                continue;
+            }
+
+            clients[c].busy = false;
+            completed++;
+            if (len == TINYBFT_ENGINE_TIMEOUT) {
+                res->failures++;
+                continue;
+            }
+            if (clients[c].is_read && len == 0) {
+                res->misses++;
+            }
+            record(clients[c].is_read, bench_now_ns() - clients[c].start_ns);
+        }
+    }
+}
+
+static void udp_stop_signal(int sig) {
+    (void)sig;
+    tinybft_udp_stop();
+}
+
+static void udp_config(const bench_config_t* cfg, tinybft_udp_config_t* udp_cfg) {
+    tinybft_udp_default_config(udp_cfg);
+    udp_cfg->batch_size = cfg->batch;
+    udp_cfg->pipeline_depth = cfg->depth;
+    udp_cfg->base_port = cfg->udp_port;
+    udp_cfg->read_only_gets = !cfg->ordered_reads;
+    udp_cfg->tentative = cfg->tentative;
+    udp_cfg->exec_threads = cfg->exec_threads;
+}
+
+// Terminate the replica processes and collect what they counted
+static void stop_udp(bench_result_t* res) {
+    tinybft_udp_clients_close();
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        if (udp_pids[r] > 0) {
+            kill(udp_pids[r], SIGTERM);
+            waitpid(udp_pids[r], NULL, 0);
+            udp_pids[r] = 0;
+        }
+    }
+    if (res != NULL) {
+        res->udp_client_syscalls = tinybft_udp_client_syscalls();
+        for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+            const tinybft_udp_stats_t* st = &udp_stats[r];
+            res->udp[r] = *st;
+            res->committed[r] = st->committed;
+            res->executed[r] = st->executed;
+            res->tentative[r] = st->tentative;
+            res->rollbacks[r] = st->rollbacks;
+            res->parallel_runs[r] = st->parallel_runs;
+            res->parallel_tasks[r] = st->parallel_tasks;
+            res->checkpoints[r] = st->checkpoints;
+            res->checkpoint_blocks[r] = st->checkpoint_blocks;
+            res->stable_checkpoints[r] = st->stable_checkpoints;
+            res->transfers[r] = st->transfers;
+            res->transfer_blocks[r] = st->transfer_blocks;
+            res->forged[r] = st->forged;
+            res->view[r] = st->view;
+            res->view_changes[r] = st->view_changes;
+            res->view_commit_ms[r] = st->view_commit_ms;
+            res->view_timeout[r] = st->view_timeout;
+            res->high_water[r] = st->high_water;
+            memcpy(res->scratch_high_water[r], st->scratch_high_water, sizeof(res->scratch_high_water[r]));
+            for (uint32_t t = 0; t < TINYBFT_MSG_TYPES; t++) {
+                res->received[t] += st->received[t];
+                res->copied_bytes[t] += st->copied_bytes[t];
+            }
+        }
+    }
+    munmap(udp_stats, sizeof(*udp_stats) * NUM_REPLICAS);
+    udp_stats = NULL;
+}
+
+// Fork a process per replica, leaving out one that is faulty from the
+// start, with counters in memory shared with this one
+static bool start_udp(const bench_config_t* cfg) {
+    tinybft_udp_config_t udp_cfg;
+
+    udp_config(cfg, &udp_cfg);
+    udp_stats = mmap(NULL, sizeof(*udp_stats) * NUM_REPLICAS, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                     -1, 0);
+    if (udp_stats == MAP_FAILED) {
+        udp_stats = NULL;
+        return false;
+    }
+    memset(udp_stats, 0, sizeof(*udp_stats) * NUM_REPLICAS);
+    memset(udp_pids, 0, sizeof(udp_pids));
+
+    fflush(stdout);
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        if ((int)r == cfg->faulty && cfg->crash_after == 0) {
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            signal(SIGTERM, udp_stop_signal);
+            _exit(tinybft_udp_run_replica(r, &udp_cfg, &udp_stats[r]) ? 0 : 1);
+        }
+        if (pid < 0) {
+            stop_udp(NULL);
+            return false;
+        }
+        udp_pids[r] = pid;
+    }
+
+    if (!tinybft_udp_clients_open(&udp_cfg)) {
+        stop_udp(NULL);
+        return false;
+    }
+
+    // The clock starts once every replica waits for datagrams
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        while (udp_pids[r] > 0 && __atomic_load_n(&udp_stats[r].wait_calls, __ATOMIC_RELAXED) == 0) {
+            if (waitpid(udp_pids[r], NULL, WNOHANG) != 0) {
+                udp_pids[r] = 0;
+                stop_udp(NULL);
+                return false;
+            }
+            usleep(1000);
+        }
+    }
+    return true;
+}
+
+// Serve one replica over UDP until interrupted, as on a node of a real cluster
+static int run_udp_replica(const bench_config_t* cfg) {
+    tinybft_udp_config_t udp_cfg;
+    tinybft_udp_stats_t st;
+
+    initialize_system();
+    pipeline_verbose = false;
+    udp_config(cfg, &udp_cfg);
+    signal(SIGINT, udp_stop_signal);
+    signal(SIGTERM, udp_stop_signal);
+    printf("Replica %d listening on UDP port %u\n", cfg->udp_replica, (unsigned)(cfg->udp_port + cfg->udp_replica));
+    fflush(stdout);
+    if (!tinybft_udp_run_replica((uint32_t)cfg->udp_replica, &udp_cfg, &st)) {
+        fprintf(stderr, "Failed to open the replica's socket\n");
+        return 1;
+    }
+    printf("Replica %d committed %llu instances, executed %llu requests, in view %u; "
+           "%llu datagrams received, %llu sent\n", cfg->udp_replica, (unsigned long long)st.committed,
+           (unsigned long long)st.executed, st.view, (unsigned long long)st.datagrams_received,
+           (unsigned long long)st.datagrams_sent);
+    return 0;
+}
+
+static bool run_benchmark(const bench_config_t* cfg, bench_result_t* res) {
+    memset(res, 0, sizeof(*res));
+    srand((unsigned int)cfg->seed);
+    initialize_system();
+    pipeline_verbose = false;
+    if (cfg->faulty >= 0 && cfg->crash_after == 0) {
+        set_replica_faulty(cfg->faulty, true);
+    }
+
+    bench_rng_t rng = { cfg->seed };
+    bench_keygen_t keygen;
+    bench_keygen_init(&keygen, cfg->dist, cfg->keys, cfg->theta);
+
+    bench_hist_reset(&put_hist);
+    bench_hist_reset(&get_hist);
+    bench_hist_reset(&all_hist);
+
+    if (cfg->mode == BENCH_MODE_PIPELINE) {
+        uint64_t start = bench_now_ns();
+        run_pipeline(cfg, &keygen, &rng, res);
+        res->elapsed_ns = bench_now_ns() - start;
+        return true;
+    }
+    if (cfg->mode == BENCH_MODE_SIM) {
+        if (!start_sim(cfg)) {
+            fprintf(stderr, "Failed to start the simulator\n");
+            return false;
+        }
+        uint64_t start = bench_now_ns();
+        run_sim(cfg, &keygen, &rng, res);
+        res->wall_ns = bench_now_ns() - start;
+        res->elapsed_ns = tinybft_sim_now_ns();
+        collect_sim(res);
+        return true;
+    }
+    if (cfg->mode == BENCH_MODE_UDP) {
+        if (!start_udp(cfg)) {
+            fprintf(stderr, "Failed to start the replica processes\n");
+            return false;
+        }
+        uint64_t start = bench_now_ns();
+        run_udp(cfg, &keygen, &rng, res);
+        res->elapsed_ns = bench_now_ns() - start;
+        stop_udp(res);
+        return true;
+    }
+
+    tinybft_engine_config_t engine_cfg;
+    tinybft_engine_default_config(&engine_cfg);
+    engine_cfg.batch_size = cfg->batch;
+    engine_cfg.pipeline_depth = cfg->depth;
+    engine_cfg.link_delay_us = cfg->delay_us;
+    engine_cfg.nvm_dir = cfg->nvm_dir;
+    engine_cfg.read_only_gets = !cfg->ordered_reads;
+    engine_cfg.tentative = cfg->tentative;
+    engine_cfg.exec_threads = cfg->exec_threads;
+    engine_cfg.groups = cfg->groups;
+    engine_cfg.forger = cfg->forger;
+    if (!tinybft_engine_start(&engine_cfg)) {
+        fprintf(stderr, "Failed to start the replica engine\n");
+        return false;
+    }
+    for (uint32_t c = 0; c < cfg->clients && cfg->window > 1; c++) {
+        tinybft_engine_set_sessions(c, c * cfg->window, cfg->window);
+    }
+    for (uint32_t r = 0; cfg->nvm_dir != NULL && r < TINYBFT_MAX_REPLICAS; r++) {
+        if (tinybft_engine_last_executed(r) > 0) {
+            printf("Replica %u resumed from NVM at sequence %u\n", r, tinybft_engine_last_executed(r));
+        }
+    }
+
+    uint64_t start = bench_now_ns();
+    run_engine(cfg, &keygen, &rng, res);
+    res->elapsed_ns = bench_now_ns() - start;
+
+    tinybft_engine_stop();
+    res->fast_reads = tinybft_engine_fast_reads();
+    res->read_fallbacks = tinybft_engine_read_fallbacks();
+    for (uint32_t n = 0; n < cfg->groups * NUM_REPLICAS; n++) {
+        uint64_t committed = tinybft_engine_committed(n);
+        uint64_t* group = &res->group_committed[n / NUM_REPLICAS];
+        *group = committed > *group ? committed : *group;
+    }
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        res->committed[r] = tinybft_engine_committed(r);
+        res->executed[r] = tinybft_engine_executed(r);
+        res->tentative[r] = tinybft_engine_tentative(r);
+        res->rollbacks[r] = tinybft_engine_rollbacks(r);
+        res->parallel_runs[r] = tinybft_engine_parallel_runs(r);
+        res->parallel_tasks[r] = tinybft_engine_parallel_tasks(r);
+        res->checkpoints[r] = tinybft_engine_checkpoints(r);
+        res->checkpoint_blocks[r] = tinybft_engine_checkpoint_blocks(r);
+        res->stable_checkpoints[r] = tinybft_engine_stable_checkpoints(r);
+        res->transfers[r] = tinybft_engine_transfers(r);
+        res->transfer_blocks[r] = tinybft_engine_transfer_blocks(r);
+        res->forged[r] = tinybft_engine_forged(r);
+        res->view[r] = tinybft_engine_view(r);
+        res->view_changes[r] = tinybft_engine_view_changes(r);
+        res->view_commit_ms[r] = tinybft_engine_view_commit_ms(r);
+        res->view_timeout[r] = tinybft_engine_view_timeout(r);
+        res->high_water[r] = tinybft_engine_memory_high_water(r);
+        for (uint32_t c = 0; c < TINYBFT_SCRATCH_CLASSES; c++) {
+            res->scratch_high_water[r][c] = tinybft_engine_scratch_high_water(r, c);
+        }
+        for (uint32_t t = 0; t < TINYBFT_MSG_TYPES; t++) {
+            res->received[t] += tinybft_engine_received(r, (tinybft_msg_type_t)t);
+            res->copied_bytes[t] += tinybft_engine_copied_bytes(r, (tinybft_msg_type_t)t);
+        }
+    }
+    return true;
+}
+
+// Failover time: from the primary's crash to the first commit of a correct
+// replica in a later view (commit times have millisecond resolution)
+static void report_failover(const bench_config_t* cfg, const bench_result_t* res) {
+    uint64_t failover_ns = UINT64_MAX;
+    uint32_t view = 0;
+
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        uint64_t commit_ns = res->view_commit_ms[r] * 1000000ull;
+        if ((int)r == cfg->faulty || res->view[r] <= res->crash_view || res->view_commit_ms[r] == 0) {
+            continue;
+        }
+        uint64_t ns = commit_ns > res->crash_ns ? commit_ns - res->crash_ns : 0;
+        if (ns < failover_ns) {
+            failover_ns = ns;
+            view = res->view[r];
+        }
+    }
+
+    if (failover_ns == UINT64_MAX) {
+        printf("Primary %d crashed in view %u; no later view committed before the run ended\n", cfg->faulty,
+               res->crash_view);
+    } else {
+        printf("Failover: primary %d crashed in view %u, first commit in view %u after %.1f ms\n", cfg->faulty,
+               res->crash_view, view, failover_ns / 1e6);
+    }
+}
+
+static void print_sweep_header(void) {
+    printf("%-6s %-6s %-8s %-12s %-10s %-10s %-10s %-10s\n",
+           "BATCH", "DEPTH", "CLIENTS", "OPS/SEC", "AVG_BATCH", "P50_NS", "P99_NS", "P999_NS");
+}
+
+static bool print_sweep_row(const bench_config_t* cfg) {
+    bench_result_t res;
+    uint32_t primary = (uint32_t)get_primary_for_view(0);
+
+    if (!run_benchmark(cfg, &res)) {
+        return false;
+    }
+
+    double avg_batch = res.committed[primary] > 0 ?
+        (double)res.executed[primary] / res.committed[primary] : 0.0;
+    printf("%-6u %-6u %-8u %-12.0f %-10.2f %-10llu %-10llu %-10llu\n",
+           cfg->batch, cfg->depth, cfg->clients, all_hist.total / (res.elapsed_ns / 1e9), avg_batch,
+           (unsigned long long)bench_hist_percentile(&all_hist, 50.0),
+           (unsigned long long)bench_hist_percentile(&all_hist, 99.0),
+           (unsigned long long)bench_hist_percentile(&all_hist, 99.9));
+    return true;
+}
+
+// Batch size vs throughput/latency curve
+static int run_batch_sweep(bench_config_t cfg) {
+    print_sweep_header();
+    for (uint32_t batch = 1; batch <= TINYBFT_MAX_BATCH; batch *= 2) {
+        cfg.batch = batch;
+        if (!print_sweep_row(&cfg)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Key-value store microbenchmark: lookup cost as the table fills
+static tinybft_kv_t kv_table;
+static char kv_keys[MAX_KEYS][MAX_KEY_SIZE];
+static char kv_absent[MAX_KEYS][MAX_KEY_SIZE];
+
+static uint64_t kv_lookups(const bench_config_t* cfg, bench_rng_t* rng, char (*keys)[MAX_KEY_SIZE],
+                           uint32_t count, uint64_t* found) {
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < cfg->ops; i++) {
+        if (tinybft_kv_get(&kv_table, keys[bench_rng_next(rng) % count]) != NULL) {
+            (*found)++;
+        }
+    }
+    return bench_now_ns() - start;
+}
+
+static int run_kv_sweep(const bench_config_t* cfg) {
+    bench_rng_t rng = { cfg->seed };
+    uint64_t found = 0;
+    uint64_t expected = 0;
+    uint32_t filled = 0;
+
+    for (uint32_t i = 0; i < MAX_KEYS; i++) {
+        snprintf(kv_keys[i], MAX_KEY_SIZE, "key-%u", i);
+        snprintf(kv_absent[i], MAX_KEY_SIZE, "absent-%u", i);
+    }
+    tinybft_kv_init(&kv_table);
+
+    printf("%-8s %-8s %-10s %-10s %-10s\n", "KEYS", "LOAD", "PUT_NS", "HIT_NS", "MISS_NS");
+    for (uint32_t step = 1; step <= 8; step++) {
+        uint32_t before = filled;
+        uint32_t target = (uint32_t)((uint64_t)MAX_KEYS * step / 8);
+        if (target == before) {
+            continue;
+        }
+
+        uint64_t start = bench_now_ns();
+        for (; filled < target; filled++) {
+            tinybft_kv_put(&kv_table, kv_keys[filled], "value");
+        }
+        double put_ns = (double)(bench_now_ns() - start) / (target - before);
+
+        uint64_t hit_ns = kv_lookups(cfg, &rng, kv_keys, filled, &found);
+        uint64_t miss_ns = kv_lookups(cfg, &rng, kv_absent, MAX_KEYS, &found);
+        printf("%-8u %-8.2f %-10.1f %-10.1f %-10.1f\n", filled, (double)filled / TINYBFT_KV_CAPACITY,
+               put_ns, (double)hit_ns / cfg->ops, (double)miss_ns / cfg->ops);
+        expected += cfg->ops;
+    }
+
+    // Every present key must have been found and no absent one
+    if (found != expected) {
+        fprintf(stderr, "Key-value store returned wrong results\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Partition tree microbenchmark: checkpoint cost against the write set
+static tinybft_partition_tree_t tree;
+
+static int run_tree_sweep(const bench_config_t* cfg) {
+    bench_rng_t rng = { cfg->seed };
+    uint32_t rounds = cfg->ops < 1000 ? (uint32_t)cfg->ops : 1000;
+    uint32_t blocks = (uint32_t)((sizeof(kv_table.state) + TINYBFT_BLOCK_SIZE - 1) / TINYBFT_BLOCK_SIZE);
+
+    tinybft_kv_init(&kv_table);
+    uint64_t start = bench_now_ns();
+    tinybft_partition_init(&tree, &kv_table.state, sizeof(kv_table.state));
+    printf("Full hash of %u blocks: %.3f ms\n", blocks, (bench_now_ns() - start) / 1e6);
+
+    printf("%-8s %-10s %-14s %-10s\n", "DIRTY", "REHASHED", "CHECKPOINT_NS", "NS/BLOCK");
+    for (uint32_t dirty = 1; dirty <= blocks; dirty *= 4) {
+        uint64_t elapsed = 0;
+        uint64_t rehashed = 0;
+
+        for (uint32_t i = 0; i < rounds; i++) {
+            for (uint32_t d = 0; d < dirty; d++) {
+                uint32_t block = (uint32_t)(bench_rng_next(&rng) % blocks);
+                tinybft_partition_modify(&tree, block * TINYBFT_BLOCK_SIZE, 1);
+            }
+            start = bench_now_ns();
+            rehashed += tinybft_partition_checkpoint(&tree, i + 1);
+            elapsed += bench_now_ns() - start;
+        }
+        printf("%-8u %-10.1f %-14.0f %-10.0f\n", dirty, (double)rehashed / rounds,
+               (double)elapsed / rounds, (double)elapsed / rehashed);
+    }
+    return 0;
+}
+
+// SHA-256 microbenchmark: throughput of each path, after checking that
+// every path agrees with the scalar one
+static uint8_t sha_input[TINYBFT_SHA256_LANES][65536];
+
+static bool sha_paths_agree(bench_rng_t* rng) {
+    static const uint8_t abc_digest[TINYBFT_SHA256_SIZE] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+    tinybft_sha256_impl_t impl = tinybft_sha256_impl();
+    uint8_t expected[TINYBFT_SHA256_LANES][TINYBFT_SHA256_SIZE];
+    uint8_t actual[TINYBFT_SHA256_LANES][TINYBFT_SHA256_SIZE];
+    const uint8_t* data[TINYBFT_SHA256_LANES];
+    uint8_t* digests[TINYBFT_SHA256_LANES];
+
+    tinybft_sha256("abc", 3, actual[0]);
+    if (memcmp(actual[0], abc_digest, TINYBFT_SHA256_SIZE) != 0) {
+        return false;
+    }
+
+    for (uint32_t len = 0; len <= 300; len += 1 + len / 16) {
+        for (uint32_t l = 0; l < TINYBFT_SHA256_LANES; l++) {
+            for (uint32_t i = 0; i < len; i++) {
+                sha_input[l][i] = (uint8_t)bench_rng_next(rng);
+            }
+            data[l] = sha_input[l];
+            digests[l] = actual[l];
+        }
+
+        tinybft_sha256_select(TINYBFT_SHA256_SCALAR);
+        for (uint32_t l = 0; l < TINYBFT_SHA256_LANES; l++) {
+            tinybft_sha256(data[l], len, expected[l]);
+        }
+        tinybft_sha256_select(impl);
+
+        tinybft_sha256(data[0], len, actual[0]);
+        if (memcmp(actual[0], expected[0], TINYBFT_SHA256_SIZE) != 0) {
+            return false;
+        }
+        tinybft_sha256_multi(data, len, digests, TINYBFT_SHA256_LANES);
+        if (memcmp(actual, expected, sizeof(expected)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static double sha_gbps(uint32_t len, uint32_t lanes, uint64_t bytes) {
+    const uint8_t* data[TINYBFT_SHA256_LANES];
+    uint8_t out[TINYBFT_SHA256_LANES][TINYBFT_SHA256_SIZE];
+    uint8_t* digests[TINYBFT_SHA256_LANES];
+    uint64_t rounds = bytes / ((uint64_t)len * lanes) + 1;
+
+    for (uint32_t l = 0; l < TINYBFT_SHA256_LANES; l++) {
+        data[l] = sha_input[l];
+        digests[l] = out[l];
+    }
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < rounds; i++) {
+        if (lanes == 1) {
+            tinybft_sha256(data[0], len, out[0]);
+        } else {
+            tinybft_sha256_multi(data, len, digests, lanes);
+        }
+    }
+    return (double)rounds * len * lanes / (bench_now_ns() - start);
+}
+
+static int run_sha_sweep(const bench_config_t* cfg) {
+    static const uint32_t sizes[] = { 64, 1024, 4096, 65536 };
+    bench_rng_t rng = { cfg->seed };
+    tinybft_sha256_impl_t best = tinybft_sha256_impl();
+    uint64_t bytes = cfg->ops * 256;  // Bytes hashed per measurement
+
+    printf("%-10s %-8s %-12s %-12s\n", "PATH", "SIZE", "SINGLE_GB/S", "MULTI_GB/S");
+    for (uint32_t impl = 0; impl < TINYBFT_SHA256_IMPL_COUNT; impl++) {
+        if (!tinybft_sha256_select((tinybft_sha256_impl_t)impl)) {
+            continue;
+        }
+        if (!sha_paths_agree(&rng)) {
+            fprintf(stderr, "SHA-256 path %s produced a wrong digest\n",
+                    tinybft_sha256_impl_name((tinybft_sha256_impl_t)impl));
+            return 1;
+        }
+        for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            printf("%-10s %-8u %-12.3f %-12.3f\n", tinybft_sha256_impl_name((tinybft_sha256_impl_t)impl),
+                   sizes[i], sha_gbps(sizes[i], 1, bytes), sha_gbps(sizes[i], TINYBFT_SHA256_LANES, bytes));
+        }
+    }
+
+    tinybft_sha256_select(best);
+    printf("Selected path: %s\n", tinybft_sha256_impl_name(best));
+    return 0;
+}
+
+// Startup microbenchmark: a replica holding --keys keys comes back either by
+// replaying every write (cold start) or by remapping its NVM file
+static tinybft_replica_t startup_replica;
+
+static void startup_send(void* ctx, uint32_t dest, const tinybft_msg_header_t* hdr, const void* payload,
+                         const uint8_t* authenticator) {
+    // A lone replica has nobody to talk to
+}
+
+static void startup_modify(void* ctx, const void* addr, uint32_t len) {
+    tinybft_replica_modify(&startup_replica, addr, len);
+}
+
+static void startup_put(uint64_t key) {
+    char name[MAX_KEY_SIZE];
+    snprintf(name, sizeof(name), "key-%llu", (unsigned long long)key);
+    tinybft_kv_put(&kv_table, name, name);
+}
+
+static bool startup_open(const bench_config_t* cfg) {
+    tinybft_replica_init(&startup_replica, 0, startup_send, NULL, NULL, NULL);
+    bool resumed = tinybft_replica_open_nvm(&startup_replica, cfg->startup_path, &kv_table.state,
+                                            sizeof(kv_table.state));
+    tinybft_kv_set_modify(&kv_table, startup_modify, NULL);
+    return resumed;
+}
+
+static int run_nvm_startup(const bench_config_t* cfg) {
+    tinybft_partition_tree_t* tree = &startup_replica.memory.checkpoint_region.partition_tree;
+    uint8_t root[TINYBFT_DIGEST_SIZE];
+    uint64_t start;
+
+    // Populate the file; every PUT stands for one executed sequence number
+    unlink(cfg->startup_path);
+    if (startup_open(cfg)) {
+        return 1;
+    }
+    tinybft_kv_init(&kv_table);
+    tinybft_replica_set_state(&startup_replica, &kv_table.state, sizeof(kv_table.state));
+    tinybft_kv_set_modify(&kv_table, startup_modify, NULL);
+    for (uint64_t k = 0; k < cfg->keys; k++) {
+        startup_put(k);
+    }
+    startup_replica.last_executed = (uint32_t)cfg->keys;
+    tinybft_replica_close_nvm(&startup_replica);
+    memcpy(root, tinybft_partition_digest(tree), sizeof(root));
+
+    // Cold start: rebuild the state by replaying every write
+    start = bench_now_ns();
+    tinybft_replica_init(&startup_replica, 0, startup_send, NULL, NULL, NULL);
+    tinybft_kv_init(&kv_table);
+    tinybft_replica_set_state(&startup_replica, &kv_table.state, sizeof(kv_table.state));
+    tinybft_kv_set_modify(&kv_table, startup_modify, NULL);
+    for (uint64_t k = 0; k < cfg->keys; k++) {
+        startup_put(k);
+    }
+    uint32_t blocks = tinybft_partition_checkpoint(tree, (uint32_t)cfg->keys);
+    uint64_t cold_ns = bench_now_ns() - start;
+    bool cold_ok = memcmp(tinybft_partition_digest(tree), root, sizeof(root)) == 0;
+
+    // Remap the sealed file: checksums, no replay
+    start = bench_now_ns();
+    bool resumed = startup_open(cfg);
+    uint64_t sealed_ns = bench_now_ns() - start;
+    bool sealed_ok = resumed && startup_replica.last_executed == cfg->keys &&
+                     memcmp(tinybft_partition_digest(tree), root, sizeof(root)) == 0;
+    tinybft_replica_close_nvm(&startup_replica);
+
+    // Crash: a child resumes, writes a tenth of the keys again and dies
+    // without closing; the parent rolls those writes back and rehashes
+    pid_t child = fork();
+    if (child == 0) {
+        if (startup_open(cfg)) {
+            for (uint64_t k = 0; k < cfg->keys / 10 + 1; k++) {
+                startup_put(cfg->keys + k);
+            }
+        }
+        _exit(0);
+    }
+    waitpid(child, NULL, 0);
+
+    start = bench_now_ns();
+    resumed = startup_open(cfg);
+    uint64_t crash_ns = bench_now_ns() - start;
+    bool crash_ok = resumed && startup_replica.last_executed == cfg->keys &&
+                    memcmp(tinybft_partition_digest(tree), root, sizeof(root)) == 0;
+    tinybft_replica_close_nvm(&startup_replica);
+
+    printf("%-22s %-10s %s\n", "STARTUP", "MS", "RESULT");
+    printf("%-22s %-10.2f %s (%u blocks rehashed)\n", "cold (replay)", cold_ns / 1e6, cold_ok ? "ok" : "MISMATCH", blocks);
+    printf("%-22s %-10.2f %s\n", "remap (sealed)", sealed_ns / 1e6, sealed_ok ? "ok" : "FAILED");
+    printf("%-22s %-10.2f %s\n", "remap (after crash)", crash_ns / 1e6, crash_ok ? "ok" : "FAILED");
+    unlink(cfg->startup_path);
+    return cold_ok && sealed_ok && crash_ok ? 0 : 1;
+}
+
+// Pipeline depth vs throughput/latency curve
+static int run_depth_sweep(bench_config_t cfg) {
+    print_sweep_header();
+    for (uint32_t depth = 1; depth <= TINYBFT_WINDOW_SIZE; depth *= 2) {
+        cfg.depth = depth;
+        if (!print_sweep_row(&cfg)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    bench_config_t cfg = {
+        .mode = BENCH_MODE_PIPELINE,
+        .faulty = -1,
+        .forger = -1,
+        .recover_after = 0,
+        .ops = 1000000,
+        .keys = MAX_KEYS,
+        .dist = BENCH_DIST_UNIFORM,
+        .theta = 0.99,
+        .read_pct = 50,
+        .seed = 1,
+        .clients = 1,
+        .window = 1,
+        .batch = TINYBFT_MAX_BATCH,
+        .depth = TINYBFT_WINDOW_SIZE,
+        .delay_us = 0,
+        .ordered_reads = false,
+        .tentative = false,
+        .exec_threads = 0,
+        .groups = 1,
+        .batch_sweep = false,
+        .depth_sweep = false,
+        .kv_sweep = false,
+        .tree_sweep = false,
+        .sha_sweep = false,
+        .nvm_dir = NULL,
+        .startup_path = NULL,
+        .link = { .reorder_us = 500 },
+        .service_ns = 2000,
+        .udp_port = TINYBFT_UDP_PORT,
+        .udp_replica = -1
+    };
+
+    if (!parse_args(argc, argv, &cfg)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (cfg.kv_sweep) {
+        printf("TinyBFT key-value store benchmark: capacity=%d lookups=%llu per step\n",
+               TINYBFT_KV_CAPACITY, (unsigned long long)cfg.ops);
+        return run_kv_sweep(&cfg);
+    }
+    if (cfg.sha_sweep) {
+        printf("TinyBFT SHA-256 benchmark: %llu bytes per measurement\n", (unsigned long long)cfg.ops * 256);
+        return run_sha_sweep(&cfg);
+    }
+    if (cfg.startup_path != NULL) {
+        printf("TinyBFT startup benchmark: keys=%llu state=%u bytes\n",
+               (unsigned long long)cfg.keys, (unsigned)sizeof(kv_table.state));
+        return run_nvm_startup(&cfg);
+    }
+    if (cfg.tree_sweep) {
+        printf("TinyBFT partition tree benchmark: state=%u bytes block=%u bytes\n",
+               (unsigned)sizeof(kv_table.state), (unsigned)TINYBFT_BLOCK_SIZE);
+        return run_tree_sweep(&cfg);
+    }
+
+    if (cfg.mode == BENCH_MODE_UDP && cfg.udp_replica >= 0) {
+        return run_udp_replica(&cfg);
+    }
+    if (cfg.batch_sweep || cfg.depth_sweep) {
+        cfg.mode = BENCH_MODE_ENGINE;
+    }
+
+    static const char* const mode_names[] = { "pipeline", "engine", "sim", "udp" };
+    printf("TinyBFT %s benchmark: ops=%llu keys=%llu dist=%s reads=%u%%", mode_names[cfg.mode],
+           (unsigned long long)cfg.ops, (unsigned long long)cfg.keys,
+           cfg.dist == BENCH_DIST_ZIPFIAN ? "zipfian" : "uniform", cfg.read_pct);
+    if (cfg.mode != BENCH_MODE_PIPELINE) {
+        printf(" clients=%u batch=%u depth=%u delay=%uus", cfg.clients, cfg.batch, cfg.depth, cfg.delay_us);
+        if (cfg.window > 1) {
+            printf(" window=%u", cfg.window);
+        }
+        if (cfg.groups > 1) {
+            printf(" groups=%u", cfg.groups);
+        }
+    }
+    if (cfg.mode == BENCH_MODE_SIM) {
+        printf(" seed=%llu", (unsigned long long)cfg.seed);
+    }
+    printf("\n");
+
+    if (cfg.batch_sweep) {
+        return run_batch_sweep(cfg);
+    }
+    if (cfg.depth_sweep) {
+        return run_depth_sweep(cfg);
+    }
+
+    bench_result_t res;
+    if (!run_benchmark(&cfg, &res)) {
+        return 1;
+    }
+
+    report("PUT", &put_hist, res.elapsed_ns);
+    report("GET", &get_hist, res.elapsed_ns);
+    report("ALL", &all_hist, res.elapsed_ns);
+    printf("GET misses: %llu, elapsed: %.3f s\n", (unsigned long long)res.misses, res.elapsed_ns / 1e9);
+
+    if (cfg.mode == BENCH_MODE_SIM) {
+        printf("Simulated %.3f s in %.3f s (%.1fx real time), %llu events, trace hash %016llx\n",
+               res.elapsed_ns / 1e9, res.wall_ns / 1e9, (double)res.elapsed_ns / (res.wall_ns > 0 ? res.wall_ns : 1),
+               (unsigned long long)res.sim.events, (unsigned long long)res.trace_hash);
+        printf("Messages: %llu sent, %llu transmissions lost, %llu dropped for buffers, %llu deferred; "
+               "%llu client resends\n",
+               (unsigned long long)res.sim.sent, (unsigned long long)res.sim.lost,
+               (unsigned long long)res.sim.overflows, (unsigned long long)res.sim.deferred,
+               (unsigned long long)res.sim.resends);
+        printf("Wire: %llu bytes, %.1f per message, %.0f%% of the in-memory framing\n",
+               (unsigned long long)res.sim.wire_bytes,
+               res.sim.sent > 0 ? (double)res.sim.wire_bytes / res.sim.sent : 0.0,
+               res.sim.frame_bytes > 0 ? 100.0 * res.sim.wire_bytes / res.sim.frame_bytes : 0.0);
+    }
+    if (cfg.mode == BENCH_MODE_UDP) {
+        uint64_t received = 0, sent = 0, sends = 0, recvs = 0, waits = 0, dropped = 0;
+        for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+            received += res.udp[r].datagrams_received;
+            sent += res.udp[r].datagrams_sent;
+            sends += res.udp[r].send_calls;
+            recvs += res.udp[r].recv_calls;
+            waits += res.udp[r].wait_calls;
+            dropped += res.udp[r].dropped;
+        }
+        double requests = all_hist.total > 0 ? (double)all_hist.total : 1.0;
+        printf("UDP: replicas received %llu datagrams (%.0f/sec), %.1f per recvmmsg, sent %.1f per sendmmsg; "
+               "%llu dropped\n", (unsigned long long)received, received / (res.elapsed_ns / 1e9),
+               recvs > 0 ? (double)received / recvs : 0.0, sends > 0 ? (double)sent / sends : 0.0,
+               (unsigned long long)dropped);
+        printf("Syscalls per request: %.2f on the replicas (sendmmsg %.2f, recvmmsg %.2f, epoll_wait %.2f), "
+               "%.2f on the clients\n", (sends + recvs + waits) / requests, sends / requests, recvs / requests,
+               waits / requests, res.udp_client_syscalls / requests);
+    }
+    if (cfg.mode != BENCH_MODE_PIPELINE) {
+        printf("Timed-out requests: %llu\n", (unsigned long long)res.failures);
+        if (res.fast_reads + res.read_fallbacks > 0) {
+            printf("Read-only GETs: %llu accepted on 2f+1 matching replies, %llu ordered after conflicting replies\n",
+                   (unsigned long long)res.fast_reads, (unsigned long long)res.read_fallbacks);
+        }
+        if (cfg.groups > 1) {
+            for (uint32_t g = 0; g < cfg.groups; g++) {
+                printf("Group %u completed %llu operations (%.0f ops/sec), committed %llu instances\n", g,
+                       (unsigned long long)res.group_ops[g], res.group_ops[g] / (res.elapsed_ns / 1e9),
+                       (unsigned long long)res.group_committed[g]);
+            }
+            printf("All %u groups: %.0f ops/sec; the replica lines below are group 0's\n", cfg.groups,
+                   all_hist.total / (res.elapsed_ns / 1e9));
+        }
+        for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+            printf("Replica %u committed %llu instances (%.0f/sec), executed %llu requests, "
+                   "%llu checkpoints (%.1f blocks rehashed each, %llu stable)\n", r,
+                   (unsigned long long)res.committed[r],
+                   res.committed[r] / (res.elapsed_ns / 1e9),
+                   (unsigned long long)res.executed[r],
+                   (unsigned long long)res.checkpoints[r],
+                   res.checkpoints[r] > 0 ? (double)res.checkpoint_blocks[r] / res.checkpoints[r] : 0.0,
+                   (unsigned long long)res.stable_checkpoints[r]);
+            if (res.tentative[r] > 0) {
+                printf("Replica %u executed %llu batches tentatively, %llu rolled back\n", r,
+                       (unsigned long long)res.tentative[r], (unsigned long long)res.rollbacks[r]);
+            }
+            if (res.parallel_runs[r] > 0) {
+                printf("Replica %u executed %llu groups of requests in parallel, %.1f keys each\n", r,
+                       (unsigned long long)res.parallel_runs[r], (double)res.parallel_tasks[r] / res.parallel_runs[r]);
+            }
+            if (res.transfers[r] > 0) {
+                printf("Replica %u completed %llu state transfers, fetching %llu blocks\n", r,
+                       (unsigned long long)res.transfers[r], (unsigned long long)res.transfer_blocks[r]);
+            }
+            if (res.forged[r] > 0) {
+                printf("Replica %u rejected %llu messages with a wrong authenticator\n", r,
+                       (unsigned long long)res.forged[r]);
+            }
+            if (res.view_changes[r] > 0) {
+                printf("Replica %u is in view %u after %llu view changes (timeout now %u ms)\n", r, res.view[r],
+                       (unsigned long long)res.view_changes[r], res.view_timeout[r]);
+            }
+            printf("Replica %u high water: %u/%u slots, %u/%u checkpoint certificates, %u/%u event buffers, scratch",
+                   r, res.high_water[r].slots, TINYBFT_WINDOW_SIZE, res.high_water[r].checkpoint_certs,
+                   TINYBFT_CHECKPOINT_CERTS, res.high_water[r].events, TINYBFT_EVENT_ENTRIES);
+            for (uint32_t c = 0; c < TINYBFT_SCRATCH_CLASSES; c++) {
+                printf(" %u x %uB", res.scratch_high_water[r][c], tinybft_scratch_class_size(c));
+            }
+            printf("\n");
+        }
+
+        // Bytes the replicas copied per message they handled, by type
+        static const char* const msg_names[TINYBFT_MSG_TYPES] = {
+            "REQUEST", "REPLY", "PRE-PREPARE", "PREPARE", "COMMIT", "CHECKPOINT",
+            "VIEW-CHANGE", "NEW-VIEW", "TRANSFER-REQ", "TRANSFER-RESP"
+        };
+        printf("%-14s %-12s %-14s %s\n", "MESSAGE", "RECEIVED", "COPIED_BYTES", "COPIED/MSG");
+        for (uint32_t t = 0; t < TINYBFT_MSG_TYPES; t++) {
+            if (res.received[t] > 0) {
+                printf("%-14s %-12llu %-14llu %.1f\n", msg_names[t], (unsigned long long)res.received[t],
+                       (unsigned long long)res.copied_bytes[t], (double)res.copied_bytes[t] / res.received[t]);
+            }
+        }
+        if (cfg.faulty >= 0 && tinybft_primary(res.crash_view) == (uint32_t)cfg.faulty) {
+            report_failover(&cfg, &res);
+        }
+        if (cfg.recover_after > 0) {
+            if (res.recovery_ns > 0) {
+                printf("Replica %d recovered %u missed sequence numbers in %.1f ms, with %llu state transfers "
+                       "fetching %llu blocks\n",
+                       cfg.faulty, res.behind_by, res.recovery_ns / 1e6, (unsigned long long)res.recovery_transfers,
+                       (unsigned long long)res.recovery_blocks);
+            } else {
+                printf("Replica %d did not keep pace with the others before the run ended (%llu state transfers)\n",
+                       cfg.faulty, (unsigned long long)res.transfers[cfg.faulty]);
+            }
+        }
+    }
+
+    return 0;
+}
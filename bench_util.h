@@ -0,0 +1,181 @@
+#ifndef TINYBFT_BENCH_UTIL_H
+#define TINYBFT_BENCH_UTIL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Shared helpers for the benchmark drivers: clock, RNG, key distributions
+// and a fixed-size latency histogram (no dynamic allocation).
+
+// Monotonic clock in nanoseconds
+static inline uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// splitmix64: small, fast and good enough for workload generation
+typedef struct {
+    uint64_t state;
+} bench_rng_t;
+
+static inline uint64_t bench_rng_next(bench_rng_t* rng) {
+    uint64_t z = (rng->state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Uniform double in [0, 1)
+static inline double bench_rng_double(bench_rng_t* rng) {
+    return (bench_rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Key distributions
+typedef enum {
+    BENCH_DIST_UNIFORM = 0,
+    BENCH_DIST_ZIPFIAN
+} bench_dist_t;
+
+// Zipfian generator over [0, n) after Gray et al. (as used by YCSB)
+typedef struct {
+    bench_dist_t dist;
+    uint64_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+    double half_pow_theta;
+} bench_keygen_t;
+
+static inline void bench_keygen_init(bench_keygen_t* gen, bench_dist_t dist, uint64_t n, double theta) {
+    memset(gen, 0, sizeof(*gen));
+    gen->dist = dist;
+    gen->n = n > 0 ? n : 1;
+    gen->theta = theta;
+
+    if (dist != BENCH_DIST_ZIPFIAN) {
+        return;
+    }
+
+    double zeta2 = 1.0 + pow(0.5, theta);
+    for (uint64_t i = 1; i <= gen->n; i++) {
+        gen->zetan += 1.0 / pow((double)i, theta);
+    }
+
+    gen->alpha = 1.0 / (1.0 - theta);
+    gen->eta = (1.0 - pow(2.0 / gen->n, 1.0 - theta)) / (1.0 - zeta2 / gen->zetan);
+    gen->half_pow_theta = 1.0 + pow(0.5, theta);
+}
+
+static inline uint64_t bench_keygen_next(bench_keygen_t* gen, bench_rng_t* rng) {
+    if (gen->dist != BENCH_DIST_ZIPFIAN) {
+        return bench_rng_next(rng) % gen->n;
+    }
+
+    double u = bench_rng_double(rng);
+    double uz = u * gen->zetan;
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < gen->half_pow_theta) {
+        return 1;
+    }
+
+    uint64_t k = (uint64_t)(gen->n * pow(gen->eta * u - gen->eta + 1.0, gen->alpha));
+    return k < gen->n ? k : gen->n - 1;
+}
+
+// Log-linear latency histogram: 2^BENCH_HIST_SUB_BITS sub-buckets per power
+// of two, giving ~3% relative precision over the full uint64_t range.
+#define BENCH_HIST_SUB_BITS 5
+#define BENCH_HIST_SUB_COUNT (1u << BENCH_HIST_SUB_BITS)
+#define BENCH_HIST_BUCKETS ((64 - BENCH_HIST_SUB_BITS + 1) * BENCH_HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[BENCH_HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+} bench_hist_t;
+
+static inline void bench_hist_reset(bench_hist_t* hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+static inline uint32_t bench_hist_index(uint64_t value) {
+    if (value < BENCH_HIST_SUB_COUNT) {
+        return (uint32_t)value;
+    }
+
+    uint32_t exponent = 63 - (uint32_t)__builtin_clzll(value);
+    uint32_t shift = exponent - BENCH_HIST_SUB_BITS;
+    return (shift + 1) * BENCH_HIST_SUB_COUNT + (uint32_t)((value >> shift) - BENCH_HIST_SUB_COUNT);
+}
+
+// Highest value that maps to the given bucket
+static inline uint64_t bench_hist_bucket_limit(uint32_t index) {
+    if (index < BENCH_HIST_SUB_COUNT) {
+        return index;
+    }
+
+    uint32_t shift = index / BENCH_HIST_SUB_COUNT - 1;
+    uint64_t sub = index % BENCH_HIST_SUB_COUNT + BENCH_HIST_SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+static inline void bench_hist_record(bench_hist_t* hist, uint64_t value) {
+    hist->counts[bench_hist_index(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+static inline void bench_hist_merge(bench_hist_t* dst, const bench_hist_t* src) {
+    for (uint32_t i = 0; i < BENCH_HIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+// Value at the given percentile (0..100), clamped to the observed maximum
+static inline uint64_t bench_hist_percentile(const bench_hist_t* hist, double percentile) {
+    if (hist->total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)ceil(percentile / 100.0 * hist->total);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BENCH_HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            uint64_t limit = bench_hist_bucket_limit(i);
+            return limit < hist->max ? limit : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+#endif // TINYBFT_BENCH_UTIL_H
@@ -0,0 +1,247 @@
+#include "client.h"
+#include "replica.h"
+#include <string.h>
+
+#define HEADER_SIZE ((uint32_t)sizeof(tinybft_msg_header_t))
+
+_Static_assert(sizeof(tinybft_msg_header_t) + sizeof(tinybft_request_t) + MAX_KEY_SIZE + MAX_VALUE_SIZE <=
+               TINYBFT_MAX_MSG_SIZE, "A request fits in its event region buffer");
+
+static tinybft_msg_header_t* request_msg(tinybft_client_t* cl, uint32_t s) {
+    return (tinybft_msg_header_t*)cl->region->client_requests[cl->first + s];
+}
+
+static tinybft_request_t* request_of(tinybft_client_t* cl, uint32_t s) {
+    return (tinybft_request_t*)(request_msg(cl, s) + 1);
+}
+
+bool tinybft_client_init(tinybft_client_t* cl, tinybft_event_region_t* region, uint32_t first, uint32_t count,
+                         const tinybft_client_config_t* config, tinybft_send_fn send, void* send_ctx) {
+    if (count == 0 || first >= TINYBFT_MAX_CLIENTS || count > TINYBFT_MAX_CLIENTS - first) {
+        return false;
+    }
+
+    memset(cl, 0, sizeof(*cl));
+    cl->region = region;
+    cl->first = first;
+    cl->count = count;
+    cl->config = *config;
+    cl->send = send;
+    cl->send_ctx = send_ctx;
+    for (uint32_t s = 0; s < count; s++) {
+        memset(request_msg(cl, s), 0, HEADER_SIZE);
+        memset(region->client_replies[first + s], 0, HEADER_SIZE);
+    }
+    return true;
+}
+
+void tinybft_client_set_timestamp(tinybft_client_t* cl, uint32_t session, uint32_t timestamp) {
+    if (session >= cl->first && session - cl->first < cl->count) {
+        cl->sessions[session - cl->first].timestamp = timestamp;
+    }
+}
+
+// Send the session's request under a fresh timestamp: a read-only request to
+// every replica, anything else to the primary of the last view vouched for
+static void send_request(tinybft_client_t* cl, uint32_t s, bool read_only, uint64_t now_ms) {
+    tinybft_session_t* session = &cl->sessions[s];
+    tinybft_msg_header_t* hdr = request_msg(cl, s);
+    tinybft_request_t* req = request_of(cl, s);
+
+    req->timestamp = ++session->timestamp;
+    req->flags = read_only ? TINYBFT_REQUEST_READ_ONLY : 0;
+    session->read_only = read_only;
+    session->replied = 0;
+    session->committed = 0;
+
+    if (read_only) {
+        session->read_deadline = now_ms + cl->config.read_timeout_ms;
+        for (uint32_t r = 0; r < TINYBFT_MAX_REPLICAS; r++) {
+            cl->send(cl->send_ctx, r, hdr, req, NULL);
+        }
+    } else {
+        session->resend_at = now_ms + cl->config.resend_ms;
+        hdr->receiver_id = tinybft_primary(cl->view);
+        hdr->view = cl->view;
+        cl->send(cl->send_ctx, hdr->receiver_id, hdr, req, NULL);
+    }
+}
+
+bool tinybft_client_issue(tinybft_client_t* cl, tinybft_op_t op, const char* key, const char* value, uint64_t tag,
+                          uint64_t now_ms) {
+    uint32_t s = 0;
+
+    while (s < cl->count && (cl->sessions[s].pending || cl->sessions[s].done)) {
+        s++;
+    }
+    if (s == cl->count) {
+        return false;
+    }
+
+    tinybft_msg_header_t* hdr = request_msg(cl, s);
+    tinybft_request_t* req = request_of(cl, s);
+    size_t key_len = strnlen(key, MAX_KEY_SIZE - 1);
+    size_t value_len = (op == TINYBFT_OP_PUT && value != NULL) ? strnlen(value, MAX_VALUE_SIZE - 1) : 0;
+
+    req->client_id = TINYBFT_CLIENT_ENDPOINT(cl->first + s);
+    req->op = (uint8_t)op;
+    req->key_len = (uint8_t)key_len;
+    req->value_len = (uint16_t)value_len;
+    memcpy(req + 1, key, key_len);
+    if (value_len > 0) {
+        memcpy((char*)(req + 1) + key_len, value, value_len);
+    }
+
+    hdr->type = MSG_TYPE_REQUEST;
+    hdr->sender_id = req->client_id;
+    hdr->receiver_id = TINYBFT_ALL_REPLICAS;
+    hdr->view = cl->view;
+    hdr->seq_num = 0;
+    hdr->data_len = tinybft_request_size(req);
+
+    cl->sessions[s].tag = tag;
+    cl->sessions[s].pending = true;
+    cl->sessions[s].deadline = now_ms + cl->config.timeout_ms;
+    cl->outstanding++;
+    send_request(cl, s, op == TINYBFT_OP_GET && cl->config.read_only_gets, now_ms);
+    return true;
+}
+
+static void complete(tinybft_client_t* cl, uint32_t s, int result) {
+    cl->sessions[s].pending = false;
+    cl->sessions[s].done = true;
+    cl->sessions[s].result = result;
+    cl->done[(cl->done_head + cl->done_count++) % TINYBFT_MAX_CLIENTS] = s;
+}
+
+// Highest view that f+1 of the replicas that replied have reached, so at
+// least one correct replica vouches for it
+static uint32_t replied_view(const tinybft_session_t* session) {
+    uint32_t view = 0;
+
+    for (uint32_t r = 0; r < TINYBFT_MAX_REPLICAS; r++) {
+        uint32_t at_least = 0;
+        for (uint32_t q = 0; q < TINYBFT_MAX_REPLICAS && (session->replied & (1u << r)); q++) {
+            at_least += (session->replied & (1u << q)) && session->reply_view[q] >= session->reply_view[r];
+        }
+        if (at_least >= TINYBFT_MAX_FAULTY + 1 && session->reply_view[r] > view) {
+            view = session->reply_view[r];
+        }
+    }
+    return view;
+}
+
+// Most replies to the session's current timestamp that agree
+static uint32_t best_match(const tinybft_session_t* session) {
+    uint32_t best = 0;
+
+    for (uint32_t r = 0; r < TINYBFT_MAX_REPLICAS; r++) {
+        uint32_t matches = 0;
+        for (uint32_t q = 0; q < TINYBFT_MAX_REPLICAS && (session->replied & (1u << r)); q++) {
+            matches += (session->replied & (1u << q)) &&
+                       memcmp(session->reply_digest[q], session->reply_digest[r], TINYBFT_DIGEST_SIZE) == 0;
+        }
+        best = matches > best ? matches : best;
+    }
+    return best;
+}
+
+void tinybft_client_receive(tinybft_client_t* cl, const tinybft_msg_header_t* msg) {
+    const tinybft_reply_t* reply = (const tinybft_reply_t*)(msg + 1);
+    uint32_t s;
+
+    if (msg->type != MSG_TYPE_REPLY || msg->sender_id >= TINYBFT_MAX_REPLICAS || msg->data_len < sizeof(*reply) ||
+        msg->data_len > TINYBFT_MAX_MSG_SIZE - HEADER_SIZE || reply->result_len > MAX_VALUE_SIZE ||
+        reply->result_len > msg->data_len - sizeof(*reply) || reply->client_id < TINYBFT_MAX_REPLICAS) {
+        return;
+    }
+    s = reply->client_id - TINYBFT_MAX_REPLICAS - cl->first;
+    if (s >= cl->count || !cl->sessions[s].pending || reply->timestamp != cl->sessions[s].timestamp) {
+        return;  // Replies count towards the session's current timestamp only
+    }
+
+    // Replies are compared by the digest of their result
+    tinybft_session_t* session = &cl->sessions[s];
+    uint32_t from = msg->sender_id;
+    tinybft_digest(&reply->result_len, (uint32_t)sizeof(reply->result_len) + reply->result_len,
+                   session->reply_digest[from]);
+    session->reply_view[from] = msg->view;
+    session->replied |= 1u << from;
+    if (reply->flags & TINYBFT_REPLY_TENTATIVE) {
+        session->committed &= ~(1u << from);
+    } else {
+        session->committed |= 1u << from;
+    }
+
+    // A read-only answer needs 2f+1 matches, an ordered one f+1 committed
+    // replies or 2f+1 that may be tentative
+    uint32_t matches = 0;
+    uint32_t committed = 0;
+    for (uint32_t q = 0; q < TINYBFT_MAX_REPLICAS; q++) {
+        bool match = (session->replied & (1u << q)) &&
+                     memcmp(session->reply_digest[q], session->reply_digest[from], TINYBFT_DIGEST_SIZE) == 0;
+        matches += match;
+        committed += match && (session->committed & (1u << q));
+    }
+    if (matches < TINYBFT_QUORUM && (session->read_only || committed < TINYBFT_MAX_FAULTY + 1)) {
+        return;
+    }
+
+    memcpy(cl->region->client_replies[cl->first + s], msg, HEADER_SIZE + msg->data_len);
+    if (session->read_only) {
+        cl->fast_reads++;
+    } else if (replied_view(session) > cl->view) {
+        cl->view = replied_view(session);
+    }
+    complete(cl, s, (int)reply->result_len);
+}
+
+void tinybft_client_tick(tinybft_client_t* cl, uint64_t now_ms) {
+    for (uint32_t s = 0; s < cl->count; s++) {
+        tinybft_session_t* session = &cl->sessions[s];
+        if (!session->pending) {
+            continue;
+        }
+
+        uint32_t replied = (uint32_t)__builtin_popcount(session->replied);
+        if (session->read_only &&
+            (best_match(session) + (TINYBFT_MAX_REPLICAS - replied) < TINYBFT_QUORUM || now_ms > session->read_deadline)) {
+            cl->read_fallbacks++;  // Conflicting or missing answers: order the request after all
+            send_request(cl, s, false, now_ms);
+        } else if (now_ms > session->deadline) {
+            complete(cl, s, TINYBFT_CLIENT_TIMEOUT);
+        } else if (!session->read_only && now_ms > session->resend_at) {
+            // The primary may be faulty: the backups relay the request and
+            // time it, and reply again if it was executed already
+            cl->resends++;
+            session->resend_at = now_ms + cl->config.resend_ms;
+            for (uint32_t r = 0; r < TINYBFT_MAX_REPLICAS; r++) {
+                cl->send(cl->send_ctx, r, request_msg(cl, s), request_of(cl, s), NULL);
+            }
+        }
+    }
+}
+
+int tinybft_client_next(tinybft_client_t* cl, uint64_t* tag, char* result, uint32_t result_cap) {
+    if (cl->done_count == 0) {
+        return TINYBFT_CLIENT_PENDING;
+    }
+
+    uint32_t s = cl->done[cl->done_head];
+    tinybft_session_t* session = &cl->sessions[s];
+    cl->done_head = (cl->done_head + 1) % TINYBFT_MAX_CLIENTS;
+    cl->done_count--;
+    cl->outstanding--;
+    session->done = false;
+
+    if (tag != NULL) {
+        *tag = session->tag;
+    }
+    if (session->result >= 0 && result != NULL) {
+        const tinybft_msg_header_t* msg = (const tinybft_msg_header_t*)cl->region->client_replies[cl->first + s];
+        const tinybft_reply_t* reply = (const tinybft_reply_t*)(msg + 1);
+        uint32_t copy = (uint32_t)session->result < result_cap ? (uint32_t)session->result : result_cap;
+        memcpy(result, reply + 1, copy);
+    }
+    return session->result;
+}
@@ -0,0 +1,93 @@
+#ifndef TINYBFT_CLIENT_H
+#define TINYBFT_CLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pbft.h"
+
+// Pipelining client core. A client issues operations through sessions:
+// client endpoints that each carry one outstanding request under their own
+// increasing timestamps, so replicas order requests and cache replies per
+// session exactly as for any client, and a client with n sessions keeps n
+// operations in flight. Like the replica core it never blocks and owns no
+// threads: the runtime carries requests through the send callback, feeds
+// in the replies addressed to the client's sessions and advances its clock.
+//
+// An ordered operation completes on f+1 matching replies, or 2f+1 when they
+// are tentative, a read-only GET on 2f+1 (it is ordered after all when they
+// cannot agree in time). The
+// outstanding request of session s is kept in client_requests[s] of an
+// event region and the reply that decided it in client_replies[s], so one
+// region serves every client of a process; replies that do not decide
+// anything are only counted by their digest.
+
+#define TINYBFT_CLIENT_PENDING (-2)  // tinybft_client_next: nothing completed yet
+#define TINYBFT_CLIENT_TIMEOUT (-1)  // The operation gave up
+
+typedef struct {
+    uint32_t timeout_ms;       // Give up on an operation after this long
+    uint32_t read_timeout_ms;  // Order a read-only GET without 2f+1 matching replies by then
+    uint32_t resend_ms;        // Send an unanswered ordered request to every replica after this long
+    bool read_only_gets;       // Send GETs to every replica unordered first
+} tinybft_client_config_t;
+
+typedef struct {
+    uint64_t tag;            // Caller's name for the operation
+    uint32_t timestamp;      // Of the request last sent
+    bool pending;            // Waiting for replies
+    bool done;               // Completed, not yet taken by tinybft_client_next
+    bool read_only;          // The current attempt is a read-only request
+    int result;              // Result length once done, or TINYBFT_CLIENT_TIMEOUT
+    uint64_t deadline;
+    uint64_t read_deadline;
+    uint64_t resend_at;
+    uint32_t replied;        // Replicas whose reply to timestamp arrived
+    uint32_t committed;      // Those whose reply was not tentative
+    uint32_t reply_view[TINYBFT_MAX_REPLICAS];
+    uint8_t reply_digest[TINYBFT_MAX_REPLICAS][TINYBFT_DIGEST_SIZE];
+} tinybft_session_t;
+
+typedef struct {
+    tinybft_event_region_t* region;
+    uint32_t first;          // Sessions first..first+count-1 are client indices (endpoint - TINYBFT_MAX_REPLICAS)
+    uint32_t count;
+    uint32_t view;           // Highest view f+1 replicas vouched for
+    tinybft_client_config_t config;
+    tinybft_session_t sessions[TINYBFT_MAX_CLIENTS];
+    uint32_t done[TINYBFT_MAX_CLIENTS];  // Completed sessions in completion order
+    uint32_t done_head;
+    uint32_t done_count;
+    uint32_t outstanding;    // Issued operations not yet taken
+    uint64_t fast_reads;     // Read-only GETs accepted on 2f+1 matching replies
+    uint64_t read_fallbacks; // Read-only GETs ordered after all
+    uint64_t resends;        // Requests sent again to every replica
+
+    tinybft_send_fn send;
+    void* send_ctx;
+} tinybft_client_t;
+
+// Set up a client with sessions first..first+count-1 of region. Timestamps
+// start at zero; see tinybft_client_set_timestamp.
+bool tinybft_client_init(tinybft_client_t* cl, tinybft_event_region_t* region, uint32_t first, uint32_t count,
+                         const tinybft_client_config_t* config, tinybft_send_fn send, void* send_ctx);
+
+// Carry on after the last timestamp a session used, e.g. one the replicas
+// have executed already
+void tinybft_client_set_timestamp(tinybft_client_t* cl, uint32_t session, uint32_t timestamp);
+
+// Issue an operation on a free session; false while every session is busy
+bool tinybft_client_issue(tinybft_client_t* cl, tinybft_op_t op, const char* key, const char* value, uint64_t tag,
+                          uint64_t now_ms);
+
+// Hand over a message addressed to one of the client's sessions
+void tinybft_client_receive(tinybft_client_t* cl, const tinybft_msg_header_t* msg);
+
+// Advance the clock: resends, read-only fallbacks and timeouts
+void tinybft_client_tick(tinybft_client_t* cl, uint64_t now_ms);
+
+// Take the next completed operation: its result length (the result is
+// copied to result, truncated to result_cap) or TINYBFT_CLIENT_TIMEOUT, with
+// its tag in *tag; TINYBFT_CLIENT_PENDING if none has completed
+int tinybft_client_next(tinybft_client_t* cl, uint64_t* tag, char* result, uint32_t result_cap);
+
+#endif // TINYBFT_CLIENT_H
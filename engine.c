@@ -0,0 +1,736 @@
+#include "engine.h"
+#include "client.h"
+#include "replica.h"
+#include "sha256.h"
+#include "spsc_ring.h"
+#include "worker_pool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// The replicas checkpoint and transfer the key-value store as their state
+_Static_assert(sizeof(tinybft_kv_state_t) <= TINYBFT_MAX_STATE_SIZE,
+               "Key-value store does not fit in TINYBFT_MAX_STATE_SIZE");
+
+#define MAX_NODES (TINYBFT_ENGINE_GROUPS * NUM_REPLICAS)
+
+// Replica cores and the rings connecting them. Node n is replica
+// n % NUM_REPLICAS of group n / NUM_REPLICAS. inbox[n][s] carries messages
+// from endpoint s of the node's group to node n; reply_rings[g][c][r] carries
+// replies from replica r of group g to client c. Every ring has exactly one
+// producer and one consumer.
+static tinybft_replica_t nodes[MAX_NODES];
+static tinybft_ring_t inbox[MAX_NODES][TINYBFT_MAX_ENDPOINTS];
+static tinybft_ring_t reply_rings[TINYBFT_ENGINE_GROUPS][TINYBFT_MAX_CLIENTS][NUM_REPLICAS];
+static pthread_t threads[MAX_NODES];
+static tinybft_pool_t pools[MAX_NODES];  // Execution workers of each node, with exec_threads
+static uint32_t exec_threads = 0;
+static uint32_t group_count = 1;
+static uint32_t node_count = NUM_REPLICAS;
+
+// Group 0 executes against replicas[]; the other groups have stores of their own
+#if TINYBFT_ENGINE_GROUPS > 1
+static replica_t group_replicas[(TINYBFT_ENGINE_GROUPS - 1) * NUM_REPLICAS];
+#endif
+
+static bool running = false;
+static uint64_t link_delay_ns = 0;
+static int forger = -1;
+
+// Position in inbox[n][s] up to which messages from replicas were verified
+static uint32_t verified[MAX_NODES][NUM_REPLICAS];
+
+// Client side: the client cores of each group, whose requests and decided
+// replies share one event region per group. Client c owns session c unless
+// tinybft_engine_set_sessions gives it others, in every group; session s of
+// group g sends on inbox[*][s] of the group and hears on reply_rings[g][s].
+static tinybft_event_region_t client_region[TINYBFT_ENGINE_GROUPS];
+static tinybft_client_t clients[TINYBFT_ENGINE_GROUPS][TINYBFT_MAX_CLIENTS];
+static bool read_only_gets = true;
+
+static bool engine_running(void) {
+    return __atomic_load_n(&running, __ATOMIC_ACQUIRE);
+}
+
+static uint32_t node_index(const tinybft_replica_t* node) {
+    return (uint32_t)(node - nodes);
+}
+
+static replica_t* node_app(uint32_t n) {
+#if TINYBFT_ENGINE_GROUPS > 1
+    return n < NUM_REPLICAS ? &replicas[n] : &group_replicas[n - NUM_REPLICAS];
+#else
+    return &replicas[n];
+#endif
+}
+
+// A replica marked faulty is faulty in every group
+static bool replica_faulty(uint32_t replica_id) {
+    return __atomic_load_n(&replicas[replica_id].is_faulty, __ATOMIC_RELAXED);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t now_ms(void) {
+    return now_ns() / 1000000;
+}
+
+enum {
+    AUTH_UNCHECKED = 0,
+    AUTH_VALID,
+    AUTH_FORGED
+};
+
+// Every ring record starts with the time at which the link delivers it and,
+// for messages between replicas, the outcome of checking their authenticator
+typedef struct {
+    uint64_t deliver_at;
+    uint32_t auth;
+} link_stamp_t;
+
+// Push a framed message, waiting for space while the engine runs
+static void ring_send(tinybft_ring_t* ring, const tinybft_msg_header_t* hdr, const void* payload,
+                      const uint8_t* authenticator) {
+    uint32_t auth_len = authenticator != NULL ? TINYBFT_AUTHENTICATOR_SIZE : 0;
+    uint32_t len = (uint32_t)(sizeof(link_stamp_t) + sizeof(*hdr) + hdr->data_len + auth_len);
+    uint8_t* dst;
+
+    while ((dst = (uint8_t*)tinybft_ring_reserve(ring, len)) == NULL) {
+        if (!engine_running()) {
+            return;
+        }
+        sched_yield();
+    }
+
+    link_stamp_t stamp = { link_delay_ns > 0 ? now_ns() + link_delay_ns : 0, AUTH_UNCHECKED };
+    memcpy(dst, &stamp, sizeof(stamp));
+    memcpy(dst + sizeof(stamp), hdr, sizeof(*hdr));
+    memcpy(dst + sizeof(stamp) + sizeof(*hdr), payload, hdr->data_len);
+    if (auth_len > 0) {
+        memcpy(dst + sizeof(stamp) + sizeof(*hdr) + hdr->data_len, authenticator, auth_len);
+    }
+    tinybft_ring_publish(ring);
+}
+
+// Oldest delivered message of a ring, or NULL if none has arrived yet
+static const tinybft_msg_header_t* ring_receive(tinybft_ring_t* ring, uint32_t* len) {
+    const uint8_t* record = (const uint8_t*)tinybft_ring_peek(ring, len);
+    if (record == NULL) {
+        return NULL;
+    }
+
+    const link_stamp_t* stamp = (const link_stamp_t*)record;
+    if (stamp->deliver_at != 0 && now_ns() < stamp->deliver_at) {
+        return NULL;  // Still on the wire
+    }
+
+    *len -= sizeof(link_stamp_t);
+    return (const tinybft_msg_header_t*)(record + sizeof(link_stamp_t));
+}
+
+// Send callback of the replica cores
+static void engine_send(void* ctx, uint32_t dest, const tinybft_msg_header_t* hdr, const void* payload,
+                        const uint8_t* authenticator) {
+    uint32_t sender = ((tinybft_replica_t*)ctx)->id;
+    uint32_t group = node_index((tinybft_replica_t*)ctx) / NUM_REPLICAS;
+
+    if (replica_faulty(sender)) {
+        return;  // A faulty replica stays silent
+    }
+
+    if (dest < NUM_REPLICAS) {
+        uint8_t garbled[TINYBFT_AUTHENTICATOR_SIZE];
+        if ((int)sender == forger && authenticator != NULL) {
+            // A forger cannot produce the MACs other senders share with dest
+            memcpy(garbled, authenticator, sizeof(garbled));
+            garbled[dest * TINYBFT_AUTH_SIZE] ^= 1;
+            authenticator = garbled;
+        }
+        ring_send(&inbox[group * NUM_REPLICAS + dest][sender], hdr, payload, authenticator);
+    } else if (dest < TINYBFT_MAX_ENDPOINTS) {
+        ring_send(&reply_rings[group][dest - NUM_REPLICAS][sender], hdr, payload, NULL);
+    }
+}
+
+// The request's key as the store keeps it
+static void request_key(const tinybft_request_t* req, char key[MAX_KEY_SIZE]) {
+    uint32_t key_len = req->key_len < MAX_KEY_SIZE - 1 ? req->key_len : MAX_KEY_SIZE - 1;
+    memcpy(key, tinybft_request_key(req), key_len);
+    key[key_len] = '\0';
+}
+
+uint32_t tinybft_engine_execute(void* app, const tinybft_request_t* req, uint8_t* result, uint32_t result_cap) {
+    replica_t* replica = (replica_t*)app;
+    char key[MAX_KEY_SIZE];
+    char value[MAX_VALUE_SIZE];
+
+    request_key(req, key);
+
+    if (req->op == TINYBFT_OP_PUT) {
+        if (req->flags & TINYBFT_REQUEST_READ_ONLY) {
+            return 0;  // Writes must be ordered
+        }
+        uint32_t value_len = req->value_len < MAX_VALUE_SIZE - 1 ? req->value_len : MAX_VALUE_SIZE - 1;
+        memcpy(value, tinybft_request_value(req), value_len);
+        value[value_len] = '\0';
+        if (key[0] != '\0') {
+            tinybft_kv_put(&replica->kv_store, key, value);  // A full store drops new keys
+        }
+        memcpy(result, "OK", 2);
+        return 2;
+    }
+
+    const char* stored = tinybft_kv_get(&replica->kv_store, key);
+    if (stored == NULL) {
+        return 0;
+    }
+
+    uint32_t len = (uint32_t)strlen(stored);
+    if (len > result_cap) {
+        len = result_cap;
+    }
+    memcpy(result, stored, len);
+    return len;
+}
+
+tinybft_access_t tinybft_engine_access(void* app, const tinybft_request_t* req, uint32_t* key) {
+    replica_t* replica = (replica_t*)app;
+    char k[MAX_KEY_SIZE];
+
+    request_key(req, k);
+    *key = tinybft_kv_hash(k);
+    if (req->op != TINYBFT_OP_PUT || (req->flags & TINYBFT_REQUEST_READ_ONLY) || k[0] == '\0') {
+        return TINYBFT_ACCESS_READ;  // Nothing is written
+    }
+    return tinybft_kv_get(&replica->kv_store, k) != NULL ? TINYBFT_ACCESS_WRITE : TINYBFT_ACCESS_EXCLUSIVE;
+}
+
+void tinybft_engine_parallel(void* ctx, uint32_t count, tinybft_task_fn task, void* arg) {
+    tinybft_pool_run((tinybft_pool_t*)ctx, count, task, arg);
+}
+
+// Session key for messages from replica `from` to replica `to`. The engine
+// stands in for key distribution by deriving every key from one secret.
+static void session_key(uint32_t from, uint32_t to, uint8_t key[TINYBFT_AUTH_KEY_SIZE]) {
+    static const char secret[] = "tinybft-engine-session";
+    uint8_t input[sizeof(secret) + 2];
+
+    _Static_assert(TINYBFT_AUTH_KEY_SIZE == TINYBFT_SHA256_SIZE, "Session keys are SHA-256 digests");
+    memcpy(input, secret, sizeof(secret));
+    input[sizeof(secret)] = (uint8_t)from;
+    input[sizeof(secret) + 1] = (uint8_t)to;
+    tinybft_sha256(input, sizeof(input), key);
+}
+
+void tinybft_engine_set_keys(tinybft_replica_t* node) {
+    for (uint32_t p = 0; p < NUM_REPLICAS; p++) {
+        uint8_t out_key[TINYBFT_AUTH_KEY_SIZE];
+        uint8_t in_key[TINYBFT_AUTH_KEY_SIZE];
+        session_key(node->id, p, out_key);
+        session_key(p, node->id, in_key);
+        tinybft_replica_set_keys(node, p, out_key, in_key);
+    }
+}
+
+// Key-value store writes dirty the checkpointed state blocks
+static void engine_modify(void* ctx, const void* addr, uint32_t len) {
+    tinybft_replica_modify((tinybft_replica_t*)ctx, addr, len);
+}
+
+// Check the authenticators of the delivered messages from replicas that no
+// earlier pass covered, up to TINYBFT_AUTH_BATCH of them in one batch. The
+// outcome is kept in each message's link stamp.
+static void verify_inbox(tinybft_replica_t* node) {
+    const tinybft_msg_header_t* msgs[TINYBFT_AUTH_BATCH];
+    link_stamp_t* stamps[TINYBFT_AUTH_BATCH];
+    bool valid[TINYBFT_AUTH_BATCH];
+    uint32_t count = 0;
+    uint32_t n = node_index(node);
+
+    for (uint32_t src = 0; src < NUM_REPLICAS && count < TINYBFT_AUTH_BATCH; src++) {
+        tinybft_ring_t* ring = &inbox[n][src];
+        uint32_t pos = verified[n][src];
+        uint8_t* record;
+        uint32_t len;
+
+        if ((int32_t)(pos - ring->head) < 0) {
+            pos = ring->head;
+        }
+        while (count < TINYBFT_AUTH_BATCH && (record = tinybft_ring_peek_at(ring, &pos, &len)) != NULL) {
+            link_stamp_t* stamp = (link_stamp_t*)record;
+            const tinybft_msg_header_t* msg = (const tinybft_msg_header_t*)(record + sizeof(*stamp));
+            if (stamp->deliver_at != 0 && now_ns() < stamp->deliver_at) {
+                break;  // Still on the wire
+            }
+
+            uint32_t msg_len = len - (uint32_t)sizeof(*stamp);
+            if (len < sizeof(*stamp) + sizeof(*msg) + TINYBFT_AUTHENTICATOR_SIZE ||
+                msg->data_len != msg_len - sizeof(*msg) - TINYBFT_AUTHENTICATOR_SIZE) {
+                stamp->auth = AUTH_FORGED;  // Malformed
+            } else {
+                msgs[count] = msg;
+                stamps[count++] = stamp;
+            }
+            pos = tinybft_ring_next(pos, len);
+        }
+        verified[n][src] = pos;
+    }
+
+    if (count > 0) {
+        tinybft_replica_verify(node, msgs, count, valid);
+        for (uint32_t i = 0; i < count; i++) {
+            stamps[i]->auth = valid[i] ? AUTH_VALID : AUTH_FORGED;
+        }
+    }
+}
+
+static void* replica_thread(void* arg) {
+    tinybft_replica_t* node = (tinybft_replica_t*)arg;
+    uint32_t id = node->id;
+    uint32_t n = node_index(node);
+
+    while (engine_running()) {
+        bool progress = false;
+
+        if (!replica_faulty(id)) {
+            verify_inbox(node);
+        }
+
+        for (uint32_t src = 0; src < TINYBFT_MAX_ENDPOINTS; src++) {
+            tinybft_ring_t* ring = &inbox[n][src];
+            uint32_t auth_len = src < NUM_REPLICAS ? TINYBFT_AUTHENTICATOR_SIZE : 0;
+            const tinybft_msg_header_t* msg;
+            uint32_t len;
+
+            while ((msg = ring_receive(ring, &len)) != NULL) {
+                uint32_t auth = auth_len > 0 ? ((const link_stamp_t*)msg - 1)->auth : AUTH_VALID;
+                bool consumed = true;
+                if (replica_faulty(id)) {
+                    // Drained unread
+                } else if (auth == AUTH_UNCHECKED) {
+                    break;  // Verified on a later pass
+                } else if (auth == AUTH_VALID && len >= sizeof(*msg) + auth_len &&
+                           len - auth_len == sizeof(*msg) + msg->data_len) {
+                    // Messages the replica keeps are received straight into their final location
+                    uint8_t* dst = tinybft_replica_recv_buffer(node, msg);
+                    if (dst != NULL) {
+                        memcpy(dst, msg, len - auth_len);
+                        msg = (const tinybft_msg_header_t*)dst;
+                    }
+                    consumed = tinybft_replica_handle(node, msg);
+                }
+                if (!consumed) {
+                    break;  // Deferred; try this ring again on the next pass
+                }
+                tinybft_ring_release(ring);
+                progress = true;
+            }
+        }
+
+        if (!replica_faulty(id)) {
+            tinybft_replica_tick(node, now_ms());
+        }
+        node_app(n)->seq_num = (int)node->last_executed;
+        if (!progress) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static bool open_client(uint32_t client, uint32_t first, uint32_t count);
+
+// Stop the execution workers of nodes 0..count-1
+static void stop_pools(uint32_t count) {
+    for (uint32_t n = 0; n < count && exec_threads > 0; n++) {
+        tinybft_pool_stop(&pools[n]);
+    }
+}
+
+// With several groups, confine each group's replica and execution threads
+// to its own share of the CPUs the process may run on, wrapping around when
+// there are fewer CPUs than groups
+static void pin_group(uint32_t group, const cpu_set_t* allowed) {
+    uint32_t cpus = (uint32_t)CPU_COUNT(allowed);
+    if (group_count < 2 || cpus == 0) {
+        return;
+    }
+
+    uint32_t share = cpus / group_count > 0 ? cpus / group_count : 1;
+    uint32_t first = (group * share) % cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (uint32_t cpu = 0, k = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, allowed)) {
+            if (k >= first && k < first + share) {
+                CPU_SET(cpu, &set);
+            }
+            k++;
+        }
+    }
+    for (uint32_t n = group * NUM_REPLICAS; n < (group + 1) * NUM_REPLICAS; n++) {
+        pthread_setaffinity_np(threads[n], sizeof(set), &set);
+        for (uint32_t w = 0; w < exec_threads && w < pools[n].workers; w++) {
+            pthread_setaffinity_np(pools[n].threads[w], sizeof(set), &set);
+        }
+    }
+}
+
+void tinybft_engine_default_config(tinybft_engine_config_t* cfg) {
+    cfg->batch_size = TINYBFT_MAX_BATCH;
+    cfg->pipeline_depth = TINYBFT_WINDOW_SIZE;
+    cfg->link_delay_us = 0;
+    cfg->nvm_dir = NULL;
+    cfg->read_only_gets = true;
+    cfg->tentative = false;
+    cfg->exec_threads = 0;
+    cfg->groups = 1;
+    cfg->forger = -1;
+}
+
+bool tinybft_engine_start(const tinybft_engine_config_t* cfg) {
+    tinybft_engine_config_t defaults;
+    if (cfg == NULL) {
+        tinybft_engine_default_config(&defaults);
+        cfg = &defaults;
+    }
+
+    if (engine_running() || cfg->exec_threads > TINYBFT_POOL_MAX_WORKERS || cfg->groups == 0 ||
+        cfg->groups > TINYBFT_ENGINE_GROUPS) {
+        return false;
+    }
+
+    exec_threads = cfg->exec_threads;
+    group_count = cfg->groups;
+    node_count = group_count * NUM_REPLICAS;
+    for (uint32_t n = 0; n < node_count; n++) {
+        uint32_t r = n % NUM_REPLICAS;
+        replica_t* app = node_app(n);
+#if TINYBFT_ENGINE_GROUPS > 1
+        if (n >= NUM_REPLICAS) {
+            app->id = (int)r;  // Groups past the first start from an empty store
+            app->seq_num = 0;
+            app->is_faulty = false;
+            tinybft_kv_init(&app->kv_store);
+        }
+#endif
+
+        for (uint32_t s = 0; s < TINYBFT_MAX_ENDPOINTS; s++) {
+            tinybft_ring_init(&inbox[n][s]);
+        }
+        for (uint32_t c = 0; c < TINYBFT_MAX_CLIENTS; c++) {
+            tinybft_ring_init(&reply_rings[n / NUM_REPLICAS][c][r]);
+        }
+        tinybft_replica_init(&nodes[n], r, engine_send, &nodes[n], tinybft_engine_execute, app);
+        tinybft_replica_set_batch_size(&nodes[n], cfg->batch_size);
+        tinybft_replica_set_pipeline_depth(&nodes[n], cfg->pipeline_depth);
+        tinybft_replica_set_tentative(&nodes[n], cfg->tentative);
+        tinybft_engine_set_keys(&nodes[n]);
+        if (cfg->exec_threads > 0) {
+            if (!tinybft_pool_start(&pools[n], cfg->exec_threads)) {
+                stop_pools(n + 1);
+                return false;
+            }
+            tinybft_replica_set_parallel(&nodes[n], tinybft_engine_access, tinybft_engine_parallel, &pools[n]);
+        }
+
+        tinybft_kv_state_t* state = &app->kv_store.state;
+        bool resumed = false;
+        if (cfg->nvm_dir != NULL) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/replica-%u.nvm", cfg->nvm_dir, n);
+            resumed = tinybft_replica_open_nvm(&nodes[n], path, state, sizeof(*state));
+            if (!resumed) {
+                tinybft_kv_init(&app->kv_store);  // Drop whatever the file held
+            }
+        }
+        if (!resumed) {
+            tinybft_replica_set_state(&nodes[n], state, sizeof(*state));
+        }
+        tinybft_kv_set_modify(&app->kv_store, engine_modify, &nodes[n]);
+    }
+    link_delay_ns = (uint64_t)cfg->link_delay_us * 1000;
+    read_only_gets = cfg->read_only_gets;
+    forger = cfg->forger;
+    memset(verified, 0, sizeof(verified));
+    for (uint32_t c = 0; c < TINYBFT_MAX_CLIENTS; c++) {
+        open_client(c, c, 1);
+    }
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+    }
+    __atomic_store_n(&running, true, __ATOMIC_RELEASE);
+    for (uint32_t n = 0; n < node_count; n++) {
+        if (pthread_create(&threads[n], NULL, replica_thread, &nodes[n]) != 0) {
+            __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+            for (uint32_t j = 0; j < n; j++) {
+                pthread_join(threads[j], NULL);
+            }
+            for (uint32_t j = 0; j < node_count; j++) {
+                tinybft_replica_close_nvm(&nodes[j]);
+            }
+            stop_pools(node_count);
+            return false;
+        }
+    }
+    for (uint32_t g = 0; g < group_count; g++) {
+        pin_group(g, &allowed);
+    }
+
+    return true;
+}
+
+void tinybft_engine_stop(void) {
+    if (!engine_running()) {
+        return;
+    }
+
+    __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+    for (uint32_t n = 0; n < node_count; n++) {
+        pthread_join(threads[n], NULL);
+        tinybft_replica_close_nvm(&nodes[n]);
+    }
+    stop_pools(node_count);
+}
+
+// Send callback of the client cores: requests go out on the session's ring
+// of the group whose event region is ctx
+static void client_send(void* ctx, uint32_t dest, const tinybft_msg_header_t* hdr, const void* payload,
+                        const uint8_t* authenticator) {
+    uint32_t group = (uint32_t)((tinybft_event_region_t*)ctx - client_region);
+    (void)authenticator;
+    if (dest < NUM_REPLICAS) {
+        ring_send(&inbox[group * NUM_REPLICAS + dest][hdr->sender_id], hdr, payload, NULL);
+    }
+}
+
+// Give a client its sessions; they carry on after the timestamps the
+// replicas have executed for them, which resumed replicas may have
+static bool open_client(uint32_t client, uint32_t first, uint32_t count) {
+    tinybft_client_config_t config = {
+        TINYBFT_ENGINE_TIMEOUT_MS, TINYBFT_ENGINE_READ_TIMEOUT_MS, TINYBFT_ENGINE_RESEND_MS, read_only_gets
+    };
+
+    for (uint32_t g = 0; g < group_count; g++) {
+        tinybft_client_t* cl = &clients[g][client];
+        if (!tinybft_client_init(cl, &client_region[g], first, count, &config, client_send, &client_region[g])) {
+            return false;
+        }
+        for (uint32_t s = first; s < first + count; s++) {
+            uint32_t timestamp = 0;
+            for (uint32_t n = g * NUM_REPLICAS; n < (g + 1) * NUM_REPLICAS; n++) {
+                uint32_t executed = __atomic_load_n(&nodes[n].client_timestamp[s], __ATOMIC_RELAXED);
+                timestamp = executed > timestamp ? executed : timestamp;
+            }
+            tinybft_client_set_timestamp(cl, s, timestamp);
+        }
+    }
+    return true;
+}
+
+// Requests a client has in flight across all groups
+static uint32_t client_outstanding(uint32_t client) {
+    uint32_t outstanding = 0;
+    for (uint32_t g = 0; g < group_count; g++) {
+        outstanding += clients[g][client].outstanding;
+    }
+    return outstanding;
+}
+
+bool tinybft_engine_set_sessions(uint32_t client, uint32_t first, uint32_t count) {
+    if (client >= TINYBFT_MAX_CLIENTS || client_outstanding(client) > 0) {
+        return false;
+    }
+    return open_client(client, first, count);
+}
+
+uint32_t tinybft_engine_group(const char* key) {
+    return (uint32_t)(((uint64_t)tinybft_kv_hash(key) * group_count) >> 32);
+}
+
+bool tinybft_engine_issue(uint32_t client, tinybft_op_t op, const char* key, const char* value, uint64_t tag) {
+    if (client >= TINYBFT_MAX_CLIENTS || !engine_running()) {
+        return false;
+    }
+    return tinybft_client_issue(&clients[tinybft_engine_group(key)][client], op, key, value, tag, now_ms());
+}
+
+int tinybft_engine_complete(uint32_t client, uint64_t* tag, char* result, uint32_t result_cap) {
+    if (client >= TINYBFT_MAX_CLIENTS) {
+        return TINYBFT_ENGINE_PENDING;
+    }
+
+    for (uint32_t g = 0; g < group_count; g++) {
+        tinybft_client_t* cl = &clients[g][client];
+        for (uint32_t s = cl->first; s < cl->first + cl->count; s++) {
+            for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+                tinybft_ring_t* ring = &reply_rings[g][s][r];
+                const tinybft_msg_header_t* msg;
+                uint32_t len;
+                while ((msg = ring_receive(ring, &len)) != NULL) {
+                    if (len >= sizeof(*msg) && len == sizeof(*msg) + msg->data_len) {
+                        tinybft_client_receive(cl, msg);
+                    }
+                    tinybft_ring_release(ring);
+                }
+            }
+        }
+        tinybft_client_tick(cl, now_ms());
+        int len = tinybft_client_next(cl, tag, result, result_cap);
+        if (len != TINYBFT_ENGINE_PENDING) {
+            return len;
+        }
+    }
+    return TINYBFT_ENGINE_PENDING;
+}
+
+bool tinybft_engine_submit(uint32_t client, tinybft_op_t op, const char* key, const char* value) {
+    return tinybft_engine_issue(client, op, key, value, 0);
+}
+
+int tinybft_engine_poll(uint32_t client, char* result, uint32_t result_cap) {
+    if (client >= TINYBFT_MAX_CLIENTS || client_outstanding(client) == 0) {
+        return TINYBFT_ENGINE_TIMEOUT;
+    }
+    return tinybft_engine_complete(client, NULL, result, result_cap);
+}
+
+int tinybft_engine_invoke(uint32_t client, tinybft_op_t op, const char* key, const char* value,
+                          char* result, uint32_t result_cap) {
+    if (!tinybft_engine_submit(client, op, key, value)) {
+        return TINYBFT_ENGINE_TIMEOUT;
+    }
+
+    int len;
+    while ((len = tinybft_engine_poll(client, result, result_cap)) == TINYBFT_ENGINE_PENDING) {
+        sched_yield();
+    }
+    return len;
+}
+
+uint64_t tinybft_engine_fast_reads(void) {
+    uint64_t reads = 0;
+    for (uint32_t g = 0; g < group_count; g++) {
+        for (uint32_t c = 0; c < TINYBFT_MAX_CLIENTS; c++) {
+            reads += clients[g][c].fast_reads;
+        }
+    }
+    return reads;
+}
+
+uint64_t tinybft_engine_read_fallbacks(void) {
+    uint64_t fallbacks = 0;
+    for (uint32_t g = 0; g < group_count; g++) {
+        for (uint32_t c = 0; c < TINYBFT_MAX_CLIENTS; c++) {
+            fallbacks += clients[g][c].read_fallbacks;
+        }
+    }
+    return fallbacks;
+}
+
+uint64_t tinybft_engine_forged(uint32_t replica_id) {
+    return replica_id < node_count ? nodes[replica_id].forged : 0;
+}
+
+uint64_t tinybft_engine_reads(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].reads, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_committed(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].committed, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_executed(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].executed, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_checkpoints(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].checkpoints, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_tentative(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].tentative, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_parallel_runs(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].parallel_runs, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_parallel_tasks(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].parallel_tasks, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_rollbacks(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].rollbacks, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_checkpoint_blocks(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].checkpoint_blocks, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_stable_checkpoints(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].stable_checkpoints, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_transfers(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].transfers, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_transfer_blocks(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].transfer_blocks, __ATOMIC_RELAXED) : 0;
+}
+
+uint32_t tinybft_engine_last_executed(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].last_executed, __ATOMIC_RELAXED) : 0;
+}
+
+uint32_t tinybft_engine_scratch_high_water(uint32_t replica_id, uint32_t size_class) {
+    if (replica_id >= node_count || size_class >= TINYBFT_SCRATCH_CLASSES) {
+        return 0;
+    }
+    return __atomic_load_n(&nodes[replica_id].memory.scratch_region.high_water[size_class], __ATOMIC_RELAXED);
+}
+
+tinybft_memory_usage_t tinybft_engine_memory_high_water(uint32_t replica_id) {
+    tinybft_memory_usage_t none = { 0, 0, 0 };
+    return replica_id < node_count ? nodes[replica_id].memory.high_water : none;
+}
+
+uint64_t tinybft_engine_received(uint32_t replica_id, tinybft_msg_type_t type) {
+    if (replica_id >= node_count || type >= TINYBFT_MSG_TYPES) {
+        return 0;
+    }
+    return __atomic_load_n(&nodes[replica_id].received[type], __ATOMIC_RELAXED);
+}
+
+uint64_t tinybft_engine_copied_bytes(uint32_t replica_id, tinybft_msg_type_t type) {
+    if (replica_id >= node_count || type >= TINYBFT_MSG_TYPES) {
+        return 0;
+    }
+    return __atomic_load_n(&nodes[replica_id].copied_bytes[type], __ATOMIC_RELAXED);
+}
+
+uint32_t tinybft_engine_view(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].view, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_view_changes(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].view_changes, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t tinybft_engine_view_commit_ms(uint32_t replica_id) {
+    return replica_id < node_count ? __atomic_load_n(&nodes[replica_id].view_commit_ms, __ATOMIC_RELAXED) : 0;
+}
+
+uint32_t tinybft_engine_view_timeout(uint32_t replica_id) {
+    return replica_id < node_count ? tinybft_view_timeout(&nodes[replica_id]) : 0;
+}
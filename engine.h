@@ -0,0 +1,156 @@
+#ifndef TINYBFT_ENGINE_H
+#define TINYBFT_ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pbft.h"
+#include "client.h"
+
+// In-process replica engine: every replica in replicas[] runs its PBFT core
+// on its own thread, and all traffic between replicas and clients travels as
+// tinybft_msg_header_t-framed messages over statically allocated SPSC rings.
+// With several groups, each is an independent set of replicas with rings and
+// a key-value store of its own, serving the keys that hash to it. The
+// per-replica getters below number the replicas of group g from
+// g * NUM_REPLICAS on; group 0 executes against replicas[].
+
+#ifndef TINYBFT_ENGINE_GROUPS
+#define TINYBFT_ENGINE_GROUPS 1  // Replica groups the engine can shard keys over
+#endif
+
+#ifndef TINYBFT_ENGINE_TIMEOUT_MS
+#define TINYBFT_ENGINE_TIMEOUT_MS 2000  // Give up on a request after this long
+#endif
+
+#ifndef TINYBFT_ENGINE_READ_TIMEOUT_MS
+#define TINYBFT_ENGINE_READ_TIMEOUT_MS 10  // Order a read-only GET that has no 2f+1 matching replies by then
+#endif
+
+#ifndef TINYBFT_ENGINE_RESEND_MS
+#define TINYBFT_ENGINE_RESEND_MS 10  // Send an unanswered ordered request to every replica after this long
+#endif
+
+#define TINYBFT_ENGINE_PENDING TINYBFT_CLIENT_PENDING  // tinybft_engine_poll: no decision yet
+#define TINYBFT_ENGINE_TIMEOUT TINYBFT_CLIENT_TIMEOUT  // Request gave up after TINYBFT_ENGINE_TIMEOUT_MS
+
+typedef struct {
+    uint32_t batch_size;      // Maximum client requests per PRE-PREPARE
+    uint32_t pipeline_depth;  // Agreement instances in flight (1..TINYBFT_WINDOW_SIZE)
+    uint32_t link_delay_us;   // One-way delay added to every link (0 = none)
+    const char* nvm_dir;      // Keep replica r in <nvm_dir>/replica-<r>.nvm and resume from it (NULL = volatile)
+    bool read_only_gets;      // Send GETs to every replica unordered, falling back to ordering
+    bool tentative;           // Execute prepared batches ahead of their commit (tinybft_replica_set_tentative)
+    uint32_t exec_threads;    // Worker threads per replica executing a batch in parallel (0 = serial)
+    uint32_t groups;          // Replica groups keys are sharded over (1..TINYBFT_ENGINE_GROUPS), each on its own CPUs
+    int forger;               // Replica whose authenticators the links garble (-1 = none)
+} tinybft_engine_config_t;
+
+void tinybft_engine_default_config(tinybft_engine_config_t* cfg);
+
+// Execute callback applying a request to the key-value store of the
+// replica_t passed as app; shared by every runtime hosting replicas[]
+uint32_t tinybft_engine_execute(void* app, const tinybft_request_t* req, uint8_t* result, uint32_t result_cap);
+
+// Access callback to go with it: requests name their key by its hash in the
+// store, and a PUT of a key not in the store yet inserts, which may move
+// other entries
+tinybft_access_t tinybft_engine_access(void* app, const tinybft_request_t* req, uint32_t* key);
+
+// Parallel callback running the tasks on the tinybft_pool_t passed as ctx
+void tinybft_engine_parallel(void* ctx, uint32_t count, tinybft_task_fn task, void* arg);
+
+// Install the session keys a replica shares with every other one
+void tinybft_engine_set_keys(tinybft_replica_t* node);
+
+// Start the replica threads; cfg may be NULL for the defaults
+bool tinybft_engine_start(const tinybft_engine_config_t* cfg);
+
+// Stop the threads and seal the replicas' NVM files
+void tinybft_engine_stop(void);
+
+// Clients 0..TINYBFT_MAX_CLIENTS-1 run the client core of client.h, client
+// c with the single session c after tinybft_engine_start. Give a client the
+// sessions first..first+count-1 instead, to keep that many operations in
+// flight; sessions of clients in use must not overlap. Fails while the
+// client has operations outstanding.
+bool tinybft_engine_set_sessions(uint32_t client, uint32_t first, uint32_t count);
+
+// Group serving a key
+uint32_t tinybft_engine_group(const char* key);
+
+// Issue an operation on a free session of the client in the key's group,
+// named by tag; false while all of them are busy
+bool tinybft_engine_issue(uint32_t client, tinybft_op_t op, const char* key, const char* value, uint64_t tag);
+
+// Take the client's next completed operation, decided by f+1 matching
+// replies (2f+1 for a read-only GET, which is resent for ordering if they
+// cannot agree): the result length or TINYBFT_ENGINE_TIMEOUT, with its tag in
+// *tag, or TINYBFT_ENGINE_PENDING if none has completed
+int tinybft_engine_complete(uint32_t client, uint64_t* tag, char* result, uint32_t result_cap);
+
+// One operation at a time: submit fails while one is outstanding (with a
+// single session), and poll returns its outcome or TINYBFT_ENGINE_PENDING
+bool tinybft_engine_submit(uint32_t client, tinybft_op_t op, const char* key, const char* value);
+int tinybft_engine_poll(uint32_t client, char* result, uint32_t result_cap);
+
+// Submit and wait for the outcome
+int tinybft_engine_invoke(uint32_t client, tinybft_op_t op, const char* key, const char* value,
+                          char* result, uint32_t result_cap);
+
+// Read-only GETs accepted on 2f+1 matching replies, and those that were
+// ordered after all
+uint64_t tinybft_engine_fast_reads(void);
+uint64_t tinybft_engine_read_fallbacks(void);
+
+// Messages from replicas that a replica rejected for a wrong authenticator
+uint64_t tinybft_engine_forged(uint32_t replica_id);
+
+// Read-only requests a replica answered without ordering them
+uint64_t tinybft_engine_reads(uint32_t replica_id);
+
+// Agreement instances committed and client requests executed by a replica
+uint64_t tinybft_engine_committed(uint32_t replica_id);
+uint64_t tinybft_engine_executed(uint32_t replica_id);
+
+// Batches a replica executed tentatively, and those it rolled back
+uint64_t tinybft_engine_tentative(uint32_t replica_id);
+uint64_t tinybft_engine_rollbacks(uint32_t replica_id);
+
+// Groups of non-conflicting requests a replica executed in parallel, and
+// the tasks (one per key) in them
+uint64_t tinybft_engine_parallel_runs(uint32_t replica_id);
+uint64_t tinybft_engine_parallel_tasks(uint32_t replica_id);
+
+// Checkpoints taken by a replica and the state blocks they rehashed
+uint64_t tinybft_engine_checkpoints(uint32_t replica_id);
+uint64_t tinybft_engine_checkpoint_blocks(uint32_t replica_id);
+
+// Checkpoints a replica saw 2f+1 replicas agree on, each moving its window
+uint64_t tinybft_engine_stable_checkpoints(uint32_t replica_id);
+
+// State transfers completed by a replica and the blocks they fetched
+uint64_t tinybft_engine_transfers(uint32_t replica_id);
+uint64_t tinybft_engine_transfer_blocks(uint32_t replica_id);
+
+// Most scratch buffers of a size class a replica had in use at once
+uint32_t tinybft_engine_scratch_high_water(uint32_t replica_id, uint32_t size_class);
+
+// Most agreement slots, checkpoint certificates and event buffers a replica had in use at once
+tinybft_memory_usage_t tinybft_engine_memory_high_water(uint32_t replica_id);
+
+// Messages of a type a replica handled, and the bytes of them it copied after
+// receiving them (kept messages are received straight into their final location)
+uint64_t tinybft_engine_received(uint32_t replica_id, tinybft_msg_type_t type);
+uint64_t tinybft_engine_copied_bytes(uint32_t replica_id, tinybft_msg_type_t type);
+
+// Highest sequence number a replica has executed (or installed by transfer)
+uint32_t tinybft_engine_last_executed(uint32_t replica_id);
+
+// A replica's current view, the NEW-VIEWs it installed, the time (ms,
+// CLOCK_MONOTONIC) it first committed in its view and its view-change timeout
+uint32_t tinybft_engine_view(uint32_t replica_id);
+uint64_t tinybft_engine_view_changes(uint32_t replica_id);
+uint64_t tinybft_engine_view_commit_ms(uint32_t replica_id);
+uint32_t tinybft_engine_view_timeout(uint32_t replica_id);
+
+#endif // TINYBFT_ENGINE_H
@@ -0,0 +1,115 @@
+#include "kv_store.h"
+#include <string.h>
+
+#define KV_MASK (TINYBFT_KV_CAPACITY - 1u)
+
+uint32_t tinybft_kv_hash(const char* key) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < TINYBFT_KV_KEY_SIZE - 1 && key[i] != '\0'; i++) {
+        h = (h ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return h != 0 ? h : 1;
+}
+
+// How far the entry in `slot` sits from its home slot
+static uint32_t probe_distance(uint32_t hash, uint32_t slot) {
+    return (slot - (hash & KV_MASK)) & KV_MASK;
+}
+
+static void copy_string(char* dst, const char* src, size_t size) {
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = '\0';
+}
+
+// Slot holding key, or -1. Robin-hood order lets a miss stop as soon as it
+// reaches an entry closer to its home slot than the probe is.
+static int32_t kv_find(const tinybft_kv_t* kv, const char* key, uint32_t hash) {
+    uint32_t slot = hash & KV_MASK;
+
+    for (uint32_t dist = 0; ; dist++, slot = (slot + 1) & KV_MASK) {
+        uint32_t h = kv->state.hashes[slot];
+        if (h == 0 || probe_distance(h, slot) < dist) {
+            return -1;
+        }
+        if (h == hash && strncmp(kv->state.entries[slot].key, key, TINYBFT_KV_KEY_SIZE - 1) == 0) {
+            return (int32_t)slot;
+        }
+    }
+}
+
+static void kv_modify(tinybft_kv_t* kv, const void* addr, uint32_t len) {
+    if (kv->modify != NULL) {
+        kv->modify(kv->modify_ctx, addr, len);
+    }
+}
+
+// Store an entry in a slot
+static void kv_store_slot(tinybft_kv_t* kv, uint32_t slot, uint32_t hash, const kv_pair_t* entry) {
+    kv_modify(kv, &kv->state.hashes[slot], sizeof(kv->state.hashes[slot]));
+    kv_modify(kv, &kv->state.entries[slot], sizeof(kv->state.entries[slot]));
+    kv->state.hashes[slot] = hash;
+    kv->state.entries[slot] = *entry;
+}
+
+void tinybft_kv_init(tinybft_kv_t* kv) {
+    // Clear every byte, unused entries included, so replicas start identical
+    memset(&kv->state, 0, sizeof(kv->state));
+    kv->modify = NULL;
+    kv->modify_ctx = NULL;
+}
+
+void tinybft_kv_set_modify(tinybft_kv_t* kv, tinybft_kv_modify_fn modify, void* ctx) {
+    kv->modify = modify;
+    kv->modify_ctx = ctx;
+}
+
+bool tinybft_kv_put(tinybft_kv_t* kv, const char* key, const char* value) {
+    uint32_t hash = tinybft_kv_hash(key);
+    int32_t found = kv_find(kv, key, hash);
+
+    if (found >= 0) {
+        kv_modify(kv, kv->state.entries[found].value, TINYBFT_KV_VALUE_SIZE);
+        copy_string(kv->state.entries[found].value, value, TINYBFT_KV_VALUE_SIZE);
+        return true;
+    }
+    if (kv->state.count >= TINYBFT_KV_MAX_KEYS) {
+        return false;
+    }
+
+    kv_pair_t entry;
+    copy_string(entry.key, key, TINYBFT_KV_KEY_SIZE);
+    copy_string(entry.value, value, TINYBFT_KV_VALUE_SIZE);
+
+    // Walk the probe sequence, displacing entries that are closer to home
+    uint32_t slot = hash & KV_MASK;
+    for (uint32_t dist = 0; ; dist++, slot = (slot + 1) & KV_MASK) {
+        uint32_t h = kv->state.hashes[slot];
+        if (h == 0) {
+            kv_store_slot(kv, slot, hash, &entry);
+            kv_modify(kv, &kv->state.count, sizeof(kv->state.count));
+            kv->state.count++;
+            return true;
+        }
+
+        uint32_t existing = probe_distance(h, slot);
+        if (existing < dist) {
+            kv_pair_t displaced = kv->state.entries[slot];
+            kv_store_slot(kv, slot, hash, &entry);
+            hash = h;
+            entry = displaced;
+            dist = existing;
+        }
+    }
+}
+
+const char* tinybft_kv_get(const tinybft_kv_t* kv, const char* key) {
+    int32_t slot = kv_find(kv, key, tinybft_kv_hash(key));
+    return slot >= 0 ? kv->state.entries[slot].value : NULL;
+}
+
+const kv_pair_t* tinybft_kv_at(const tinybft_kv_t* kv, uint32_t slot) {
+    if (slot >= TINYBFT_KV_CAPACITY || kv->state.hashes[slot] == 0) {
+        return NULL;
+    }
+    return &kv->state.entries[slot];
+}
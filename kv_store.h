@@ -0,0 +1,70 @@
+#ifndef TINYBFT_KV_STORE_H
+#define TINYBFT_KV_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Fixed-capacity key-value store: an open-addressing hash table with
+// robin-hood linear probing over statically sized arrays. Each slot caches
+// the hash of its key, so probes compare keys only on a hash match.
+
+#ifndef TINYBFT_KV_CAPACITY
+#define TINYBFT_KV_CAPACITY 16  // Table slots, must be a power of two
+#endif
+
+#define TINYBFT_KV_KEY_SIZE 32
+#define TINYBFT_KV_VALUE_SIZE 256
+
+// Inserts fail beyond 7/8 occupancy so probe sequences stay short
+#define TINYBFT_KV_MAX_KEYS (TINYBFT_KV_CAPACITY - TINYBFT_KV_CAPACITY / 8)
+
+_Static_assert(TINYBFT_KV_CAPACITY >= 8 && (TINYBFT_KV_CAPACITY & (TINYBFT_KV_CAPACITY - 1)) == 0,
+               "TINYBFT_KV_CAPACITY must be a power of two of at least 8");
+
+// Key-value pair
+typedef struct {
+    char key[TINYBFT_KV_KEY_SIZE];
+    char value[TINYBFT_KV_VALUE_SIZE];
+} kv_pair_t;
+
+#ifndef TINYBFT_KV_ALIGN
+#define TINYBFT_KV_ALIGN 4096  // Page-aligned so the state can be mapped from an NVM file
+#endif
+
+// Replicated contents of the table. This is the application state covered
+// by checkpoints, so it holds no pointers and every byte is deterministic.
+typedef struct __attribute__((aligned(TINYBFT_KV_ALIGN))) {
+    uint32_t count;
+    uint32_t hashes[TINYBFT_KV_CAPACITY];  // 0 marks an empty slot
+    kv_pair_t entries[TINYBFT_KV_CAPACITY];
+} tinybft_kv_state_t;
+
+// Called with every byte range an update is about to write
+typedef void (*tinybft_kv_modify_fn)(void* ctx, const void* addr, uint32_t len);
+
+typedef struct {
+    tinybft_kv_state_t state;
+    tinybft_kv_modify_fn modify;
+    void* modify_ctx;
+} tinybft_kv_t;
+
+void tinybft_kv_init(tinybft_kv_t* kv);
+
+// Report writes to modify (NULL to stop) before they happen, e.g. so dirty
+// state blocks can be tracked and preserved
+void tinybft_kv_set_modify(tinybft_kv_t* kv, tinybft_kv_modify_fn modify, void* ctx);
+
+// FNV-1a over the stored (possibly truncated) key, never 0 (which marks
+// empty slots); keys that hash differently are different keys
+uint32_t tinybft_kv_hash(const char* key);
+
+// Insert or overwrite; fails only when the table is full
+bool tinybft_kv_put(tinybft_kv_t* kv, const char* key, const char* value);
+
+// Value stored under key, or NULL if absent
+const char* tinybft_kv_get(const tinybft_kv_t* kv, const char* key);
+
+// Entry held by a table slot (0..TINYBFT_KV_CAPACITY-1), or NULL if empty
+const kv_pair_t* tinybft_kv_at(const tinybft_kv_t* kv, uint32_t slot);
+
+#endif // TINYBFT_KV_STORE_H
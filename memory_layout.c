@@ -1,158 +1,541 @@
 #include "memory_layout.h"
+#include <stddef.h>
 #include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
-// Memory regions
-static tinybft_agreement_region_t agreement_region;
-static tinybft_checkpoint_region_t checkpoint_region;
-static tinybft_event_region_t event_region;
-static tinybft_scratch_region_t scratch_region;
+static const uint32_t scratch_sizes[TINYBFT_SCRATCH_CLASSES] = {
+    TINYBFT_SCRATCH_SMALL, TINYBFT_SCRATCH_MEDIUM, TINYBFT_SCRATCH_LARGE
+};
+static const uint32_t scratch_slots[TINYBFT_SCRATCH_CLASSES] = {
+    TINYBFT_SCRATCH_SMALL_SLOTS, TINYBFT_SCRATCH_MEDIUM_SLOTS, TINYBFT_SCRATCH_LARGE_SLOTS
+};
 
-// Flag to indicate if the regions are in non-volatile memory
-static bool using_nvm = false;
+static uint8_t* scratch_base(tinybft_scratch_region_t* scratch, uint32_t size_class) {
+    switch (size_class) {
+        case 0: return &scratch->small[0][0];
+        case 1: return &scratch->medium[0][0];
+        default: return &scratch->large[0][0];
+    }
+}
+
+_Static_assert(TINYBFT_AGREEMENT_BUDGET == 0 || sizeof(tinybft_agreement_region_t) <= TINYBFT_AGREEMENT_BUDGET,
+               "Agreement region exceeds TINYBFT_AGREEMENT_BUDGET");
+_Static_assert(TINYBFT_CHECKPOINT_BUDGET == 0 || sizeof(tinybft_checkpoint_region_t) <= TINYBFT_CHECKPOINT_BUDGET,
+               "Checkpoint region exceeds TINYBFT_CHECKPOINT_BUDGET");
+_Static_assert(TINYBFT_EVENT_BUDGET == 0 || sizeof(tinybft_event_region_t) <= TINYBFT_EVENT_BUDGET,
+               "Event region exceeds TINYBFT_EVENT_BUDGET");
+_Static_assert(TINYBFT_SCRATCH_BUDGET == 0 || sizeof(tinybft_scratch_region_t) <= TINYBFT_SCRATCH_BUDGET,
+               "Scratch region exceeds TINYBFT_SCRATCH_BUDGET");
+_Static_assert(TINYBFT_MEMORY_BUDGET == 0 || sizeof(tinybft_memory_t) <= TINYBFT_MEMORY_BUDGET,
+               "Replica memory exceeds TINYBFT_MEMORY_BUDGET");
+
+#define ITEM(name, depth, type, count, budget) { name, depth, (uint32_t)sizeof(type), count, budget }
+
+static const tinybft_memory_item_t memory_items[] = {
+    ITEM("Agreement region", 0, tinybft_agreement_region_t, 1, TINYBFT_AGREEMENT_BUDGET),
+    ITEM("Agreement slot", 1, tinybft_agreement_slot_t, TINYBFT_WINDOW_SIZE, 0),
+    ITEM("Prepare certificate", 1, tinybft_prepare_certificate_t, TINYBFT_WINDOW_SIZE, 0),
+    ITEM("Commit certificate", 1, tinybft_commit_certificate_t, TINYBFT_WINDOW_SIZE, 0),
+    ITEM("Vote set", 1, tinybft_vote_set_t, 2 * TINYBFT_WINDOW_SIZE + TINYBFT_CHECKPOINT_CERTS, 0),
+    ITEM("Checkpoint region", 0, tinybft_checkpoint_region_t, 1, TINYBFT_CHECKPOINT_BUDGET),
+    ITEM("Checkpoint certificate", 1, tinybft_checkpoint_certificate_t, TINYBFT_CHECKPOINT_CERTS, 0),
+    ITEM("Partition tree node", 1, tinybft_partition_node_t, 2 * TINYBFT_PARTITION_NODES, 0),
+    ITEM("Partition snapshot", 1, tinybft_partition_snapshot_t, 1, 0),
+    ITEM("Event region", 0, tinybft_event_region_t, 1, TINYBFT_EVENT_BUDGET),
+    ITEM("Message buffer", 1, uint8_t[TINYBFT_MAX_MSG_SIZE], TINYBFT_EVENT_ENTRIES, 0),
+    ITEM("Scratch region", 0, tinybft_scratch_region_t, 1, TINYBFT_SCRATCH_BUDGET),
+    ITEM("Small buffer", 1, uint8_t[TINYBFT_SCRATCH_SMALL], TINYBFT_SCRATCH_SMALL_SLOTS, 0),
+    ITEM("Medium buffer", 1, uint8_t[TINYBFT_SCRATCH_MEDIUM], TINYBFT_SCRATCH_MEDIUM_SLOTS, 0),
+    ITEM("Large buffer", 1, uint8_t[TINYBFT_SCRATCH_LARGE], TINYBFT_SCRATCH_LARGE_SLOTS, 0),
+    ITEM("Replica memory", 0, tinybft_memory_t, 1, TINYBFT_MEMORY_BUDGET),
+};
+
+_Static_assert(sizeof(tinybft_event_region_t) == TINYBFT_EVENT_ENTRIES * TINYBFT_MAX_MSG_SIZE,
+               "Event region holds TINYBFT_EVENT_ENTRIES message buffers");
+
+uint32_t tinybft_memory_layout(const tinybft_memory_item_t** items) {
+    *items = memory_items;
+    return (uint32_t)(sizeof(memory_items) / sizeof(memory_items[0]));
+}
+
+// Mark every slot free
+static void scratch_init(tinybft_scratch_region_t* scratch) {
+    for (uint32_t c = 0; c < TINYBFT_SCRATCH_CLASSES; c++) {
+        for (uint32_t i = 0; i < scratch_slots[c]; i++) {
+            scratch->free[c][i / 64] |= 1ull << (i % 64);
+        }
+    }
+}
 
 // Initialize the memory regions
-void tinybft_memory_init(void) {
+void tinybft_memory_init(tinybft_memory_t* mem) {
     // Zero out all memory regions
-    memset(&agreement_region, 0, sizeof(agreement_region));
-    memset(&checkpoint_region, 0, sizeof(checkpoint_region));
-    memset(&event_region, 0, sizeof(event_region));
-    memset(&scratch_region, 0, sizeof(scratch_region));
+    memset(&mem->agreement_region, 0, sizeof(mem->agreement_region));
+    memset(&mem->checkpoint_region, 0, sizeof(mem->checkpoint_region));
+    memset(&mem->event_region, 0, sizeof(mem->event_region));
+    memset(&mem->scratch_region, 0, sizeof(mem->scratch_region));
+    scratch_init(&mem->scratch_region);
+    mem->using_nvm = false;
+    memset(&mem->in_use, 0, sizeof(mem->in_use));
+    memset(&mem->high_water, 0, sizeof(mem->high_water));
+    memset(&mem->nvm, 0, sizeof(mem->nvm));
+    mem->nvm.fd = -1;
+}
+
+// MS_ASYNC leaves write-back to the kernel: a process crash loses nothing,
+// power loss may lose checkpoints since the last write-back
+#ifndef TINYBFT_NVM_MSYNC
+#define TINYBFT_NVM_MSYNC MS_SYNC
+#endif
+
+// The persistent regions form one contiguous, page-aligned span, mapped from
+// the file with a single mmap; the scratch region stays volatile
+#define NVM_REGIONS_SIZE (offsetof(tinybft_memory_t, scratch_region) - offsetof(tinybft_memory_t, agreement_region))
+#define NVM_MAGIC 0x4d564e5446424e54ull  // "TNBFTNVM"
+
+_Static_assert(offsetof(tinybft_memory_t, checkpoint_region) ==
+               offsetof(tinybft_memory_t, agreement_region) + sizeof(tinybft_agreement_region_t) &&
+               offsetof(tinybft_memory_t, event_region) ==
+               offsetof(tinybft_memory_t, checkpoint_region) + sizeof(tinybft_checkpoint_region_t) &&
+               NVM_REGIONS_SIZE == sizeof(tinybft_agreement_region_t) + sizeof(tinybft_checkpoint_region_t) +
+                                   sizeof(tinybft_event_region_t),
+               "Persistent regions must be contiguous");
+
+// First page of the file
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t sealed;  // Closed cleanly; the checksums are valid
+    uint32_t reserved;
+    uint64_t offset[TINYBFT_NVM_RANGES];
+    uint64_t size[TINYBFT_NVM_RANGES];
+    uint64_t checksum[TINYBFT_NVM_RANGES];
+    uint64_t header_checksum;
+} nvm_header_t;
+
+_Static_assert(sizeof(nvm_header_t) <= TINYBFT_PAGE_SIZE, "NVM header must fit in a page");
+
+static uint8_t* nvm_range(tinybft_memory_t* mem, uint32_t range, uint64_t* size) {
+    switch (range) {
+        case 0: *size = sizeof(mem->agreement_region); return (uint8_t*)&mem->agreement_region;
+        case 1: *size = sizeof(mem->checkpoint_region); return (uint8_t*)&mem->checkpoint_region;
+        case 2: *size = sizeof(mem->event_region); return (uint8_t*)&mem->event_region;
+        default: *size = mem->nvm.state_size; return mem->nvm.state;
+    }
+}
+
+// Four independent multiply-rotate lanes over 8-byte words (sizes are page
+// multiples), fast enough to verify the whole file at startup
+static uint64_t nvm_checksum(const uint8_t* data, uint64_t size) {
+    const uint64_t p1 = 0x9e3779b185ebca87ull;
+    const uint64_t p2 = 0xc2b2ae3d27d4eb4full;
+    uint64_t lanes[4] = { p1, p2, p1 ^ p2, p1 + p2 };
+
+    for (uint64_t i = 0; i + 32 <= size; i += 32) {
+        for (uint32_t l = 0; l < 4; l++) {
+            uint64_t w;
+            memcpy(&w, data + i + 8 * l, sizeof(w));
+            lanes[l] += w * p2;
+            lanes[l] = ((lanes[l] << 31) | (lanes[l] >> 33)) * p1;
+        }
+    }
+
+    uint64_t h = size;
+    for (uint32_t l = 0; l < 4; l++) {
+        h = (h ^ lanes[l]) * p1;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+#ifndef _WIN32
+
+static void nvm_layout(tinybft_memory_t* mem, nvm_header_t* hdr) {
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->magic = NVM_MAGIC;
+    hdr->version = TINYBFT_NVM_VERSION;
+    hdr->page_size = TINYBFT_PAGE_SIZE;
+
+    uint64_t offset = TINYBFT_PAGE_SIZE;
+    for (uint32_t i = 0; i < TINYBFT_NVM_RANGES; i++) {
+        nvm_range(mem, i, &hdr->size[i]);
+        hdr->offset[i] = offset;
+        offset += hdr->size[i];
+    }
+}
+
+static bool nvm_write_header(int fd, nvm_header_t* hdr) {
+    hdr->header_checksum = nvm_checksum((const uint8_t*)hdr, offsetof(nvm_header_t, header_checksum));
+    return pwrite(fd, hdr, sizeof(*hdr), 0) == (ssize_t)sizeof(*hdr) && fdatasync(fd) == 0;
+}
+
+// Header from an earlier run, if it describes the layout we expect
+static bool nvm_read_header(int fd, const nvm_header_t* expected, nvm_header_t* hdr) {
+    if (pread(fd, hdr, sizeof(*hdr), 0) != (ssize_t)sizeof(*hdr) ||
+        hdr->header_checksum != nvm_checksum((const uint8_t*)hdr, offsetof(nvm_header_t, header_checksum))) {
+        return false;
+    }
+    return hdr->magic == expected->magic && hdr->version == expected->version &&
+           hdr->page_size == expected->page_size &&
+           memcmp(hdr->offset, expected->offset, sizeof(hdr->offset)) == 0 &&
+           memcmp(hdr->size, expected->size, sizeof(hdr->size)) == 0;
+}
+
+// Replace the memory of [addr, addr + size) with file bytes at offset
+static bool nvm_map(void* addr, uint64_t size, int fd, uint64_t offset, int flags) {
+    return size == 0 ||
+           mmap(addr, size, PROT_READ | PROT_WRITE, flags | MAP_FIXED, fd, (off_t)offset) == addr;
+}
+
+static void nvm_detach(tinybft_memory_t* mem) {
+    tinybft_nvm_t* nvm = &mem->nvm;
+    nvm_header_t hdr;
+
+    nvm_layout(mem, &hdr);
+    if (tinybft_memory_sync_nvm(mem)) {
+        for (uint32_t i = 0; i < TINYBFT_NVM_RANGES; i++) {
+            uint64_t size = 0;
+            hdr.checksum[i] = nvm_checksum(nvm_range(mem, i, &size), size);
+        }
+        hdr.sealed = 1;
+        nvm_write_header(nvm->fd, &hdr);
+    }
+
+    // Keep the contents but stop writing through to the file
+    nvm_map(&mem->agreement_region, NVM_REGIONS_SIZE, nvm->fd, hdr.offset[0], MAP_PRIVATE);
+    nvm_map(nvm->state, nvm->state_size, nvm->fd, hdr.offset[3], MAP_PRIVATE);
+    close(nvm->fd);
+
+    memset(nvm, 0, sizeof(*nvm));
+    nvm->fd = -1;
+    mem->using_nvm = false;
+}
+
+tinybft_nvm_status_t tinybft_memory_set_nvm(tinybft_memory_t* mem, const char* path, void* state, uint32_t state_size) {
+    if (mem->using_nvm) {
+        nvm_detach(mem);
+    }
+    if (path == NULL) {
+        return TINYBFT_NVM_OFF;
+    }
+    if ((uintptr_t)state % TINYBFT_PAGE_SIZE != 0 || state_size % TINYBFT_PAGE_SIZE != 0) {
+        return TINYBFT_NVM_ERROR;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return TINYBFT_NVM_ERROR;
+    }
+
+    tinybft_nvm_t* nvm = &mem->nvm;
+    nvm->state = state;
+    nvm->state_size = state_size;
+
+    nvm_header_t expected;
+    nvm_header_t hdr;
+    tinybft_nvm_status_t status = TINYBFT_NVM_UNSEALED;
+    nvm_layout(mem, &expected);
+
+    if (!nvm_read_header(fd, &expected, &hdr)) {
+        // New file (or another layout): write out what we hold now
+        uint64_t end = expected.offset[TINYBFT_NVM_RANGES - 1] + expected.size[TINYBFT_NVM_RANGES - 1];
+        bool written = ftruncate(fd, (off_t)end) == 0;
+        for (uint32_t i = 0; i < TINYBFT_NVM_RANGES && written; i++) {
+            uint64_t size = 0;
+            const uint8_t* data = nvm_range(mem, i, &size);
+            written = pwrite(fd, data, size, (off_t)expected.offset[i]) == (ssize_t)size;
+        }
+        if (!written) {
+            close(fd);
+            return TINYBFT_NVM_ERROR;
+        }
+        status = TINYBFT_NVM_CREATED;
+    }
+
+    if (!nvm_map(&mem->agreement_region, NVM_REGIONS_SIZE, fd, expected.offset[0], MAP_SHARED) ||
+        !nvm_map(state, state_size, fd, expected.offset[3], MAP_SHARED)) {
+        close(fd);
+        return TINYBFT_NVM_ERROR;
+    }
+
+    if (status != TINYBFT_NVM_CREATED && hdr.sealed) {
+        status = TINYBFT_NVM_SEALED;
+        for (uint32_t i = 0; i < TINYBFT_NVM_RANGES; i++) {
+            uint64_t size = 0;
+            if (nvm_checksum(nvm_range(mem, i, &size), size) != hdr.checksum[i]) {
+                status = TINYBFT_NVM_UNSEALED;
+            }
+        }
+    }
+
+    // Until the next clean close the file holds whatever was synced last
+    nvm_write_header(fd, &expected);
+    nvm->fd = fd;
+    nvm->dirty_lo = state_size;
+    nvm->dirty_hi = 0;
+    mem->using_nvm = true;
+    return status;
+}
+
+bool tinybft_memory_sync_nvm(tinybft_memory_t* mem) {
+    tinybft_nvm_t* nvm = &mem->nvm;
+    if (!mem->using_nvm) {
+        return true;
+    }
+
+    // A resumed replica rebuilds agreement and event state from its peers,
+    // so only the checkpoint region and the state's dirty range are flushed
+    bool ok = msync(&mem->checkpoint_region, sizeof(mem->checkpoint_region), TINYBFT_NVM_MSYNC) == 0;
+    if (nvm->dirty_lo < nvm->dirty_hi) {
+        uint32_t lo = nvm->dirty_lo / TINYBFT_PAGE_SIZE * TINYBFT_PAGE_SIZE;
+        ok = msync(nvm->state + lo, nvm->dirty_hi - lo, TINYBFT_NVM_MSYNC) == 0 && ok;
+    }
+    nvm->dirty_lo = nvm->state_size;
+    nvm->dirty_hi = 0;
+    nvm->syncs++;
+    return ok;
+}
+
+#else
+
+tinybft_nvm_status_t tinybft_memory_set_nvm(tinybft_memory_t* mem, const char* path, void* state, uint32_t state_size) {
+    return path == NULL ? TINYBFT_NVM_OFF : TINYBFT_NVM_ERROR;  // No mmap
+}
+
+bool tinybft_memory_sync_nvm(tinybft_memory_t* mem) {
+    return true;
 }
 
-// Set non-volatile memory usage
-void tinybft_memory_set_nvm(bool use_nvm) {
-    using_nvm = use_nvm;
-    
-    // In a real implementation, if using_nvm is true, we would:
-    // 1. Map agreement_region to non-volatile memory
-    // 2. Map checkpoint_region to non-volatile memory
-    // 3. Map event_region to non-volatile memory
-    // While keeping scratch_region in volatile memory for faster access
+#endif
+
+void tinybft_memory_nvm_modify(tinybft_memory_t* mem, const void* addr, uint32_t len) {
+    tinybft_nvm_t* nvm = &mem->nvm;
+    const uint8_t* p = addr;
+
+    if (!mem->using_nvm || p < nvm->state || p >= nvm->state + nvm->state_size) {
+        return;
+    }
+    uint32_t lo = (uint32_t)(p - nvm->state);
+    uint32_t hi = len < nvm->state_size - lo ? lo + len : nvm->state_size;
+    nvm->dirty_lo = lo < nvm->dirty_lo ? lo : nvm->dirty_lo;
+    nvm->dirty_hi = hi > nvm->dirty_hi ? hi : nvm->dirty_hi;
 }
 
 // Get a pointer to the specified memory region
-void* tinybft_get_region(tinybft_memory_region_t region) {
+void* tinybft_get_region(tinybft_memory_t* mem, tinybft_memory_region_t region) {
     switch (region) {
         case MEMORY_REGION_AGREEMENT:
-            return &agreement_region;
+            return &mem->agreement_region;
         case MEMORY_REGION_CHECKPOINT:
-            return &checkpoint_region;
+            return &mem->checkpoint_region;
         case MEMORY_REGION_EVENT:
-            return &event_region;
+            return &mem->event_region;
         case MEMORY_REGION_SCRATCH:
-            return &scratch_region;
+            return &mem->scratch_region;
         default:
             return NULL;
     }
 }
 
+static void raise_high_water(uint32_t* high_water, uint32_t in_use) {
+    *high_water = in_use > *high_water ? in_use : *high_water;
+}
+
+void tinybft_memory_track(tinybft_memory_t* mem) {
+    tinybft_memory_usage_t* use = &mem->in_use;
+    const uint8_t* events = (const uint8_t*)&mem->event_region;
+
+    use->slots = 0;
+    for (uint32_t i = 0; i < TINYBFT_WINDOW_SIZE; i++) {
+        use->slots += mem->agreement_region.slots[i].seq_num != 0;
+    }
+    use->checkpoint_certs = 0;
+    for (uint32_t i = 0; i < TINYBFT_CHECKPOINT_CERTS; i++) {
+        use->checkpoint_certs += mem->checkpoint_region.certificates[i].seq_num != 0;
+    }
+    // A buffer holds a message while its stored header has a payload
+    use->events = 0;
+    for (uint32_t i = 0; i < TINYBFT_EVENT_ENTRIES; i++) {
+        use->events += ((const tinybft_msg_header_t*)(events + i * TINYBFT_MAX_MSG_SIZE))->data_len > 0;
+    }
+
+    raise_high_water(&mem->high_water.slots, use->slots);
+    raise_high_water(&mem->high_water.checkpoint_certs, use->checkpoint_certs);
+    raise_high_water(&mem->high_water.events, use->events);
+}
+
+uint32_t tinybft_scratch_class_size(uint32_t size_class) {
+    return size_class < TINYBFT_SCRATCH_CLASSES ? scratch_sizes[size_class] : 0;
+}
+
 // Allocate space from the scratch region
-void* tinybft_alloc_from_scratch(uint32_t size) {
-    if (size > TINYBFT_MAX_MSG_SIZE) {
+void* tinybft_alloc_from_scratch(tinybft_memory_t* mem, uint32_t size) {
+    tinybft_scratch_region_t* scratch = &mem->scratch_region;
+
+    if (size > TINYBFT_SCRATCH_LARGE) {
         return NULL;  // Too large
     }
-    
-    // Find an empty buffer
-    for (uint32_t i = 0; i < TINYBFT_MAX_REPLICAS; i++) {
-        if (scratch_region.buffer_used[i] == 0) {
-            scratch_region.buffer_used[i] = size;
-            return scratch_region.buffers[i];
+
+    // Fall back to larger classes when the fitting one is exhausted
+    for (uint32_t c = 0; c < TINYBFT_SCRATCH_CLASSES; c++) {
+        if (size > scratch_sizes[c]) {
+            continue;
+        }
+        for (uint32_t w = 0; w < TINYBFT_SCRATCH_WORDS; w++) {
+            if (scratch->free[c][w] != 0) {
+                uint32_t slot = w * 64 + (uint32_t)__builtin_ctzll(scratch->free[c][w]);
+                scratch->free[c][w] &= scratch->free[c][w] - 1;
+                if (++scratch->in_use[c] > scratch->high_water[c]) {
+                    scratch->high_water[c] = scratch->in_use[c];
+                }
+                return scratch_base(scratch, c) + slot * scratch_sizes[c];
+            }
         }
     }
-    
+
+    scratch->failed++;
     return NULL;  // No free buffers
 }
 
-// Move data from scratch to another region
-void tinybft_move_to_region(tinybft_memory_region_t dst_region, void* scratch_ptr, uint32_t size) {
-    // First, identify which scratch buffer this is
-    uint32_t buffer_idx = 0;
-    bool found = false;
-    
-    for (uint32_t i = 0; i < TINYBFT_MAX_REPLICAS; i++) {
-        if (scratch_region.buffers[i] == scratch_ptr) {
-            buffer_idx = i;
-            found = true;
+// Return a scratch buffer whose contents are no longer needed
+void tinybft_free_scratch(tinybft_memory_t* mem, void* scratch_ptr) {
+    tinybft_scratch_region_t* scratch = &mem->scratch_region;
+
+    // The classes are laid out back to back, smallest first
+    for (uint32_t c = TINYBFT_SCRATCH_CLASSES; c-- > 0;) {
+        uint8_t* base = scratch_base(scratch, c);
+        if ((uint8_t*)scratch_ptr < base) {
+            continue;
+        }
+
+        uintptr_t offset = (uintptr_t)((uint8_t*)scratch_ptr - base);
+        uint32_t slot = (uint32_t)(offset / scratch_sizes[c]);
+        uint64_t bit = 1ull << (slot % 64);
+        if (offset % scratch_sizes[c] == 0 && slot < scratch_slots[c] && (scratch->free[c][slot / 64] & bit) == 0) {
+            scratch->free[c][slot / 64] |= bit;
+            scratch->in_use[c]--;
+        }
+        return;  // Anything else is not a live scratch buffer
+    }
+}
+
+// Route a message by its header to where it is kept
+uint8_t* tinybft_msg_location(tinybft_memory_t* mem, const tinybft_msg_header_t* hdr,
+                              tinybft_memory_region_t* region) {
+    uint32_t client = hdr->sender_id - TINYBFT_MAX_REPLICAS;
+    uint8_t* location = NULL;
+
+    switch (hdr->type) {
+        case MSG_TYPE_PRE_PREPARE: {
+            tinybft_agreement_slot_t* slot = tinybft_find_agreement_slot(mem, hdr->seq_num);
+            if (slot != NULL && hdr->sender_id < TINYBFT_MAX_REPLICAS) {
+                location = slot->prepare_cert.pre_prepare;
+                *region = MEMORY_REGION_AGREEMENT;
+            }
             break;
         }
+        case MSG_TYPE_REQUEST:
+            if (hdr->sender_id >= TINYBFT_MAX_REPLICAS && client < TINYBFT_MAX_CLIENTS) {
+                location = mem->event_region.client_requests[client];
+                *region = MEMORY_REGION_EVENT;
+            }
+            break;
+        case MSG_TYPE_REPLY:
+            client = hdr->receiver_id - TINYBFT_MAX_REPLICAS;
+            if (hdr->receiver_id >= TINYBFT_MAX_REPLICAS && client < TINYBFT_MAX_CLIENTS) {
+                location = mem->event_region.client_replies[client];
+                *region = MEMORY_REGION_EVENT;
+            }
+            break;
+        case MSG_TYPE_VIEW_CHANGE:
+        case MSG_TYPE_NEW_VIEW:
+            if (hdr->sender_id < TINYBFT_MAX_REPLICAS) {
+                location = hdr->type == MSG_TYPE_VIEW_CHANGE ? mem->event_region.view_change_msgs[hdr->sender_id] :
+                           mem->event_region.new_view_msgs[hdr->sender_id];
+                *region = MEMORY_REGION_EVENT;
+            }
+            break;
+        default:
+            break;  // Votes, checkpoints and transfer messages are handled where they arrive
     }
-    
-    if (!found || scratch_region.buffer_used[buffer_idx] == 0) {
-        return;  // Invalid scratch pointer
+
+    return hdr->data_len <= TINYBFT_MAX_MSG_SIZE - sizeof(*hdr) ? location : NULL;
+}
+
+// Check a sequence number against the low and high watermarks
+bool tinybft_in_window(const tinybft_memory_t* mem, uint32_t seq_num) {
+    uint32_t low = mem->agreement_region.low_watermark;
+    return seq_num > low && seq_num - low <= TINYBFT_WINDOW_SIZE;
+}
+
+// Advance the window past a stable checkpoint
+void tinybft_set_low_watermark(tinybft_memory_t* mem, uint32_t low_watermark) {
+    uint32_t old_low = mem->agreement_region.low_watermark;
+    if (low_watermark <= old_low) {
+        return;
     }
-    
-    // Copy to the appropriate region based on the destination and message type
-    // This is a simplified implementation - a real one would determine the 
-    // exact location within the region based on message type and content
-    if (dst_region == MEMORY_REGION_AGREEMENT) {
-        // Handle copying to agreement region - would need to examine message content
-        // to determine the exact location in the agreement slots
-    } else if (dst_region == MEMORY_REGION_CHECKPOINT) {
-        // Handle copying to checkpoint region
-    } else if (dst_region == MEMORY_REGION_EVENT) {
-        // Handle copying to event region
+    mem->agreement_region.low_watermark = low_watermark;
+
+    // Release everything at or below it in one pass; the stable checkpoint's
+    // own certificate stays as its proof
+    for (uint32_t i = 0; i < TINYBFT_WINDOW_SIZE; i++) {
+        tinybft_agreement_slot_t* slot = &mem->agreement_region.slots[i];
+        if (slot->seq_num != 0 && slot->seq_num <= low_watermark) {
+            memset(slot, 0, sizeof(*slot));
+        }
+    }
+    for (uint32_t i = 0; i < TINYBFT_CHECKPOINT_CERTS; i++) {
+        tinybft_checkpoint_certificate_t* cert = &mem->checkpoint_region.certificates[i];
+        if (cert->seq_num != 0 && cert->seq_num < low_watermark) {
+            memset(cert, 0, sizeof(*cert));
+        }
     }
-    
-    // Reset the scratch buffer usage
-    scratch_region.buffer_used[buffer_idx] = 0;
 }
 
 // Find an agreement slot by sequence number
-tinybft_agreement_slot_t* tinybft_find_agreement_slot(uint32_t seq_num) {
-    for (uint32_t i = 0; i < TINYBFT_WINDOW_SIZE; i++) {
-        if (agreement_region.slots[i].seq_num == seq_num) {
-            return &agreement_region.slots[i];
-        }
+tinybft_agreement_slot_t* tinybft_find_agreement_slot(tinybft_memory_t* mem, uint32_t seq_num) {
+    if (!tinybft_in_window(mem, seq_num)) {
+        return NULL;
     }
-    return NULL;
+
+    // Sequence numbers in the window map to distinct slots
+    tinybft_agreement_slot_t* slot = &mem->agreement_region.slots[seq_num % TINYBFT_WINDOW_SIZE];
+    return slot->seq_num == seq_num ? slot : NULL;
 }
 
 // Initialize an agreement slot for a new sequence number
-tinybft_agreement_slot_t* tinybft_init_agreement_slot(uint32_t seq_num) {
-    // Find the oldest slot (to reuse)
-    uint32_t oldest_idx = 0;
-    uint32_t oldest_seq = UINT32_MAX;
-    
-    for (uint32_t i = 0; i < TINYBFT_WINDOW_SIZE; i++) {
-        if (agreement_region.slots[i].seq_num < oldest_seq) {
-            oldest_seq = agreement_region.slots[i].seq_num;
-            oldest_idx = i;
-        }
+tinybft_agreement_slot_t* tinybft_init_agreement_slot(tinybft_memory_t* mem, uint32_t seq_num) {
+    if (!tinybft_in_window(mem, seq_num)) {
+        return NULL;
     }
-    
-    // Reset and initialize the slot
-    tinybft_agreement_slot_t* slot = &agreement_region.slots[oldest_idx];
+
+    // Reset and initialize the slot; its previous owner is below the low watermark
+    tinybft_agreement_slot_t* slot = &mem->agreement_region.slots[seq_num % TINYBFT_WINDOW_SIZE];
     memset(slot, 0, sizeof(tinybft_agreement_slot_t));
     slot->seq_num = seq_num;
-    
+
     return slot;
 }
 
 // Find or initialize checkpoint certificate for sequence number
-tinybft_checkpoint_certificate_t* tinybft_find_checkpoint_cert(uint32_t seq_num) {
-    uint32_t num_certs = TINYBFT_WINDOW_SIZE / TINYBFT_CHECKPOINT_INTERVAL + 1;
-    
-    for (uint32_t i = 0; i < num_certs; i++) {
-        if (checkpoint_region.certificates[i].seq_num == seq_num) {
-            return &checkpoint_region.certificates[i];
-        }
+tinybft_checkpoint_certificate_t* tinybft_find_checkpoint_cert(tinybft_memory_t* mem, uint32_t seq_num) {
+    if (seq_num % TINYBFT_CHECKPOINT_INTERVAL != 0 ||
+        (seq_num != mem->agreement_region.low_watermark && !tinybft_in_window(mem, seq_num))) {
+        return NULL;
     }
-    
-    // If not found, initialize one
-    uint32_t oldest_idx = 0;
-    uint32_t oldest_seq = UINT32_MAX;
-    
-    for (uint32_t i = 0; i < num_certs; i++) {
-        if (checkpoint_region.certificates[i].seq_num < oldest_seq && 
-            !checkpoint_region.certificates[i].valid) {
-            oldest_seq = checkpoint_region.certificates[i].seq_num;
-            oldest_idx = i;
-        }
+
+    // Checkpoints in [low, low + W] map to distinct certificates; the one
+    // there before belongs to a checkpoint below the low watermark
+    tinybft_checkpoint_certificate_t* cert =
+        &mem->checkpoint_region.certificates[(seq_num / TINYBFT_CHECKPOINT_INTERVAL) % TINYBFT_CHECKPOINT_CERTS];
+    if (cert->seq_num != seq_num) {
+        memset(cert, 0, sizeof(*cert));
+        cert->seq_num = seq_num;
     }
-    
-    tinybft_checkpoint_certificate_t* cert = &checkpoint_region.certificates[oldest_idx];
-    memset(cert, 0, sizeof(tinybft_checkpoint_certificate_t));
-    cert->seq_num = seq_num;
-    
     return cert;
 }
\ No newline at end of file
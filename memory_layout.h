@@ -37,6 +37,39 @@
 #define TINYBFT_BLOCK_SIZE 1024   // Size of state blocks (1 KiB)
 #endif
 
+// Checkpoints between the low watermark (the last stable one) and the highest
+// sequence number the window admits
+#define TINYBFT_CHECKPOINT_CERTS (TINYBFT_WINDOW_SIZE / TINYBFT_CHECKPOINT_INTERVAL + 1)
+
+#ifndef TINYBFT_PAGE_SIZE
+#define TINYBFT_PAGE_SIZE 4096  // Persistent regions are page-aligned so they can be mapped from a file
+#endif
+
+#define TINYBFT_PAGE_ALIGNED __attribute__((aligned(TINYBFT_PAGE_SIZE)))
+
+// RAM budgets in bytes: a configuration whose regions outgrow them does not
+// build (0 disables a check). The defaults fit a 400 KB ESP32-C3 with room
+// for the application state.
+#ifndef TINYBFT_AGREEMENT_BUDGET
+#define TINYBFT_AGREEMENT_BUDGET (40 * 1024)
+#endif
+
+#ifndef TINYBFT_CHECKPOINT_BUDGET
+#define TINYBFT_CHECKPOINT_BUDGET (24 * 1024)
+#endif
+
+#ifndef TINYBFT_EVENT_BUDGET
+#define TINYBFT_EVENT_BUDGET (16 * 1024)
+#endif
+
+#ifndef TINYBFT_SCRATCH_BUDGET
+#define TINYBFT_SCRATCH_BUDGET (8 * 1024)
+#endif
+
+#ifndef TINYBFT_MEMORY_BUDGET
+#define TINYBFT_MEMORY_BUDGET (96 * 1024)  // All regions of a replica together
+#endif
+
 // Memory region types
 typedef enum {
     MEMORY_REGION_AGREEMENT = 0,
@@ -60,6 +93,8 @@ typedef enum {
     MSG_TYPE_STATE_TRANSFER_RESP
 } tinybft_msg_type_t;
 
+#define TINYBFT_MSG_TYPES (MSG_TYPE_STATE_TRANSFER_RESP + 1)
+
 // Message structure (header)
 typedef struct {
     tinybft_msg_type_t type;
@@ -71,13 +106,29 @@ typedef struct {
     // Message data follows this header (variable size)
 } tinybft_msg_header_t;
 
+#define TINYBFT_DIGEST_SIZE 32  // SHA-256 sized request digest
+#define TINYBFT_AUTH_SIZE 16    // Per-replica authenticator (truncated MAC)
+
+_Static_assert(TINYBFT_MAX_REPLICAS <= 32, "Sender bitmaps hold at most 32 replicas");
+
+// PREPARE/COMMIT votes only carry view, sequence number and digest, so a
+// certificate records who voted (one bit per replica) and the authenticator
+// each vote came with instead of keeping the messages
+typedef struct {
+    uint32_t senders;  // Bit i is set once replica i voted
+    uint8_t auth[TINYBFT_MAX_REPLICAS][TINYBFT_AUTH_SIZE];
+} tinybft_vote_set_t;
+
 // Certificate structures
 typedef struct {
     uint32_t view;
     uint32_t seq_num;
     bool valid;
-    uint8_t pre_prepare[TINYBFT_MAX_MSG_SIZE];
-    uint8_t prepares[TINYBFT_MAX_REPLICAS][TINYBFT_MAX_MSG_SIZE];
+    bool has_digest;
+    bool fixed;  // Digest decided by a NEW-VIEW; a PRE-PREPARE for another one is refused
+    uint8_t digest[TINYBFT_DIGEST_SIZE];  // Digest every vote of the slot refers to
+    uint8_t pre_prepare[TINYBFT_MAX_MSG_SIZE];  // Only the pre-prepare is kept in full
+    tinybft_vote_set_t prepares;
     uint32_t prepare_count;
 } tinybft_prepare_certificate_t;
 
@@ -85,14 +136,18 @@ typedef struct {
     uint32_t view;
     uint32_t seq_num;
     bool valid;
-    uint8_t commits[TINYBFT_MAX_REPLICAS][TINYBFT_MAX_MSG_SIZE];
+    tinybft_vote_set_t commits;  // Votes for the digest of the slot's prepare certificate
     uint32_t commit_count;
 } tinybft_commit_certificate_t;
 
+// CHECKPOINT messages are votes on the state digest at seq_num. Until the
+// replica takes its own checkpoint the first vote provisionally fixes the digest.
 typedef struct {
     uint32_t seq_num;
-    bool valid;
-    uint8_t checkpoints[TINYBFT_MAX_REPLICAS][TINYBFT_MAX_MSG_SIZE];
+    bool valid;  // Stable: 2f+1 replicas, this one included, reported this digest
+    bool has_digest;
+    uint8_t digest[TINYBFT_DIGEST_SIZE];  // Digest every vote of the certificate refers to
+    tinybft_vote_set_t checkpoints;
     uint32_t checkpoint_count;
 } tinybft_checkpoint_certificate_t;
 
@@ -103,45 +158,206 @@ typedef struct {
     tinybft_commit_certificate_t commit_cert;
 } tinybft_agreement_slot_t;
 
-// Memory layout for each region
-typedef struct {
-    tinybft_agreement_slot_t slots[TINYBFT_WINDOW_SIZE];
+// Memory layout for each region. The agreement, checkpoint and event regions
+// are page-aligned (and so page-sized) to be mappable from an NVM file.
+typedef struct TINYBFT_PAGE_ALIGNED {
+    tinybft_agreement_slot_t slots[TINYBFT_WINDOW_SIZE];  // Slot of seq_num is seq_num % TINYBFT_WINDOW_SIZE
+    uint32_t low_watermark;  // Sequence numbers in (low, low + TINYBFT_WINDOW_SIZE] are accepted
 } tinybft_agreement_region_t;
 
+// Partition tree for state management. The application state is split into
+// TINYBFT_BLOCK_SIZE blocks; the tree is stored as an implicit binary heap,
+// so the children of node i are nodes 2i+1 and 2i+2 and block b is leaf
+// TINYBFT_STATE_BLOCKS - 1 + b.
+#define TINYBFT_STATE_BLOCKS (TINYBFT_MAX_STATE_SIZE / TINYBFT_BLOCK_SIZE)
+#define TINYBFT_PARTITION_NODES (2 * TINYBFT_STATE_BLOCKS - 1)
+
+_Static_assert(TINYBFT_MAX_STATE_SIZE % TINYBFT_BLOCK_SIZE == 0 &&
+               (TINYBFT_STATE_BLOCKS & (TINYBFT_STATE_BLOCKS - 1)) == 0,
+               "TINYBFT_MAX_STATE_SIZE must be a power-of-two number of blocks");
+
 typedef struct {
-    tinybft_checkpoint_certificate_t certificates[TINYBFT_WINDOW_SIZE / TINYBFT_CHECKPOINT_INTERVAL + 1];
-    uint8_t checkpoint_msgs[TINYBFT_MAX_REPLICAS][TINYBFT_MAX_MSG_SIZE];
-} tinybft_checkpoint_region_t;
+    uint32_t block_index;  // First block covered by the node
+    uint32_t block_count;  // Number of blocks covered
+    uint64_t version;      // Checkpoint that last changed a block below the node
+    uint8_t hash[TINYBFT_DIGEST_SIZE];
+} tinybft_partition_node_t;
+
+#ifndef TINYBFT_SNAPSHOT_BLOCKS
+#define TINYBFT_SNAPSHOT_BLOCKS (TINYBFT_STATE_BLOCKS < 256 ? TINYBFT_STATE_BLOCKS : 256)
+#endif
+
+// State as of one checkpoint, served to replicas doing a state transfer.
+// Blocks are copied on their first write after the checkpoint; pinning also
+// keeps the tree nodes of that checkpoint while later checkpoints are taken.
+typedef struct {
+    uint32_t seq_num;
+    bool pinned;
+    bool overflow;  // A block changed without being saved; the snapshot is lost
+    uint32_t block_count;
+    uint32_t block_index[TINYBFT_SNAPSHOT_BLOCKS];
+    uint8_t blocks[TINYBFT_SNAPSHOT_BLOCKS][TINYBFT_BLOCK_SIZE];
+    uint64_t saved[(TINYBFT_STATE_BLOCKS + 63) / 64];  // Blocks with a copy above
+    tinybft_partition_node_t nodes[TINYBFT_PARTITION_NODES];  // Valid while pinned
+} tinybft_partition_snapshot_t;
 
 typedef struct {
+    tinybft_partition_node_t nodes[TINYBFT_PARTITION_NODES];
+    uint64_t dirty[(TINYBFT_PARTITION_NODES + 63) / 64];  // Nodes to rehash at the next checkpoint
+    uint8_t* state;  // Application state covered by the tree
+    uint32_t state_size;
+    uint32_t checkpoint_seq;  // Sequence number of the last checkpoint
+    tinybft_partition_snapshot_t snapshot;
+} tinybft_partition_tree_t;
+
+typedef struct TINYBFT_PAGE_ALIGNED {
+    // Certificate of seq_num at (seq_num / K) % TINYBFT_CHECKPOINT_CERTS
+    tinybft_checkpoint_certificate_t certificates[TINYBFT_CHECKPOINT_CERTS];
+    tinybft_partition_tree_t partition_tree;
+    // Protocol state at the snapshot's checkpoint, to serve or resume from it
+    uint32_t snapshot_view;
+    uint32_t snapshot_timestamp[TINYBFT_MAX_CLIENTS];
+} tinybft_checkpoint_region_t;
+
+typedef struct TINYBFT_PAGE_ALIGNED {
     uint8_t client_requests[TINYBFT_MAX_CLIENTS][TINYBFT_MAX_MSG_SIZE];
     uint8_t client_replies[TINYBFT_MAX_CLIENTS][TINYBFT_MAX_MSG_SIZE];
     uint8_t view_change_msgs[TINYBFT_MAX_REPLICAS][TINYBFT_MAX_MSG_SIZE];
     uint8_t new_view_msgs[TINYBFT_MAX_REPLICAS][TINYBFT_MAX_MSG_SIZE];
 } tinybft_event_region_t;
 
+// Scratch region: a slab of TINYBFT_SCRATCH_SIZE bytes split into size
+// classes. Half the bytes hold whole messages, a quarter each hold 64- and
+// 256-byte buffers, so short messages do not tie up a full buffer.
+#ifndef TINYBFT_SCRATCH_SIZE
+#define TINYBFT_SCRATCH_SIZE (TINYBFT_MAX_REPLICAS * TINYBFT_MAX_MSG_SIZE)
+#endif
+
+#define TINYBFT_SCRATCH_CLASSES 3
+#define TINYBFT_SCRATCH_SMALL 64
+#define TINYBFT_SCRATCH_MEDIUM 256
+#define TINYBFT_SCRATCH_LARGE TINYBFT_MAX_MSG_SIZE
+
+#define TINYBFT_SCRATCH_SMALL_SLOTS (TINYBFT_SCRATCH_SIZE / 4 / TINYBFT_SCRATCH_SMALL)
+#define TINYBFT_SCRATCH_MEDIUM_SLOTS (TINYBFT_SCRATCH_SIZE / 4 / TINYBFT_SCRATCH_MEDIUM)
+#define TINYBFT_SCRATCH_LARGE_SLOTS (TINYBFT_SCRATCH_SIZE / 2 / TINYBFT_SCRATCH_LARGE)
+#define TINYBFT_SCRATCH_WORDS ((TINYBFT_SCRATCH_SMALL_SLOTS + 63) / 64)  // The small class has the most slots
+
+_Static_assert(TINYBFT_SCRATCH_LARGE >= TINYBFT_SCRATCH_MEDIUM, "Messages must fit the largest scratch class");
+_Static_assert(TINYBFT_SCRATCH_LARGE_SLOTS > 0, "Scratch region too small for a whole message");
+
 typedef struct {
-    uint8_t buffers[TINYBFT_MAX_REPLICAS][TINYBFT_MAX_MSG_SIZE];
-    uint32_t buffer_used[TINYBFT_MAX_REPLICAS];
+    uint8_t small[TINYBFT_SCRATCH_SMALL_SLOTS][TINYBFT_SCRATCH_SMALL];
+    uint8_t medium[TINYBFT_SCRATCH_MEDIUM_SLOTS][TINYBFT_SCRATCH_MEDIUM];
+    uint8_t large[TINYBFT_SCRATCH_LARGE_SLOTS][TINYBFT_SCRATCH_LARGE];
+    uint64_t free[TINYBFT_SCRATCH_CLASSES][TINYBFT_SCRATCH_WORDS];  // Set bits mark free slots
+    uint32_t in_use[TINYBFT_SCRATCH_CLASSES];
+    uint32_t high_water[TINYBFT_SCRATCH_CLASSES];  // Most slots of a class ever in use at once
+    uint32_t failed;  // Allocations no class could satisfy
 } tinybft_scratch_region_t;
 
-// Partition tree for state management
-typedef struct partition_node {
-    uint32_t block_index;
-    uint32_t block_count;
-    uint64_t version;
-    uint8_t hash[32];  // SHA-256 hash
-    struct partition_node* children;
-} tinybft_partition_node_t;
+// NVM file: a header page, then the agreement, checkpoint and event regions
+// and the application state, each mapped over its memory in place
+#define TINYBFT_NVM_RANGES 4  // Per-range checksums: the three regions, then the state
+#define TINYBFT_NVM_VERSION 1
+
+typedef enum {
+    TINYBFT_NVM_OFF = 0,    // Regions are volatile
+    TINYBFT_NVM_CREATED,    // New file, initialized from the current contents
+    TINYBFT_NVM_SEALED,     // Mapped a cleanly closed file whose checksums match
+    TINYBFT_NVM_UNSEALED,   // Mapped a file that was not closed cleanly (or failed its checksums)
+    TINYBFT_NVM_ERROR       // File could not be mapped; regions stay volatile
+} tinybft_nvm_status_t;
+
+typedef struct {
+    int fd;
+    uint8_t* state;       // Application state mapped after the regions
+    uint32_t state_size;
+    uint32_t dirty_lo;    // State bytes [dirty_lo, dirty_hi) written since the last sync
+    uint32_t dirty_hi;
+    uint64_t syncs;
+} tinybft_nvm_t;
+
+// Entries of the regions holding something (scratch buffers are counted by
+// the scratch region itself)
+typedef struct {
+    uint32_t slots;             // Agreement slots of instances in the window
+    uint32_t checkpoint_certs;  // Checkpoint certificates in use
+    uint32_t events;            // Event-region buffers holding a message
+} tinybft_memory_usage_t;
+
+// Complete set of memory regions owned by one replica
+typedef struct {
+    tinybft_agreement_region_t agreement_region;
+    tinybft_checkpoint_region_t checkpoint_region;
+    tinybft_event_region_t event_region;
+    tinybft_scratch_region_t scratch_region;
+    bool using_nvm;  // Flag to indicate if the regions are in non-volatile memory
+    tinybft_nvm_t nvm;
+    tinybft_memory_usage_t in_use;      // As of the last tinybft_memory_track
+    tinybft_memory_usage_t high_water;  // Most entries ever in use at once
+} tinybft_memory_t;
+
+// Size of a region or of a structure in one, fixed at compile time
+typedef struct {
+    const char* name;
+    uint32_t depth;   // 0 for a region, 1 for a structure it holds
+    uint32_t size;    // sizeof one instance
+    uint32_t count;   // Instances per replica
+    uint32_t budget;  // Region budget (0 = none)
+} tinybft_memory_item_t;
+
+#define TINYBFT_EVENT_ENTRIES (2 * TINYBFT_MAX_CLIENTS + 2 * TINYBFT_MAX_REPLICAS)
 
 // Memory layout initialization and management functions
-void tinybft_memory_init(void);
-void tinybft_memory_set_nvm(bool use_nvm);
-void* tinybft_get_region(tinybft_memory_region_t region);
-void* tinybft_alloc_from_scratch(uint32_t size);
-void tinybft_move_to_region(tinybft_memory_region_t dst_region, void* scratch_ptr, uint32_t size);
-tinybft_agreement_slot_t* tinybft_find_agreement_slot(uint32_t seq_num);
-tinybft_agreement_slot_t* tinybft_init_agreement_slot(uint32_t seq_num);
-tinybft_checkpoint_certificate_t* tinybft_find_checkpoint_cert(uint32_t seq_num);
+void tinybft_memory_init(tinybft_memory_t* mem);
+
+// Map the agreement, checkpoint and event regions and the application state
+// (page-aligned, a multiple of TINYBFT_PAGE_SIZE) from the file at path,
+// creating it from the current contents if it does not hold this layout.
+// A NULL path seals the file (checksums, clean flag) and detaches from it;
+// the contents stay in memory.
+tinybft_nvm_status_t tinybft_memory_set_nvm(tinybft_memory_t* mem, const char* path, void* state, uint32_t state_size);
+
+// Record application state writes; at a checkpoint, flush them and the
+// checkpoint region with msync
+void tinybft_memory_nvm_modify(tinybft_memory_t* mem, const void* addr, uint32_t len);
+bool tinybft_memory_sync_nvm(tinybft_memory_t* mem);
+
+void* tinybft_get_region(tinybft_memory_t* mem, tinybft_memory_region_t region);
+
+// The regions, each followed by the structures it holds, and their sizes for
+// the TINYBFT_* configuration this was built with
+uint32_t tinybft_memory_layout(const tinybft_memory_item_t** items);
+
+// Recount the entries in use and raise the high-water marks; call after
+// anything that may have filled a slot, certificate or event buffer
+void tinybft_memory_track(tinybft_memory_t* mem);
+
+// Scratch buffers come from the smallest class that fits and has a free
+// slot, found with a ctz over the class's free bitmap
+void* tinybft_alloc_from_scratch(tinybft_memory_t* mem, uint32_t size);
+void tinybft_free_scratch(tinybft_memory_t* mem, void* scratch_ptr);
+uint32_t tinybft_scratch_class_size(uint32_t size_class);
+
+// Final location of a message that is kept after it is handled, decided from
+// its header alone: the agreement slot of its sequence number (which must
+// exist), its client's request or reply buffer, or its sender's view-change
+// or new-view buffer. Receiving straight into it means the message is never
+// copied again. NULL for messages handled where they arrive.
+uint8_t* tinybft_msg_location(tinybft_memory_t* mem, const tinybft_msg_header_t* hdr,
+                              tinybft_memory_region_t* region);
+
+tinybft_agreement_slot_t* tinybft_find_agreement_slot(tinybft_memory_t* mem, uint32_t seq_num);
+tinybft_agreement_slot_t* tinybft_init_agreement_slot(tinybft_memory_t* mem, uint32_t seq_num);
+bool tinybft_in_window(const tinybft_memory_t* mem, uint32_t seq_num);
+
+// Advance the low watermark to a stable checkpoint, releasing the agreement
+// slots and checkpoint certificates below it
+void tinybft_set_low_watermark(tinybft_memory_t* mem, uint32_t low_watermark);
+
+// Certificate of a checkpoint in the window, initialized on first use; NULL
+// outside the window or for a sequence number that is not a checkpoint
+tinybft_checkpoint_certificate_t* tinybft_find_checkpoint_cert(tinybft_memory_t* mem, uint32_t seq_num);
 
 #endif // TINYBFT_MEMORY_LAYOUT_H
\ No newline at end of file
@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include "memory_layout.h"
+#include "kv_store.h"
+#include "bench_util.h"
+
+// Microbenchmarks of the memory-layout primitives and the key-value store
+// for the TINYBFT_* configuration this was built with. Prints one JSON
+// object per primitive and line: ns/op, and cycles/op and cache misses from
+// perf_event_open (null where the counters are not available).
+
+#define DEFAULT_OPS 1000000
+#define KV_KEYS (TINYBFT_KV_MAX_KEYS / 2)  // Keys present in the lookup and update runs
+
+enum {
+    COUNTER_CYCLES = 0,
+    COUNTER_CACHE_MISSES,
+    COUNTERS
+};
+
+// Time and hardware counters of the current benchmark; they only run
+// between meter_resume() and meter_pause()
+typedef struct {
+    int fds[COUNTERS];
+    uint64_t ns;
+    uint64_t started_ns;
+} micro_meter_t;
+
+typedef struct {
+    const char* name;
+    void (*setup)(void);
+    uintptr_t (*run)(uint64_t ops);
+} micro_bench_t;
+
+static micro_meter_t meter = { { -1, -1 }, 0, 0 };
+static tinybft_memory_t mem;
+static tinybft_kv_t kv;
+static char keys[TINYBFT_KV_MAX_KEYS][TINYBFT_KV_KEY_SIZE];
+static char absent[KV_KEYS][TINYBFT_KV_KEY_SIZE];
+static volatile uintptr_t sink;  // Keeps results alive
+
+#ifdef __linux__
+static int counter_open(uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+static void meter_open(void) {
+#ifdef __linux__
+    meter.fds[COUNTER_CYCLES] = counter_open(PERF_COUNT_HW_CPU_CYCLES);
+    meter.fds[COUNTER_CACHE_MISSES] = counter_open(PERF_COUNT_HW_CACHE_MISSES);
+#endif
+}
+
+static void meter_reset(void) {
+    meter.ns = 0;
+#ifdef __linux__
+    for (uint32_t c = 0; c < COUNTERS; c++) {
+        if (meter.fds[c] >= 0) {
+            ioctl(meter.fds[c], PERF_EVENT_IOC_RESET, 0);
+        }
+    }
+#endif
+}
+
+static void meter_resume(void) {
+#ifdef __linux__
+    for (uint32_t c = 0; c < COUNTERS; c++) {
+        if (meter.fds[c] >= 0) {
+            ioctl(meter.fds[c], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+    meter.started_ns = bench_now_ns();
+}
+
+static void meter_pause(void) {
+    meter.ns += bench_now_ns() - meter.started_ns;
+#ifdef __linux__
+    for (uint32_t c = 0; c < COUNTERS; c++) {
+        if (meter.fds[c] >= 0) {
+            ioctl(meter.fds[c], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+}
+
+// Count of a counter since meter_reset(); false if it is not available
+static bool meter_read(uint32_t counter, uint64_t* value) {
+    return meter.fds[counter] >= 0 && read(meter.fds[counter], value, sizeof(*value)) == (ssize_t)sizeof(*value);
+}
+
+// Sequence numbers first..first+count-1 in turn
+static uint32_t next_seq(uint32_t seq, uint32_t first, uint32_t count) {
+    return seq + 1 < first + count ? seq + 1 : first;
+}
+
+// A window that has moved past its start, every slot in use
+static void setup_window(void) {
+    tinybft_memory_init(&mem);
+    tinybft_set_low_watermark(&mem, 10 * TINYBFT_WINDOW_SIZE * TINYBFT_CHECKPOINT_INTERVAL);
+    for (uint32_t i = 1; i <= TINYBFT_WINDOW_SIZE; i++) {
+        tinybft_init_agreement_slot(&mem, mem.agreement_region.low_watermark + i);
+    }
+    for (uint32_t i = TINYBFT_CHECKPOINT_INTERVAL; i <= TINYBFT_WINDOW_SIZE; i += TINYBFT_CHECKPOINT_INTERVAL) {
+        tinybft_find_checkpoint_cert(&mem, mem.agreement_region.low_watermark + i);
+    }
+}
+
+static uintptr_t run_find_slot(uint64_t ops) {
+    uint32_t first = mem.agreement_region.low_watermark + 1;
+    uint32_t seq = first;
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        acc += (uintptr_t)tinybft_find_agreement_slot(&mem, seq);
+        seq = next_seq(seq, first, TINYBFT_WINDOW_SIZE);
+    }
+    return acc;
+}
+
+static uintptr_t run_init_slot(uint64_t ops) {
+    uint32_t first = mem.agreement_region.low_watermark + 1;
+    uint32_t seq = first;
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        acc += (uintptr_t)tinybft_init_agreement_slot(&mem, seq);
+        seq = next_seq(seq, first, TINYBFT_WINDOW_SIZE);
+    }
+    return acc;
+}
+
+// Certificates of the checkpoints in the window, all in use
+static uintptr_t run_find_cert(uint64_t ops) {
+    uint32_t first = mem.agreement_region.low_watermark / TINYBFT_CHECKPOINT_INTERVAL + 1;
+    uint32_t checkpoint = first;
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        acc += (uintptr_t)tinybft_find_checkpoint_cert(&mem, checkpoint * TINYBFT_CHECKPOINT_INTERVAL);
+        checkpoint = next_seq(checkpoint, first, TINYBFT_WINDOW_SIZE / TINYBFT_CHECKPOINT_INTERVAL);
+    }
+    return acc;
+}
+
+static void setup_scratch(void) {
+    tinybft_memory_init(&mem);
+}
+
+// Hold every small buffer but the last, so allocations scan the whole bitmap
+static void setup_scratch_full(void) {
+    tinybft_memory_init(&mem);
+    for (uint32_t i = 0; i + 1 < TINYBFT_SCRATCH_SMALL_SLOTS; i++) {
+        tinybft_alloc_from_scratch(&mem, TINYBFT_SCRATCH_SMALL);
+    }
+}
+
+// A short vote, a request and a whole message in turn, each freed at once
+static uintptr_t run_scratch(uint64_t ops) {
+    static const uint32_t sizes[3] = { 48, 200, TINYBFT_MAX_MSG_SIZE };
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        void* buffer = tinybft_alloc_from_scratch(&mem, sizes[i % 3]);
+        acc += (uintptr_t)buffer;
+        tinybft_free_scratch(&mem, buffer);
+    }
+    return acc;
+}
+
+static uintptr_t run_scratch_small(uint64_t ops) {
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        void* buffer = tinybft_alloc_from_scratch(&mem, TINYBFT_SCRATCH_SMALL);
+        acc += (uintptr_t)buffer;
+        tinybft_free_scratch(&mem, buffer);
+    }
+    return acc;
+}
+
+// Headers of the kept message types: PRE-PREPAREs for the window, client
+// requests and replies, VIEW-CHANGEs
+static void msg_header(uint64_t i, tinybft_msg_header_t* hdr, uint32_t data_len) {
+    uint32_t n = (uint32_t)(i / 4);
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->data_len = data_len;
+    switch (i % 4) {
+        case 0:
+            hdr->type = MSG_TYPE_PRE_PREPARE;
+            hdr->sender_id = 0;
+            hdr->seq_num = mem.agreement_region.low_watermark + 1 + n % TINYBFT_WINDOW_SIZE;
+            break;
+        case 1:
+            hdr->type = MSG_TYPE_REQUEST;
+            hdr->sender_id = TINYBFT_MAX_REPLICAS + n % TINYBFT_MAX_CLIENTS;
+            break;
+        case 2:
+            hdr->type = MSG_TYPE_REPLY;
+            hdr->receiver_id = TINYBFT_MAX_REPLICAS + n % TINYBFT_MAX_CLIENTS;
+            break;
+        default:
+            hdr->type = MSG_TYPE_VIEW_CHANGE;
+            hdr->sender_id = n % TINYBFT_MAX_REPLICAS;
+            break;
+    }
+}
+
+static uintptr_t run_msg_location(uint64_t ops) {
+    tinybft_msg_header_t hdr;
+    tinybft_memory_region_t region;
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        msg_header(i, &hdr, 0);
+        acc += (uintptr_t)tinybft_msg_location(&mem, &hdr, &region);
+    }
+    return acc;
+}
+
+// What receiving a whole message into its final location costs
+static uintptr_t run_msg_store(uint64_t ops) {
+    static uint8_t message[TINYBFT_MAX_MSG_SIZE];
+    tinybft_msg_header_t* hdr = (tinybft_msg_header_t*)message;
+    tinybft_memory_region_t region;
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        msg_header(i, hdr, TINYBFT_MAX_MSG_SIZE - sizeof(*hdr));
+        uint8_t* location = tinybft_msg_location(&mem, hdr, &region);
+        memcpy(location, message, TINYBFT_MAX_MSG_SIZE);
+        acc += (uintptr_t)location;
+    }
+    return acc;
+}
+
+static void setup_kv(void) {
+    tinybft_kv_init(&kv);
+    for (uint32_t i = 0; i < KV_KEYS; i++) {
+        tinybft_kv_put(&kv, keys[i], "value");
+    }
+}
+
+// Keys visited with a stride, so consecutive lookups hit unrelated slots
+static uintptr_t run_kv_get(uint64_t ops) {
+    uint32_t k = 0;
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        acc += (uintptr_t)tinybft_kv_get(&kv, keys[k]);
+        k = (k + 7919) % KV_KEYS;
+    }
+    return acc;
+}
+
+static uintptr_t run_kv_get_miss(uint64_t ops) {
+    uint32_t k = 0;
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        acc += (uintptr_t)tinybft_kv_get(&kv, absent[k]);
+        k = (k + 7919) % KV_KEYS;
+    }
+    return acc;
+}
+
+static uintptr_t run_kv_update(uint64_t ops) {
+    uint32_t k = 0;
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        acc += tinybft_kv_put(&kv, keys[k], "updated");
+        k = (k + 7919) % KV_KEYS;
+    }
+    return acc;
+}
+
+static void setup_kv_empty(void) {
+    tinybft_kv_init(&kv);
+}
+
+// Fill the empty store to TINYBFT_KV_MAX_KEYS, again and again; emptying it
+// is not measured
+static uintptr_t run_kv_insert(uint64_t ops) {
+    uint32_t k = 0;
+    uintptr_t acc = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        if (k == TINYBFT_KV_MAX_KEYS) {
+            meter_pause();
+            tinybft_kv_init(&kv);
+            k = 0;
+            meter_resume();
+        }
+        acc += tinybft_kv_put(&kv, keys[k++], "value");
+    }
+    return acc;
+}
+
+static const micro_bench_t benches[] = {
+    { "find_agreement_slot", setup_window, run_find_slot },
+    { "init_agreement_slot", setup_window, run_init_slot },
+    { "find_checkpoint_cert", setup_window, run_find_cert },
+    { "alloc_free_scratch", setup_scratch, run_scratch },
+    { "alloc_free_scratch_full", setup_scratch_full, run_scratch_small },
+    { "msg_location", setup_window, run_msg_location },
+    { "msg_location_store", setup_window, run_msg_store },
+    { "kv_get", setup_kv, run_kv_get },
+    { "kv_get_miss", setup_kv, run_kv_get_miss },
+    { "kv_put_update", setup_kv, run_kv_update },
+    { "kv_put_insert", setup_kv_empty, run_kv_insert }
+};
+
+// A counter's value, or null if it is not available
+static void print_counter(const char* name, bool available, const char* format, double value) {
+    printf(",\"%s\":", name);
+    if (available) {
+        printf(format, value);
+    } else {
+        printf("null");
+    }
+}
+
+static void run_bench(const micro_bench_t* bench, uint64_t ops) {
+    uint64_t cycles = 0;
+    uint64_t misses = 0;
+
+    bench->setup();
+    sink = bench->run(ops / 10 + 1);  // Warm the caches and branch predictors
+    bench->setup();
+    meter_reset();
+    meter_resume();
+    sink = bench->run(ops);
+    meter_pause();
+
+    printf("{\"window_size\":%d,\"max_replicas\":%d,\"max_msg_size\":%d,\"kv_capacity\":%d,"
+           "\"primitive\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.2f",
+           TINYBFT_WINDOW_SIZE, TINYBFT_MAX_REPLICAS, TINYBFT_MAX_MSG_SIZE, TINYBFT_KV_CAPACITY,
+           bench->name, (unsigned long long)ops, (double)meter.ns / ops);
+    print_counter("cycles_per_op", meter_read(COUNTER_CYCLES, &cycles), "%.2f", (double)cycles / ops);
+    print_counter("cache_misses", meter_read(COUNTER_CACHE_MISSES, &misses), "%.0f", (double)misses);
+    printf("}\n");
+}
+
+int main(int argc, char** argv) {
+    uint64_t ops = DEFAULT_OPS;
+    const char* only = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            ops = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--ops N] [--only PRIMITIVE]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (ops == 0) {
+        fprintf(stderr, "Invalid configuration\n");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < TINYBFT_KV_MAX_KEYS; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "key-%u", i);
+    }
+    for (uint32_t i = 0; i < KV_KEYS; i++) {
+        snprintf(absent[i], sizeof(absent[i]), "absent-%u", i);
+    }
+
+    meter_open();
+    for (uint32_t b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+        if (only == NULL || strcmp(only, benches[b].name) == 0) {
+            run_bench(&benches[b], ops);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,204 @@
+#include "partition_tree.h"
+#include "sha256.h"
+#include <string.h>
+
+#define FIRST_LEAF (TINYBFT_STATE_BLOCKS - 1u)
+#define DIRTY_WORDS ((TINYBFT_PARTITION_NODES + 63) / 64)
+
+static void mark_dirty(tinybft_partition_tree_t* tree, uint32_t node) {
+    tree->dirty[node / 64] |= 1ull << (node % 64);
+}
+
+static bool block_saved(const tinybft_partition_snapshot_t* snap, uint32_t block) {
+    return (snap->saved[block / 64] & (1ull << (block % 64))) != 0;
+}
+
+// Keep the checkpointed contents of a block that is about to change
+static void save_block(tinybft_partition_tree_t* tree, uint32_t block) {
+    tinybft_partition_snapshot_t* snap = &tree->snapshot;
+
+    if (block_saved(snap, block)) {
+        return;
+    }
+    if (snap->block_count == TINYBFT_SNAPSHOT_BLOCKS) {
+        snap->overflow = true;
+        return;
+    }
+
+    memcpy(snap->blocks[snap->block_count], tree->state + block * TINYBFT_BLOCK_SIZE,
+           tinybft_partition_block_len(tree, block));
+    snap->block_index[snap->block_count++] = block;
+    snap->saved[block / 64] |= 1ull << (block % 64);
+}
+
+// Start preserving the state of checkpoint seq_num
+static void reset_snapshot(tinybft_partition_tree_t* tree, uint32_t seq_num) {
+    tinybft_partition_snapshot_t* snap = &tree->snapshot;
+
+    for (uint32_t i = 0; i < snap->block_count; i++) {
+        snap->saved[snap->block_index[i] / 64] &= ~(1ull << (snap->block_index[i] % 64));
+    }
+    snap->block_count = 0;
+    snap->overflow = false;
+    snap->pinned = false;
+    snap->seq_num = seq_num;
+}
+
+uint32_t tinybft_partition_block_len(const tinybft_partition_tree_t* tree, uint32_t block) {
+    uint32_t offset = block * TINYBFT_BLOCK_SIZE;
+    if (offset >= tree->state_size) {
+        return 0;  // Blocks past the end of the state are empty
+    }
+    return tree->state_size - offset < TINYBFT_BLOCK_SIZE ? tree->state_size - offset : TINYBFT_BLOCK_SIZE;
+}
+
+// Nodes of one tree level waiting to be hashed together. Nodes of a level
+// do not depend on each other, so up to TINYBFT_SHA256_LANES equal-length
+// inputs go to the multi-buffer hash at once.
+typedef struct {
+    const uint8_t* data[TINYBFT_SHA256_LANES];
+    uint8_t* digests[TINYBFT_SHA256_LANES];
+    uint8_t children[TINYBFT_SHA256_LANES][2 * TINYBFT_DIGEST_SIZE];
+    uint32_t len;
+    uint32_t count;
+} hash_batch_t;
+
+_Static_assert(TINYBFT_DIGEST_SIZE == TINYBFT_SHA256_SIZE, "Partition tree hashes are SHA-256");
+
+static void flush_batch(hash_batch_t* batch) {
+    if (batch->count > 0) {
+        tinybft_sha256_multi(batch->data, batch->len, batch->digests, batch->count);
+        batch->count = 0;
+    }
+}
+
+// Leaves hash their block, inner nodes the concatenated hashes of their children
+static void queue_node(tinybft_partition_tree_t* tree, hash_batch_t* batch, uint32_t index) {
+    tinybft_partition_node_t* node = &tree->nodes[index];
+    uint32_t len = index >= FIRST_LEAF ? tinybft_partition_block_len(tree, node->block_index) : 2 * TINYBFT_DIGEST_SIZE;
+
+    if (batch->count == TINYBFT_SHA256_LANES || (batch->count > 0 && batch->len != len)) {
+        flush_batch(batch);
+    }
+
+    uint32_t lane = batch->count++;
+    if (index >= FIRST_LEAF) {
+        batch->data[lane] = tree->state + (len > 0 ? node->block_index * TINYBFT_BLOCK_SIZE : 0);
+    } else {
+        memcpy(batch->children[lane], tree->nodes[2 * index + 1].hash, TINYBFT_DIGEST_SIZE);
+        memcpy(batch->children[lane] + TINYBFT_DIGEST_SIZE, tree->nodes[2 * index + 2].hash, TINYBFT_DIGEST_SIZE);
+        batch->data[lane] = batch->children[lane];
+    }
+    batch->digests[lane] = node->hash;
+    batch->len = len;
+}
+
+void tinybft_partition_init(tinybft_partition_tree_t* tree, void* state, uint32_t size) {
+    memset(tree, 0, sizeof(*tree));
+    tree->state = state;
+    tree->state_size = size < TINYBFT_MAX_STATE_SIZE ? size : TINYBFT_MAX_STATE_SIZE;
+
+    for (uint32_t b = 0; b < TINYBFT_STATE_BLOCKS; b++) {
+        tree->nodes[FIRST_LEAF + b].block_index = b;
+        tree->nodes[FIRST_LEAF + b].block_count = 1;
+        mark_dirty(tree, FIRST_LEAF + b);
+    }
+    for (uint32_t i = FIRST_LEAF; i-- > 0;) {
+        tree->nodes[i].block_index = tree->nodes[2 * i + 1].block_index;
+        tree->nodes[i].block_count = 2 * tree->nodes[2 * i + 1].block_count;
+    }
+
+    tinybft_partition_checkpoint(tree, 0);
+}
+
+void tinybft_partition_modify(tinybft_partition_tree_t* tree, uint32_t offset, uint32_t len) {
+    if (len == 0 || offset >= tree->state_size) {
+        return;
+    }
+    if (len > tree->state_size - offset) {
+        len = tree->state_size - offset;
+    }
+
+    uint32_t last = (offset + len - 1) / TINYBFT_BLOCK_SIZE;
+    for (uint32_t b = offset / TINYBFT_BLOCK_SIZE; b <= last; b++) {
+        save_block(tree, b);
+        mark_dirty(tree, FIRST_LEAF + b);
+    }
+}
+
+uint32_t tinybft_partition_checkpoint(tinybft_partition_tree_t* tree, uint32_t seq_num) {
+    hash_batch_t batch;
+    uint32_t level_first = UINT32_MAX;
+    uint32_t rehashed = 0;
+
+    batch.count = 0;
+
+    // Parents have lower indices than their children, so a descending scan
+    // of the dirty bits reaches each level only after the level below it
+    for (uint32_t w = DIRTY_WORDS; w-- > 0;) {
+        while (tree->dirty[w] != 0) {
+            uint32_t bit = 63 - (uint32_t)__builtin_clzll(tree->dirty[w]);
+            uint32_t index = w * 64 + bit;
+            tree->dirty[w] &= ~(1ull << bit);
+
+            if (index < level_first) {
+                // Entering a new level: the one below must be hashed first
+                flush_batch(&batch);
+                level_first = (1u << (31 - __builtin_clz(index + 1))) - 1;
+            }
+
+            queue_node(tree, &batch, index);
+            tree->nodes[index].version = seq_num;
+            if (index >= FIRST_LEAF) {
+                rehashed++;
+            }
+            if (index > 0) {
+                mark_dirty(tree, (index - 1) / 2);
+            }
+        }
+    }
+    flush_batch(&batch);
+
+    // A pinned snapshot stays with its checkpoint unless it lost a block
+    if (!tree->snapshot.pinned || tree->snapshot.overflow) {
+        reset_snapshot(tree, seq_num);
+    }
+
+    tree->checkpoint_seq = seq_num;
+    return rehashed;
+}
+
+const uint8_t* tinybft_partition_digest(const tinybft_partition_tree_t* tree) {
+    return tree->nodes[0].hash;
+}
+
+bool tinybft_partition_pin(tinybft_partition_tree_t* tree) {
+    tinybft_partition_snapshot_t* snap = &tree->snapshot;
+
+    if (snap->overflow) {
+        return false;
+    }
+    if (!snap->pinned) {
+        // Unpinned, the snapshot belongs to the last checkpoint, like the tree
+        memcpy(snap->nodes, tree->nodes, sizeof(snap->nodes));
+        snap->pinned = true;
+    }
+    return true;
+}
+
+void tinybft_partition_unpin(tinybft_partition_tree_t* tree) {
+    tree->snapshot.pinned = false;
+}
+
+const uint8_t* tinybft_partition_snapshot_block(const tinybft_partition_tree_t* tree, uint32_t block) {
+    const tinybft_partition_snapshot_t* snap = &tree->snapshot;
+
+    if (block_saved(snap, block)) {
+        for (uint32_t i = 0; i < snap->block_count; i++) {
+            if (snap->block_index[i] == block) {
+                return snap->blocks[i];
+            }
+        }
+    }
+    return tree->state + block * TINYBFT_BLOCK_SIZE;
+}
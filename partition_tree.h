@@ -0,0 +1,36 @@
+#ifndef TINYBFT_PARTITION_TREE_H
+#define TINYBFT_PARTITION_TREE_H
+
+#include <stdint.h>
+#include "memory_layout.h"
+
+// Incremental Merkle tree over the application state. Writes mark their
+// blocks dirty; a checkpoint rehashes only the dirty blocks and their
+// ancestors, so its cost follows the write set rather than the state size.
+// The tree also keeps a copy-on-write snapshot of the last checkpoint (or of
+// a pinned older one) for state transfer.
+
+// Cover `size` bytes (at most TINYBFT_MAX_STATE_SIZE) of state and hash them all
+void tinybft_partition_init(tinybft_partition_tree_t* tree, void* state, uint32_t size);
+
+// Record that state bytes [offset, offset + len) are about to change
+void tinybft_partition_modify(tinybft_partition_tree_t* tree, uint32_t offset, uint32_t len);
+
+// Rehash what changed since the last checkpoint; returns the blocks rehashed
+uint32_t tinybft_partition_checkpoint(tinybft_partition_tree_t* tree, uint32_t seq_num);
+
+// State digest as of the last checkpoint (the root hash)
+const uint8_t* tinybft_partition_digest(const tinybft_partition_tree_t* tree);
+
+// Bytes of state in a block (the last blocks may be short or empty)
+uint32_t tinybft_partition_block_len(const tinybft_partition_tree_t* tree, uint32_t block);
+
+// Keep the snapshot (tree->snapshot.seq_num, nodes and blocks) across later
+// checkpoints; fails if a changed block could not be saved
+bool tinybft_partition_pin(tinybft_partition_tree_t* tree);
+void tinybft_partition_unpin(tinybft_partition_tree_t* tree);
+
+// Contents of a block as of the snapshot
+const uint8_t* tinybft_partition_snapshot_block(const tinybft_partition_tree_t* tree, uint32_t block);
+
+#endif // TINYBFT_PARTITION_TREE_H
@@ -0,0 +1,1729 @@
+#include "pbft.h"
+#include "partition_tree.h"
+#include "sha256.h"
+#include "state_transfer.h"
+#include <string.h>
+
+#define HEADER_SIZE ((uint32_t)sizeof(tinybft_msg_header_t))
+#define MAX_PAYLOAD (TINYBFT_MAX_MSG_SIZE - HEADER_SIZE)
+
+// Get primary for view
+uint32_t tinybft_primary(uint32_t view) {
+    return view % TINYBFT_MAX_REPLICAS;
+}
+
+_Static_assert(TINYBFT_DIGEST_SIZE == TINYBFT_SHA256_SIZE, "Digests are SHA-256");
+
+void tinybft_digest(const void* data, uint32_t len, uint8_t digest[TINYBFT_DIGEST_SIZE]) {
+    tinybft_sha256(data, len, digest);
+}
+
+void tinybft_replica_init(tinybft_replica_t* r, uint32_t id,
+                          tinybft_send_fn send, void* send_ctx,
+                          tinybft_execute_fn execute, void* app) {
+    memset(r, 0, sizeof(*r));
+    r->id = id;
+    r->view = 0;
+    r->next_seq = 1;
+    r->last_executed = 0;
+    r->batch_size = TINYBFT_MAX_BATCH;
+    r->pipeline_depth = TINYBFT_WINDOW_SIZE;
+    r->send = send;
+    r->send_ctx = send_ctx;
+    r->execute = execute;
+    r->app = app;
+    tinybft_auth_init(&r->auth, id);
+    tinybft_memory_init(&r->memory);
+}
+
+void tinybft_replica_set_keys(tinybft_replica_t* r, uint32_t peer, const uint8_t out_key[TINYBFT_AUTH_KEY_SIZE],
+                              const uint8_t in_key[TINYBFT_AUTH_KEY_SIZE]) {
+    tinybft_auth_set_keys(&r->auth, peer, out_key, in_key);
+}
+
+void tinybft_replica_verify(tinybft_replica_t* r, const tinybft_msg_header_t* const msgs[], uint32_t count,
+                            bool valid[]) {
+    tinybft_auth_verify(&r->auth, msgs, count, valid);
+    for (uint32_t i = 0; i < count; i++) {
+        r->forged += valid[i] ? 0 : 1;
+    }
+}
+
+void tinybft_replica_set_state(tinybft_replica_t* r, void* state, uint32_t size) {
+    tinybft_partition_init(&r->memory.checkpoint_region.partition_tree, state, size);
+}
+
+static void check_view_timers(tinybft_replica_t* r);
+
+void tinybft_replica_tick(tinybft_replica_t* r, uint64_t now_ms) {
+    r->now_ms = now_ms;
+    tinybft_transfer_tick(r);
+    check_view_timers(r);
+}
+
+// Undo records: the overwritten bytes between two copies of where they
+// came from, so the log can be walked either way. Records take multiples of
+// 16 bytes; one that would wrap around the end of the log is preceded by a
+// pad record filling the rest.
+typedef struct {
+    uint32_t offset;  // UNDO_PAD for padding
+    uint32_t len;
+} undo_record_t;
+
+#define UNDO_PAD UINT32_MAX
+#define UNDO_RECORD_SIZE(len) (2 * (uint32_t)sizeof(undo_record_t) + (((len) + 15u) & ~15u))
+#define UNDO_AT(pos) ((pos) & (TINYBFT_UNDO_SIZE - 1u))
+
+static void put_record(tinybft_undo_t* undo, undo_record_t rec) {
+    uint8_t* at = undo->log + UNDO_AT(undo->head);
+    memcpy(at, &rec, sizeof(rec));
+    memcpy(at + UNDO_RECORD_SIZE(rec.len) - sizeof(rec), &rec, sizeof(rec));
+}
+
+static void log_undo(tinybft_replica_t* r, uint32_t offset, uint32_t len) {
+    tinybft_partition_tree_t* tree = &r->memory.checkpoint_region.partition_tree;
+    tinybft_undo_t* undo = &r->undo;
+    undo_record_t rec = { offset, len < tree->state_size - offset ? len : tree->state_size - offset };
+    uint32_t size = UNDO_RECORD_SIZE(rec.len);
+    uint32_t room = TINYBFT_UNDO_SIZE - UNDO_AT(undo->head);
+    uint32_t pad = size > room ? room : 0;
+
+    if (undo->overflow || size > TINYBFT_UNDO_SIZE || size + pad > TINYBFT_UNDO_SIZE - (undo->head - undo->tail)) {
+        undo->overflow = true;
+        return;
+    }
+    if (pad > 0) {
+        put_record(undo, (undo_record_t){ UNDO_PAD, pad - UNDO_RECORD_SIZE(0) });
+        undo->head += pad;
+    }
+    put_record(undo, rec);
+    memcpy(undo->log + UNDO_AT(undo->head) + sizeof(rec), tree->state + offset, rec.len);
+    undo->head += size;
+}
+
+void tinybft_replica_modify(tinybft_replica_t* r, const void* addr, uint32_t len) {
+    tinybft_partition_tree_t* tree = &r->memory.checkpoint_region.partition_tree;
+    const uint8_t* p = addr;
+
+    if (p >= tree->state && p < tree->state + tree->state_size) {
+        bool locked = r->executing_parallel;
+        while (locked && __atomic_test_and_set(&r->modify_lock, __ATOMIC_ACQUIRE)) {
+        }
+        if (r->undo.recording) {
+            log_undo(r, (uint32_t)(p - tree->state), len);
+        }
+        tinybft_partition_modify(tree, (uint32_t)(p - tree->state), len);
+        tinybft_memory_nvm_modify(&r->memory, addr, len);
+        if (locked) {
+            __atomic_clear(&r->modify_lock, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+// Restore the replica at the snapshot's checkpoint. A file that was not
+// sealed may also hold writes made after that checkpoint: they are rolled
+// back with the snapshot's saved blocks, and the result must hash to the
+// checkpoint's root.
+static bool resume_from_nvm(tinybft_replica_t* r, void* state, uint32_t size, bool sealed) {
+    tinybft_checkpoint_region_t* cp = &r->memory.checkpoint_region;
+    tinybft_partition_tree_t* tree = &cp->partition_tree;
+    tinybft_partition_snapshot_t* snap = &tree->snapshot;
+    uint32_t seq_num = snap->seq_num;
+
+    if (tree->state_size != (size < TINYBFT_MAX_STATE_SIZE ? size : TINYBFT_MAX_STATE_SIZE)) {
+        return false;
+    }
+    tree->state = state;
+
+    if (!sealed) {
+        uint8_t root[TINYBFT_DIGEST_SIZE];
+        if (snap->overflow || snap->block_count > TINYBFT_SNAPSHOT_BLOCKS ||
+            (!snap->pinned && tree->checkpoint_seq != seq_num)) {
+            return false;
+        }
+        memcpy(root, snap->pinned ? snap->nodes[0].hash : tree->nodes[0].hash, TINYBFT_DIGEST_SIZE);
+
+        for (uint32_t i = 0; i < snap->block_count; i++) {
+            uint32_t block = snap->block_index[i];
+            if (block >= TINYBFT_STATE_BLOCKS) {
+                return false;
+            }
+            memcpy(tree->state + block * TINYBFT_BLOCK_SIZE, snap->blocks[i], tinybft_partition_block_len(tree, block));
+        }
+
+        tinybft_partition_init(tree, state, size);
+        if (memcmp(tinybft_partition_digest(tree), root, TINYBFT_DIGEST_SIZE) != 0) {
+            return false;
+        }
+        tree->checkpoint_seq = seq_num;
+        tree->snapshot.seq_num = seq_num;
+    }
+
+    r->view = cp->snapshot_view;
+    r->last_executed = seq_num;
+    r->next_seq = seq_num + 1;
+    memcpy(r->client_timestamp, cp->snapshot_timestamp, sizeof(r->client_timestamp));
+
+    // Instances, requests and checkpoint votes past the checkpoint start over
+    memset(&r->memory.agreement_region, 0, sizeof(r->memory.agreement_region));
+    memset(&r->memory.event_region, 0, sizeof(r->memory.event_region));
+    memset(cp->certificates, 0, sizeof(cp->certificates));
+    r->memory.agreement_region.low_watermark = seq_num;
+    return true;
+}
+
+bool tinybft_replica_open_nvm(tinybft_replica_t* r, const char* path, void* state, uint32_t size) {
+    tinybft_nvm_status_t status = tinybft_memory_set_nvm(&r->memory, path, state, size);
+
+    if ((status == TINYBFT_NVM_SEALED || status == TINYBFT_NVM_UNSEALED) &&
+        resume_from_nvm(r, state, size, status == TINYBFT_NVM_SEALED)) {
+        return true;
+    }
+
+    // Nothing usable in the file; start from empty regions
+    memset(&r->memory.agreement_region, 0, sizeof(r->memory.agreement_region));
+    memset(&r->memory.checkpoint_region, 0, sizeof(r->memory.checkpoint_region));
+    memset(&r->memory.event_region, 0, sizeof(r->memory.event_region));
+    return false;
+}
+
+static void rollback_tentative(tinybft_replica_t* r, uint32_t seq_num);
+
+void tinybft_replica_close_nvm(tinybft_replica_t* r) {
+    tinybft_partition_tree_t* tree = &r->memory.checkpoint_region.partition_tree;
+
+    if (!r->memory.using_nvm) {
+        return;
+    }
+    rollback_tentative(r, r->last_executed + 1);  // Not committed yet
+
+    // Resume from exactly what was executed
+    tinybft_partition_unpin(tree);
+    tinybft_partition_checkpoint(tree, r->last_executed);
+    tinybft_transfer_checkpointed(r);
+    tinybft_memory_set_nvm(&r->memory, NULL, NULL, 0);
+}
+
+void tinybft_replica_set_batch_size(tinybft_replica_t* r, uint32_t batch_size) {
+    if (batch_size < 1) {
+        batch_size = 1;
+    }
+    r->batch_size = batch_size < TINYBFT_MAX_BATCH ? batch_size : TINYBFT_MAX_BATCH;
+}
+
+void tinybft_replica_set_tentative(tinybft_replica_t* r, bool tentative) {
+    r->tentative_execution = tentative;
+}
+
+void tinybft_replica_set_parallel(tinybft_replica_t* r, tinybft_access_fn access, tinybft_parallel_fn parallel,
+                                  void* ctx) {
+    r->access = parallel != NULL ? access : NULL;
+    r->parallel = parallel;
+    r->parallel_ctx = ctx;
+}
+
+void tinybft_replica_set_pipeline_depth(tinybft_replica_t* r, uint32_t depth) {
+    if (depth < 1) {
+        depth = 1;
+    }
+    r->pipeline_depth = depth < TINYBFT_WINDOW_SIZE ? depth : TINYBFT_WINDOW_SIZE;
+}
+
+// Stored messages are kept verbatim (header followed by payload)
+static const tinybft_msg_header_t* stored_msg(const uint8_t* buf) {
+    return (const tinybft_msg_header_t*)buf;
+}
+
+static bool stored_is(const uint8_t* buf, tinybft_msg_type_t type) {
+    return stored_msg(buf)->type == type && stored_msg(buf)->data_len > 0;
+}
+
+// Keep a message in its final location; one received there is not copied
+static void keep_msg(tinybft_replica_t* r, uint8_t* buf, const tinybft_msg_header_t* msg) {
+    if (buf != (const uint8_t*)msg) {
+        memcpy(buf, msg, HEADER_SIZE + msg->data_len);
+        r->copied_bytes[msg->type] += HEADER_SIZE + msg->data_len;
+    }
+    if (msg == r->receiving) {
+        r->receiving = NULL;
+    }
+}
+
+// One authenticator covers the message for every receiver
+static void broadcast(tinybft_replica_t* r, tinybft_msg_header_t* hdr, const void* payload) {
+    uint8_t authenticator[TINYBFT_AUTHENTICATOR_SIZE];
+    uint32_t others = ((1u << (TINYBFT_MAX_REPLICAS - 1)) * 2 - 1) & ~(1u << r->id);
+
+    hdr->receiver_id = TINYBFT_ALL_REPLICAS;
+    tinybft_auth_sign(&r->auth, hdr, payload, others, authenticator);
+    for (uint32_t i = 0; i < TINYBFT_MAX_REPLICAS; i++) {
+        if (i != r->id) {
+            r->send(r->send_ctx, i, hdr, payload, authenticator);
+        }
+    }
+}
+
+// This replica's entry of the authenticator that came with a vote
+static const uint8_t* vote_auth(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    return tinybft_msg_authenticator(msg) + r->id * TINYBFT_AUTH_SIZE;
+}
+
+// Slot for a sequence number inside the current window, created on demand
+static tinybft_agreement_slot_t* window_slot(tinybft_replica_t* r, uint32_t seq_num) {
+    tinybft_agreement_slot_t* slot = tinybft_find_agreement_slot(&r->memory, seq_num);
+    if (slot == NULL) {
+        slot = tinybft_init_agreement_slot(&r->memory, seq_num);
+        if (slot == NULL) {
+            return NULL;  // Outside the watermarks
+        }
+        slot->prepare_cert.view = r->view;
+        slot->prepare_cert.seq_num = seq_num;
+        slot->commit_cert.view = r->view;
+        slot->commit_cert.seq_num = seq_num;
+    }
+    return slot;
+}
+
+// Votes are only collected for the digest the slot is agreeing on, which
+// the PRE-PREPARE (or a NEW-VIEW) fixes; a vote alone never chooses it
+static bool matches_digest(const tinybft_prepare_certificate_t* pc, const uint8_t digest[TINYBFT_DIGEST_SIZE]) {
+    return memcmp(pc->digest, digest, TINYBFT_DIGEST_SIZE) == 0;
+}
+
+static void add_vote(tinybft_vote_set_t* votes, uint32_t sender, const uint8_t* auth) {
+    votes->senders |= 1u << sender;
+    if (auth != NULL) {
+        memcpy(votes->auth[sender], auth, TINYBFT_AUTH_SIZE);
+    }
+}
+
+static uint32_t count_votes(const tinybft_vote_set_t* votes, uint32_t excluded) {
+    return (uint32_t)__builtin_popcount(votes->senders & ~excluded);
+}
+
+static void send_vote(tinybft_replica_t* r, tinybft_msg_type_t type, uint32_t seq_num,
+                      const uint8_t digest[TINYBFT_DIGEST_SIZE], tinybft_vote_set_t* votes) {
+    struct {
+        tinybft_msg_header_t hdr;
+        uint8_t digest[TINYBFT_DIGEST_SIZE];
+    } vote;
+
+    vote.hdr.type = type;
+    vote.hdr.sender_id = r->id;
+    vote.hdr.receiver_id = r->id;
+    vote.hdr.view = r->view;
+    vote.hdr.seq_num = seq_num;
+    vote.hdr.data_len = TINYBFT_DIGEST_SIZE;
+    memcpy(vote.digest, digest, TINYBFT_DIGEST_SIZE);
+
+    // Our own vote counts towards the certificate
+    add_vote(votes, r->id, NULL);
+    broadcast(r, &vote.hdr, vote.digest);
+}
+
+// Install the pre-prepare and with it the digest votes are counted for,
+// unless a NEW-VIEW decided on another one
+static bool accept_pre_prepare(tinybft_replica_t* r, tinybft_agreement_slot_t* slot, const tinybft_msg_header_t* msg) {
+    tinybft_prepare_certificate_t* pc = &slot->prepare_cert;
+    uint8_t digest[TINYBFT_DIGEST_SIZE];
+
+    tinybft_digest(msg + 1, msg->data_len, digest);
+    if (pc->has_digest && memcmp(pc->digest, digest, TINYBFT_DIGEST_SIZE) != 0) {
+        if (pc->fixed) {
+            return false;
+        }
+        pc->prepares.senders = 0;
+        slot->commit_cert.commits.senders = 0;
+    }
+
+    memcpy(pc->digest, digest, TINYBFT_DIGEST_SIZE);
+    pc->has_digest = true;
+    keep_msg(r, pc->pre_prepare, msg);
+
+    // Commit latency is measured one instance at a time
+    if (r->probe_seq == 0) {
+        r->probe_seq = slot->seq_num;
+        r->probe_start = r->now_ms;
+    }
+    return true;
+}
+
+static bool client_index(uint32_t client_id, uint32_t* index) {
+    if (client_id < TINYBFT_MAX_REPLICAS || client_id >= TINYBFT_MAX_ENDPOINTS) {
+        return false;
+    }
+    *index = client_id - TINYBFT_MAX_REPLICAS;
+    return true;
+}
+
+typedef struct {
+    tinybft_msg_header_t hdr;
+    tinybft_reply_t reply;
+    uint8_t result[MAX_PAYLOAD - sizeof(tinybft_reply_t)];
+} reply_msg_t;
+
+// Run a request against the current state and build the reply in out
+static void build_reply(tinybft_replica_t* r, uint32_t seq_num, const tinybft_request_t* req, uint32_t flags,
+                        reply_msg_t* out) {
+    out->reply.client_id = req->client_id;
+    out->reply.timestamp = req->timestamp;
+    out->reply.flags = flags;
+    out->reply.result_len = r->execute(r->app, req, out->result, sizeof(out->result));
+
+    out->hdr.type = MSG_TYPE_REPLY;
+    out->hdr.sender_id = r->id;
+    out->hdr.receiver_id = req->client_id;
+    out->hdr.view = r->view;
+    out->hdr.seq_num = seq_num;
+    out->hdr.data_len = (uint32_t)sizeof(tinybft_reply_t) + out->reply.result_len;
+}
+
+// Run a request against the current state and reply with the result, built in out
+static void execute_and_reply(tinybft_replica_t* r, uint32_t seq_num, const tinybft_request_t* req, uint32_t flags,
+                              reply_msg_t* out) {
+    build_reply(r, seq_num, req, flags, out);
+    r->send(r->send_ctx, req->client_id, &out->hdr, &out->reply, NULL);
+}
+
+// The reply to each client's last executed request stays in the event
+// region, to answer the client again if it retransmits
+static void execute_request(tinybft_replica_t* r, uint32_t seq_num, const tinybft_request_t* req, uint32_t flags) {
+    uint32_t c;
+    if (!client_index(req->client_id, &c) || req->timestamp <= r->client_timestamp[c]) {
+        return;  // Unknown client or already executed
+    }
+
+    execute_and_reply(r, seq_num, req, flags, (reply_msg_t*)r->memory.event_region.client_replies[c]);
+    r->client_timestamp[c] = req->timestamp;
+    r->executed++;
+}
+
+static void resend_reply(tinybft_replica_t* r, uint32_t c, uint32_t timestamp) {
+    const reply_msg_t* out = (const reply_msg_t*)r->memory.event_region.client_replies[c];
+
+    if (stored_is(r->memory.event_region.client_replies[c], MSG_TYPE_REPLY) && out->reply.timestamp == timestamp) {
+        r->send(r->send_ctx, out->hdr.receiver_id, &out->hdr, &out->reply, NULL);
+    }
+}
+
+// Whether a kept client request still waits for execution, or a tentative
+// batch for its commit; requests that were executed meanwhile are dropped
+static bool requests_waiting(tinybft_replica_t* r) {
+    bool waiting = false;
+
+    for (uint32_t c = 0; c < TINYBFT_MAX_CLIENTS; c++) {
+        uint8_t* pending = r->memory.event_region.client_requests[c];
+        if (!stored_is(pending, MSG_TYPE_REQUEST)) {
+            continue;
+        }
+        if (((const tinybft_request_t*)(stored_msg(pending) + 1))->timestamp <= r->client_timestamp[c]) {
+            memset(pending, 0, HEADER_SIZE);
+        } else {
+            waiting = true;
+        }
+    }
+    return waiting || r->undo.count > 0;
+}
+
+static void try_propose(tinybft_replica_t* r);
+
+// A checkpoint is stable once 2f+1 replicas, this one included, reported the
+// same digest; the window then moves past it
+static void check_stable(tinybft_replica_t* r, tinybft_checkpoint_certificate_t* cert) {
+    cert->checkpoint_count = count_votes(&cert->checkpoints, 0);
+    if (cert->valid || cert->checkpoint_count < TINYBFT_QUORUM || (cert->checkpoints.senders & (1u << r->id)) == 0) {
+        return;
+    }
+    cert->valid = true;
+    r->stable_checkpoints++;
+    tinybft_set_low_watermark(&r->memory, cert->seq_num);
+    try_propose(r);  // The primary may have been waiting for room in the window
+}
+
+// Announce the state digest at last_executed, a checkpoint
+static void send_checkpoint(tinybft_replica_t* r, const uint8_t digest[TINYBFT_DIGEST_SIZE]) {
+    tinybft_checkpoint_certificate_t* cert = tinybft_find_checkpoint_cert(&r->memory, r->last_executed);
+    if (cert == NULL) {
+        return;
+    }
+    if (cert->has_digest && memcmp(cert->digest, digest, TINYBFT_DIGEST_SIZE) != 0) {
+        memset(&cert->checkpoints, 0, sizeof(cert->checkpoints));  // Early votes were for another state
+    }
+    memcpy(cert->digest, digest, TINYBFT_DIGEST_SIZE);
+    cert->has_digest = true;
+    send_vote(r, MSG_TYPE_CHECKPOINT, r->last_executed, digest, &cert->checkpoints);
+    check_stable(r, cert);
+}
+
+// A batch executed in parallel: the requests to execute, and the tasks
+// formed by those on one key hash, each a chain in batch order
+typedef struct {
+    tinybft_replica_t* r;
+    uint32_t seq_num;
+    uint32_t flags;
+    uint32_t count;
+    const tinybft_request_t* reqs[TINYBFT_MAX_BATCH];
+    uint32_t clients[TINYBFT_MAX_BATCH];
+    reply_msg_t* outs[TINYBFT_MAX_BATCH];
+    uint32_t next[TINYBFT_MAX_BATCH];   // Next request of the same task
+    uint32_t tasks;
+    uint32_t keys[TINYBFT_MAX_BATCH];   // Key hash of each task
+    uint32_t first[TINYBFT_MAX_BATCH];
+    uint32_t last[TINYBFT_MAX_BATCH];
+} parallel_batch_t;
+
+#define NO_REQUEST UINT32_MAX
+
+static void run_task(void* arg, uint32_t task) {
+    parallel_batch_t* pb = (parallel_batch_t*)arg;
+
+    for (uint32_t i = pb->first[task]; i != NO_REQUEST; i = pb->next[i]) {
+        build_reply(pb->r, pb->seq_num, pb->reqs[i], pb->flags, pb->outs[i]);
+    }
+}
+
+// Run the tasks collected so far, concurrently if there are several
+static void run_tasks(parallel_batch_t* pb) {
+    tinybft_replica_t* r = pb->r;
+
+    if (pb->tasks > 1) {
+        r->executing_parallel = true;
+        r->parallel(r->parallel_ctx, pb->tasks, run_task, pb);
+        r->executing_parallel = false;
+        r->parallel_runs++;
+        r->parallel_tasks += pb->tasks;
+    } else if (pb->tasks == 1) {
+        run_task(pb, 0);
+    }
+    pb->tasks = 0;
+}
+
+// Collect the requests of a batch that are due for execution; false if a
+// client has several, whose replies would share its reply buffer
+static bool collect_requests(tinybft_replica_t* r, const tinybft_batch_t* batch, parallel_batch_t* pb) {
+    const uint8_t* payload = (const uint8_t*)batch;
+    uint32_t offset = sizeof(tinybft_batch_t);
+    uint32_t c;
+
+    pb->count = 0;
+    for (uint32_t i = 0; i < batch->count; i++) {
+        const tinybft_request_t* req = (const tinybft_request_t*)(payload + offset);
+        offset += TINYBFT_BATCH_ALIGN(tinybft_request_size(req));
+        if (!client_index(req->client_id, &c) || req->timestamp <= r->client_timestamp[c]) {
+            continue;  // Unknown client or already executed
+        }
+
+        for (uint32_t k = 0; k < pb->count; k++) {
+            if (pb->clients[k] == c) {
+                return false;
+            }
+        }
+        pb->reqs[pb->count] = req;
+        pb->clients[pb->count] = c;
+        pb->outs[pb->count++] = (reply_msg_t*)r->memory.event_region.client_replies[c];
+    }
+    return true;
+}
+
+// Execute a batch with the same outcome as in batch order: requests that
+// take exclusive access run alone, and between them one task per key hash
+static bool execute_parallel(tinybft_replica_t* r, uint32_t seq_num, const tinybft_batch_t* batch, uint32_t flags) {
+    parallel_batch_t pb;
+
+    pb.r = r;
+    pb.seq_num = seq_num;
+    pb.flags = flags;
+    pb.tasks = 0;
+    if (!collect_requests(r, batch, &pb)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < pb.count; i++) {
+        uint32_t key = 0;
+        if (r->access(r->app, pb.reqs[i], &key) == TINYBFT_ACCESS_EXCLUSIVE) {
+            run_tasks(&pb);
+            build_reply(r, seq_num, pb.reqs[i], flags, pb.outs[i]);
+            continue;
+        }
+
+        uint32_t t = 0;
+        while (t < pb.tasks && pb.keys[t] != key) {
+            t++;
+        }
+        if (t == pb.tasks) {
+            pb.keys[pb.tasks++] = key;
+            pb.first[t] = i;
+        } else {
+            pb.next[pb.last[t]] = i;
+        }
+        pb.last[t] = i;
+        pb.next[i] = NO_REQUEST;
+    }
+    run_tasks(&pb);
+
+    // Replies leave in batch order, as they would have serially
+    for (uint32_t i = 0; i < pb.count; i++) {
+        r->client_timestamp[pb.clients[i]] = pb.reqs[i]->timestamp;
+        r->executed++;
+        r->send(r->send_ctx, pb.reqs[i]->client_id, &pb.outs[i]->hdr, &pb.outs[i]->reply, NULL);
+    }
+    return true;
+}
+
+// Apply the whole batch of slot, replying with flags
+static void execute_batch(tinybft_replica_t* r, const tinybft_agreement_slot_t* slot, uint32_t flags) {
+    const tinybft_msg_header_t* pre_prepare = stored_msg(slot->prepare_cert.pre_prepare);
+    const uint8_t* payload = (const uint8_t*)(pre_prepare + 1);
+    const tinybft_batch_t* batch = (const tinybft_batch_t*)payload;
+    uint32_t offset = sizeof(tinybft_batch_t);
+
+    if (r->access != NULL && execute_parallel(r, slot->seq_num, batch, flags)) {
+        return;
+    }
+    for (uint32_t i = 0; i < batch->count; i++) {
+        const tinybft_request_t* req = (const tinybft_request_t*)(payload + offset);
+        execute_request(r, slot->seq_num, req, flags);
+        offset += TINYBFT_BATCH_ALIGN(tinybft_request_size(req));
+    }
+}
+
+// The oldest tentative batch committed: its cached replies now stand as
+// committed ones and its records leave the log
+static void confirm_tentative(tinybft_replica_t* r, const tinybft_agreement_slot_t* slot) {
+    const tinybft_msg_header_t* pre_prepare = stored_msg(slot->prepare_cert.pre_prepare);
+    const uint8_t* payload = (const uint8_t*)(pre_prepare + 1);
+    const tinybft_batch_t* batch = (const tinybft_batch_t*)payload;
+    tinybft_undo_t* undo = &r->undo;
+    uint32_t offset = sizeof(tinybft_batch_t);
+    uint32_t c;
+
+    for (uint32_t i = 0; i < batch->count; i++) {
+        const tinybft_request_t* req = (const tinybft_request_t*)(payload + offset);
+        reply_msg_t* out = NULL;
+        if (client_index(req->client_id, &c) && stored_is(r->memory.event_region.client_replies[c], MSG_TYPE_REPLY)) {
+            out = (reply_msg_t*)r->memory.event_region.client_replies[c];
+        }
+        if (out != NULL && out->reply.timestamp == req->timestamp) {
+            out->reply.flags &= ~TINYBFT_REPLY_TENTATIVE;
+        }
+        offset += TINYBFT_BATCH_ALIGN(tinybft_request_size(req));
+    }
+
+    undo->count--;
+    undo->tail = undo->count > 0 ? undo->marks[(slot->seq_num + 1) % TINYBFT_WINDOW_SIZE].start : undo->head;
+    undo->overflow = undo->overflow && undo->count > 0;
+}
+
+// The state no longer matches last_executed and the log cannot restore it:
+// fetch a later checkpoint
+static void lose_state(tinybft_replica_t* r) {
+    r->undo.lost = true;
+    if (r->behind_since == 0) {
+        r->behind_since = r->now_ms;
+    }
+}
+
+// Exchange a record's bytes with the state they were logged from
+static void swap_record(tinybft_replica_t* r, uint32_t pos, undo_record_t rec) {
+    uint8_t* state = r->memory.checkpoint_region.partition_tree.state + rec.offset;
+    uint8_t* saved = r->undo.log + UNDO_AT(pos) + sizeof(rec);
+    uint8_t tmp[256];
+
+    tinybft_replica_modify(r, state, rec.len);
+    for (uint32_t done = 0; done < rec.len; done += sizeof(tmp)) {
+        uint32_t n = rec.len - done < sizeof(tmp) ? rec.len - done : (uint32_t)sizeof(tmp);
+        memcpy(tmp, state + done, n);
+        memcpy(state + done, saved + done, n);
+        memcpy(saved + done, tmp, n);
+    }
+}
+
+// Swap the records from start on with the state, newest first: the state
+// returns to what it was at start, and the records keep what it held
+static void swap_back(tinybft_replica_t* r, uint32_t start) {
+    for (uint32_t pos = r->undo.head; pos != start;) {
+        undo_record_t rec;
+        memcpy(&rec, r->undo.log + UNDO_AT(pos - sizeof(rec)), sizeof(rec));
+        pos -= UNDO_RECORD_SIZE(rec.len);
+        if (rec.offset != UNDO_PAD) {
+            swap_record(r, pos, rec);
+        }
+    }
+}
+
+// Undo swap_back, oldest first
+static void swap_forward(tinybft_replica_t* r, uint32_t start) {
+    for (uint32_t pos = start; pos != r->undo.head;) {
+        undo_record_t rec;
+        memcpy(&rec, r->undo.log + UNDO_AT(pos), sizeof(rec));
+        if (rec.offset != UNDO_PAD) {
+            swap_record(r, pos, rec);
+        }
+        pos += UNDO_RECORD_SIZE(rec.len);
+    }
+}
+
+// Write back what the tentative batches from seq_num on overwrote and
+// forget their execution
+static void rollback_tentative(tinybft_replica_t* r, uint32_t seq_num) {
+    tinybft_undo_t* undo = &r->undo;
+    uint32_t newest = r->last_executed + undo->count;
+
+    if (seq_num <= r->last_executed) {
+        seq_num = r->last_executed + 1;
+    }
+    if (seq_num > newest) {
+        return;
+    }
+
+    const tinybft_undo_mark_t* mark = &undo->marks[seq_num % TINYBFT_WINDOW_SIZE];
+    if (undo->overflow) {
+        lose_state(r);
+    } else {
+        swap_back(r, mark->start);
+    }
+    undo->head = mark->start;
+    undo->count = seq_num - r->last_executed - 1;
+    undo->overflow = false;
+    memcpy(r->client_timestamp, mark->client_timestamp, sizeof(r->client_timestamp));
+    r->executed = mark->executed;
+    r->rollbacks += newest - seq_num + 1;
+}
+
+// Execute prepared batches past the last executed one ahead of their
+// commit, logging the state they overwrite. A batch starts only with half
+// the log free, and none during a view change or a transfer.
+static void execute_tentative(tinybft_replica_t* r) {
+    tinybft_undo_t* undo = &r->undo;
+
+    if (!r->tentative_execution || undo->lost || r->view_changing || r->transfer.active) {
+        return;
+    }
+    while (!undo->overflow && undo->head - undo->tail <= TINYBFT_UNDO_SIZE / 2) {
+        uint32_t seq_num = r->last_executed + undo->count + 1;
+        tinybft_agreement_slot_t* slot = tinybft_find_agreement_slot(&r->memory, seq_num);
+        if (slot == NULL || !slot->prepare_cert.valid || !stored_is(slot->prepare_cert.pre_prepare, MSG_TYPE_PRE_PREPARE)) {
+            return;
+        }
+
+        tinybft_undo_mark_t* mark = &undo->marks[seq_num % TINYBFT_WINDOW_SIZE];
+        mark->start = undo->head;
+        mark->executed = r->executed;
+        memcpy(mark->client_timestamp, r->client_timestamp, sizeof(mark->client_timestamp));
+        undo->count++;
+
+        undo->recording = true;
+        execute_batch(r, slot, TINYBFT_REPLY_TENTATIVE);
+        undo->recording = false;
+        r->tentative++;
+        if (r->request_since == 0) {
+            r->request_since = r->now_ms;  // Until it commits
+        }
+    }
+}
+
+// Checkpoint the state at last_executed. Tentative batches past it are
+// swapped out of the state while it is hashed and synced.
+static void take_checkpoint(tinybft_replica_t* r) {
+    tinybft_partition_tree_t* tree = &r->memory.checkpoint_region.partition_tree;
+    tinybft_undo_t* undo = &r->undo;
+    uint32_t timestamps[TINYBFT_MAX_CLIENTS];
+
+    if (undo->count > 0) {
+        if (undo->overflow) {
+            lose_state(r);
+            return;
+        }
+        swap_back(r, undo->tail);
+        memcpy(timestamps, r->client_timestamp, sizeof(timestamps));
+        memcpy(r->client_timestamp, undo->marks[(r->last_executed + 1) % TINYBFT_WINDOW_SIZE].client_timestamp,
+               sizeof(r->client_timestamp));
+    }
+
+    r->checkpoint_blocks += tinybft_partition_checkpoint(tree, r->last_executed);
+    r->checkpoints++;
+    tinybft_transfer_checkpointed(r);
+    tinybft_memory_sync_nvm(&r->memory);
+
+    if (undo->count > 0) {
+        swap_forward(r, undo->tail);
+        memcpy(r->client_timestamp, timestamps, sizeof(r->client_timestamp));
+    }
+    send_checkpoint(r, tinybft_partition_digest(tree));
+}
+
+// Execute committed batches in sequence-number order
+static void execute_committed(tinybft_replica_t* r) {
+    uint32_t executed = r->last_executed;
+
+    while (!r->undo.lost) {
+        tinybft_agreement_slot_t* slot = tinybft_find_agreement_slot(&r->memory, r->last_executed + 1);
+        if (slot == NULL || !slot->commit_cert.valid) {
+            break;
+        }
+
+        // The whole batch is applied before the next sequence number
+        if (r->undo.count > 0) {
+            confirm_tentative(r, slot);
+        } else {
+            execute_batch(r, slot, 0);
+        }
+
+        r->last_executed++;
+        r->behind_since = 0;
+
+        if (r->last_executed % TINYBFT_CHECKPOINT_INTERVAL == 0) {
+            take_checkpoint(r);
+        }
+    }
+
+    // Progress restarts the view-change timer for the requests still waiting
+    if (r->last_executed != executed) {
+        r->request_since = requests_waiting(r) ? r->now_ms : 0;
+    }
+    execute_tentative(r);
+    try_propose(r);
+}
+
+// Smoothed like a TCP round-trip time: gain 1/8 for the mean, 1/4 for the deviation
+static void sample_commit_latency(tinybft_replica_t* r) {
+    int64_t sample = (int64_t)(r->now_ms - r->probe_start) * 1000;
+    int64_t avg = r->commit_avg_us;
+    int64_t dev = r->commit_dev_us;
+
+    if (avg == 0 && dev == 0) {
+        avg = sample;
+        dev = sample / 2;
+    } else {
+        int64_t err = sample - avg;
+        avg += err / 8;
+        dev += ((err < 0 ? -err : err) - dev) / 4;
+    }
+    r->commit_avg_us = (uint32_t)avg;
+    r->commit_dev_us = (uint32_t)dev;
+    r->probe_seq = 0;
+}
+
+uint32_t tinybft_view_timeout(const tinybft_replica_t* r) {
+    uint64_t timeout = ((uint64_t)r->commit_avg_us + 4ull * r->commit_dev_us + 999) / 1000;
+
+    if (timeout < TINYBFT_VIEW_TIMEOUT_MIN_MS) {
+        timeout = TINYBFT_VIEW_TIMEOUT_MIN_MS;
+    }
+    timeout <<= r->failed_views < 16 ? r->failed_views : 16;
+    return timeout < TINYBFT_VIEW_TIMEOUT_MAX_MS ? (uint32_t)timeout : TINYBFT_VIEW_TIMEOUT_MAX_MS;
+}
+
+// Advance the agreement instance held in slot as far as its certificates allow
+static void check_progress(tinybft_replica_t* r, tinybft_agreement_slot_t* slot) {
+    tinybft_prepare_certificate_t* pc = &slot->prepare_cert;
+    tinybft_commit_certificate_t* cc = &slot->commit_cert;
+
+    if (!stored_is(pc->pre_prepare, MSG_TYPE_PRE_PREPARE)) {
+        return;
+    }
+
+    if (!pc->valid) {
+        // Prepared: pre-prepare plus 2f matching PREPAREs from backups
+        pc->prepare_count = count_votes(&pc->prepares, 1u << tinybft_primary(r->view));
+        if (pc->prepare_count < 2 * TINYBFT_MAX_FAULTY) {
+            return;
+        }
+        pc->valid = true;
+        send_vote(r, MSG_TYPE_COMMIT, slot->seq_num, pc->digest, &cc->commits);
+    }
+
+    if (!cc->valid) {
+        // Committed: prepared plus 2f+1 matching COMMITs
+        cc->commit_count = count_votes(&cc->commits, 0);
+        if (cc->commit_count < TINYBFT_QUORUM) {
+            execute_tentative(r);
+            return;
+        }
+        cc->valid = true;
+        r->committed++;
+        if (!pc->fixed) {
+            r->failed_views = 0;  // The view orders requests of its own, not just what its NEW-VIEW re-issued
+        }
+        if (r->view_commit_ms == 0) {
+            r->view_commit_ms = r->now_ms;
+        }
+        if (slot->seq_num == r->probe_seq) {
+            sample_commit_latency(r);
+        }
+        execute_committed(r);
+    }
+}
+
+// Primary: pack pending client requests into one PRE-PREPARE
+static void try_propose(tinybft_replica_t* r) {
+    // Keep at most pipeline_depth instances in flight inside the window
+    if (tinybft_primary(r->view) != r->id || r->view_changing || r->transfer.active ||
+        r->next_seq - r->last_executed > r->pipeline_depth || !tinybft_in_window(&r->memory, r->next_seq)) {
+        return;
+    }
+
+    // The batch is built in place in the slot that keeps the PRE-PREPARE
+    tinybft_agreement_slot_t* slot = window_slot(r, r->next_seq);
+    if (slot == NULL || stored_is(slot->prepare_cert.pre_prepare, MSG_TYPE_PRE_PREPARE)) {
+        return;
+    }
+    tinybft_msg_header_t* pp = (tinybft_msg_header_t*)slot->prepare_cert.pre_prepare;
+    uint8_t* payload = (uint8_t*)(pp + 1);
+
+    tinybft_batch_t* batch = (tinybft_batch_t*)payload;
+    uint32_t offset = sizeof(tinybft_batch_t);
+    batch->count = 0;
+
+    for (uint32_t k = 0; k < TINYBFT_MAX_CLIENTS && batch->count < r->batch_size; k++) {
+        uint32_t c = (r->next_client + k) % TINYBFT_MAX_CLIENTS;
+        uint8_t* pending = r->memory.event_region.client_requests[c];
+        if (!stored_is(pending, MSG_TYPE_REQUEST)) {
+            continue;
+        }
+
+        const tinybft_msg_header_t* req = stored_msg(pending);
+        uint32_t size = TINYBFT_BATCH_ALIGN(req->data_len);
+        if (offset + size > MAX_PAYLOAD) {
+            break;  // Batch is full; the rest waits for the next instance
+        }
+
+        memcpy(payload + offset, req + 1, req->data_len);
+        r->copied_bytes[MSG_TYPE_REQUEST] += req->data_len;
+        offset += size;
+        batch->count++;
+        memset(pending, 0, HEADER_SIZE);
+        r->next_client = (c + 1) % TINYBFT_MAX_CLIENTS;
+    }
+
+    if (batch->count == 0) {
+        return;
+    }
+
+    pp->type = MSG_TYPE_PRE_PREPARE;
+    pp->sender_id = r->id;
+    pp->receiver_id = r->id;
+    pp->view = r->view;
+    pp->seq_num = r->next_seq++;
+    pp->data_len = offset;
+
+    accept_pre_prepare(r, slot, pp);
+    broadcast(r, pp, payload);
+
+    check_progress(r, slot);
+}
+
+// Hold a client request in the event region until it is batched (primary)
+// or executed (backups, which time it and pass it on should they become
+// primary). Clients retransmit to every replica.
+static void handle_request(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    const tinybft_request_t* req = (const tinybft_request_t*)(msg + 1);
+    uint32_t c;
+
+    if (req->client_id != msg->sender_id || !client_index(req->client_id, &c)) {
+        return;
+    }
+    if (req->timestamp <= r->client_timestamp[c]) {
+        resend_reply(r, c, req->timestamp);  // Executed; the reply may have been lost
+        return;
+    }
+
+    uint8_t* pending = r->memory.event_region.client_requests[c];
+    if (pending != (const uint8_t*)msg && stored_is(pending, MSG_TYPE_REQUEST) &&
+        ((const tinybft_request_t*)(stored_msg(pending) + 1))->timestamp >= req->timestamp) {
+        return;  // Duplicate
+    }
+
+    keep_msg(r, pending, msg);
+    if (r->request_since == 0) {
+        r->request_since = r->now_ms;
+    }
+    try_propose(r);
+}
+
+static bool valid_request(const tinybft_msg_header_t* msg) {
+    return msg->data_len >= sizeof(tinybft_request_t) &&
+           tinybft_request_size((const tinybft_request_t*)(msg + 1)) <= msg->data_len;
+}
+
+static bool read_only(const tinybft_msg_header_t* msg) {
+    return msg->data_len >= sizeof(tinybft_request_t) &&
+           (((const tinybft_request_t*)(msg + 1))->flags & TINYBFT_REQUEST_READ_ONLY) != 0;
+}
+
+// Every replica answers a read-only request straight from the state it has
+// executed, tagged with last_executed; the client needs 2f+1 matching answers
+// and otherwise resends the request for ordering. Nothing is recorded, so the
+// request uses up no sequence number and no client timestamp. A tentatively
+// executed batch is visible to it: 2f+1 matching answers that include its
+// writes come from replicas that all prepared it, as 2f+1 tentative replies do.
+static void handle_read_only(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    const tinybft_request_t* req = (const tinybft_request_t*)(msg + 1);
+    uint32_t c;
+
+    if (r->transfer.active || r->undo.lost || req->client_id != msg->sender_id || !client_index(req->client_id, &c)) {
+        return;  // Mid-transfer the state matches no checkpoint
+    }
+    reply_msg_t out;
+    execute_and_reply(r, r->last_executed, req, 0, &out);
+    r->reads++;
+}
+
+// Every request of a batch must lie entirely within the payload
+static bool valid_batch(const tinybft_msg_header_t* msg) {
+    const uint8_t* payload = (const uint8_t*)(msg + 1);
+    if (msg->data_len < sizeof(tinybft_batch_t)) {
+        return false;
+    }
+
+    const tinybft_batch_t* batch = (const tinybft_batch_t*)payload;
+    if (batch->count == 0 || batch->count > TINYBFT_MAX_BATCH) {
+        return false;
+    }
+
+    uint32_t offset = sizeof(tinybft_batch_t);
+    for (uint32_t i = 0; i < batch->count; i++) {
+        if (offset + sizeof(tinybft_request_t) > msg->data_len) {
+            return false;
+        }
+        uint32_t size = tinybft_request_size((const tinybft_request_t*)(payload + offset));
+        if (offset + size > msg->data_len) {
+            return false;
+        }
+        offset += TINYBFT_BATCH_ALIGN(size);
+    }
+
+    return true;
+}
+
+uint8_t* tinybft_replica_recv_buffer(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    tinybft_memory_region_t region;
+    uint8_t* location;
+    uint32_t c;
+
+    // Only messages that will be kept, into a location nothing else holds
+    switch (msg->type) {
+        case MSG_TYPE_PRE_PREPARE:
+            if (msg->view != r->view || r->view_changing || (r->transfer.active && !r->transfer.fetching) ||
+                msg->seq_num <= r->last_executed || msg->sender_id != tinybft_primary(r->view) ||
+                window_slot(r, msg->seq_num) == NULL) {
+                return NULL;
+            }
+            location = tinybft_msg_location(&r->memory, msg, &region);
+            return location != NULL && !stored_is(location, MSG_TYPE_PRE_PREPARE) ? location : NULL;
+        case MSG_TYPE_REQUEST:
+            if (!client_index(msg->sender_id, &c) || read_only(msg)) {
+                return NULL;
+            }
+            location = tinybft_msg_location(&r->memory, msg, &region);
+            return location != NULL && !stored_is(location, MSG_TYPE_REQUEST) ? location : NULL;
+        default:
+            return NULL;
+    }
+}
+
+static bool handle_msg(tinybft_replica_t* r, const tinybft_msg_header_t* msg);
+
+bool tinybft_replica_handle(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    tinybft_memory_region_t region;
+    bool in_place = msg->type < TINYBFT_MSG_TYPES && msg->sender_id < TINYBFT_MAX_ENDPOINTS &&
+                    (const uint8_t*)msg == tinybft_msg_location(&r->memory, msg, &region);
+
+    r->receiving = msg;
+    bool consumed = handle_msg(r, msg);
+    if (consumed && msg->type < TINYBFT_MSG_TYPES) {
+        r->received[msg->type]++;
+    }
+
+    // Received into its final location but rejected: it must not look kept
+    if (in_place && r->receiving == msg) {
+        memset((void*)msg, 0, HEADER_SIZE);
+    }
+    r->receiving = NULL;
+    tinybft_memory_track(&r->memory);
+    return consumed;
+}
+
+// CHECKPOINT: a vote on the state digest at seq_num. Votes are counted as
+// they arrive, even ahead of execution, so a lagging replica never holds up
+// the rest of the sender's messages behind one.
+static bool handle_checkpoint(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    tinybft_agreement_region_t* ar = &r->memory.agreement_region;
+    if (msg->data_len != TINYBFT_DIGEST_SIZE || msg->seq_num <= ar->low_watermark) {
+        return true;  // Malformed or already stable
+    }
+
+    tinybft_checkpoint_certificate_t* cert = tinybft_find_checkpoint_cert(&r->memory, msg->seq_num);
+    if (cert == NULL) {
+        if (msg->seq_num - ar->low_watermark > TINYBFT_WINDOW_SIZE && r->behind_since == 0) {
+            r->behind_since = r->now_ms;  // Others are past our window; lag detection starts
+        }
+        return true;
+    }
+    if (!cert->has_digest) {
+        memcpy(cert->digest, msg + 1, TINYBFT_DIGEST_SIZE);
+        cert->has_digest = true;
+    } else if (memcmp(cert->digest, msg + 1, TINYBFT_DIGEST_SIZE) != 0) {
+        return true;  // A different state
+    }
+    add_vote(&cert->checkpoints, msg->sender_id, vote_auth(r, msg));
+    check_stable(r, cert);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// State transfer
+
+static void try_install_new_view(tinybft_replica_t* r);
+
+// A NEW-VIEW kept during the transfer takes over from the checkpoint's view
+void tinybft_resume_agreement(tinybft_replica_t* r) {
+    r->request_since = requests_waiting(r) ? r->now_ms : 0;  // Waiting on the transfer is no fault of the primary
+    try_install_new_view(r);
+    execute_committed(r);
+}
+
+// Send a message to one replica, authenticated for it alone
+static void send_to(tinybft_replica_t* r, uint32_t dest, const tinybft_msg_header_t* msg, const void* payload) {
+    tinybft_msg_header_t hdr = *msg;
+    uint8_t authenticator[TINYBFT_AUTHENTICATOR_SIZE];
+
+    hdr.receiver_id = dest;
+    tinybft_auth_sign(&r->auth, &hdr, payload, 1u << dest, authenticator);
+    r->send(r->send_ctx, dest, &hdr, payload, authenticator);
+}
+
+static void resend_vote(tinybft_replica_t* r, uint32_t dest, tinybft_msg_type_t type, uint32_t seq_num,
+                        const uint8_t digest[TINYBFT_DIGEST_SIZE]) {
+    tinybft_msg_header_t hdr;
+
+    hdr.type = type;
+    hdr.sender_id = r->id;
+    hdr.view = r->view;
+    hdr.seq_num = seq_num;
+    hdr.data_len = TINYBFT_DIGEST_SIZE;
+    send_to(r, dest, &hdr, digest);
+}
+
+// dest is still short of our view: send it our VIEW-CHANGE for the view,
+// and our NEW-VIEW if we lead it, so that it follows
+static void resend_view(tinybft_replica_t* r, uint32_t dest) {
+    const uint8_t* vc = r->memory.event_region.view_change_msgs[r->id];
+    const uint8_t* nv = r->memory.event_region.new_view_msgs[r->id];
+
+    if (stored_is(vc, MSG_TYPE_VIEW_CHANGE) && stored_msg(vc)->view == r->view) {
+        send_to(r, dest, stored_msg(vc), stored_msg(vc) + 1);
+    }
+    if (!r->view_changing && tinybft_primary(r->view) == r->id && stored_is(nv, MSG_TYPE_NEW_VIEW) &&
+        stored_msg(nv)->view == r->view) {
+        send_to(r, dest, stored_msg(nv), stored_msg(nv) + 1);
+    }
+}
+
+// dest installed the checkpoint at seq_num in view: send it again what we
+// sent for the checkpoints and instances after it. Should we be in a later
+// view, our VIEW-CHANGE for it (and the primary's NEW-VIEW) go first so that
+// dest follows; checkpoint votes go before the instances so that its window
+// can move past them.
+void tinybft_resend_instances(tinybft_replica_t* r, uint32_t dest, uint32_t view, uint32_t seq_num) {
+    tinybft_memory_t* mem = &r->memory;
+    bool primary = tinybft_primary(r->view) == r->id;
+
+    if (r->view_changing || view > r->view) {
+        return;  // Nothing settled to send
+    }
+    if (view < r->view) {
+        resend_view(r, dest);
+    }
+
+    for (uint32_t i = 0; i < TINYBFT_CHECKPOINT_CERTS; i++) {
+        const tinybft_checkpoint_certificate_t* cert = &mem->checkpoint_region.certificates[i];
+        if (cert->seq_num > seq_num && (cert->checkpoints.senders & (1u << r->id)) != 0) {
+            resend_vote(r, dest, MSG_TYPE_CHECKPOINT, cert->seq_num, cert->digest);
+        }
+    }
+
+    uint32_t low = mem->agreement_region.low_watermark;
+    for (uint32_t seq = (seq_num > low ? seq_num : low) + 1; tinybft_in_window(mem, seq); seq++) {
+        const tinybft_agreement_slot_t* slot = tinybft_find_agreement_slot(mem, seq);
+        if (slot == NULL || !slot->prepare_cert.has_digest) {
+            continue;
+        }
+        const uint8_t* pp = slot->prepare_cert.pre_prepare;
+        if (primary && stored_is(pp, MSG_TYPE_PRE_PREPARE)) {
+            send_to(r, dest, stored_msg(pp), stored_msg(pp) + 1);
+        }
+        if (slot->prepare_cert.prepares.senders & (1u << r->id)) {
+            resend_vote(r, dest, MSG_TYPE_PREPARE, seq, slot->prepare_cert.digest);
+        }
+        if (slot->commit_cert.commits.senders & (1u << r->id)) {
+            resend_vote(r, dest, MSG_TYPE_COMMIT, seq, slot->prepare_cert.digest);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// View changes
+
+#define VIEW_CHANGE_SIZE(count) ((uint32_t)(sizeof(tinybft_view_change_t) + (count) * sizeof(tinybft_view_change_entry_t)))
+#define NEW_VIEW_SIZE(count) ((uint32_t)(sizeof(tinybft_new_view_t) + (count) * TINYBFT_DIGEST_SIZE))
+
+_Static_assert(VIEW_CHANGE_SIZE(TINYBFT_WINDOW_SIZE) <= MAX_PAYLOAD, "VIEW-CHANGE for a full window exceeds TINYBFT_MAX_MSG_SIZE");
+_Static_assert(NEW_VIEW_SIZE(TINYBFT_WINDOW_SIZE) <= MAX_PAYLOAD, "NEW-VIEW for a full window exceeds TINYBFT_MAX_MSG_SIZE");
+
+// NEW-VIEW as decided locally: its payload and room for a full window of digests
+typedef struct {
+    tinybft_new_view_t nv;
+    uint8_t digests[TINYBFT_WINDOW_SIZE][TINYBFT_DIGEST_SIZE];
+} new_view_t;
+
+static void start_view_change(tinybft_replica_t* r, uint32_t view);
+static void start_view_timer(tinybft_replica_t* r);
+static void step_over(tinybft_replica_t* r, uint32_t view);
+
+// Digest of an empty batch, which fills a sequence number no certificate survived for
+static void null_digest(uint8_t digest[TINYBFT_DIGEST_SIZE]) {
+    tinybft_batch_t empty = { 0 };
+    tinybft_digest(&empty, sizeof(empty), digest);
+}
+
+static const tinybft_view_change_t* stored_view_change(tinybft_replica_t* r, uint32_t sender) {
+    const uint8_t* buf = r->memory.event_region.view_change_msgs[sender];
+    return stored_is(buf, MSG_TYPE_VIEW_CHANGE) ? (const tinybft_view_change_t*)(stored_msg(buf) + 1) : NULL;
+}
+
+// Replicas whose kept VIEW-CHANGE moves to view
+static uint32_t view_change_senders(tinybft_replica_t* r, uint32_t view) {
+    uint32_t senders = 0;
+    for (uint32_t i = 0; i < TINYBFT_MAX_REPLICAS; i++) {
+        if (stored_view_change(r, i) != NULL &&
+            stored_msg(r->memory.event_region.view_change_msgs[i])->view == view) {
+            senders |= 1u << i;
+        }
+    }
+    return senders;
+}
+
+static const tinybft_view_change_entry_t* view_change_entry(const tinybft_view_change_t* vc, uint32_t seq_num) {
+    const tinybft_view_change_entry_t* entries = (const tinybft_view_change_entry_t*)(vc + 1);
+    for (uint32_t i = 0; i < vc->count; i++) {
+        if (entries[i].seq_num == seq_num) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Decide what the VIEW-CHANGE messages of `senders` (the new primary among
+// them) carry into view. Instances start after the newest checkpoint f+1 of
+// them hold stable, or the primary's own if that is newer. Each sequence
+// number takes the digest prepared in the highest view that f+1 of them
+// pre-prepared in that view or later, so at least one correct replica
+// vouches for it; otherwise it stays empty.
+static void decide_new_view(tinybft_replica_t* r, uint32_t view, uint32_t senders, new_view_t* out) {
+    const tinybft_view_change_t* vcs[TINYBFT_MAX_REPLICAS];
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < TINYBFT_MAX_REPLICAS; i++) {
+        if (senders & (1u << i)) {
+            vcs[n++] = stored_view_change(r, i);
+        }
+    }
+
+    uint32_t low = stored_view_change(r, tinybft_primary(view))->low_watermark;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t at_least = 0;
+        for (uint32_t j = 0; j < n; j++) {
+            at_least += vcs[j]->low_watermark >= vcs[i]->low_watermark;
+        }
+        if (at_least >= TINYBFT_MAX_FAULTY + 1 && vcs[i]->low_watermark > low) {
+            low = vcs[i]->low_watermark;
+        }
+    }
+
+    out->nv.low_watermark = low;
+    out->nv.senders = senders;
+    out->nv.count = 0;
+    for (uint32_t k = 0; k < TINYBFT_WINDOW_SIZE; k++) {
+        const tinybft_view_change_entry_t* chosen = NULL;
+
+        for (uint32_t i = 0; i < n; i++) {
+            const tinybft_view_change_entry_t* e = view_change_entry(vcs[i], low + k + 1);
+            if (e == NULL || !e->prepared || (chosen != NULL && e->view <= chosen->view)) {
+                continue;
+            }
+            uint32_t support = 0;
+            for (uint32_t j = 0; j < n; j++) {
+                const tinybft_view_change_entry_t* other = view_change_entry(vcs[j], low + k + 1);
+                support += other != NULL && other->view >= e->view &&
+                           memcmp(other->digest, e->digest, TINYBFT_DIGEST_SIZE) == 0;
+            }
+            if (support >= TINYBFT_MAX_FAULTY + 1) {
+                chosen = e;
+            }
+        }
+
+        if (chosen != NULL) {
+            memcpy(out->digests[k], chosen->digest, TINYBFT_DIGEST_SIZE);
+            out->nv.count = k + 1;
+        } else {
+            null_digest(out->digests[k]);
+        }
+    }
+}
+
+// Enter view with the instances nv re-issues. Slots holding the decided
+// batch keep it; empty instances are filled locally; the primary sends the
+// other batches again. Instances this replica already executed are voted
+// for at once so that the others can commit them too.
+static void install_new_view(tinybft_replica_t* r, uint32_t view, const tinybft_new_view_t* nv) {
+    const uint8_t (*digests)[TINYBFT_DIGEST_SIZE] = (const uint8_t (*)[TINYBFT_DIGEST_SIZE])(nv + 1);
+    uint32_t last = nv->low_watermark + nv->count;
+    bool primary = tinybft_primary(view) == r->id;
+    uint8_t empty[TINYBFT_DIGEST_SIZE];
+
+    // Tentative batches stand as far as the new view re-issues them
+    for (uint32_t seq_num = r->last_executed + 1; seq_num <= r->last_executed + r->undo.count; seq_num++) {
+        const tinybft_agreement_slot_t* slot = tinybft_find_agreement_slot(&r->memory, seq_num);
+        if (seq_num <= nv->low_watermark || seq_num > last || slot == NULL ||
+            memcmp(slot->prepare_cert.digest, digests[seq_num - nv->low_watermark - 1], TINYBFT_DIGEST_SIZE) != 0) {
+            rollback_tentative(r, seq_num);
+            break;
+        }
+    }
+
+    null_digest(empty);
+    r->view = view;
+    r->view_changing = false;
+    r->view_changes++;
+    r->view_commit_ms = 0;
+    r->probe_seq = 0;
+
+    // Instances the NEW-VIEW does not carry are void
+    for (uint32_t i = 0; i < TINYBFT_WINDOW_SIZE; i++) {
+        tinybft_agreement_slot_t* slot = &r->memory.agreement_region.slots[i];
+        if (slot->seq_num > r->last_executed && (slot->seq_num <= nv->low_watermark || slot->seq_num > last)) {
+            memset(slot, 0, sizeof(*slot));
+        }
+    }
+    if (nv->low_watermark > r->last_executed && r->behind_since == 0) {
+        r->behind_since = r->now_ms;  // Behind the new view's checkpoint: fetch it
+    }
+
+    for (uint32_t seq_num = nv->low_watermark + 1; seq_num <= last; seq_num++) {
+        const uint8_t* digest = digests[seq_num - nv->low_watermark - 1];
+        tinybft_agreement_slot_t* slot = tinybft_find_agreement_slot(&r->memory, seq_num);
+        if (!tinybft_in_window(&r->memory, seq_num)) {
+            continue;
+        }
+
+        bool executed = seq_num <= r->last_executed;
+        bool null = memcmp(digest, empty, TINYBFT_DIGEST_SIZE) == 0;
+        bool kept = slot != NULL && stored_is(slot->prepare_cert.pre_prepare, MSG_TYPE_PRE_PREPARE) &&
+                    memcmp(slot->prepare_cert.digest, digest, TINYBFT_DIGEST_SIZE) == 0;
+        if (!kept) {
+            slot = tinybft_init_agreement_slot(&r->memory, seq_num);
+        }
+
+        tinybft_prepare_certificate_t* pc = &slot->prepare_cert;
+        tinybft_commit_certificate_t* cc = &slot->commit_cert;
+        tinybft_msg_header_t* pp = (tinybft_msg_header_t*)pc->pre_prepare;
+        pc->view = view;
+        pc->valid = executed;
+        pc->has_digest = true;
+        pc->fixed = true;
+        memcpy(pc->digest, digest, TINYBFT_DIGEST_SIZE);
+        memset(&pc->prepares, 0, sizeof(pc->prepares));
+        cc->view = view;
+        cc->valid = executed;
+        memset(&cc->commits, 0, sizeof(cc->commits));
+
+        if (!kept && null) {
+            ((tinybft_batch_t*)(pp + 1))->count = 0;
+            pp->type = MSG_TYPE_PRE_PREPARE;
+            pp->receiver_id = r->id;
+            pp->seq_num = seq_num;
+            pp->data_len = sizeof(tinybft_batch_t);
+            kept = true;
+        }
+        if (kept) {
+            pp->sender_id = tinybft_primary(view);
+            pp->view = view;
+            if (primary && !null) {
+                broadcast(r, pp, pp + 1);
+            }
+        } else if (!executed) {
+            continue;  // The primary's PRE-PREPARE brings the batch
+        }
+
+        // Votes need only the digest, so executed instances are voted for even without their batch
+        if (!primary) {
+            send_vote(r, MSG_TYPE_PREPARE, seq_num, digest, &pc->prepares);
+        }
+        if (executed) {
+            send_vote(r, MSG_TYPE_COMMIT, seq_num, digest, &cc->commits);
+        }
+    }
+
+    r->next_seq = (last > r->last_executed ? last : r->last_executed) + 1;
+    r->request_since = requests_waiting(r) ? r->now_ms : 0;
+    try_propose(r);
+}
+
+// New primary: once 2f+1 replicas, itself included, asked for the view,
+// announce it. It must hold every batch it re-issues; otherwise it leaves
+// the view to time out, or gives it up at once if it is behind.
+static void try_new_view(tinybft_replica_t* r) {
+    uint32_t senders = view_change_senders(r, r->view);
+
+    if (!r->view_changing || tinybft_primary(r->view) != r->id || (senders & (1u << r->id)) == 0 ||
+        (uint32_t)__builtin_popcount(senders) < TINYBFT_QUORUM) {
+        return;
+    }
+
+    tinybft_msg_header_t* msg = (tinybft_msg_header_t*)r->memory.event_region.new_view_msgs[r->id];
+    new_view_t* out = (new_view_t*)(msg + 1);
+    uint8_t empty[TINYBFT_DIGEST_SIZE];
+
+    decide_new_view(r, r->view, senders, out);
+    null_digest(empty);
+    for (uint32_t k = 0; k < out->nv.count; k++) {
+        uint32_t seq_num = out->nv.low_watermark + k + 1;
+        tinybft_agreement_slot_t* slot = tinybft_find_agreement_slot(&r->memory, seq_num);
+        if (!tinybft_in_window(&r->memory, seq_num) || memcmp(out->digests[k], empty, TINYBFT_DIGEST_SIZE) == 0) {
+            if (seq_num > r->memory.agreement_region.low_watermark + TINYBFT_WINDOW_SIZE) {
+                // Behind the others' checkpoint: fetch it and leave the view to the next primary
+                if (r->behind_since == 0) {
+                    r->behind_since = r->now_ms;
+                }
+                start_view_change(r, r->view + 1);
+                return;
+            }
+            continue;
+        }
+        if (slot == NULL || !stored_is(slot->prepare_cert.pre_prepare, MSG_TYPE_PRE_PREPARE) ||
+            memcmp(slot->prepare_cert.digest, out->digests[k], TINYBFT_DIGEST_SIZE) != 0) {
+            return;
+        }
+    }
+
+    msg->type = MSG_TYPE_NEW_VIEW;
+    msg->sender_id = r->id;
+    msg->view = r->view;
+    msg->seq_num = out->nv.low_watermark;
+    msg->data_len = NEW_VIEW_SIZE(out->nv.count);
+    broadcast(r, msg, out);
+    install_new_view(r, r->view, &out->nv);
+}
+
+// Backup: install a kept NEW-VIEW for our view or a later one once we hold
+// the VIEW-CHANGE messages it names and reach the same decision. One that
+// decided otherwise is dropped and the view times out. While a checkpoint is
+// fetched the view is the checkpoint's; the NEW-VIEW waits until it is in.
+static void try_install_new_view(tinybft_replica_t* r) {
+    if (r->transfer.active) {
+        return;
+    }
+    for (uint32_t p = 0; p < TINYBFT_MAX_REPLICAS; p++) {
+        uint8_t* buf = r->memory.event_region.new_view_msgs[p];
+        const tinybft_msg_header_t* msg = stored_msg(buf);
+        const tinybft_new_view_t* nv = (const tinybft_new_view_t*)(msg + 1);
+        new_view_t decided;
+
+        if (p == r->id || !stored_is(buf, MSG_TYPE_NEW_VIEW) || msg->view < r->view ||
+            (msg->view == r->view && !r->view_changing)) {
+            continue;
+        }
+        if ((nv->senders & ~view_change_senders(r, msg->view)) != 0) {
+            continue;  // Still missing some of its VIEW-CHANGE messages
+        }
+
+        decide_new_view(r, msg->view, nv->senders, &decided);
+        if (decided.nv.low_watermark != nv->low_watermark || decided.nv.count != nv->count ||
+            memcmp(decided.digests, nv + 1, nv->count * TINYBFT_DIGEST_SIZE) != 0) {
+            memset(buf, 0, HEADER_SIZE);
+            continue;
+        }
+        install_new_view(r, msg->view, nv);
+        return;
+    }
+}
+
+// VIEW-CHANGE: kept per sender, newest view only. f+1 replicas asking for
+// views past ours include a correct one, so we follow to the lowest of them,
+// and at once when the primary of the view we change to asks for the next.
+// One asking for a view we already installed, or an earlier one, missed
+// messages of the view change: it gets ours again. A resent one we already
+// hold is checked against these rules again, as we may have been unable to
+// follow when it first came.
+static void handle_view_change(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    const tinybft_view_change_t* vc = (const tinybft_view_change_t*)(msg + 1);
+    uint8_t* buf = r->memory.event_region.view_change_msgs[msg->sender_id];
+
+    if (msg->data_len < sizeof(*vc) || vc->count > TINYBFT_WINDOW_SIZE || msg->data_len != VIEW_CHANGE_SIZE(vc->count) ||
+        msg->sender_id == r->id) {
+        return;
+    }
+    if (msg->view < r->view || (msg->view == r->view && !r->view_changing)) {
+        resend_view(r, msg->sender_id);
+        return;
+    }
+    if (!stored_is(buf, MSG_TYPE_VIEW_CHANGE) || stored_msg(buf)->view < msg->view) {
+        keep_msg(r, buf, msg);
+        start_view_timer(r);
+    }
+
+    if (r->transfer.active) {
+        // The view is the checkpoint's until it is installed; only our turn as
+        // primary, once f+1 replicas ask for it, needs an answer
+        if ((uint32_t)__builtin_popcount(view_change_senders(r, msg->view)) >= TINYBFT_MAX_FAULTY + 1) {
+            step_over(r, msg->view);
+        }
+        return;
+    }
+    if (r->view_changing && msg->view == r->view + 1 && msg->sender_id == tinybft_primary(r->view)) {
+        start_view_change(r, msg->view);  // The primary of our view gives it up
+        return;
+    }
+
+    uint32_t ahead = 0;
+    uint32_t lowest = UINT32_MAX;
+    for (uint32_t i = 0; i < TINYBFT_MAX_REPLICAS; i++) {
+        const uint8_t* other = r->memory.event_region.view_change_msgs[i];
+        if (stored_view_change(r, i) != NULL && stored_msg(other)->view > r->view) {
+            ahead++;
+            lowest = stored_msg(other)->view < lowest ? stored_msg(other)->view : lowest;
+        }
+    }
+    if (ahead >= TINYBFT_MAX_FAULTY + 1) {
+        start_view_change(r, lowest);
+        return;
+    }
+
+    try_new_view(r);
+    try_install_new_view(r);
+}
+
+// NEW-VIEW: kept per primary, newest view only
+static void handle_new_view(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    const tinybft_new_view_t* nv = (const tinybft_new_view_t*)(msg + 1);
+    uint8_t* buf = r->memory.event_region.new_view_msgs[msg->sender_id];
+
+    if (msg->data_len < sizeof(*nv) || nv->count > TINYBFT_WINDOW_SIZE || msg->data_len != NEW_VIEW_SIZE(nv->count) ||
+        msg->sender_id != tinybft_primary(msg->view) || msg->sender_id == r->id ||
+        (uint32_t)__builtin_popcount(nv->senders) < TINYBFT_QUORUM || (nv->senders & (1u << msg->sender_id)) == 0 ||
+        msg->view < r->view || (msg->view == r->view && !r->view_changing) ||
+        (stored_is(buf, MSG_TYPE_NEW_VIEW) && stored_msg(buf)->view > msg->view)) {
+        return;
+    }
+    keep_msg(r, buf, msg);
+    try_install_new_view(r);
+}
+
+// The timer of a view change runs once 2f+1 replicas, this one included,
+// ask for the view. A replica that got ahead of the others waits for them
+// there rather than moving further on, which would keep it out of step.
+static void start_view_timer(tinybft_replica_t* r) {
+    uint32_t senders = view_change_senders(r, r->view);
+
+    if (r->view_changing && r->view_change_since == 0 && (senders & (1u << r->id)) != 0 &&
+        (uint32_t)__builtin_popcount(senders) >= TINYBFT_QUORUM) {
+        r->view_change_since = r->now_ms;
+    }
+}
+
+// Ask for view: report the instances of our window that hold a PRE-PREPARE.
+// The message is built in place in our own VIEW-CHANGE buffer.
+static void send_view_change(tinybft_replica_t* r, uint32_t view) {
+    tinybft_agreement_region_t* ar = &r->memory.agreement_region;
+    tinybft_msg_header_t* msg = (tinybft_msg_header_t*)r->memory.event_region.view_change_msgs[r->id];
+    tinybft_view_change_t* vc = (tinybft_view_change_t*)(msg + 1);
+    tinybft_view_change_entry_t* entries = (tinybft_view_change_entry_t*)(vc + 1);
+
+    vc->low_watermark = ar->low_watermark;
+    vc->count = 0;
+    for (uint32_t i = 0; i < TINYBFT_WINDOW_SIZE; i++) {
+        const tinybft_agreement_slot_t* slot = &ar->slots[i];
+        if (slot->seq_num == 0 || !stored_is(slot->prepare_cert.pre_prepare, MSG_TYPE_PRE_PREPARE)) {
+            continue;
+        }
+        tinybft_view_change_entry_t* e = &entries[vc->count++];
+        e->seq_num = slot->seq_num;
+        e->view = stored_msg(slot->prepare_cert.pre_prepare)->view;
+        e->prepared = slot->prepare_cert.valid;
+        memcpy(e->digest, slot->prepare_cert.digest, TINYBFT_DIGEST_SIZE);
+    }
+
+    msg->type = MSG_TYPE_VIEW_CHANGE;
+    msg->sender_id = r->id;
+    msg->view = view;
+    msg->seq_num = ar->low_watermark;
+    msg->data_len = VIEW_CHANGE_SIZE(vc->count);
+    broadcast(r, msg, vc);
+    r->view_change_sent = r->now_ms;
+}
+
+// Move on to view and ask the others for it
+static void start_view_change(tinybft_replica_t* r, uint32_t view) {
+    r->view = view;
+    r->view_changing = true;
+    r->view_change_since = 0;
+    r->failed_views++;
+    r->request_since = 0;
+    r->probe_seq = 0;
+    send_view_change(r, view);
+    start_view_timer(r);
+
+    try_new_view(r);
+    try_install_new_view(r);
+}
+
+// We are asked to lead view while fetching a checkpoint, which we cannot:
+// give the view up at once rather than let the others time out on it
+static void step_over(tinybft_replica_t* r, uint32_t view) {
+    const uint8_t* own = r->memory.event_region.view_change_msgs[r->id];
+
+    if (tinybft_primary(view) != r->id || (stored_is(own, MSG_TYPE_VIEW_CHANGE) && stored_msg(own)->view > view)) {
+        return;
+    }
+    send_view_change(r, view + 1);
+}
+
+// A request waited a timeout without any execution, or a view change took
+// one, counted from its quorum, without its NEW-VIEW: move on to the next
+// view. Until then a pending VIEW-CHANGE is sent again every minimum
+// timeout, as any of it may have been lost. A replica that knows it lags
+// behind the others does not blame the primary.
+static void check_view_timers(tinybft_replica_t* r) {
+    uint64_t since = r->view_changing ? r->view_change_since : r->request_since;
+    uint8_t* own = r->memory.event_region.view_change_msgs[r->id];
+
+    if (r->transfer.active || r->behind_since != 0) {
+        return;
+    }
+    if (since != 0 && r->now_ms - since >= tinybft_view_timeout(r)) {
+        start_view_change(r, r->view + 1);
+    } else if (r->view_changing && r->now_ms - r->view_change_sent >= TINYBFT_VIEW_TIMEOUT_MIN_MS &&
+               stored_is(own, MSG_TYPE_VIEW_CHANGE) && stored_msg(own)->view == r->view) {
+        broadcast(r, (tinybft_msg_header_t*)own, stored_msg(own) + 1);
+        r->view_change_sent = r->now_ms;
+    }
+}
+
+// A message that cannot be used yet is offered again later, except while a
+// checkpoint is fetched: the transfer responses queued behind it must get
+// through. Nor while its sender resends the instances after the checkpoint:
+// those queued behind it supersede it.
+static bool can_defer(const tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    return !r->transfer.active &&
+           (msg->sender_id >= TINYBFT_MAX_REPLICAS || (r->transfer.resending & (1u << msg->sender_id)) == 0);
+}
+
+static bool handle_msg(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    if (msg->data_len > MAX_PAYLOAD || msg->sender_id >= TINYBFT_MAX_ENDPOINTS) {
+        return true;  // Malformed, drop
+    }
+
+    if (msg->type == MSG_TYPE_REQUEST) {
+        if (valid_request(msg)) {
+            if (read_only(msg)) {
+                handle_read_only(r, msg);
+            } else {
+                handle_request(r, msg);
+            }
+        }
+        return true;
+    }
+
+    if (msg->sender_id >= TINYBFT_MAX_REPLICAS) {
+        return true;
+    }
+
+    if (msg->type == MSG_TYPE_STATE_TRANSFER_REQ) {
+        tinybft_transfer_handle_req(r, msg);
+        return true;
+    }
+    if (msg->type == MSG_TYPE_STATE_TRANSFER_RESP) {
+        tinybft_transfer_handle_resp(r, msg);
+        return true;
+    }
+
+    if (msg->type == MSG_TYPE_VIEW_CHANGE) {
+        handle_view_change(r, msg);
+        return true;
+    }
+    if (msg->type == MSG_TYPE_NEW_VIEW) {
+        handle_new_view(r, msg);
+        return true;
+    }
+    // Agreement is moot until a transfer settles on a checkpoint; from then
+    // on the window starts there
+    if (r->transfer.active && !r->transfer.fetching) {
+        return true;
+    }
+    if (msg->type == MSG_TYPE_CHECKPOINT) {
+        return handle_checkpoint(r, msg);
+    }
+    if (msg->view < r->view) {
+        resend_view(r, msg->sender_id);  // From an earlier view: its sender missed our view change
+        return true;
+    }
+
+    // Only sequence numbers between the watermarks can be held
+    if (!tinybft_in_window(&r->memory, msg->seq_num) && msg->seq_num > r->last_executed) {
+        if (r->behind_since == 0) {
+            r->behind_since = r->now_ms;  // Lag detection starts (needs ticks)
+        }
+        if (msg->seq_num - r->memory.agreement_region.low_watermark > 2 * TINYBFT_WINDOW_SIZE) {
+            return true;  // The sender dropped the instances in between, in whatever view: only a transfer catches up
+        }
+    }
+    if (msg->view > r->view || r->view_changing) {
+        return !can_defer(r, msg);  // The new view's instances wait for its NEW-VIEW
+    }
+    if (msg->seq_num <= r->last_executed) {
+        return true;  // Already executed
+    }
+    if (!tinybft_in_window(&r->memory, msg->seq_num)) {
+        return !can_defer(r, msg);  // Above the high watermark, retry once the window advances
+    }
+
+    tinybft_agreement_slot_t* slot;
+    switch (msg->type) {
+        case MSG_TYPE_PRE_PREPARE: {
+            if (msg->sender_id != tinybft_primary(r->view) || !valid_batch(msg)) {
+                return true;
+            }
+            slot = window_slot(r, msg->seq_num);
+            if (slot->prepare_cert.pre_prepare != (const uint8_t*)msg &&
+                stored_is(slot->prepare_cert.pre_prepare, MSG_TYPE_PRE_PREPARE)) {
+                return true;  // Duplicate
+            }
+            if (!accept_pre_prepare(r, slot, msg)) {
+                return true;
+            }
+            send_vote(r, MSG_TYPE_PREPARE, msg->seq_num, slot->prepare_cert.digest, &slot->prepare_cert.prepares);
+            break;
+        }
+        case MSG_TYPE_PREPARE:
+        case MSG_TYPE_COMMIT:
+            if (msg->data_len != TINYBFT_DIGEST_SIZE) {
+                return true;
+            }
+            slot = window_slot(r, msg->seq_num);
+            if (!slot->prepare_cert.has_digest) {
+                return !can_defer(r, msg);  // Wait for the PRE-PREPARE
+            }
+            if (!matches_digest(&slot->prepare_cert, (const uint8_t*)(msg + 1))) {
+                return true;  // Vote for a different request
+            }
+            add_vote(msg->type == MSG_TYPE_PREPARE ? &slot->prepare_cert.prepares : &slot->commit_cert.commits,
+                     msg->sender_id, vote_auth(r, msg));
+            break;
+        default:
+            return true;
+    }
+
+    check_progress(r, slot);
+    return true;
+}
@@ -0,0 +1,397 @@
+#ifndef TINYBFT_PBFT_H
+#define TINYBFT_PBFT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory_layout.h"
+#include "auth.h"
+
+// Event-driven PBFT replica core. The core never blocks and owns no threads:
+// a runtime feeds it messages through tinybft_replica_handle() and carries
+// its outgoing messages through the send callback.
+
+#define TINYBFT_QUORUM (2 * TINYBFT_MAX_FAULTY + 1)
+
+#ifndef TINYBFT_MAX_BATCH
+#define TINYBFT_MAX_BATCH 32  // Maximum client requests ordered by one PRE-PREPARE
+#endif
+
+// Endpoints 0..TINYBFT_MAX_REPLICAS-1 are replicas, the rest are clients
+#define TINYBFT_MAX_ENDPOINTS (TINYBFT_MAX_REPLICAS + TINYBFT_MAX_CLIENTS)
+#define TINYBFT_CLIENT_ENDPOINT(client) (TINYBFT_MAX_REPLICAS + (client))
+#define TINYBFT_ALL_REPLICAS UINT32_MAX  // receiver_id of a message multicast to every replica
+
+// Operations carried by client requests
+typedef enum {
+    TINYBFT_OP_PUT = 0,
+    TINYBFT_OP_GET
+} tinybft_op_t;
+
+// Request flags
+#define TINYBFT_REQUEST_READ_ONLY 0x1u  // Sent to every replica and answered without ordering
+
+// Client request (payload of MSG_TYPE_REQUEST, batched in MSG_TYPE_PRE_PREPARE)
+typedef struct {
+    uint32_t client_id;   // Endpoint of the issuing client
+    uint32_t timestamp;   // Client-assigned, increases with every request
+    uint8_t op;
+    uint8_t key_len;
+    uint16_t value_len;
+    uint32_t flags;       // TINYBFT_REQUEST_* bits
+    // Key bytes followed by value bytes
+} tinybft_request_t;
+
+// Batch of client requests (payload of MSG_TYPE_PRE_PREPARE)
+typedef struct {
+    uint32_t count;
+    // count requests follow, each padded to a multiple of 4 bytes
+} tinybft_batch_t;
+
+#define TINYBFT_BATCH_ALIGN(len) (((len) + 3u) & ~3u)
+
+// Reply flags
+#define TINYBFT_REPLY_TENTATIVE 0x1u  // Executed before its batch committed (see tinybft_undo_t)
+
+// Reply to a client (payload of MSG_TYPE_REPLY)
+typedef struct {
+    uint32_t client_id;
+    uint32_t timestamp;
+    uint32_t flags;       // TINYBFT_REPLY_* bits
+    uint32_t result_len;
+    // Result bytes follow
+} tinybft_reply_t;
+
+// State transfer. A replica that falls behind the window fetches the
+// partition tree of a recent checkpoint top-down from the other replicas and
+// only downloads the blocks whose hashes differ from its own.
+#ifndef TINYBFT_TRANSFER_TIMEOUT_MS
+#define TINYBFT_TRANSFER_TIMEOUT_MS 20  // Lag detection, and the longest wait between resends
+#endif
+
+#ifndef TINYBFT_TRANSFER_RETRY_MS
+#define TINYBFT_TRANSFER_RETRY_MS 5  // First resend of an unanswered request, doubling up to the timeout
+#endif
+
+#ifndef TINYBFT_TRANSFER_ENTRIES
+#define TINYBFT_TRANSFER_ENTRIES 256  // Tree nodes and blocks queued for fetching
+#endif
+
+#define TINYBFT_TRANSFER_INFLIGHT 8  // Requests outstanding at once
+#define TINYBFT_TRANSFER_FANOUT 16   // Descendants returned by one NODES request
+
+typedef enum {
+    TINYBFT_TRANSFER_META = 0,  // Checkpoint sequence number, root and client timestamps
+    TINYBFT_TRANSFER_NODES,     // Hashes of the descendants of a node, 4 levels down
+    TINYBFT_TRANSFER_BLOCK,     // Contents of a state block
+    TINYBFT_TRANSFER_INSTANCES  // The responder's agreement messages for the instances after the checkpoint
+} tinybft_transfer_kind_t;
+
+// Payload of MSG_TYPE_STATE_TRANSFER_REQ. The header's seq_num names the
+// checkpoint, or for META the oldest checkpoint the requester accepts.
+// INSTANCES is answered with ordinary agreement messages, then an empty
+// response.
+typedef struct {
+    uint32_t kind;
+    uint32_t index;  // Tree node (NODES) or block (BLOCK)
+} tinybft_transfer_req_t;
+
+// Payload of MSG_TYPE_STATE_TRANSFER_RESP, followed by len bytes. A META
+// response to a NODES or BLOCK request means the checkpoint is gone.
+typedef struct {
+    uint32_t kind;
+    uint32_t index;   // First node returned (NODES) or block (BLOCK)
+    uint32_t offset;  // Position of the bytes within the block (BLOCK)
+    uint32_t len;
+} tinybft_transfer_resp_t;
+
+typedef struct {
+    uint8_t root[TINYBFT_DIGEST_SIZE];
+    uint32_t view;  // View the checkpoint was taken in; a replica that fetches it joins that view
+    uint32_t client_timestamp[TINYBFT_MAX_CLIENTS];
+} tinybft_transfer_meta_t;
+
+typedef struct {
+    uint32_t index;  // Tree node; leaves stand for their block
+    uint8_t hash[TINYBFT_DIGEST_SIZE];  // Verified hash the fetched data must match
+    uint8_t status;
+    uint32_t source;
+    uint8_t* block;  // Scratch buffer assembling a block
+    uint32_t received;
+    uint64_t sent_ms;  // Last request for it, for resends
+    uint32_t tries;
+} tinybft_transfer_entry_t;
+
+typedef struct {
+    // Requester side
+    bool active;
+    bool fetching;        // Past the META phase, target chosen
+    uint64_t activity_ms; // Last useful response
+    uint64_t meta_sent_ms; // Last META request to the replicas yet to answer, for resends
+    uint32_t meta_tries;
+    uint32_t metas_from;  // Replicas whose META is in metas[]
+    uint32_t meta_seq[TINYBFT_MAX_REPLICAS];
+    tinybft_transfer_meta_t metas[TINYBFT_MAX_REPLICAS];
+    uint32_t asked_seq;   // Newest checkpoint asked of lagging responders
+    uint32_t target_seq;
+    tinybft_transfer_meta_t target;
+    uint32_t sources;     // Replicas that vouched for the target
+    uint32_t next_source;
+    uint32_t inflight;
+    tinybft_transfer_entry_t entries[TINYBFT_TRANSFER_ENTRIES];
+    uint32_t resending;   // Replicas yet to finish resending the instances after the installed checkpoint
+    uint64_t asked_ms;    // Instances after our stable checkpoint last asked for again, before a transfer
+
+    // Responder side
+    uint32_t waiters;     // Replicas waiting for a checkpoint of at least wait_seq
+    uint32_t wait_seq;
+    uint64_t served_ms;   // Last request served from the pinned snapshot
+} tinybft_transfer_t;
+
+// View changes. Every replica keeps the ordered requests clients send it
+// and times them: one that waits longer than the view timeout without any
+// execution makes the replica send VIEW-CHANGE for the next view, reporting
+// its last stable checkpoint and the instances it pre-prepared or prepared.
+// The new primary decides the next view from 2f+1 VIEW-CHANGE messages and
+// re-issues the instances in NEW-VIEW; backups redo the decision from the
+// same messages before installing it. The timeout follows the measured
+// commit latency and doubles with every view change that commits nothing; a
+// view change is timed from when 2f+1 replicas ask for it. A pending
+// VIEW-CHANGE is resent until its NEW-VIEW arrives, and messages from an
+// earlier view are answered with the VIEW-CHANGE (and NEW-VIEW) of ours.
+#ifndef TINYBFT_VIEW_TIMEOUT_MIN_MS
+#define TINYBFT_VIEW_TIMEOUT_MIN_MS 10
+#endif
+
+#ifndef TINYBFT_VIEW_TIMEOUT_MAX_MS
+#define TINYBFT_VIEW_TIMEOUT_MAX_MS 1000
+#endif
+
+// Instance reported by a VIEW-CHANGE: a slot of the sender's window that
+// holds a PRE-PREPARE
+typedef struct {
+    uint32_t seq_num;
+    uint32_t view;      // View of the PRE-PREPARE
+    uint32_t prepared;  // The sender collected a prepare certificate for it
+    uint8_t digest[TINYBFT_DIGEST_SIZE];
+} tinybft_view_change_entry_t;
+
+// Payload of MSG_TYPE_VIEW_CHANGE; the header's view is the one moved to
+typedef struct {
+    uint32_t low_watermark;  // Sender's last stable checkpoint
+    uint32_t count;
+    // count tinybft_view_change_entry_t follow
+} tinybft_view_change_t;
+
+// Payload of MSG_TYPE_NEW_VIEW
+typedef struct {
+    uint32_t low_watermark;  // Instances are re-issued from the next sequence number on
+    uint32_t senders;        // Replicas whose VIEW-CHANGE messages decided them
+    uint32_t count;
+    // count digests follow, one per sequence number; an empty batch's digest
+    // fills one no certificate survived for
+} tinybft_new_view_t;
+
+// Tentative execution. A replica that has it enabled executes each batch as
+// soon as it is prepared and all batches before it have executed, committed
+// or not, and marks its replies TINYBFT_REPLY_TENTATIVE; a client accepts
+// 2f+1 matching tentative replies, or f+1 committed ones. Replies cached for
+// retransmission lose the mark once their batch commits. The state bytes a
+// tentative batch overwrites are logged first: they are swapped back in to
+// checkpoint the committed state, and written back for good if a NEW-VIEW
+// does not re-issue the batch. Should the log run out of room when it is
+// needed, the replica fetches a later checkpoint instead.
+#ifndef TINYBFT_UNDO_SIZE
+#define TINYBFT_UNDO_SIZE (8 * 1024)  // Bytes of undo log, a power of two
+#endif
+
+_Static_assert(TINYBFT_UNDO_SIZE >= 64 && (TINYBFT_UNDO_SIZE & (TINYBFT_UNDO_SIZE - 1)) == 0,
+               "TINYBFT_UNDO_SIZE must be a power of two of at least 64");
+
+// Where a tentative batch's records start, and what it changed besides the state
+typedef struct {
+    uint32_t start;
+    uint64_t executed;
+    uint32_t client_timestamp[TINYBFT_MAX_CLIENTS];  // As before the batch ran
+} tinybft_undo_mark_t;
+
+typedef struct {
+    uint32_t count;       // Batches after last_executed that ran tentatively
+    bool recording;       // Log the writes reported through tinybft_replica_modify()
+    bool overflow;        // A write of the newest batch did not fit the log
+    bool lost;            // The log was needed after an overflow: the state waits for a transfer
+    uint32_t head;        // Log positions, modulo TINYBFT_UNDO_SIZE; records of tentative batches lie in [tail, head)
+    uint32_t tail;
+    tinybft_undo_mark_t marks[TINYBFT_WINDOW_SIZE];  // Batch seq_num at seq_num % TINYBFT_WINDOW_SIZE
+    uint8_t log[TINYBFT_UNDO_SIZE];  // Overwritten bytes, each run between two copies of its offset and length
+} tinybft_undo_t;
+
+// Carries a message (header followed by header->data_len payload bytes) to
+// dest. Messages to replicas carry a TINYBFT_AUTHENTICATOR_SIZE-byte
+// authenticator that travels after the payload; it is NULL for clients.
+typedef void (*tinybft_send_fn)(void* ctx, uint32_t dest, const tinybft_msg_header_t* hdr, const void* payload,
+                                const uint8_t* authenticator);
+
+// Applies a committed request to the application; returns the result length.
+// Requests flagged TINYBFT_REQUEST_READ_ONLY run against the current state
+// and must leave it unchanged.
+typedef uint32_t (*tinybft_execute_fn)(void* app, const tinybft_request_t* req, uint8_t* result, uint32_t result_cap);
+
+// Parallel execution. Within a batch, requests on different keys commute
+// unless one of them changes the layout of the state (e.g. inserts into a
+// hash table). The access callback classifies a request against the current
+// state and names its key by a hash; equal hashes conflict. Between two
+// TINYBFT_ACCESS_EXCLUSIVE requests, the requests of each key hash form a
+// task that runs in batch order, and the tasks run concurrently through
+// the parallel callback. Execute callbacks then run on several threads at
+// once, and their tinybft_replica_modify() calls are serialized.
+typedef enum {
+    TINYBFT_ACCESS_READ,       // Reads the state under *key
+    TINYBFT_ACCESS_WRITE,      // Reads and writes the state under *key only
+    TINYBFT_ACCESS_EXCLUSIVE   // May touch anything: runs alone
+} tinybft_access_t;
+
+typedef tinybft_access_t (*tinybft_access_fn)(void* app, const tinybft_request_t* req, uint32_t* key);
+
+// Runs task(arg, i) for every i < count, concurrently and in any order, and
+// returns once all have finished
+typedef void (*tinybft_task_fn)(void* arg, uint32_t task);
+typedef void (*tinybft_parallel_fn)(void* ctx, uint32_t count, tinybft_task_fn task, void* arg);
+
+// Protocol state of one replica
+typedef struct {
+    uint32_t id;
+    uint32_t view;
+    uint32_t next_seq;       // Next sequence number to assign (primary only)
+    uint32_t last_executed;  // Highest sequence number executed so far
+    uint64_t committed;      // Agreement instances committed locally
+    uint64_t executed;       // Client requests executed locally
+    uint64_t reads;          // Read-only requests answered without ordering
+    uint64_t tentative;      // Batches executed before they committed
+    uint64_t rollbacks;      // Tentative batches undone by a view change
+    uint64_t parallel_runs;  // Groups of conflict-free tasks handed to the parallel callback
+    uint64_t parallel_tasks; // Tasks in those groups
+    uint64_t checkpoints;        // Checkpoints taken locally
+    uint64_t checkpoint_blocks;  // State blocks rehashed by those checkpoints
+    uint64_t stable_checkpoints; // Checkpoints that 2f+1 replicas confirmed
+    uint32_t batch_size;     // Maximum requests per PRE-PREPARE (primary only)
+    uint32_t pipeline_depth; // Maximum instances in flight, at most the window (primary only)
+    uint32_t next_client;    // Round-robin start for batching (primary only)
+    bool tentative_execution;  // Execute prepared batches ahead of their commit
+    uint32_t client_timestamp[TINYBFT_MAX_CLIENTS];  // Last executed per client
+    uint64_t now_ms;         // Time of the last tick
+    uint64_t behind_since;   // Messages above the window waiting since then without progress (0 = none)
+    uint64_t transfers;       // State transfers completed
+    uint64_t transfer_blocks; // State blocks fetched by them
+    uint64_t received[TINYBFT_MSG_TYPES];      // Messages handled, by type
+    uint64_t copied_bytes[TINYBFT_MSG_TYPES];  // Bytes of them copied after reception
+    uint64_t forged;          // Messages from replicas whose authenticator entry did not verify
+    bool view_changing;       // Sent VIEW-CHANGE for view; its NEW-VIEW is not installed yet
+    uint64_t request_since;   // A client request has waited for execution since then (0 = none)
+    uint64_t view_change_since; // 2f+1 replicas asked for the pending view change since then (0 = not yet)
+    uint64_t view_change_sent;  // Our VIEW-CHANGE for it was last sent then
+    uint32_t failed_views;    // View changes since a view last made progress, each doubling the timeout
+    uint32_t probe_seq;       // Instance whose commit latency is being measured (0 = none)
+    uint64_t probe_start;
+    uint32_t commit_avg_us;   // Smoothed commit latency and its mean deviation
+    uint32_t commit_dev_us;
+    uint64_t view_changes;    // NEW-VIEWs installed
+    uint64_t view_commit_ms;  // First commit in the current view (0 = none yet)
+    const tinybft_msg_header_t* receiving;     // Message being handled, until the replica keeps it
+    tinybft_transfer_t transfer;
+    tinybft_undo_t undo;
+    tinybft_auth_t auth;
+    tinybft_memory_t memory;
+
+    tinybft_send_fn send;
+    void* send_ctx;
+    tinybft_execute_fn execute;
+    void* app;
+    tinybft_access_fn access;      // NULL: execute serially
+    tinybft_parallel_fn parallel;
+    void* parallel_ctx;
+    bool modify_lock;              // Held by a tinybft_replica_modify() during parallel execution
+    bool executing_parallel;
+} tinybft_replica_t;
+
+void tinybft_replica_init(tinybft_replica_t* r, uint32_t id,
+                          tinybft_send_fn send, void* send_ctx,
+                          tinybft_execute_fn execute, void* app);
+
+// Limit the number of client requests packed into one PRE-PREPARE
+void tinybft_replica_set_batch_size(tinybft_replica_t* r, uint32_t batch_size);
+
+// Limit the number of agreement instances the primary keeps in flight
+void tinybft_replica_set_pipeline_depth(tinybft_replica_t* r, uint32_t depth);
+
+// Execute each prepared batch ahead of its commit, with tentative replies
+void tinybft_replica_set_tentative(tinybft_replica_t* r, bool tentative);
+
+// Execute non-conflicting requests of a batch concurrently (see
+// tinybft_access_t); access NULL returns to serial execution
+void tinybft_replica_set_parallel(tinybft_replica_t* r, tinybft_access_fn access, tinybft_parallel_fn parallel,
+                                  void* ctx);
+
+// Register the application state covered by checkpoints (at most
+// TINYBFT_MAX_STATE_SIZE bytes). The execute callback must report every
+// write to it through tinybft_replica_modify() before making it; state
+// transfer overwrites it directly.
+void tinybft_replica_set_state(tinybft_replica_t* r, void* state, uint32_t size);
+void tinybft_replica_modify(tinybft_replica_t* r, const void* addr, uint32_t len);
+
+// Keep the agreement, checkpoint and event regions and the application state
+// (page-aligned, see tinybft_memory_set_nvm) in the file at path, synced at
+// every checkpoint. Call after tinybft_replica_init() instead of
+// tinybft_replica_set_state(). Returns true if the replica resumed from the
+// checkpoint kept in the file; otherwise the caller reinitializes the state
+// and registers it with tinybft_replica_set_state() as usual.
+bool tinybft_replica_open_nvm(tinybft_replica_t* r, const char* path, void* state, uint32_t size);
+
+// Checkpoint everything executed so far and seal the file
+void tinybft_replica_close_nvm(tinybft_replica_t* r);
+
+// Install the session keys shared with another replica: out_key
+// authenticates messages to it, in_key messages from it
+void tinybft_replica_set_keys(tinybft_replica_t* r, uint32_t peer, const uint8_t out_key[TINYBFT_AUTH_KEY_SIZE],
+                              const uint8_t in_key[TINYBFT_AUTH_KEY_SIZE]);
+
+// Check the authenticators of messages from replicas, each followed by its
+// authenticator, in one batch. Only messages that verified may be passed to
+// tinybft_replica_handle(); the others are dropped and counted as forged.
+void tinybft_replica_verify(tinybft_replica_t* r, const tinybft_msg_header_t* const msgs[], uint32_t count,
+                            bool valid[]);
+
+// Advance the replica's clock; drives lag detection, transfer retries and
+// the view-change timers
+void tinybft_replica_tick(tinybft_replica_t* r, uint64_t now_ms);
+
+// Milliseconds a request may wait for execution before the replica moves to
+// the next view (and a view change may take before it moves on again)
+uint32_t tinybft_view_timeout(const tinybft_replica_t* r);
+
+// Where the runtime should receive msg, still in its transport buffer, so the
+// replica keeps it without copying (see tinybft_msg_location), or NULL to
+// hand it over where it is. The runtime copies the whole message there and
+// passes that copy to tinybft_replica_handle().
+uint8_t* tinybft_replica_recv_buffer(tinybft_replica_t* r, const tinybft_msg_header_t* msg);
+
+// Process one message; returns false if the message cannot be processed yet
+// and should be offered again later (the runtime must not drop it)
+bool tinybft_replica_handle(tinybft_replica_t* r, const tinybft_msg_header_t* msg);
+
+uint32_t tinybft_primary(uint32_t view);
+void tinybft_digest(const void* data, uint32_t len, uint8_t digest[TINYBFT_DIGEST_SIZE]);
+
+// Request layout helpers
+static inline const char* tinybft_request_key(const tinybft_request_t* req) {
+    return (const char*)(req + 1);
+}
+
+static inline const char* tinybft_request_value(const tinybft_request_t* req) {
+    return (const char*)(req + 1) + req->key_len;
+}
+
+static inline uint32_t tinybft_request_size(const tinybft_request_t* req) {
+    return (uint32_t)sizeof(*req) + req->key_len + req->value_len;
+}
+
+#endif // TINYBFT_PBFT_H
@@ -0,0 +1,246 @@
+#include "replica.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+// Global state
+replica_t replicas[NUM_REPLICAS];
+int current_seq = 0;
+int current_view = 0;
+bool pipeline_verbose = true;
+
+// Print protocol progress unless running silently
+static void log_phase(const char* fmt, ...) {
+    if (!pipeline_verbose) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+// Initialize system
+void initialize_system() {
+    // Initialize replicas
+    for (int i = 0; i < NUM_REPLICAS; i++) {
+        replicas[i].id = i;
+        replicas[i].view = 0;
+        replicas[i].seq_num = 0;
+        replicas[i].is_primary = (i == get_primary_for_view(0));
+        replicas[i].is_faulty = false;
+
+        // Clear key-value store
+        tinybft_kv_init(&replicas[i].kv_store);
+    }
+
+    // Initialize sequence number and view
+    current_seq = 0;
+    current_view = 0;
+}
+
+// Set replica faulty status
+void set_replica_faulty(int replica_id, bool faulty) {
+    if (replica_id >= 0 && replica_id < NUM_REPLICAS) {
+        replicas[replica_id].is_faulty = faulty;
+    }
+}
+
+// Check if replica is primary
+bool is_primary(int replica_id) {
+    return replicas[replica_id].is_primary;
+}
+
+// Get primary for view
+int get_primary_for_view(int view) {
+    return view % NUM_REPLICAS;
+}
+
+// A faulty primary never orders the request: the backups' timers expire,
+// they move to the next view, and the view changes again until its primary
+// is correct. Returns true if the view changed.
+bool simulate_view_change(void) {
+    int view = current_view;
+
+    while (replicas[get_primary_for_view(view)].is_faulty && view - current_view < NUM_REPLICAS) {
+        view++;
+    }
+    if (view == current_view || view - current_view == NUM_REPLICAS) {
+        return false;
+    }
+
+    log_phase("0. VIEW CHANGE:\n");
+    log_phase("   Primary (Replica %d) is faulty; the request times out at the backups\n",
+              get_primary_for_view(current_view));
+    for (int v = current_view + 1; v <= view; v++) {
+        log_phase("   Replicas broadcast VIEW-CHANGE for view %d (primary: Replica %d%s)\n", v,
+                  get_primary_for_view(v), replicas[get_primary_for_view(v)].is_faulty ? ", FAULTY" : "");
+    }
+    log_phase("   Replica %d collects 2f+1=%d VIEW-CHANGEs and broadcasts NEW-VIEW for view %d\n",
+              get_primary_for_view(view), 2 * FAULTY_THRESHOLD + 1, view);
+    log_phase("   Prepared requests are carried over; the client retries with the new primary\n\n");
+
+    current_view = view;
+    for (int i = 0; i < NUM_REPLICAS; i++) {
+        replicas[i].view = view;
+        replicas[i].is_primary = (i == get_primary_for_view(view));
+    }
+    return true;
+}
+
+// Simulate client request phase
+void simulate_request_phase(const char* key, const char* value) {
+    simulate_view_change();
+    int primary = get_primary_for_view(current_view);
+
+    log_phase("1. CLIENT REQUEST PHASE:\n");
+    log_phase("   Client sends request to primary (Replica %d): PUT %s=%s\n",
+              primary, key, value);
+}
+
+// Simulate pre-prepare phase
+void simulate_pre_prepare_phase(const char* key, const char* value) {
+    int primary = get_primary_for_view(current_view);
+
+    log_phase("2. PRE-PREPARE PHASE:\n");
+    log_phase("   Primary (Replica %d) assigns sequence number %d\n", primary, current_seq);
+    log_phase("   Primary broadcasts PRE-PREPARE to all replicas\n");
+
+    // Update primary's sequence number
+    replicas[primary].seq_num = current_seq;
+}
+
+// Simulate prepare phase
+void simulate_prepare_phase() {
+    log_phase("3. PREPARE PHASE:\n");
+
+    for (int i = 0; i < NUM_REPLICAS; i++) {
+        if (!replicas[i].is_faulty) {
+            log_phase("   Replica %d broadcasts PREPARE message\n", i);
+        } else {
+            log_phase("   Replica %d (FAULTY) might send corrupt PREPARE or none at all\n", i);
+        }
+    }
+
+    int valid_prepares = 0;
+    for (int i = 0; i < NUM_REPLICAS; i++) {
+        if (!replicas[i].is_faulty) {
+            valid_prepares++;
+        }
+    }
+
+    log_phase("\n   Total valid PREPARE messages: %d\n", valid_prepares);
+
+    if (valid_prepares >= 2 * FAULTY_THRESHOLD + 1) {
+        log_phase("   Each replica receives 2f+1=%d valid PREPAREs (prepare certificate)\n",
+                  2 * FAULTY_THRESHOLD + 1);
+    } else {
+        log_phase("   Not enough valid PREPAREs for certificate (%d needed)\n",
+                  2 * FAULTY_THRESHOLD + 1);
+    }
+}
+
+// Simulate commit phase
+void simulate_commit_phase() {
+    log_phase("4. COMMIT PHASE:\n");
+
+    for (int i = 0; i < NUM_REPLICAS; i++) {
+        if (!replicas[i].is_faulty) {
+            log_phase("   Replica %d broadcasts COMMIT message\n", i);
+        } else {
+            log_phase("   Replica %d (FAULTY) might send corrupt COMMIT or none at all\n", i);
+        }
+    }
+
+    int valid_commits = 0;
+    for (int i = 0; i < NUM_REPLICAS; i++) {
+        if (!replicas[i].is_faulty) {
+            valid_commits++;
+        }
+    }
+
+    log_phase("\n   Total valid COMMIT messages: %d\n", valid_commits);
+
+    if (valid_commits >= 2 * FAULTY_THRESHOLD + 1) {
+        log_phase("   Each replica receives 2f+1=%d valid COMMITs (commit certificate)\n",
+                  2 * FAULTY_THRESHOLD + 1);
+    } else {
+        log_phase("   Not enough valid COMMITs for certificate (%d needed)\n",
+                  2 * FAULTY_THRESHOLD + 1);
+    }
+}
+
+// Simulate execute phase
+void simulate_execute_phase(const char* key, const char* value) {
+    log_phase("5. EXECUTE PHASE:\n");
+
+    int valid_replicas = 0;
+    for (int i = 0; i < NUM_REPLICAS; i++) {
+        if (!replicas[i].is_faulty) {
+            valid_replicas++;
+            update_kv_store(i, key, value);
+            log_phase("   Replica %d executes PUT %s=%s\n", i, key, value);
+            replicas[i].seq_num = current_seq;
+        } else {
+            log_phase("   Replica %d (FAULTY) might execute incorrectly or not at all\n", i);
+
+            // 50% chance for a faulty replica to update incorrectly
+            if (rand() % 2 == 0) {
+                char corrupt_value[MAX_VALUE_SIZE];
+                strncpy(corrupt_value, value, MAX_VALUE_SIZE - 1);
+                corrupt_value[MAX_VALUE_SIZE - 1] = '\0';
+                corrupt_value[0] = 'X'; // Simple corruption
+                update_kv_store(i, key, corrupt_value);
+                log_phase("   Replica %d incorrectly executes PUT %s=%s\n", i, key, corrupt_value);
+            } else {
+                log_phase("   Replica %d did not execute the operation\n", i);
+            }
+        }
+    }
+
+    log_phase("\n   Operation complete! %d of %d replicas have consistent state.\n",
+              valid_replicas, NUM_REPLICAS);
+}
+
+// Run a PUT through all protocol phases back to back
+void run_put_operation(const char* key, const char* value) {
+    // Increment global sequence number
+    current_seq++;
+
+    simulate_request_phase(key, value);
+    simulate_pre_prepare_phase(key, value);
+    simulate_prepare_phase();
+    simulate_commit_phase();
+    simulate_execute_phase(key, value);
+}
+
+// Read a key from every replica; returns the number of replicas holding it
+int run_get_operation(const char* key, const char* values[NUM_REPLICAS]) {
+    int found = 0;
+
+    for (int i = 0; i < NUM_REPLICAS; i++) {
+        values[i] = lookup_kv_store(i, key);
+        if (values[i] != NULL) {
+            found++;
+        }
+    }
+
+    return found;
+}
+
+// Update key-value store
+void update_kv_store(int replica_id, const char* key, const char* value) {
+    if (key[0] == '\0') {
+        return;
+    }
+
+    // A full store drops new keys, existing keys are always updated
+    tinybft_kv_put(&replicas[replica_id].kv_store, key, value);
+}
+
+// Look up a key in a replica's key-value store (NULL if absent)
+const char* lookup_kv_store(int replica_id, const char* key) {
+    return tinybft_kv_get(&replicas[replica_id].kv_store, key);
+}
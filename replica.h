@@ -0,0 +1,64 @@
+#ifndef TINYBFT_REPLICA_H
+#define TINYBFT_REPLICA_H
+
+#include <stdbool.h>
+#include "memory_layout.h"
+#include "kv_store.h"
+
+// Configuration
+#define NUM_REPLICAS TINYBFT_MAX_REPLICAS
+#define FAULTY_THRESHOLD TINYBFT_MAX_FAULTY  // f value (can tolerate up to f Byzantine faults)
+#define MAX_KEY_SIZE TINYBFT_KV_KEY_SIZE
+#define MAX_VALUE_SIZE TINYBFT_KV_VALUE_SIZE
+#define MAX_KEYS TINYBFT_KV_MAX_KEYS
+
+// PBFT message types for protocol demonstration
+typedef enum {
+    MSG_REQUEST,      // Client request
+    MSG_PRE_PREPARE,  // Primary assigns sequence number
+    MSG_PREPARE,      // Replicas acknowledge pre-prepare
+    MSG_COMMIT,       // Replicas commit to the request
+    MSG_REPLY         // Reply to client
+} message_type_t;
+
+// Replica state
+typedef struct {
+    int id;
+    int view;
+    int seq_num;
+    bool is_primary;
+    bool is_faulty;
+    tinybft_kv_t kv_store;
+} replica_t;
+
+// Global state
+extern replica_t replicas[NUM_REPLICAS];
+extern int current_seq;
+extern int current_view;
+
+// When false, the protocol phases run silently (used by the benchmark driver)
+extern bool pipeline_verbose;
+
+// Replica management
+void initialize_system(void);
+void set_replica_faulty(int replica_id, bool faulty);
+bool is_primary(int replica_id);
+int get_primary_for_view(int view);
+
+// PBFT protocol phases
+bool simulate_view_change(void);
+void simulate_request_phase(const char* key, const char* value);
+void simulate_pre_prepare_phase(const char* key, const char* value);
+void simulate_prepare_phase(void);
+void simulate_commit_phase(void);
+void simulate_execute_phase(const char* key, const char* value);
+
+// Run a complete operation through the pipeline without user interaction
+void run_put_operation(const char* key, const char* value);
+int run_get_operation(const char* key, const char* values[NUM_REPLICAS]);
+
+// Key-value store access
+void update_kv_store(int replica_id, const char* key, const char* value);
+const char* lookup_kv_store(int replica_id, const char* key);
+
+#endif // TINYBFT_REPLICA_H
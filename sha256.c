@@ -0,0 +1,364 @@
+#include "sha256.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+typedef void (*compress_fn)(uint32_t state[8], const uint8_t* blocks, uint32_t block_count);
+
+static uint32_t load_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+// Final one or two blocks: the tail of the message, 0x80, zeros, bit length.
+// Returns the number of blocks written to pad.
+static uint32_t pad_tail(uint8_t pad[128], const uint8_t* tail, uint32_t tail_len, uint64_t total_len) {
+    uint32_t blocks = tail_len < 56 ? 1 : 2;
+    uint64_t bits = total_len * 8;
+
+    memset(pad, 0, 128);
+    memcpy(pad, tail, tail_len);
+    pad[tail_len] = 0x80;
+    for (uint32_t i = 0; i < 8; i++) {
+        pad[blocks * 64 - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+    return blocks;
+}
+
+// Portable path
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void compress_scalar(uint32_t state[8], const uint8_t* blocks, uint32_t block_count) {
+    uint32_t w[64];
+
+    for (; block_count > 0; block_count--, blocks += 64) {
+        for (uint32_t t = 0; t < 16; t++) {
+            w[t] = load_be32(blocks + 4 * t);
+        }
+        for (uint32_t t = 16; t < 64; t++) {
+            uint32_t s0 = ROTR(w[t - 15], 7) ^ ROTR(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = ROTR(w[t - 2], 17) ^ ROTR(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (uint32_t t = 0; t < 64; t++) {
+            uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t];
+            uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+static void sha256_with(compress_fn compress, const uint8_t* data, uint32_t len, uint8_t digest[TINYBFT_SHA256_SIZE]) {
+    uint32_t state[8];
+    uint8_t pad[128];
+
+    memcpy(state, H0, sizeof(state));
+    compress(state, data, len / 64);
+    compress(state, pad, pad_tail(pad, data + (len & ~63u), len % 64, len));
+
+    for (uint32_t i = 0; i < 8; i++) {
+        store_be32(digest + 4 * i, state[i]);
+    }
+}
+
+#ifdef SHA256_X86
+
+// SHA-NI path: the state is kept as ABEF/CDGH halves, four rounds per step
+
+__attribute__((target("sha,sse4.1")))
+static void compress_shani(uint32_t state[8], const uint8_t* blocks, uint32_t block_count) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);  // CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);  // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);       // CDGH
+
+    for (; block_count > 0; block_count--, blocks += 64) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i msg[4];
+
+#pragma GCC unroll 16
+        for (uint32_t i = 0; i < 16; i++) {
+            if (i < 4) {
+                msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 16 * i)), bswap);
+            } else {
+                // W[4i..4i+3] from the previous sixteen words
+                __m128i w = _mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]);
+                w = _mm_add_epi32(w, _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4));
+                msg[i & 3] = _mm_sha256msg2_epu32(w, msg[(i + 3) & 3]);
+            }
+
+            __m128i wk = _mm_add_epi32(msg[i & 3], _mm_loadu_si128((const __m128i*)&K[4 * i]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);        // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);     // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);  // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);     // HGFE
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+// AVX2 path: lane l of every vector belongs to message l
+
+#define ROTR8(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+
+__attribute__((target("avx2")))
+static void compress_avx2(__m256i s[8], const uint8_t* const blocks[TINYBFT_SHA256_LANES], uint32_t offset) {
+    __m256i w[16];
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+#pragma GCC unroll 16
+    for (uint32_t t = 0; t < 64; t++) {
+        __m256i wt;
+        if (t < 16) {
+            uint32_t at = offset + 4 * t;
+            wt = _mm256_set_epi32((int)load_be32(blocks[7] + at), (int)load_be32(blocks[6] + at),
+                                  (int)load_be32(blocks[5] + at), (int)load_be32(blocks[4] + at),
+                                  (int)load_be32(blocks[3] + at), (int)load_be32(blocks[2] + at),
+                                  (int)load_be32(blocks[1] + at), (int)load_be32(blocks[0] + at));
+        } else {
+            __m256i w15 = w[(t - 15) & 15];
+            __m256i w2 = w[(t - 2) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w15, 7), ROTR8(w15, 18)), _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w2, 17), ROTR8(w2, 19)), _mm256_srli_epi32(w2, 10));
+            wt = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+        }
+        w[t & 15] = wt;
+
+        __m256i sum1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(e, 6), ROTR8(e, 11)), ROTR8(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, sum1),
+                                      _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32((int)K[t]), wt)));
+        __m256i sum0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(a, 2), ROTR8(a, 13)), ROTR8(a, 22));
+        __m256i maj = _mm256_xor_si256(_mm256_and_si256(a, _mm256_xor_si256(b, c)), _mm256_and_si256(b, c));
+        __m256i t2 = _mm256_add_epi32(sum0, maj);
+
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+
+    s[0] = _mm256_add_epi32(s[0], a);
+    s[1] = _mm256_add_epi32(s[1], b);
+    s[2] = _mm256_add_epi32(s[2], c);
+    s[3] = _mm256_add_epi32(s[3], d);
+    s[4] = _mm256_add_epi32(s[4], e);
+    s[5] = _mm256_add_epi32(s[5], f);
+    s[6] = _mm256_add_epi32(s[6], g);
+    s[7] = _mm256_add_epi32(s[7], h);
+}
+
+// Hash up to 8 messages of len bytes; unused lanes repeat message 0
+__attribute__((target("avx2")))
+static void sha256_x8(const uint8_t* const data[], uint32_t len, uint8_t* const digests[], uint32_t count) {
+    const uint8_t* lanes[TINYBFT_SHA256_LANES];
+    uint8_t pad[TINYBFT_SHA256_LANES][128];
+    uint32_t words[8][TINYBFT_SHA256_LANES];
+    __m256i s[8];
+
+    for (uint32_t l = 0; l < TINYBFT_SHA256_LANES; l++) {
+        lanes[l] = data[l < count ? l : 0];
+    }
+    for (uint32_t i = 0; i < 8; i++) {
+        s[i] = _mm256_set1_epi32((int)H0[i]);
+    }
+
+    for (uint32_t offset = 0; offset + 64 <= len; offset += 64) {
+        compress_avx2(s, lanes, offset);
+    }
+
+    // Every lane has the same length, so they all need the same number of tail blocks
+    uint32_t tail = len & ~63u;
+    uint32_t pad_blocks = 0;
+    for (uint32_t l = 0; l < TINYBFT_SHA256_LANES; l++) {
+        pad_blocks = pad_tail(pad[l], lanes[l] + tail, len % 64, len);
+        lanes[l] = pad[l];
+    }
+    for (uint32_t b = 0; b < pad_blocks; b++) {
+        compress_avx2(s, lanes, 64 * b);
+    }
+
+    for (uint32_t i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i*)words[i], s[i]);
+    }
+    for (uint32_t l = 0; l < count; l++) {
+        for (uint32_t i = 0; i < 8; i++) {
+            store_be32(digests[l] + 4 * i, words[i][l]);
+        }
+    }
+}
+
+static uint32_t detect_impl(void) {
+    unsigned int eax, ebx, ecx, edx;
+    bool sse41, osxsave;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 1u << TINYBFT_SHA256_SCALAR;
+    }
+    sse41 = (ecx & bit_SSE4_1) != 0;
+    osxsave = (ecx & bit_OSXSAVE) != 0;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return 1u << TINYBFT_SHA256_SCALAR;
+    }
+
+    uint32_t supported = 1u << TINYBFT_SHA256_SCALAR;
+    if (sse41 && (ebx & (1u << 29)) != 0) {
+        supported |= 1u << TINYBFT_SHA256_SHANI;
+    }
+    if (osxsave && (ebx & bit_AVX2) != 0) {
+        // The OS must save the YMM registers as well
+        uint32_t xcr0_lo, xcr0_hi;
+        __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        if ((xcr0_lo & 6) == 6) {
+            supported |= 1u << TINYBFT_SHA256_AVX2;
+        }
+    }
+    return supported;
+}
+
+#else
+
+static uint32_t detect_impl(void) {
+    return 1u << TINYBFT_SHA256_SCALAR;
+}
+
+#endif // SHA256_X86
+
+// Bitmask of supported paths and the selected one; -1 until first use
+static uint32_t supported_impls = 0;
+static int selected_impl = -1;
+
+static tinybft_sha256_impl_t current_impl(void) {
+    int impl = __atomic_load_n(&selected_impl, __ATOMIC_ACQUIRE);
+    if (impl >= 0) {
+        return (tinybft_sha256_impl_t)impl;
+    }
+
+    // Racing threads detect the same CPU, so they store the same values
+    uint32_t supported = detect_impl();
+    __atomic_store_n(&supported_impls, supported, __ATOMIC_RELAXED);
+
+    // SHA-NI outruns eight AVX2 lanes on parts that have both
+    impl = TINYBFT_SHA256_SCALAR;
+    if (supported & (1u << TINYBFT_SHA256_SHANI)) {
+        impl = TINYBFT_SHA256_SHANI;
+    } else if (supported & (1u << TINYBFT_SHA256_AVX2)) {
+        impl = TINYBFT_SHA256_AVX2;
+    }
+    __atomic_store_n(&selected_impl, impl, __ATOMIC_RELEASE);
+    return (tinybft_sha256_impl_t)impl;
+}
+
+void tinybft_sha256(const void* data, uint32_t len, uint8_t digest[TINYBFT_SHA256_SIZE]) {
+#ifdef SHA256_X86
+    if (current_impl() == TINYBFT_SHA256_SHANI) {
+        sha256_with(compress_shani, data, len, digest);
+        return;
+    }
+#endif
+    sha256_with(compress_scalar, data, len, digest);
+}
+
+void tinybft_sha256_multi(const uint8_t* const data[], uint32_t len, uint8_t* const digests[], uint32_t count) {
+#ifdef SHA256_X86
+    if (current_impl() == TINYBFT_SHA256_AVX2) {
+        for (uint32_t i = 0; i < count; i += TINYBFT_SHA256_LANES) {
+            uint32_t n = count - i < TINYBFT_SHA256_LANES ? count - i : TINYBFT_SHA256_LANES;
+            sha256_x8(data + i, len, digests + i, n);
+        }
+        return;
+    }
+#endif
+    for (uint32_t i = 0; i < count; i++) {
+        tinybft_sha256(data[i], len, digests[i]);
+    }
+}
+
+tinybft_sha256_impl_t tinybft_sha256_impl(void) {
+    return current_impl();
+}
+
+bool tinybft_sha256_supported(tinybft_sha256_impl_t impl) {
+    current_impl();
+    return impl < TINYBFT_SHA256_IMPL_COUNT && (__atomic_load_n(&supported_impls, __ATOMIC_RELAXED) & (1u << impl)) != 0;
+}
+
+const char* tinybft_sha256_impl_name(tinybft_sha256_impl_t impl) {
+    switch (impl) {
+        case TINYBFT_SHA256_SCALAR:
+            return "scalar";
+        case TINYBFT_SHA256_AVX2:
+            return "avx2-x8";
+        case TINYBFT_SHA256_SHANI:
+            return "sha-ni";
+        default:
+            return "unknown";
+    }
+}
+
+bool tinybft_sha256_select(tinybft_sha256_impl_t impl) {
+    if (!tinybft_sha256_supported(impl)) {
+        return false;
+    }
+    __atomic_store_n(&selected_impl, (int)impl, __ATOMIC_RELEASE);
+    return true;
+}
@@ -0,0 +1,33 @@
+#ifndef TINYBFT_SHA256_H
+#define TINYBFT_SHA256_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Self-contained SHA-256 with a portable scalar path, an AVX2 path that
+// hashes 8 equal-length messages at once and a SHA-NI path. The fastest
+// path the CPU supports is picked by CPUID on first use.
+
+#define TINYBFT_SHA256_SIZE 32
+#define TINYBFT_SHA256_LANES 8  // Messages hashed together by the AVX2 path
+
+typedef enum {
+    TINYBFT_SHA256_SCALAR = 0,
+    TINYBFT_SHA256_AVX2,   // Multi-buffer only; single messages use the scalar path
+    TINYBFT_SHA256_SHANI,
+    TINYBFT_SHA256_IMPL_COUNT
+} tinybft_sha256_impl_t;
+
+void tinybft_sha256(const void* data, uint32_t len, uint8_t digest[TINYBFT_SHA256_SIZE]);
+
+// Hash `count` independent messages of `len` bytes each
+void tinybft_sha256_multi(const uint8_t* const data[], uint32_t len, uint8_t* const digests[], uint32_t count);
+
+tinybft_sha256_impl_t tinybft_sha256_impl(void);
+bool tinybft_sha256_supported(tinybft_sha256_impl_t impl);
+const char* tinybft_sha256_impl_name(tinybft_sha256_impl_t impl);
+
+// Force a path (e.g. to compare them); fails if the CPU lacks it
+bool tinybft_sha256_select(tinybft_sha256_impl_t impl);
+
+#endif // TINYBFT_SHA256_H
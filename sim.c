@@ -0,0 +1,687 @@
+#include "sim.h"
+#include "replica.h"
+#include "wire.h"
+#include "worker_pool.h"
+#include <math.h>
+#include <string.h>
+
+#define NO_MSG UINT32_MAX
+#define MAX_EVENTS (TINYBFT_SIM_MESSAGES + NUM_REPLICAS + TINYBFT_MAX_CLIENTS)
+
+// A message travelling over a link or deferred by its receiver, in the
+// wire format: transmission times follow its encoded length
+typedef struct {
+    uint32_t src;
+    uint32_t dst;
+    uint32_t len;   // Encoded length
+    uint32_t next;  // Free list or backlog
+    uint8_t bytes[TINYBFT_WIRE_MAX_SIZE];
+} sim_msg_t;
+
+// In-memory framing of a message being sent or handed to a replica
+typedef union {
+    uint64_t align;
+    uint8_t bytes[TINYBFT_MAX_MSG_SIZE + TINYBFT_AUTHENTICATOR_SIZE];
+} sim_frame_t;
+
+enum {
+    EVENT_DELIVER = 0,  // arg: message
+    EVENT_TICK,         // arg: replica
+    EVENT_RESEND        // arg: client
+};
+
+typedef struct {
+    uint64_t time;
+    uint64_t order;  // Events at the same time run in the order they were scheduled
+    uint32_t kind;
+    uint32_t arg;
+} sim_event_t;
+
+typedef struct {
+    tinybft_msg_header_t hdr;
+    tinybft_request_t req;
+    char data[MAX_KEY_SIZE + MAX_VALUE_SIZE];
+} sim_request_t;
+
+typedef struct {
+    sim_request_t request;
+    uint32_t timestamp;
+    bool pending;
+    bool read_only;         // The current attempt is a read-only request
+    bool resend_scheduled;  // An EVENT_RESEND for the client is queued
+    uint64_t deadline;
+    uint64_t read_deadline;
+    uint64_t resend_at;
+    uint32_t view;          // View of the last accepted reply
+    int reply_len[NUM_REPLICAS];
+    uint32_t reply_view[NUM_REPLICAS];
+    bool reply_tentative[NUM_REPLICAS];
+    char reply[NUM_REPLICAS][MAX_VALUE_SIZE];
+} sim_client_t;
+
+static tinybft_replica_t nodes[NUM_REPLICAS];
+static tinybft_pool_t pools[NUM_REPLICAS];  // Execution workers, kept until the next start
+static bool pools_started = false;
+static sim_msg_t msgs[TINYBFT_SIM_MESSAGES];
+static uint32_t free_msgs;
+static sim_event_t heap[MAX_EVENTS];
+static uint32_t heap_size;
+static uint64_t next_order;
+
+static tinybft_sim_link_t links[TINYBFT_MAX_ENDPOINTS][TINYBFT_MAX_ENDPOINTS];
+static uint64_t link_busy[TINYBFT_MAX_ENDPOINTS][TINYBFT_MAX_ENDPOINTS];  // Transmitting until then
+static uint64_t replica_busy[NUM_REPLICAS];  // Processing until then
+static uint32_t backlog_head[NUM_REPLICAS];
+static uint32_t backlog_tail[NUM_REPLICAS];
+static uint64_t backlog_at[NUM_REPLICAS];    // Replica position the backlog was last offered at
+static uint64_t backlog_pre_prepares[NUM_REPLICAS];  // and the PRE-PREPAREs it had handled then
+static sim_client_t clients[TINYBFT_MAX_CLIENTS];
+
+static tinybft_sim_config_t config;
+static tinybft_sim_stats_t stats;
+static uint64_t now;
+static uint64_t send_time;  // Departure of what the replica being run sends
+static uint64_t rng_state;
+static uint64_t trace;
+
+// splitmix64, as in the benchmark workloads
+static uint64_t random_next(void) {
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double random_double(void) {
+    return (random_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void trace_mix(uint64_t value) {
+    trace = (trace ^ value) * 0x100000001b3ull;
+    trace ^= trace >> 29;
+}
+
+// Event queue: binary min-heap on (time, order)
+static bool earlier(const sim_event_t* a, const sim_event_t* b) {
+    return a->time != b->time ? a->time < b->time : a->order < b->order;
+}
+
+static void schedule(uint64_t time, uint32_t kind, uint32_t arg) {
+    uint32_t i = heap_size++;
+    sim_event_t ev = { time, next_order++, kind, arg };
+
+    while (i > 0 && earlier(&ev, &heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = ev;
+}
+
+static sim_event_t next_event(void) {
+    sim_event_t top = heap[0];
+    sim_event_t last = heap[--heap_size];
+    uint32_t i = 0;
+
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= heap_size) {
+            break;
+        }
+        if (child + 1 < heap_size && earlier(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!earlier(&heap[child], &last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+static uint32_t alloc_msg(uint32_t src, uint32_t dst) {
+    uint32_t m = free_msgs;
+    if (m == NO_MSG) {
+        stats.overflows++;
+        return NO_MSG;
+    }
+    free_msgs = msgs[m].next;
+    msgs[m].src = src;
+    msgs[m].dst = dst;
+    msgs[m].next = NO_MSG;
+    return m;
+}
+
+static void free_msg(uint32_t m) {
+    msgs[m].next = free_msgs;
+    free_msgs = m;
+}
+
+static sim_frame_t send_frame;  // Message a replica is sending
+static sim_frame_t recv_frame;  // Message a replica is handling
+
+// Encode a framed message into a message buffer and count its bytes
+static void encode_msg(uint32_t m, const tinybft_msg_header_t* hdr, const uint8_t* authenticator) {
+    msgs[m].len = tinybft_wire_encode(hdr, hdr + 1, authenticator, msgs[m].bytes, sizeof(msgs[m].bytes));
+    stats.wire_bytes += msgs[m].len;
+    stats.frame_bytes += (uint32_t)sizeof(*hdr) + hdr->data_len + (authenticator != NULL ? TINYBFT_AUTHENTICATOR_SIZE : 0);
+}
+
+// Parse a message buffer and lay it out in frame; NULL if it is malformed
+static const tinybft_msg_header_t* decode_msg(uint32_t m, const uint8_t** authenticator) {
+    tinybft_wire_msg_t msg;
+
+    if (!tinybft_wire_parse(msgs[m].bytes, msgs[m].len, &msg)) {
+        return NULL;
+    }
+    tinybft_wire_unpack(&msg, recv_frame.bytes);
+    *authenticator = msg.authenticator != NULL ? recv_frame.bytes + sizeof(msg.hdr) + msg.hdr.data_len : NULL;
+    return (const tinybft_msg_header_t*)recv_frame.bytes;
+}
+
+static uint64_t link_delay(const tinybft_sim_link_t* link) {
+    uint64_t delay = link->latency_us * 1000ull;
+    uint64_t jitter = link->jitter_us * 1000ull;
+
+    if (jitter > 0 && link->dist == TINYBFT_SIM_UNIFORM) {
+        delay += random_next() % jitter;
+    } else if (jitter > 0 && link->dist == TINYBFT_SIM_EXPONENTIAL) {
+        delay += (uint64_t)(-log(1.0 - random_double()) * (double)jitter);
+    }
+    return delay;
+}
+
+// Put a message on its link: it waits for the messages ahead of it, takes
+// its transmission time, then the link's delay, and again after every loss
+static void transmit(uint32_t m, uint64_t depart) {
+    sim_msg_t* msg = &msgs[m];
+    const tinybft_sim_link_t* link = &links[msg->src][msg->dst];
+    uint64_t* busy = &link_busy[msg->src][msg->dst];
+    uint64_t tx = link->bandwidth_mbps > 0 ? (uint64_t)msg->len * 8000 / link->bandwidth_mbps : 0;
+    uint64_t start = depart > *busy ? depart : *busy;
+
+    *busy = start + tx;
+    uint64_t arrive = start + tx + link_delay(link);
+    while (link->loss > 0.0 && random_double() < link->loss) {
+        stats.lost++;
+        if (link->rto_us == 0 || link->loss >= 1.0) {
+            free_msg(m);
+            return;
+        }
+        arrive += link->rto_us * 1000ull + tx;
+    }
+    if (link->reorder > 0.0 && random_double() < link->reorder) {
+        arrive += link->reorder_us * 1000ull;
+    }
+
+    stats.sent++;
+    schedule(arrive, EVENT_DELIVER, m);
+}
+
+// Byzantine senders tamper with their copy of a message; true if it changed
+static bool misbehave(const tinybft_replica_t* node, uint32_t dest, tinybft_msg_header_t* msg) {
+    uint8_t* payload = (uint8_t*)(msg + 1);
+
+    if (msg->type == MSG_TYPE_PRE_PREPARE && node->id == tinybft_primary(msg->view) &&
+        (config.faults.equivocate & (1u << dest)) && msg->data_len > sizeof(tinybft_batch_t)) {
+        payload[msg->data_len - 1] ^= 0xff;  // Another batch under the same sequence number
+        return true;
+    }
+    if ((msg->type == MSG_TYPE_PREPARE || msg->type == MSG_TYPE_COMMIT) &&
+        (config.faults.corrupt_votes & (1u << node->id)) && msg->data_len == TINYBFT_DIGEST_SIZE) {
+        payload[0] ^= 0xff;
+        return true;
+    }
+    return false;
+}
+
+static void sim_send(void* ctx, uint32_t dest, const tinybft_msg_header_t* hdr, const void* payload,
+                     const uint8_t* authenticator) {
+    tinybft_replica_t* node = (tinybft_replica_t*)ctx;
+    uint32_t auth_len = authenticator != NULL ? TINYBFT_AUTHENTICATOR_SIZE : 0;
+
+    if ((config.faults.silent & (1u << node->id)) || dest >= TINYBFT_MAX_ENDPOINTS ||
+        hdr->data_len > TINYBFT_MAX_MSG_SIZE - sizeof(*hdr)) {
+        return;
+    }
+    uint32_t m = alloc_msg(node->id, dest);
+    if (m == NO_MSG) {
+        return;
+    }
+
+    tinybft_msg_header_t* copy = (tinybft_msg_header_t*)send_frame.bytes;
+    uint8_t* body = (uint8_t*)(copy + 1);
+    memcpy(copy, hdr, sizeof(*hdr));
+    memcpy(body, payload, hdr->data_len);
+    if (auth_len > 0) {
+        memcpy(body + hdr->data_len, authenticator, auth_len);
+        if (misbehave(node, dest, copy)) {
+            // A Byzantine replica authenticates whatever it sends
+            tinybft_auth_sign(&node->auth, copy, body, 1u << dest, body + hdr->data_len);
+        }
+    }
+    encode_msg(m, copy, auth_len > 0 ? body + hdr->data_len : NULL);
+    transmit(m, send_time);
+}
+
+static void sim_modify(void* ctx, const void* addr, uint32_t len) {
+    tinybft_replica_modify((tinybft_replica_t*)ctx, addr, len);
+}
+
+// Hand a decoded message to its replica; false if the replica defers it
+static bool offer(tinybft_replica_t* node, const tinybft_msg_header_t* hdr) {
+    uint8_t* dst = tinybft_replica_recv_buffer(node, hdr);
+
+    if (dst != NULL) {
+        memcpy(dst, hdr, sizeof(*hdr) + hdr->data_len);
+        hdr = (const tinybft_msg_header_t*)dst;
+    }
+    return tinybft_replica_handle(node, hdr);
+}
+
+// Replicas defer messages above their window, those of a view they have
+// not entered yet and votes that arrive before their PRE-PREPARE, so the
+// backlog is offered again, in arrival order, whenever the low watermark or
+// the view has moved or another PRE-PREPARE was handled
+static uint64_t backlog_position(const tinybft_replica_t* node) {
+    return (uint64_t)node->view << 33 | (uint64_t)node->view_changing << 32 | node->memory.agreement_region.low_watermark;
+}
+
+static bool backlog_moved(const tinybft_replica_t* node) {
+    return backlog_at[node->id] != backlog_position(node) ||
+           backlog_pre_prepares[node->id] != node->received[MSG_TYPE_PRE_PREPARE];
+}
+
+static void mark_backlog(const tinybft_replica_t* node) {
+    backlog_at[node->id] = backlog_position(node);
+    backlog_pre_prepares[node->id] = node->received[MSG_TYPE_PRE_PREPARE];
+}
+
+static void offer_backlog(tinybft_replica_t* node) {
+    uint32_t r = node->id;
+
+    while (backlog_head[r] != NO_MSG && backlog_moved(node)) {
+        mark_backlog(node);
+
+        uint32_t kept = NO_MSG;
+        uint32_t tail = NO_MSG;
+        for (uint32_t m = backlog_head[r]; m != NO_MSG;) {
+            uint32_t next = msgs[m].next;
+            const uint8_t* authenticator;
+            const tinybft_msg_header_t* hdr = decode_msg(m, &authenticator);
+            if (hdr == NULL || offer(node, hdr)) {
+                free_msg(m);
+            } else {
+                msgs[m].next = NO_MSG;
+                if (tail == NO_MSG) {
+                    kept = m;
+                } else {
+                    msgs[tail].next = m;
+                }
+                tail = m;
+            }
+            m = next;
+        }
+        backlog_head[r] = kept;
+        backlog_tail[r] = tail;
+    }
+}
+
+static void defer(tinybft_replica_t* node, uint32_t m) {
+    uint32_t r = node->id;
+
+    stats.deferred++;
+    msgs[m].next = NO_MSG;
+    if (backlog_head[r] == NO_MSG) {
+        backlog_head[r] = m;
+        mark_backlog(node);
+    } else {
+        msgs[backlog_tail[r]].next = m;
+    }
+    backlog_tail[r] = m;
+}
+
+// Replies count towards the client's current timestamp only
+static void client_receive(uint32_t client, const tinybft_msg_header_t* msg) {
+    sim_client_t* cl = &clients[client];
+    const tinybft_reply_t* reply = (const tinybft_reply_t*)(msg + 1);
+
+    if (msg->type == MSG_TYPE_REPLY && msg->sender_id < NUM_REPLICAS && msg->data_len >= sizeof(*reply) && reply->timestamp == cl->timestamp && reply->result_len <= MAX_VALUE_SIZE &&
+        reply->result_len <= msg->data_len - sizeof(*reply)) {
+        memcpy(cl->reply[msg->sender_id], reply + 1, reply->result_len);
+        cl->reply_len[msg->sender_id] = (int)reply->result_len;
+        cl->reply_view[msg->sender_id] = msg->view;
+        cl->reply_tentative[msg->sender_id] = (reply->flags & TINYBFT_REPLY_TENTATIVE) != 0;
+    }
+}
+
+static void deliver(uint32_t m) {
+    sim_msg_t* msg = &msgs[m];
+    const uint8_t* authenticator;
+    const tinybft_msg_header_t* hdr = decode_msg(m, &authenticator);
+
+    if (hdr != NULL && msg->dst >= NUM_REPLICAS) {
+        client_receive(msg->dst - NUM_REPLICAS, hdr);
+    }
+    if (hdr == NULL || msg->dst >= NUM_REPLICAS) {
+        free_msg(m);
+        return;
+    }
+
+    // Messages between replicas, and only those, are authenticated
+    tinybft_replica_t* node = &nodes[msg->dst];
+    bool valid = (authenticator != NULL) == (msg->src < NUM_REPLICAS) && !(config.faults.silent & (1u << node->id));
+    if (valid && authenticator != NULL) {
+        const tinybft_msg_header_t* batch[1] = { hdr };
+        tinybft_replica_verify(node, batch, 1, &valid);
+    }
+    if (!valid) {
+        free_msg(m);
+        return;
+    }
+
+    // Messages queue for the replica's processor
+    uint32_t r = node->id;
+    replica_busy[r] = (now > replica_busy[r] ? now : replica_busy[r]) + config.service_ns;
+    send_time = replica_busy[r];
+    if (offer(node, hdr)) {
+        free_msg(m);
+        offer_backlog(node);
+    } else {
+        defer(node, m);
+    }
+}
+
+static void client_send(uint32_t client, uint32_t dest) {
+    sim_request_t* request = &clients[client].request;
+    uint32_t m = alloc_msg(TINYBFT_CLIENT_ENDPOINT(client), dest);
+
+    if (m != NO_MSG) {
+        encode_msg(m, &request->hdr, NULL);
+        transmit(m, now);
+    }
+}
+
+static void schedule_resend(uint32_t client) {
+    if (!clients[client].resend_scheduled) {
+        clients[client].resend_scheduled = true;
+        schedule(clients[client].resend_at, EVENT_RESEND, client);
+    }
+}
+
+// Send the request under a fresh timestamp, as tinybft_engine_submit does
+static void send_request(uint32_t client, bool read_only) {
+    sim_client_t* cl = &clients[client];
+
+    cl->timestamp++;
+    cl->read_only = read_only;
+    cl->request.req.timestamp = cl->timestamp;
+    cl->request.req.flags = read_only ? TINYBFT_REQUEST_READ_ONLY : 0;
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        cl->reply_len[r] = -1;
+    }
+
+    if (read_only) {
+        cl->read_deadline = now + TINYBFT_ENGINE_READ_TIMEOUT_MS * 1000000ull;
+        for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+            client_send(client, r);
+        }
+    } else {
+        cl->request.hdr.receiver_id = tinybft_primary(cl->view);
+        cl->request.hdr.view = cl->view;
+        client_send(client, cl->request.hdr.receiver_id);
+        cl->resend_at = now + TINYBFT_SIM_RESEND_MS * 1000000ull;
+        schedule_resend(client);
+    }
+}
+
+// A request the primary never ordered (or whose replies were lost) goes out
+// again to every replica under the same timestamp: the backups relay it and
+// time it, and replicas that executed it already reply again
+static void resend(uint32_t client) {
+    sim_client_t* cl = &clients[client];
+
+    cl->resend_scheduled = false;
+    if (!cl->pending || cl->read_only) {
+        return;
+    }
+    if (now >= cl->resend_at) {
+        stats.resends++;
+        for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+            client_send(client, r);
+        }
+        cl->resend_at = now + TINYBFT_SIM_RESEND_MS * 1000000ull;
+        schedule_resend(client);
+    } else {
+        schedule_resend(client);
+    }
+}
+
+static void tick(tinybft_replica_t* node) {
+    uint32_t r = node->id;
+
+    if (!(config.faults.silent & (1u << r))) {
+        send_time = now > replica_busy[r] ? now : replica_busy[r];
+        tinybft_replica_tick(node, now / 1000000);
+        offer_backlog(node);
+    }
+    schedule(now + config.tick_ms * 1000000ull, EVENT_TICK, r);
+}
+
+void tinybft_sim_default_config(tinybft_sim_config_t* cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->seed = 1;
+    cfg->batch_size = TINYBFT_MAX_BATCH;
+    cfg->pipeline_depth = TINYBFT_WINDOW_SIZE;
+    cfg->read_only_gets = true;
+    cfg->service_ns = 2000;
+    cfg->tick_ms = 1;
+    cfg->link.latency_us = 100;
+    cfg->link.dist = TINYBFT_SIM_FIXED;
+}
+
+bool tinybft_sim_start(const tinybft_sim_config_t* cfg) {
+    if (cfg == NULL) {
+        tinybft_sim_default_config(&config);
+    } else {
+        config = *cfg;
+    }
+    if (config.tick_ms == 0 || config.exec_threads > TINYBFT_POOL_MAX_WORKERS) {
+        return false;
+    }
+    for (uint32_t r = 0; r < NUM_REPLICAS && pools_started; r++) {
+        tinybft_pool_stop(&pools[r]);
+    }
+    pools_started = false;
+
+    memset(&stats, 0, sizeof(stats));
+    memset(link_busy, 0, sizeof(link_busy));
+    memset(replica_busy, 0, sizeof(replica_busy));
+    memset(clients, 0, sizeof(clients));
+    now = 0;
+    heap_size = 0;
+    next_order = 0;
+    rng_state = config.seed;
+    trace = 0xcbf29ce484222325ull;
+
+    free_msgs = NO_MSG;
+    for (uint32_t m = TINYBFT_SIM_MESSAGES; m-- > 0;) {
+        free_msg(m);
+    }
+    for (uint32_t from = 0; from < TINYBFT_MAX_ENDPOINTS; from++) {
+        for (uint32_t to = 0; to < TINYBFT_MAX_ENDPOINTS; to++) {
+            links[from][to] = config.link;
+        }
+    }
+
+    // Every run starts from empty stores so that it repeats exactly
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        tinybft_replica_init(&nodes[r], r, sim_send, &nodes[r], tinybft_engine_execute, &replicas[r]);
+        tinybft_replica_set_batch_size(&nodes[r], config.batch_size);
+        tinybft_replica_set_pipeline_depth(&nodes[r], config.pipeline_depth);
+        tinybft_replica_set_tentative(&nodes[r], config.tentative);
+        tinybft_engine_set_keys(&nodes[r]);
+        if (config.exec_threads > 0) {
+            tinybft_pool_start(&pools[r], config.exec_threads);  // Runs with fewer threads if some fail to start
+            tinybft_replica_set_parallel(&nodes[r], tinybft_engine_access, tinybft_engine_parallel, &pools[r]);
+        }
+        tinybft_kv_init(&replicas[r].kv_store);
+        tinybft_replica_set_state(&nodes[r], &replicas[r].kv_store.state, sizeof(replicas[r].kv_store.state));
+        tinybft_kv_set_modify(&replicas[r].kv_store, sim_modify, &nodes[r]);
+
+        backlog_head[r] = NO_MSG;
+        backlog_tail[r] = NO_MSG;
+        schedule(config.tick_ms * 1000000ull, EVENT_TICK, r);
+    }
+    pools_started = config.exec_threads > 0;
+    return true;
+}
+
+void tinybft_sim_set_link(uint32_t from, uint32_t to, const tinybft_sim_link_t* link) {
+    if (from < TINYBFT_MAX_ENDPOINTS && to < TINYBFT_MAX_ENDPOINTS) {
+        links[from][to] = *link;
+    }
+}
+
+bool tinybft_sim_submit(uint32_t client, tinybft_op_t op, const char* key, const char* value) {
+    if (client >= TINYBFT_MAX_CLIENTS || clients[client].pending) {
+        return false;
+    }
+
+    sim_request_t* msg = &clients[client].request;
+    size_t key_len = strnlen(key, MAX_KEY_SIZE - 1);
+    size_t value_len = (op == TINYBFT_OP_PUT && value != NULL) ? strnlen(value, MAX_VALUE_SIZE - 1) : 0;
+
+    msg->req.client_id = TINYBFT_CLIENT_ENDPOINT(client);
+    msg->req.op = (uint8_t)op;
+    msg->req.key_len = (uint8_t)key_len;
+    msg->req.value_len = (uint16_t)value_len;
+    memcpy(msg->data, key, key_len);
+    if (value_len > 0) {
+        memcpy(msg->data + key_len, value, value_len);
+    }
+
+    msg->hdr.type = MSG_TYPE_REQUEST;
+    msg->hdr.sender_id = msg->req.client_id;
+    msg->hdr.receiver_id = TINYBFT_ALL_REPLICAS;
+    msg->hdr.view = clients[client].view;
+    msg->hdr.seq_num = 0;
+    msg->hdr.data_len = tinybft_request_size(&msg->req);
+
+    clients[client].pending = true;
+    clients[client].deadline = now + TINYBFT_ENGINE_TIMEOUT_MS * 1000000ull;
+    send_request(client, op == TINYBFT_OP_GET && config.read_only_gets);
+    return true;
+}
+
+// Highest view that f+1 of the replicas that replied have reached, so at
+// least one correct replica vouches for it
+static uint32_t replied_view(const uint32_t views[NUM_REPLICAS], const int lengths[NUM_REPLICAS]) {
+    uint32_t view = 0;
+
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        uint32_t at_least = 0;
+        for (uint32_t q = 0; q < NUM_REPLICAS && lengths[r] >= 0; q++) {
+            at_least += lengths[q] >= 0 && views[q] >= views[r];
+        }
+        if (at_least >= TINYBFT_MAX_FAULTY + 1 && views[r] > view) {
+            view = views[r];
+        }
+    }
+    return view;
+}
+
+int tinybft_sim_poll(uint32_t client, char* result, uint32_t result_cap) {
+    if (client >= TINYBFT_MAX_CLIENTS || !clients[client].pending) {
+        return TINYBFT_SIM_TIMEOUT;
+    }
+
+    sim_client_t* cl = &clients[client];
+    uint32_t quorum = cl->read_only ? TINYBFT_QUORUM : TINYBFT_MAX_FAULTY + 1;
+    uint32_t best = 0;
+    uint32_t replied = 0;
+
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        if (cl->reply_len[r] < 0) {
+            continue;
+        }
+        replied++;
+
+        // f+1 committed replies, or 2f+1 that may be tentative
+        uint32_t matches = 0;
+        uint32_t committed = 0;
+        for (uint32_t q = 0; q < NUM_REPLICAS; q++) {
+            bool match = cl->reply_len[q] == cl->reply_len[r] &&
+                         memcmp(cl->reply[q], cl->reply[r], (size_t)cl->reply_len[r]) == 0;
+            matches += match;
+            committed += match && !cl->reply_tentative[q];
+        }
+        best = matches > best ? matches : best;
+        if (matches >= TINYBFT_QUORUM || (!cl->read_only && committed >= quorum)) {
+            cl->pending = false;
+            if (!cl->read_only && replied_view(cl->reply_view, cl->reply_len) > cl->view) {
+                cl->view = replied_view(cl->reply_view, cl->reply_len);
+            }
+            if (result != NULL) {
+                uint32_t copy = (uint32_t)cl->reply_len[r] < result_cap ? (uint32_t)cl->reply_len[r] : result_cap;
+                memcpy(result, cl->reply[r], copy);
+            }
+            return cl->reply_len[r];
+        }
+    }
+
+    if (cl->read_only && (best + (NUM_REPLICAS - replied) < quorum || now > cl->read_deadline)) {
+        send_request(client, false);  // Conflicting or missing answers: order it after all
+    } else if (now > cl->deadline) {
+        cl->pending = false;
+        return TINYBFT_SIM_TIMEOUT;
+    }
+    return TINYBFT_SIM_PENDING;
+}
+
+bool tinybft_sim_step(void) {
+    if (heap_size == 0) {
+        return false;
+    }
+
+    sim_event_t ev = next_event();
+    now = ev.time;
+    stats.events++;
+    trace_mix(ev.time);
+    trace_mix((uint64_t)ev.kind << 32 | ev.arg);
+
+    switch (ev.kind) {
+        case EVENT_DELIVER:
+            trace_mix((uint64_t)msgs[ev.arg].src << 40 | (uint64_t)msgs[ev.arg].dst << 32 | msgs[ev.arg].len);
+            deliver(ev.arg);
+            break;
+        case EVENT_TICK:
+            tick(&nodes[ev.arg]);
+            break;
+        default:
+            resend(ev.arg);
+            break;
+    }
+    return true;
+}
+
+uint64_t tinybft_sim_now_ns(void) {
+    return now;
+}
+
+uint64_t tinybft_sim_trace_hash(void) {
+    return trace;
+}
+
+void tinybft_sim_get_stats(tinybft_sim_stats_t* out) {
+    *out = stats;
+}
+
+const tinybft_replica_t* tinybft_sim_replica(uint32_t replica_id) {
+    return replica_id < NUM_REPLICAS ? &nodes[replica_id] : NULL;
+}
+
+void tinybft_sim_set_faults(const tinybft_sim_faults_t* faults) {
+    config.faults = *faults;
+}
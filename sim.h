@@ -0,0 +1,104 @@
+#ifndef TINYBFT_SIM_H
+#define TINYBFT_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+
+// Deterministic discrete-event simulator. The replica cores of replicas[] run
+// on the caller's thread in virtual time: every message is an event that a
+// modelled link delivers after its latency, queueing and transmission time,
+// and every random choice (jitter, loss, reordering) comes from one seeded
+// generator. The same seed and the same client operations reproduce a run
+// event for event, which tinybft_sim_trace_hash() summarizes.
+
+#ifndef TINYBFT_SIM_MESSAGES
+#define TINYBFT_SIM_MESSAGES 8192  // Messages in flight or deferred at once
+#endif
+
+#ifndef TINYBFT_SIM_RESEND_MS
+#define TINYBFT_SIM_RESEND_MS 10  // A client sends an unanswered request to every replica after this long
+#endif
+
+#define TINYBFT_SIM_PENDING TINYBFT_ENGINE_PENDING
+#define TINYBFT_SIM_TIMEOUT TINYBFT_ENGINE_TIMEOUT  // After TINYBFT_ENGINE_TIMEOUT_MS of virtual time
+
+// Spread of the per-message delay added to a link's latency
+typedef enum {
+    TINYBFT_SIM_FIXED = 0,    // None
+    TINYBFT_SIM_UNIFORM,      // Uniform in [0, jitter)
+    TINYBFT_SIM_EXPONENTIAL   // Exponential with mean jitter
+} tinybft_sim_dist_t;
+
+typedef struct {
+    uint32_t latency_us;
+    uint32_t jitter_us;
+    tinybft_sim_dist_t dist;
+    uint32_t bandwidth_mbps;  // Messages serialize behind each other (0 = unlimited)
+    double loss;              // Probability that a transmission is lost
+    uint32_t rto_us;          // Lost messages are sent again after this long (0 = lost for good)
+    double reorder;           // Probability that a message is held back, letting later ones overtake it
+    uint32_t reorder_us;      // How long it is held back
+} tinybft_sim_link_t;
+
+// Byzantine replicas, as bitmaps of replica ids
+typedef struct {
+    uint32_t silent;         // Send nothing
+    uint32_t equivocate;     // Backups the primary sends a conflicting PRE-PREPARE
+    uint32_t corrupt_votes;  // Send PREPARE and COMMIT votes for a wrong digest
+} tinybft_sim_faults_t;
+
+typedef struct {
+    uint64_t seed;
+    uint32_t batch_size;
+    uint32_t pipeline_depth;
+    bool read_only_gets;         // As in tinybft_engine_config_t
+    bool tentative;              // As in tinybft_engine_config_t
+    uint32_t exec_threads;       // As in tinybft_engine_config_t; execution takes no virtual time either way
+    uint32_t service_ns;         // Processing time a replica spends on each message
+    uint32_t tick_ms;            // Replica clock resolution
+    tinybft_sim_link_t link;     // Every link, until tinybft_sim_set_link changes one
+    tinybft_sim_faults_t faults;
+} tinybft_sim_config_t;
+
+typedef struct {
+    uint64_t events;       // Events processed
+    uint64_t sent;         // Messages handed to a link
+    uint64_t lost;         // Transmissions lost (retransmitted ones count again)
+    uint64_t overflows;    // Messages dropped with all TINYBFT_SIM_MESSAGES buffers in use
+    uint64_t deferred;     // Deliveries a replica could not process yet
+    uint64_t resends;      // Client requests sent again to every replica
+    uint64_t wire_bytes;   // Bytes handed to links, in the wire format
+    uint64_t frame_bytes;  // The same messages in the in-memory framing
+} tinybft_sim_stats_t;
+
+void tinybft_sim_default_config(tinybft_sim_config_t* cfg);
+
+// Reset the virtual clock, the links and the replica cores; cfg may be NULL
+// for the defaults
+bool tinybft_sim_start(const tinybft_sim_config_t* cfg);
+
+// Change the Byzantine replicas mid-run, e.g. to crash the primary
+void tinybft_sim_set_faults(const tinybft_sim_faults_t* faults);
+
+// Model the link from endpoint `from` to endpoint `to` (replicas, then clients)
+void tinybft_sim_set_link(uint32_t from, uint32_t to, const tinybft_sim_link_t* link);
+
+// Client interface of tinybft_engine_submit/poll, in virtual time
+bool tinybft_sim_submit(uint32_t client, tinybft_op_t op, const char* key, const char* value);
+int tinybft_sim_poll(uint32_t client, char* result, uint32_t result_cap);
+
+// Advance virtual time to the next event and process it; false once none is left
+bool tinybft_sim_step(void);
+
+uint64_t tinybft_sim_now_ns(void);
+
+// Hash over every event processed so far (time, kind, endpoints, bytes)
+uint64_t tinybft_sim_trace_hash(void);
+
+void tinybft_sim_get_stats(tinybft_sim_stats_t* stats);
+
+// Replica core, for its protocol counters
+const tinybft_replica_t* tinybft_sim_replica(uint32_t replica_id);
+
+#endif // TINYBFT_SIM_H
@@ -0,0 +1,146 @@
+#ifndef TINYBFT_SPSC_RING_H
+#define TINYBFT_SPSC_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Lock-free single-producer/single-consumer ring carrying variable-length
+// messages. Each record is an 8-byte length prefix followed by the message
+// bytes, padded to 8 bytes and always contiguous; a zero length marks the
+// unused tail of the buffer before wrapping. Rings are statically allocated.
+
+#ifndef TINYBFT_RING_SIZE
+#define TINYBFT_RING_SIZE 16384  // Bytes per ring (must be a power of two)
+#endif
+
+#define TINYBFT_RING_MASK (TINYBFT_RING_SIZE - 1)
+#define TINYBFT_RING_ALIGN(len) (((len) + 7u) & ~7u)
+#define TINYBFT_RING_PREFIX 8u
+#define TINYBFT_CACHE_LINE 64
+
+_Static_assert((TINYBFT_RING_SIZE & TINYBFT_RING_MASK) == 0, "TINYBFT_RING_SIZE must be a power of two");
+
+typedef struct {
+    // Consumer-owned
+    uint32_t head;
+    uint8_t pad_head[TINYBFT_CACHE_LINE - sizeof(uint32_t)];
+    // Producer-owned
+    uint32_t tail;
+    uint32_t reserved;  // Position of the record handed out by reserve
+    uint8_t pad_tail[TINYBFT_CACHE_LINE - 2 * sizeof(uint32_t)];
+    uint8_t data[TINYBFT_RING_SIZE] __attribute__((aligned(TINYBFT_CACHE_LINE)));
+} tinybft_ring_t;
+
+static inline void tinybft_ring_init(tinybft_ring_t* ring) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->reserved = 0;
+}
+
+// Producer: reserve space for a message of len bytes; NULL if the ring is full
+static inline void* tinybft_ring_reserve(tinybft_ring_t* ring, uint32_t len) {
+    uint32_t need = TINYBFT_RING_ALIGN(TINYBFT_RING_PREFIX + len);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = ring->tail;
+    uint32_t offset = tail & TINYBFT_RING_MASK;
+    uint32_t to_end = TINYBFT_RING_SIZE - offset;
+    uint32_t skip = (need > to_end) ? to_end : 0;
+
+    if (need > TINYBFT_RING_SIZE || (tail + skip + need) - head > TINYBFT_RING_SIZE) {
+        return NULL;
+    }
+
+    if (skip > 0) {
+        // Mark the remainder of the buffer as padding and wrap to the start
+        *(uint32_t*)&ring->data[offset] = 0;
+        offset = 0;
+    }
+
+    *(uint32_t*)&ring->data[offset] = len;
+    ring->reserved = tail + skip;
+    return &ring->data[offset + TINYBFT_RING_PREFIX];
+}
+
+// Producer: make the reserved message visible to the consumer
+static inline void tinybft_ring_publish(tinybft_ring_t* ring) {
+    uint32_t offset = ring->reserved & TINYBFT_RING_MASK;
+    uint32_t len = *(uint32_t*)&ring->data[offset];
+    __atomic_store_n(&ring->tail, ring->reserved + TINYBFT_RING_ALIGN(TINYBFT_RING_PREFIX + len),
+                     __ATOMIC_RELEASE);
+}
+
+// Producer: copy a message made of two parts (e.g. header and payload)
+static inline bool tinybft_ring_push(tinybft_ring_t* ring, const void* part1, uint32_t len1,
+                                     const void* part2, uint32_t len2) {
+    uint8_t* dst = (uint8_t*)tinybft_ring_reserve(ring, len1 + len2);
+    if (dst == NULL) {
+        return false;
+    }
+
+    memcpy(dst, part1, len1);
+    if (len2 > 0) {
+        memcpy(dst + len1, part2, len2);
+    }
+    tinybft_ring_publish(ring);
+    return true;
+}
+
+// Consumer: oldest message in the ring (left in place), or NULL if empty
+static inline const void* tinybft_ring_peek(tinybft_ring_t* ring, uint32_t* len) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t head = ring->head;
+
+    while (head != tail) {
+        uint32_t offset = head & TINYBFT_RING_MASK;
+        uint32_t record_len = *(uint32_t*)&ring->data[offset];
+
+        if (record_len == 0) {
+            // Padding up to the end of the buffer
+            head += TINYBFT_RING_SIZE - offset;
+            __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        *len = record_len;
+        return &ring->data[offset + TINYBFT_RING_PREFIX];
+    }
+
+    return NULL;
+}
+
+// Consumer: message at position *pos (the head, or a position returned by
+// tinybft_ring_next) left in place, or NULL if none has been published there
+// yet. Padding is skipped by moving *pos.
+static inline void* tinybft_ring_peek_at(tinybft_ring_t* ring, uint32_t* pos, uint32_t* len) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    while (*pos != tail) {
+        uint32_t offset = *pos & TINYBFT_RING_MASK;
+        uint32_t record_len = *(uint32_t*)&ring->data[offset];
+
+        if (record_len == 0) {
+            *pos += TINYBFT_RING_SIZE - offset;
+            continue;
+        }
+
+        *len = record_len;
+        return &ring->data[offset + TINYBFT_RING_PREFIX];
+    }
+
+    return NULL;
+}
+
+// Consumer: position of the message after the len-byte one at pos
+static inline uint32_t tinybft_ring_next(uint32_t pos, uint32_t len) {
+    return pos + TINYBFT_RING_ALIGN(TINYBFT_RING_PREFIX + len);
+}
+
+// Consumer: drop the message returned by the last peek
+static inline void tinybft_ring_release(tinybft_ring_t* ring) {
+    uint32_t head = ring->head;
+    uint32_t len = *(uint32_t*)&ring->data[head & TINYBFT_RING_MASK];
+    __atomic_store_n(&ring->head, head + TINYBFT_RING_ALIGN(TINYBFT_RING_PREFIX + len), __ATOMIC_RELEASE);
+}
+
+#endif // TINYBFT_SPSC_RING_H
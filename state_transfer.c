@@ -0,0 +1,678 @@
+#include "state_transfer.h"
+#include "partition_tree.h"
+#include "sha256.h"
+#include <string.h>
+
+#define HEADER_SIZE ((uint32_t)sizeof(tinybft_msg_header_t))
+#define MAX_PAYLOAD (TINYBFT_MAX_MSG_SIZE - HEADER_SIZE)
+#define RESP_SIZE ((uint32_t)sizeof(tinybft_transfer_resp_t))
+#define CHUNK_SIZE (MAX_PAYLOAD - RESP_SIZE)  // Block bytes carried by one response
+
+#define FIRST_LEAF (TINYBFT_STATE_BLOCKS - 1)
+#define FETCH_LEVELS 4
+
+_Static_assert(TINYBFT_TRANSFER_FANOUT == 1 << FETCH_LEVELS, "NODES returns the descendants FETCH_LEVELS down");
+_Static_assert(TINYBFT_TRANSFER_FANOUT * TINYBFT_DIGEST_SIZE <= CHUNK_SIZE, "NODES response exceeds TINYBFT_MAX_MSG_SIZE");
+_Static_assert(TINYBFT_BLOCK_SIZE <= TINYBFT_MAX_MSG_SIZE, "Blocks are assembled in scratch buffers");
+_Static_assert(TINYBFT_TRANSFER_ENTRIES >= TINYBFT_TRANSFER_FANOUT + 1, "Too few transfer entries");
+
+enum {
+    ENTRY_FREE = 0,
+    ENTRY_QUEUED,
+    ENTRY_SENT
+};
+
+static tinybft_partition_tree_t* state_tree(tinybft_replica_t* r) {
+    return &r->memory.checkpoint_region.partition_tree;
+}
+
+static uint32_t node_depth(uint32_t index) {
+    return 31 - (uint32_t)__builtin_clz(index + 1);
+}
+
+// Levels between a node and the descendants a NODES request returns
+static uint32_t fetch_levels(uint32_t index) {
+    uint32_t below = node_depth(FIRST_LEAF) - node_depth(index);
+    return below < FETCH_LEVELS ? below : FETCH_LEVELS;
+}
+
+static void send_transfer(tinybft_replica_t* r, uint32_t dest, tinybft_msg_type_t type, uint32_t seq_num,
+                          const void* payload, uint32_t len) {
+    tinybft_msg_header_t hdr;
+
+    hdr.type = type;
+    hdr.sender_id = r->id;
+    hdr.receiver_id = dest;
+    hdr.view = r->view;
+    hdr.seq_num = seq_num;
+    hdr.data_len = len;
+
+    uint8_t authenticator[TINYBFT_AUTHENTICATOR_SIZE];
+    tinybft_auth_sign(&r->auth, &hdr, payload, 1u << dest, authenticator);
+    r->send(r->send_ctx, dest, &hdr, payload, authenticator);
+}
+
+// Wait before asking again for what a request sent tries times ago asked
+static uint64_t retry_ms(uint32_t tries) {
+    uint64_t wait = (uint64_t)TINYBFT_TRANSFER_RETRY_MS << (tries < 8 ? tries : 8);
+    return wait < TINYBFT_TRANSFER_TIMEOUT_MS ? wait : TINYBFT_TRANSFER_TIMEOUT_MS;
+}
+
+static void send_request(tinybft_replica_t* r, uint32_t dest, uint32_t seq_num, uint32_t kind, uint32_t index) {
+    tinybft_transfer_req_t req = { kind, index };
+    send_transfer(r, dest, MSG_TYPE_STATE_TRANSFER_REQ, seq_num, &req, sizeof(req));
+}
+
+// ---------------------------------------------------------------------------
+// Responder: serves the pinned snapshot of one checkpoint. A replica that
+// fetches a checkpoint itself keeps serving the one it held before.
+
+static void send_meta(tinybft_replica_t* r, uint32_t dest) {
+    tinybft_partition_tree_t* tree = state_tree(r);
+    struct {
+        tinybft_transfer_resp_t resp;
+        tinybft_transfer_meta_t meta;
+    } out;
+
+    out.resp.kind = TINYBFT_TRANSFER_META;
+    out.resp.index = 0;
+    out.resp.offset = 0;
+    out.resp.len = sizeof(out.meta);
+    memcpy(out.meta.root, tree->snapshot.nodes[0].hash, TINYBFT_DIGEST_SIZE);
+    out.meta.view = r->memory.checkpoint_region.snapshot_view;
+    memcpy(out.meta.client_timestamp, r->memory.checkpoint_region.snapshot_timestamp, sizeof(out.meta.client_timestamp));
+    send_transfer(r, dest, MSG_TYPE_STATE_TRANSFER_RESP, tree->snapshot.seq_num, &out, sizeof(out));
+}
+
+static void serve_nodes(tinybft_replica_t* r, uint32_t dest, uint32_t index) {
+    tinybft_partition_tree_t* tree = state_tree(r);
+    struct {
+        tinybft_transfer_resp_t resp;
+        uint8_t hashes[TINYBFT_TRANSFER_FANOUT][TINYBFT_DIGEST_SIZE];
+    } out;
+
+    uint32_t levels = fetch_levels(index);
+    uint32_t first = ((index + 1) << levels) - 1;
+    uint32_t count = 1u << levels;
+
+    for (uint32_t j = 0; j < count; j++) {
+        memcpy(out.hashes[j], tree->snapshot.nodes[first + j].hash, TINYBFT_DIGEST_SIZE);
+    }
+    out.resp.kind = TINYBFT_TRANSFER_NODES;
+    out.resp.index = index;
+    out.resp.offset = 0;
+    out.resp.len = count * TINYBFT_DIGEST_SIZE;
+    send_transfer(r, dest, MSG_TYPE_STATE_TRANSFER_RESP, tree->snapshot.seq_num, &out, RESP_SIZE + out.resp.len);
+}
+
+static void serve_block(tinybft_replica_t* r, uint32_t dest, uint32_t block) {
+    tinybft_partition_tree_t* tree = state_tree(r);
+    const uint8_t* data = tinybft_partition_snapshot_block(tree, block);
+    uint32_t len = tinybft_partition_block_len(tree, block);
+    uint32_t offset = 0;
+    struct {
+        tinybft_transfer_resp_t resp;
+        uint8_t data[CHUNK_SIZE];
+    } out;
+
+    do {
+        uint32_t chunk = len - offset < CHUNK_SIZE ? len - offset : CHUNK_SIZE;
+        out.resp.kind = TINYBFT_TRANSFER_BLOCK;
+        out.resp.index = block;
+        out.resp.offset = offset;
+        out.resp.len = chunk;
+        memcpy(out.data, data + offset, chunk);
+        send_transfer(r, dest, MSG_TYPE_STATE_TRANSFER_RESP, tree->snapshot.seq_num, &out, RESP_SIZE + chunk);
+        offset += chunk;
+    } while (offset < len);
+}
+
+void tinybft_transfer_handle_req(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    tinybft_transfer_t* t = &r->transfer;
+    tinybft_partition_tree_t* tree = state_tree(r);
+    const tinybft_transfer_req_t* req = (const tinybft_transfer_req_t*)(msg + 1);
+
+    if (msg->data_len != sizeof(*req) || msg->sender_id == r->id) {
+        return;
+    }
+    if (req->kind == TINYBFT_TRANSFER_INSTANCES && msg->sender_id < TINYBFT_MAX_REPLICAS) {
+        tinybft_transfer_resp_t done = { TINYBFT_TRANSFER_INSTANCES, 0, 0, 0 };
+        if (!t->active) {
+            tinybft_resend_instances(r, msg->sender_id, msg->view, msg->seq_num);
+        }
+        send_transfer(r, msg->sender_id, MSG_TYPE_STATE_TRANSFER_RESP, msg->seq_num, &done, sizeof(done));
+        return;
+    }
+
+    if (req->kind == TINYBFT_TRANSFER_META) {
+        // Serve the pinned checkpoint if it is recent enough; otherwise
+        // answer from the first checkpoint that is. While we are fetching,
+        // our state is not worth pinning.
+        bool ready = tree->snapshot.seq_num >= msg->seq_num &&
+                     (tree->snapshot.pinned || (!t->active && tinybft_partition_pin(tree)));
+        if (!ready) {
+            if (!t->active) {
+                tinybft_partition_unpin(tree);
+            }
+            t->waiters |= 1u << msg->sender_id;
+            t->wait_seq = msg->seq_num > t->wait_seq ? msg->seq_num : t->wait_seq;
+            return;
+        }
+        t->served_ms = r->now_ms;
+        send_meta(r, msg->sender_id);
+        return;
+    }
+
+    if (!tree->snapshot.pinned || tree->snapshot.seq_num != msg->seq_num) {
+        send_meta(r, msg->sender_id);  // That checkpoint is gone
+        return;
+    }
+
+    t->served_ms = r->now_ms;
+    if (req->kind == TINYBFT_TRANSFER_NODES && req->index < FIRST_LEAF) {
+        serve_nodes(r, msg->sender_id, req->index);
+    } else if (req->kind == TINYBFT_TRANSFER_BLOCK && req->index < TINYBFT_STATE_BLOCKS) {
+        serve_block(r, msg->sender_id, req->index);
+    }
+}
+
+void tinybft_transfer_checkpointed(tinybft_replica_t* r) {
+    tinybft_transfer_t* t = &r->transfer;
+    tinybft_partition_tree_t* tree = state_tree(r);
+
+    // A fresh snapshot belongs to this checkpoint
+    if (tree->snapshot.seq_num == tree->checkpoint_seq && !tree->snapshot.pinned) {
+        tinybft_checkpoint_region_t* cp = &r->memory.checkpoint_region;
+        cp->snapshot_view = r->view;
+        memcpy(cp->snapshot_timestamp, r->client_timestamp, sizeof(cp->snapshot_timestamp));
+    }
+
+    if (t->waiters == 0 || t->active || tree->checkpoint_seq < t->wait_seq || !tinybft_partition_pin(tree)) {
+        return;
+    }
+    for (uint32_t i = 0; i < TINYBFT_MAX_REPLICAS; i++) {
+        if (t->waiters & (1u << i)) {
+            send_meta(r, i);
+        }
+    }
+    t->waiters = 0;
+    t->wait_seq = 0;
+    t->served_ms = r->now_ms;
+}
+
+// ---------------------------------------------------------------------------
+// Requester
+
+static void release_entry(tinybft_replica_t* r, tinybft_transfer_entry_t* e) {
+    if (e->status == ENTRY_SENT) {
+        r->transfer.inflight--;
+    }
+    if (e->block != NULL) {
+        tinybft_free_scratch(&r->memory, e->block);
+    }
+    memset(e, 0, sizeof(*e));
+}
+
+static void start_transfer(tinybft_replica_t* r) {
+    tinybft_transfer_t* t = &r->transfer;
+
+    for (uint32_t i = 0; i < TINYBFT_TRANSFER_ENTRIES; i++) {
+        release_entry(r, &t->entries[i]);
+    }
+
+    // Hash what we hold (including blocks fetched by an earlier attempt) so
+    // matching subtrees are skipped. Our last checkpoint stays pinned for
+    // the others meanwhile.
+    if (!t->active) {
+        tinybft_partition_pin(state_tree(r));
+    }
+    tinybft_partition_checkpoint(state_tree(r), r->last_executed);
+    tinybft_transfer_checkpointed(r);
+
+    t->active = true;
+    t->fetching = false;
+    t->activity_ms = r->now_ms;
+    t->meta_sent_ms = r->now_ms;
+    t->meta_tries = 0;
+    t->metas_from = 0;
+    t->asked_seq = r->last_executed + 1;
+    if (t->asked_seq < r->memory.agreement_region.low_watermark) {
+        t->asked_seq = r->memory.agreement_region.low_watermark;  // The target an earlier attempt settled on
+    }
+    t->sources = 0;
+    for (uint32_t i = 0; i < TINYBFT_MAX_REPLICAS; i++) {
+        if (i != r->id) {
+            send_request(r, i, t->asked_seq, TINYBFT_TRANSFER_META, 0);
+        }
+    }
+}
+
+// Queue a node or block unless our own tree already holds that hash
+static void queue_entry(tinybft_replica_t* r, uint32_t index, const uint8_t hash[TINYBFT_DIGEST_SIZE]) {
+    tinybft_transfer_t* t = &r->transfer;
+
+    if (memcmp(state_tree(r)->nodes[index].hash, hash, TINYBFT_DIGEST_SIZE) == 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < TINYBFT_TRANSFER_ENTRIES; i++) {
+        tinybft_transfer_entry_t* e = &t->entries[i];
+        if (e->status == ENTRY_FREE) {
+            e->index = index;
+            memcpy(e->hash, hash, TINYBFT_DIGEST_SIZE);
+            e->status = ENTRY_QUEUED;
+            return;
+        }
+    }
+}
+
+static tinybft_transfer_entry_t* sent_entry(tinybft_transfer_t* t, uint32_t index, uint32_t source) {
+    for (uint32_t i = 0; i < TINYBFT_TRANSFER_ENTRIES; i++) {
+        tinybft_transfer_entry_t* e = &t->entries[i];
+        if (e->status == ENTRY_SENT && e->index == index && e->source == source) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Stop using a source that sent bad data or lost the checkpoint
+static void drop_source(tinybft_replica_t* r, uint32_t source) {
+    tinybft_transfer_t* t = &r->transfer;
+
+    t->sources &= ~(1u << source);
+    for (uint32_t i = 0; i < TINYBFT_TRANSFER_ENTRIES; i++) {
+        tinybft_transfer_entry_t* e = &t->entries[i];
+        if (e->status == ENTRY_SENT && e->source == source) {
+            t->inflight--;
+            e->status = ENTRY_QUEUED;
+            e->received = 0;
+        }
+    }
+    if (t->sources == 0) {
+        start_transfer(r);
+    }
+}
+
+static uint32_t pick_source(tinybft_transfer_t* t) {
+    for (uint32_t k = 0; k < TINYBFT_MAX_REPLICAS; k++) {
+        uint32_t s = (t->next_source + k) % TINYBFT_MAX_REPLICAS;
+        if (t->sources & (1u << s)) {
+            t->next_source = s + 1;
+            return s;
+        }
+    }
+    return 0;
+}
+
+static void issue_requests(tinybft_replica_t* r) {
+    tinybft_transfer_t* t = &r->transfer;
+
+    while (t->fetching && t->inflight < TINYBFT_TRANSFER_INFLIGHT) {
+        // Deepest entries first keep the walk depth-first and the pool small
+        tinybft_transfer_entry_t* leaf = NULL;
+        tinybft_transfer_entry_t* node = NULL;
+        uint32_t free_entries = 0;
+
+        for (uint32_t i = 0; i < TINYBFT_TRANSFER_ENTRIES; i++) {
+            tinybft_transfer_entry_t* e = &t->entries[i];
+            if (e->status == ENTRY_FREE) {
+                free_entries++;
+            } else if (e->status == ENTRY_QUEUED) {
+                tinybft_transfer_entry_t** best = e->index >= FIRST_LEAF ? &leaf : &node;
+                if (*best == NULL || e->index > (*best)->index) {
+                    *best = e;
+                }
+            }
+        }
+
+        tinybft_transfer_entry_t* e = NULL;
+        if (leaf != NULL && (leaf->block != NULL ||
+                             (leaf->block = tinybft_alloc_from_scratch(&r->memory, TINYBFT_BLOCK_SIZE)) != NULL)) {
+            e = leaf;
+        } else if (node != NULL && free_entries >= TINYBFT_TRANSFER_FANOUT) {
+            e = node;  // Room for every descendant the response may queue
+        }
+        if (e == NULL) {
+            return;
+        }
+
+        e->status = ENTRY_SENT;
+        e->source = pick_source(t);
+        e->received = 0;
+        e->sent_ms = r->now_ms;
+        t->inflight++;
+        if (e->index >= FIRST_LEAF) {
+            send_request(r, e->source, t->target_seq, TINYBFT_TRANSFER_BLOCK, e->index - FIRST_LEAF);
+        } else {
+            send_request(r, e->source, t->target_seq, TINYBFT_TRANSFER_NODES, e->index);
+        }
+    }
+}
+
+static bool same_meta(const tinybft_transfer_t* t, uint32_t a, uint32_t b) {
+    return t->meta_seq[a] == t->meta_seq[b] && memcmp(&t->metas[a], &t->metas[b], sizeof(t->metas[a])) == 0;
+}
+
+static void handle_meta(tinybft_replica_t* r, const tinybft_msg_header_t* msg, const tinybft_transfer_resp_t* resp) {
+    tinybft_transfer_t* t = &r->transfer;
+    uint32_t s = msg->sender_id;
+
+    if (t->fetching) {
+        if ((t->sources & (1u << s)) && msg->seq_num != t->target_seq) {
+            drop_source(r, s);  // It moved on from the target
+        }
+        return;
+    }
+    if (resp->len != sizeof(tinybft_transfer_meta_t) || msg->seq_num <= r->last_executed ||
+        msg->seq_num < r->memory.agreement_region.low_watermark) {
+        return;
+    }
+
+    memcpy(&t->metas[s], resp + 1, sizeof(t->metas[s]));
+    r->copied_bytes[MSG_TYPE_STATE_TRANSFER_RESP] += sizeof(t->metas[s]);
+    t->meta_seq[s] = msg->seq_num;
+    t->metas_from |= 1u << s;
+    t->activity_ms = r->now_ms;
+
+    // f+1 identical answers include a correct replica
+    uint32_t matches = 0;
+    uint32_t newest = 0;
+    for (uint32_t q = 0; q < TINYBFT_MAX_REPLICAS; q++) {
+        if (t->metas_from & (1u << q)) {
+            if (same_meta(t, q, s)) {
+                matches |= 1u << q;
+            }
+            newest = t->meta_seq[q] > newest ? t->meta_seq[q] : newest;
+        }
+    }
+
+    if ((uint32_t)__builtin_popcount(matches) >= TINYBFT_MAX_FAULTY + 1) {
+        t->fetching = true;
+        t->target_seq = msg->seq_num;
+        t->target = t->metas[s];
+        t->sources = matches;
+        queue_entry(r, 0, t->target.root);
+
+        // The window moves to the target at once: the instances after it
+        // are agreed on while the state is fetched
+        if (t->target.view > r->view || r->view_changing) {
+            r->view = t->target.view;  // The view the checkpoint was taken in, over any view change we tried
+            r->view_changing = false;
+        }
+        tinybft_set_low_watermark(&r->memory, t->target_seq);
+        return;
+    }
+
+    // Replicas at older checkpoints are asked for the newest one reported
+    if (newest > t->asked_seq) {
+        t->asked_seq = newest;
+    }
+    for (uint32_t q = 0; q < TINYBFT_MAX_REPLICAS; q++) {
+        if ((t->metas_from & (1u << q)) && t->meta_seq[q] < t->asked_seq) {
+            t->metas_from &= ~(1u << q);
+            send_request(r, q, t->asked_seq, TINYBFT_TRANSFER_META, 0);
+        }
+    }
+}
+
+// Rehash a NODES response up to the node it was requested for
+static bool verify_nodes(const uint8_t* hashes, uint32_t levels, const uint8_t expected[TINYBFT_DIGEST_SIZE]) {
+    uint8_t level[2][TINYBFT_TRANSFER_FANOUT][TINYBFT_DIGEST_SIZE];
+    const uint8_t* data[TINYBFT_TRANSFER_FANOUT / 2];
+    uint8_t* digests[TINYBFT_TRANSFER_FANOUT / 2];
+    uint32_t cur = 0;
+
+    memcpy(level[0], hashes, (1u << levels) * TINYBFT_DIGEST_SIZE);
+    for (uint32_t n = 1u << levels; n > 1; n /= 2, cur ^= 1) {
+        for (uint32_t i = 0; i < n / 2; i++) {
+            data[i] = level[cur][2 * i];
+            digests[i] = level[cur ^ 1][i];
+        }
+        tinybft_sha256_multi(data, 2 * TINYBFT_DIGEST_SIZE, digests, n / 2);
+    }
+    return memcmp(level[cur][0], expected, TINYBFT_DIGEST_SIZE) == 0;
+}
+
+static void handle_nodes(tinybft_replica_t* r, const tinybft_msg_header_t* msg, const tinybft_transfer_resp_t* resp) {
+    tinybft_transfer_t* t = &r->transfer;
+    const uint8_t* hashes = (const uint8_t*)(resp + 1);
+    tinybft_transfer_entry_t* e;
+
+    if (resp->index >= FIRST_LEAF || (e = sent_entry(t, resp->index, msg->sender_id)) == NULL) {
+        return;
+    }
+
+    uint32_t levels = fetch_levels(resp->index);
+    if (resp->len != (1u << levels) * TINYBFT_DIGEST_SIZE || !verify_nodes(hashes, levels, e->hash)) {
+        drop_source(r, msg->sender_id);
+        return;
+    }
+
+    t->activity_ms = r->now_ms;
+    release_entry(r, e);
+
+    uint32_t first = ((resp->index + 1) << levels) - 1;
+    for (uint32_t j = 0; j < 1u << levels; j++) {
+        queue_entry(r, first + j, hashes + j * TINYBFT_DIGEST_SIZE);
+    }
+}
+
+static void handle_block(tinybft_replica_t* r, const tinybft_msg_header_t* msg, const tinybft_transfer_resp_t* resp) {
+    tinybft_transfer_t* t = &r->transfer;
+    tinybft_partition_tree_t* tree = state_tree(r);
+    tinybft_transfer_entry_t* e;
+
+    if (resp->index >= TINYBFT_STATE_BLOCKS || (e = sent_entry(t, FIRST_LEAF + resp->index, msg->sender_id)) == NULL) {
+        return;
+    }
+
+    uint32_t len = tinybft_partition_block_len(tree, resp->index);
+    if (resp->offset != e->received) {
+        return;  // A chunk before it was lost; the block is asked for again
+    }
+    if (resp->len > len - e->received) {
+        drop_source(r, msg->sender_id);
+        return;
+    }
+
+    memcpy(e->block + e->received, resp + 1, resp->len);
+    r->copied_bytes[MSG_TYPE_STATE_TRANSFER_RESP] += resp->len;  // Blocks arrive in chunks
+    e->received += resp->len;
+    t->activity_ms = r->now_ms;
+    if (e->received < len) {
+        return;
+    }
+
+    uint8_t hash[TINYBFT_DIGEST_SIZE];
+    tinybft_sha256(e->block, len, hash);
+    if (memcmp(hash, e->hash, TINYBFT_DIGEST_SIZE) != 0) {
+        drop_source(r, msg->sender_id);
+        return;
+    }
+
+    uint8_t* dst = tree->state + resp->index * TINYBFT_BLOCK_SIZE;
+    tinybft_replica_modify(r, dst, len);
+    memcpy(dst, e->block, len);
+    release_entry(r, e);
+    r->transfer_blocks++;
+}
+
+// Ask every other replica to send again its checkpoint votes and agreement
+// messages after seq_num
+static void ask_instances(tinybft_replica_t* r, uint32_t seq_num) {
+    tinybft_transfer_t* t = &r->transfer;
+
+    t->activity_ms = r->now_ms;
+    t->resending = 0;
+    for (uint32_t i = 0; i < TINYBFT_MAX_REPLICAS; i++) {
+        if (i != r->id) {
+            t->resending |= 1u << i;
+            send_request(r, i, seq_num, TINYBFT_TRANSFER_INSTANCES, 0);
+        }
+    }
+}
+
+// Install the target checkpoint once nothing is left to fetch. The window
+// already starts there; its instances go on from what was collected
+// meanwhile, and the other replicas are asked for what was missed.
+static void finish_transfer(tinybft_replica_t* r) {
+    tinybft_transfer_t* t = &r->transfer;
+    tinybft_partition_tree_t* tree = state_tree(r);
+
+    for (uint32_t i = 0; i < TINYBFT_TRANSFER_ENTRIES; i++) {
+        if (t->entries[i].status != ENTRY_FREE) {
+            return;
+        }
+    }
+
+    if (t->waiters == 0 && r->now_ms - t->served_ms > 2 * TINYBFT_TRANSFER_TIMEOUT_MS) {
+        tinybft_partition_unpin(tree);  // Nobody fetches the old checkpoint: snapshot the new one
+    }
+    tinybft_partition_checkpoint(tree, t->target_seq);
+    if (memcmp(tinybft_partition_digest(tree), t->target.root, TINYBFT_DIGEST_SIZE) != 0) {
+        start_transfer(r);
+        return;
+    }
+
+    r->last_executed = t->target_seq;
+    memcpy(r->client_timestamp, t->target.client_timestamp, sizeof(r->client_timestamp));
+    r->undo.count = 0;  // The fetched state supersedes tentative batches
+    r->undo.tail = r->undo.head;
+    r->undo.overflow = false;
+    r->undo.lost = false;
+    if (r->next_seq <= r->last_executed) {
+        r->next_seq = r->last_executed + 1;
+    }
+
+    t->active = false;
+    t->fetching = false;
+    r->behind_since = 0;
+    r->transfers++;
+    tinybft_transfer_checkpointed(r);
+
+    tinybft_resume_agreement(r);
+    ask_instances(r, r->last_executed);
+}
+
+void tinybft_transfer_handle_resp(tinybft_replica_t* r, const tinybft_msg_header_t* msg) {
+    tinybft_transfer_t* t = &r->transfer;
+    const tinybft_transfer_resp_t* resp = (const tinybft_transfer_resp_t*)(msg + 1);
+
+    if (msg->data_len < RESP_SIZE || resp->len != msg->data_len - RESP_SIZE) {
+        return;
+    }
+    if (resp->kind == TINYBFT_TRANSFER_INSTANCES && msg->sender_id < TINYBFT_MAX_REPLICAS) {
+        t->resending &= ~(1u << msg->sender_id);  // What it sends from here on follows the resent instances
+        return;
+    }
+    if (!t->active) {
+        return;
+    }
+
+    if (resp->kind == TINYBFT_TRANSFER_META) {
+        handle_meta(r, msg, resp);
+    } else if (!t->fetching || msg->seq_num != t->target_seq) {
+        return;
+    } else if (resp->kind == TINYBFT_TRANSFER_NODES) {
+        handle_nodes(r, msg, resp);
+    } else if (resp->kind == TINYBFT_TRANSFER_BLOCK) {
+        handle_block(r, msg, resp);
+    }
+
+    if (t->fetching) {
+        issue_requests(r);
+        finish_transfer(r);
+    }
+}
+
+// No replica reports a checkpoint past what we executed: we were not behind
+// after all, or the others cannot get ahead without us. Take part in
+// agreement again; lag detection starts over if we still lag.
+static void give_up_transfer(tinybft_replica_t* r) {
+    r->transfer.active = false;
+    r->behind_since = r->undo.lost ? r->now_ms : 0;
+    tinybft_resume_agreement(r);
+    ask_instances(r, r->memory.agreement_region.low_watermark);
+}
+
+// Requests and responses may be lost. A META request goes again to the
+// replicas yet to answer it, and a fetch to the next source, each after a
+// wait that doubles with every resend. Sources that stay quiet through
+// several resends are given up on.
+static void resend_requests(tinybft_replica_t* r) {
+    tinybft_transfer_t* t = &r->transfer;
+
+    if (r->now_ms - t->activity_ms >= 4 * TINYBFT_TRANSFER_TIMEOUT_MS) {
+        if (t->fetching) {
+            start_transfer(r);
+        } else {
+            give_up_transfer(r);
+        }
+        return;
+    }
+    if (!t->fetching) {
+        if (r->now_ms - t->meta_sent_ms < retry_ms(t->meta_tries)) {
+            return;
+        }
+        for (uint32_t i = 0; i < TINYBFT_MAX_REPLICAS; i++) {
+            if (i != r->id && (t->metas_from & (1u << i)) == 0) {
+                send_request(r, i, t->asked_seq, TINYBFT_TRANSFER_META, 0);
+            }
+        }
+        t->meta_sent_ms = r->now_ms;
+        t->meta_tries++;
+        return;
+    }
+
+    for (uint32_t i = 0; i < TINYBFT_TRANSFER_ENTRIES; i++) {
+        tinybft_transfer_entry_t* e = &t->entries[i];
+        if (e->status == ENTRY_SENT && r->now_ms - e->sent_ms >= retry_ms(e->tries)) {
+            t->inflight--;
+            e->status = ENTRY_QUEUED;
+            e->received = 0;
+            e->tries++;
+        }
+    }
+    issue_requests(r);
+}
+
+void tinybft_transfer_tick(tinybft_replica_t* r) {
+    tinybft_transfer_t* t = &r->transfer;
+    tinybft_partition_tree_t* tree = state_tree(r);
+
+    // Let the snapshot follow new checkpoints again once nobody fetches it
+    if (tree->snapshot.pinned && !t->active && t->waiters == 0 &&
+        r->now_ms - t->served_ms > 2 * TINYBFT_TRANSFER_TIMEOUT_MS) {
+        tinybft_partition_unpin(tree);
+    }
+
+    if (t->active) {
+        resend_requests(r);
+        return;
+    }
+    if (t->resending != 0 && r->now_ms - t->activity_ms > TINYBFT_TRANSFER_TIMEOUT_MS) {
+        t->resending = 0;  // Those left will not answer
+    }
+
+    // Messages above the window keep arriving but nothing executes: the
+    // instances in between were missed. The messages wait meanwhile, and so
+    // may their senders, so this is settled well within a view timeout.
+    // Should the whole window be executed, only the votes that make its
+    // checkpoint stable were lost: those are asked for again first, and a
+    // transfer follows if that does not help either.
+    uint32_t lag_ms = tinybft_view_timeout(r) / 2;
+    if (lag_ms > TINYBFT_TRANSFER_TIMEOUT_MS) {
+        lag_ms = TINYBFT_TRANSFER_TIMEOUT_MS;
+    }
+    if (r->behind_since == 0 || r->now_ms - r->behind_since < lag_ms) {
+        return;
+    }
+    uint32_t low = r->memory.agreement_region.low_watermark;
+    bool window_done = r->last_executed >= low + TINYBFT_WINDOW_SIZE && !r->undo.lost;
+    if (window_done && t->asked_ms <= r->behind_since) {
+        ask_instances(r, low);
+        t->asked_ms = r->now_ms;
+    } else if (!window_done || r->now_ms - t->asked_ms >= lag_ms) {
+        start_transfer(r);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef TINYBFT_STATE_TRANSFER_H
+#define TINYBFT_STATE_TRANSFER_H
+
+#include "pbft.h"
+
+// Block-level state transfer, driven by the PBFT core. A lagging replica
+// asks for the checkpoint metadata, settles on a checkpoint f+1 replicas
+// agree on, then walks the partition tree from the root, fetching the
+// hashes of a subtree's descendants four levels at a time and skipping
+// every subtree whose hash it already holds. Each response is checked
+// against the hash it was requested for, so one honest source suffices.
+
+// Lag detection and retries; called on every tick
+void tinybft_transfer_tick(tinybft_replica_t* r);
+
+// Called after every checkpoint the replica takes
+void tinybft_transfer_checkpointed(tinybft_replica_t* r);
+
+void tinybft_transfer_handle_req(tinybft_replica_t* r, const tinybft_msg_header_t* msg);
+void tinybft_transfer_handle_resp(tinybft_replica_t* r, const tinybft_msg_header_t* msg);
+
+// Provided by the PBFT core. Once the checkpoint is installed, agreement
+// carries on from the instances collected while it was fetched, and the
+// other replicas send theirs again for those it missed.
+void tinybft_resume_agreement(tinybft_replica_t* r);
+void tinybft_resend_instances(tinybft_replica_t* r, uint32_t dest, uint32_t view, uint32_t seq_num);
+
+#endif // TINYBFT_STATE_TRANSFER_H
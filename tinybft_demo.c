@@ -3,65 +3,27 @@
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
-#include <conio.h>  // For _getch() on Windows
-
-// Configuration
-#define NUM_REPLICAS 4
-#define FAULTY_THRESHOLD 1  // f value (can tolerate up to f Byzantine faults)
-#define MAX_KEY_SIZE 32
-#define MAX_VALUE_SIZE 256
-#define MAX_KEYS 10
-
-// PBFT message types for protocol demonstration
-typedef enum {
-    MSG_REQUEST,      // Client request
-    MSG_PRE_PREPARE,  // Primary assigns sequence number
-    MSG_PREPARE,      // Replicas acknowledge pre-prepare
-    MSG_COMMIT,       // Replicas commit to the request
-    MSG_REPLY         // Reply to client
-} message_type_t;
-
-// Key-value pair
-typedef struct {
-    char key[MAX_KEY_SIZE];
-    char value[MAX_VALUE_SIZE];
-    bool used;
-} kv_pair_t;
+#include "replica.h"
 
-// Replica state
-typedef struct {
-    int id;
-    int view;
-    int seq_num;
-    bool is_primary;
-    bool is_faulty;
-    kv_pair_t kv_store[MAX_KEYS];
-} replica_t;
-
-// Global state
-replica_t replicas[NUM_REPLICAS];
-int current_seq = 0;
+#ifdef _WIN32
+#include <conio.h>  // For _getch() on Windows
+#else
+#include <strings.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
 
 // Function declarations
-void initialize_system(void);
-void set_replica_faulty(int replica_id, bool faulty);
-bool is_primary(int replica_id);
-int get_primary_for_view(int view);
 void process_command(const char* command);
 void execute_put_command(const char* key, const char* value);
 void execute_get_command(const char* key);
-void simulate_request_phase(const char* key, const char* value);
-void simulate_pre_prepare_phase(const char* key, const char* value);
-void simulate_prepare_phase(void);
-void simulate_commit_phase(void);
-void simulate_execute_phase(const char* key, const char* value);
-void update_kv_store(int replica_id, const char* key, const char* value);
 void display_status(void);
 void display_key_value_stores(void);
 void display_memory_usage(void);
 void clear_screen(void);
 void print_header(const char* title);
 void wait_for_key(void);
+int read_key(void);
 
 int main() {
     // Seed random number generator
@@ -83,7 +45,7 @@ int main() {
     printf("This demo illustrates the PBFT protocol with 4 replicas (3f+1 where f=1).\n");
     printf("It demonstrates Byzantine fault tolerance and static memory allocation.\n\n");
     printf("Press any key to start...");
-    _getch();
+    read_key();
     
     while (1) {
         clear_screen();
@@ -137,41 +99,6 @@ int main() {
     return 0;
 }
 
-// Initialize system
-void initialize_system() {
-    // Initialize replicas
-    for (int i = 0; i < NUM_REPLICAS; i++) {
-        replicas[i].id = i;
-        replicas[i].view = 0;
-        replicas[i].seq_num = 0;
-        replicas[i].is_primary = (i == get_primary_for_view(0));
-        replicas[i].is_faulty = false;
-        
-        // Clear key-value store
-        memset(replicas[i].kv_store, 0, sizeof(replicas[i].kv_store));
-    }
-    
-    // Initialize sequence number
-    current_seq = 0;
-}
-
-// Set replica faulty status
-void set_replica_faulty(int replica_id, bool faulty) {
-    if (replica_id >= 0 && replica_id < NUM_REPLICAS) {
-        replicas[replica_id].is_faulty = faulty;
-    }
-}
-
-// Check if replica is primary
-bool is_primary(int replica_id) {
-    return replicas[replica_id].is_primary;
-}
-
-// Get primary for view
-int get_primary_for_view(int view) {
-    return view % NUM_REPLICAS;
-}
-
 // Process user command
 void process_command(const char* command) {
     char cmd[32];
@@ -212,15 +139,20 @@ void process_command(const char* command) {
             printf("Press a key after each phase to continue...\n\n");
             wait_for_key();
             
+            // A faulty primary is replaced first
+            if (simulate_view_change()) {
+                wait_for_key();
+            }
+
             // Phase 1: Request
             printf("1. CLIENT REQUEST PHASE:\n");
             printf("   Client sends request to primary (Replica %d): PUT %s=%s\n", 
-                   get_primary_for_view(0), demo_key, demo_value);
+                   get_primary_for_view(current_view), demo_key, demo_value);
             wait_for_key();
             
             // Phase 2: Pre-prepare
             printf("2. PRE-PREPARE PHASE:\n");
-            printf("   Primary (Replica %d) assigns sequence number %d\n", get_primary_for_view(0), current_seq);
+            printf("   Primary (Replica %d) assigns sequence number %d\n", get_primary_for_view(current_view), current_seq);
             printf("   Primary broadcasts PRE-PREPARE to all replicas\n");
             wait_for_key();
             
@@ -328,9 +260,9 @@ void process_command(const char* command) {
             printf("\n=== SYSTEM CONFIGURATION ===\n");
             printf("Total replicas:      %d\n", NUM_REPLICAS);
             printf("Fault tolerance (f): %d\n", FAULTY_THRESHOLD);
-            printf("Current view:        %d\n", 0);
+            printf("Current view:        %d\n", current_view);
             printf("Current sequence:    %d\n", current_seq);
-            printf("Primary replica:     %d\n", get_primary_for_view(0));
+            printf("Primary replica:     %d\n", get_primary_for_view(current_view));
             
             printf("\n=== BFT PROTOCOL PARAMETERS ===\n");
             printf("Protocol:            PBFT (Practical Byzantine Fault Tolerance)\n");
@@ -351,52 +283,7 @@ void process_command(const char* command) {
             
             wait_for_key();
         } else if (strcasecmp(cmd, "MEMORY") == 0) {
-            clear_screen();
-            print_header("MEMORY USAGE ANALYSIS");
-            
-            // Calculate memory usage for TinyBFT based on paper
-            size_t agreement_size = 37008;  // From the actual implementation
-            size_t checkpoint_size = 16420;
-            size_t event_size = 16384;
-            size_t scratch_size = 4112;
-            
-            size_t total_static = agreement_size + checkpoint_size + event_size + scratch_size;
-            size_t state_machine_size = 16384 + 64; // Application state + management overhead
-            size_t total_size = total_static + state_machine_size;
-            
-            printf("TinyBFT memory regions:\n");
-            printf("- Agreement Region:            %7zu bytes (%.1f KB)\n", agreement_size, agreement_size/1024.0);
-            printf("- Checkpoint Region:           %7zu bytes (%.1f KB)\n", checkpoint_size, checkpoint_size/1024.0);
-            printf("- Event Region:                %7zu bytes (%.1f KB)\n", event_size, event_size/1024.0);
-            printf("- Scratch Region:              %7zu bytes (%.1f KB)\n", scratch_size, scratch_size/1024.0);
-            printf("Total static memory:           %7zu bytes (%.1f KB)\n", 
-                   total_static, total_static / 1024.0);
-            printf("Application state:             %7zu bytes (%.1f KB)\n", 
-                   state_machine_size, state_machine_size / 1024.0);
-            printf("TOTAL MEMORY:                  %7zu bytes (%.1f KB)\n", 
-                   total_size, total_size / 1024.0);
-            
-            // Compare with standard implementation
-            size_t std_impl_size = 8600000; // 8.6 MB (from paper)
-            float reduction = 100.0 * (1.0 - ((float)total_size / std_impl_size));
-            float esp32_usage = 100.0 * total_size / (400.0 * 1024);
-            
-            printf("\n=== COMPARISON ===\n");
-            printf("Memory reduction: %.1f%% vs standard implementation\n", reduction);
-            printf("ESP32-C3 RAM usage: %.1f%% of 400KB available RAM\n", esp32_usage);
-            
-            printf("\n=== KEY INNOVATIONS ===\n");
-            printf("1. Static Memory Allocation\n");
-            printf("   - All memory allocated at compile time\n");
-            printf("   - No dynamic allocation (malloc/free) during operation\n");
-            printf("   - Fixed memory footprint regardless of workload\n");
-            
-            printf("\n2. Four-Region Memory Layout\n");
-            printf("   - Agreement Region: Protocol certificates (%.1f KB)\n", agreement_size/1024.0);
-            printf("   - Checkpoint Region: Stable checkpoints (%.1f KB)\n", checkpoint_size/1024.0);
-            printf("   - Event Region: Messages with varied lifetimes (%.1f KB)\n", event_size/1024.0);
-            printf("   - Scratch Region: Temporary processing buffer (%.1f KB)\n", scratch_size/1024.0);
-            
+            display_memory_usage();
             wait_for_key();
         } else if (strcasecmp(cmd, "CLEAR") == 0) {
             // Will clear on next iteration
@@ -450,171 +337,47 @@ void execute_get_command(const char* key) {
     
     printf("Retrieving values for key: '%s'\n\n", key);
     
+    const char* values[NUM_REPLICAS];
+    run_get_operation(key, values);
+    
     for (int i = 0; i < NUM_REPLICAS; i++) {
         printf("Replica %d: ", i);
-        bool found = false;
         
-        for (int j = 0; j < MAX_KEYS; j++) {
-            if (replicas[i].kv_store[j].used && strcmp(replicas[i].kv_store[j].key, key) == 0) {
-                printf("'%s' = '%s'", key, replicas[i].kv_store[j].value);
-                found = true;
-                break;
-            }
-        }
-        
-        if (!found) {
+        if (values[i] != NULL) {
+            printf("'%s' = '%s'", key, values[i]);
+        } else {
             printf("Key '%s' not found", key);
         }
         printf("\n");
     }
-    
-    wait_for_key();
-}
-
-// Simulate client request phase
-void simulate_request_phase(const char* key, const char* value) {
-    int primary = get_primary_for_view(0);
-    
-    printf("1. CLIENT REQUEST PHASE:\n");
-    printf("   Client sends request to primary (Replica %d): PUT %s=%s\n", 
-           primary, key, value);
-}
 
-// Simulate pre-prepare phase
-void simulate_pre_prepare_phase(const char* key, const char* value) {
-    int primary = get_primary_for_view(0);
-    
-    printf("2. PRE-PREPARE PHASE:\n");
-    printf("   Primary (Replica %d) assigns sequence number %d\n", primary, current_seq);
-    printf("   Primary broadcasts PRE-PREPARE to all replicas\n");
-    
-    // Update primary's sequence number
-    replicas[primary].seq_num = current_seq;
-}
-
-// Simulate prepare phase
-void simulate_prepare_phase() {
-    printf("3. PREPARE PHASE:\n");
-    
+    // Read-only optimization: accept the value 2f+1 replicas agree on
+    int best = -1;
+    int best_matches = 0;
     for (int i = 0; i < NUM_REPLICAS; i++) {
-        if (!replicas[i].is_faulty) {
-            printf("   Replica %d broadcasts PREPARE message\n", i);
-        } else {
-            printf("   Replica %d (FAULTY) might send corrupt PREPARE or none at all\n", i);
+        int matches = 0;
+        for (int j = 0; j < NUM_REPLICAS; j++) {
+            if ((values[i] == NULL && values[j] == NULL) ||
+                (values[i] != NULL && values[j] != NULL && strcmp(values[i], values[j]) == 0)) {
+                matches++;
+            }
         }
-    }
-    
-    int valid_prepares = 0;
-    for (int i = 0; i < NUM_REPLICAS; i++) {
-        if (!replicas[i].is_faulty) {
-            valid_prepares++;
+        if (matches > best_matches) {
+            best = i;
+            best_matches = matches;
         }
     }
-    
-    printf("\n   Total valid PREPARE messages: %d\n", valid_prepares);
-    
-    if (valid_prepares >= 2 * FAULTY_THRESHOLD + 1) {
-        printf("   Each replica receives 2f+1=%d valid PREPAREs (prepare certificate)\n", 
-              2 * FAULTY_THRESHOLD + 1);
-    } else {
-        printf("   Not enough valid PREPAREs for certificate (%d needed)\n", 
-              2 * FAULTY_THRESHOLD + 1);
-    }
-}
 
-// Simulate commit phase
-void simulate_commit_phase() {
-    printf("4. COMMIT PHASE:\n");
-    
-    for (int i = 0; i < NUM_REPLICAS; i++) {
-        if (!replicas[i].is_faulty) {
-            printf("   Replica %d broadcasts COMMIT message\n", i);
-        } else {
-            printf("   Replica %d (FAULTY) might send corrupt COMMIT or none at all\n", i);
-        }
-    }
-    
-    int valid_commits = 0;
-    for (int i = 0; i < NUM_REPLICAS; i++) {
-        if (!replicas[i].is_faulty) {
-            valid_commits++;
-        }
-    }
-    
-    printf("\n   Total valid COMMIT messages: %d\n", valid_commits);
-    
-    if (valid_commits >= 2 * FAULTY_THRESHOLD + 1) {
-        printf("   Each replica receives 2f+1=%d valid COMMITs (commit certificate)\n", 
-              2 * FAULTY_THRESHOLD + 1);
+    printf("\n");
+    if (best_matches >= 2 * FAULTY_THRESHOLD + 1) {
+        printf("Read-only result (%d of %d replies match): %s\n", best_matches, NUM_REPLICAS,
+               values[best] != NULL ? values[best] : "not found");
     } else {
-        printf("   Not enough valid COMMITs for certificate (%d needed)\n", 
-              2 * FAULTY_THRESHOLD + 1);
+        printf("Only %d of %d replies match; the GET falls back to full PBFT ordering\n",
+               best_matches, NUM_REPLICAS);
     }
-}
 
-// Simulate execute phase
-void simulate_execute_phase(const char* key, const char* value) {
-    printf("5. EXECUTE PHASE:\n");
-    
-    int valid_replicas = 0;
-    for (int i = 0; i < NUM_REPLICAS; i++) {
-        if (!replicas[i].is_faulty) {
-            valid_replicas++;
-            update_kv_store(i, key, value);
-            printf("   Replica %d executes PUT %s=%s\n", i, key, value);
-            replicas[i].seq_num = current_seq;
-        } else {
-            printf("   Replica %d (FAULTY) might execute incorrectly or not at all\n", i);
-            
-            // 50% chance for a faulty replica to update incorrectly
-            if (rand() % 2 == 0) {
-                char corrupt_value[MAX_VALUE_SIZE];
-                strcpy(corrupt_value, value);
-                corrupt_value[0] = 'X'; // Simple corruption
-                update_kv_store(i, key, corrupt_value);
-                printf("   Replica %d incorrectly executes PUT %s=%s\n", i, key, corrupt_value);
-            } else {
-                printf("   Replica %d did not execute the operation\n", i);
-            }
-        }
-    }
-    
-    printf("\n   Operation complete! %d of %d replicas have consistent state.\n", 
-           valid_replicas, NUM_REPLICAS);
-}
-
-// Update key-value store
-void update_kv_store(int replica_id, const char* key, const char* value) {
-    if (key[0] == '\0') {
-        return;
-    }
-    
-    // Find the key or an empty slot
-    int empty_slot = -1;
-    for (int i = 0; i < MAX_KEYS; i++) {
-        if (replicas[replica_id].kv_store[i].used && 
-            strcmp(replicas[replica_id].kv_store[i].key, key) == 0) {
-            // Update existing key
-            strncpy(replicas[replica_id].kv_store[i].value, value, MAX_VALUE_SIZE - 1);
-            replicas[replica_id].kv_store[i].value[MAX_VALUE_SIZE - 1] = '\0';
-            return;
-        }
-        
-        if (!replicas[replica_id].kv_store[i].used && empty_slot < 0) {
-            empty_slot = i;
-        }
-    }
-    
-    // Add new key if slot available
-    if (empty_slot >= 0) {
-        strncpy(replicas[replica_id].kv_store[empty_slot].key, key, MAX_KEY_SIZE - 1);
-        replicas[replica_id].kv_store[empty_slot].key[MAX_KEY_SIZE - 1] = '\0';
-        
-        strncpy(replicas[replica_id].kv_store[empty_slot].value, value, MAX_VALUE_SIZE - 1);
-        replicas[replica_id].kv_store[empty_slot].value[MAX_VALUE_SIZE - 1] = '\0';
-        
-        replicas[replica_id].kv_store[empty_slot].used = true;
-    }
+    wait_for_key();
 }
 
 // Display detailed status
@@ -637,9 +400,9 @@ void display_status() {
     printf("\n=== SYSTEM CONFIGURATION ===\n");
     printf("Total replicas:      %d\n", NUM_REPLICAS);
     printf("Fault tolerance (f): %d\n", FAULTY_THRESHOLD);
-    printf("Current view:        %d\n", 0);
+    printf("Current view:        %d\n", current_view);
     printf("Current sequence:    %d\n", current_seq);
-    printf("Primary replica:     %d\n", get_primary_for_view(0));
+    printf("Primary replica:     %d\n", get_primary_for_view(current_view));
     
     printf("\n=== BFT PROTOCOL PARAMETERS ===\n");
     printf("Protocol:            PBFT (Practical Byzantine Fault Tolerance)\n");
@@ -666,18 +429,19 @@ void display_key_value_stores() {
     int key_count = 0;
     
     for (int i = 0; i < NUM_REPLICAS; i++) {
-        for (int j = 0; j < MAX_KEYS; j++) {
-            if (replicas[i].kv_store[j].used) {
+        for (uint32_t j = 0; j < TINYBFT_KV_CAPACITY; j++) {
+            const kv_pair_t* entry = tinybft_kv_at(&replicas[i].kv_store, j);
+            if (entry != NULL) {
                 bool found = false;
                 for (int k = 0; k < key_count; k++) {
-                    if (strcmp(keys[k], replicas[i].kv_store[j].key) == 0) {
+                    if (strcmp(keys[k], entry->key) == 0) {
                         found = true;
                         break;
                     }
                 }
                 
                 if (!found && key_count < MAX_KEYS) {
-                    strncpy(keys[key_count], replicas[i].kv_store[j].key, MAX_KEY_SIZE - 1);
+                    strncpy(keys[key_count], entry->key, MAX_KEY_SIZE - 1);
                     keys[key_count][MAX_KEY_SIZE - 1] = '\0';
                     key_count++;
                 }
@@ -703,19 +467,8 @@ void display_key_value_stores() {
         printf("%-10s ", keys[k]);
         
         for (int i = 0; i < NUM_REPLICAS; i++) {
-            bool found = false;
-            for (int j = 0; j < MAX_KEYS; j++) {
-                if (replicas[i].kv_store[j].used && 
-                    strcmp(replicas[i].kv_store[j].key, keys[k]) == 0) {
-                    printf("%-12s ", replicas[i].kv_store[j].value);
-                    found = true;
-                    break;
-                }
-            }
-            
-            if (!found) {
-                printf("%-12s ", "---");
-            }
+            const char* value = lookup_kv_store(i, keys[k]);
+            printf("%-12s ", value != NULL ? value : "---");
         }
         printf("\n");
     }
@@ -726,21 +479,36 @@ void display_memory_usage() {
     clear_screen();
     print_header("MEMORY USAGE ANALYSIS");
     
-    // Calculate memory usage for TinyBFT based on paper
-    size_t agreement_size = 37008;  // From the actual implementation
-    size_t checkpoint_size = 16420;
-    size_t event_size = 16384;
-    size_t scratch_size = 4112;
+    // Sizes come from the structures as built with this TINYBFT_* configuration
+    const tinybft_memory_item_t* items;
+    uint32_t count = tinybft_memory_layout(&items);
+    size_t region_size[MEMORY_REGION_COUNT] = { 0 };
+    size_t total_static = 0;
+    uint32_t region = 0;
+    
+    printf("TinyBFT memory regions (W=%d, K=%d, %d replicas, %d clients, %d-byte messages):\n",
+           TINYBFT_WINDOW_SIZE, TINYBFT_CHECKPOINT_INTERVAL, TINYBFT_MAX_REPLICAS, TINYBFT_MAX_CLIENTS,
+           TINYBFT_MAX_MSG_SIZE);
+    for (uint32_t i = 0; i < count; i++) {
+        const tinybft_memory_item_t* item = &items[i];
+        if (item->depth == 0) {
+            printf("- %-28s %8u bytes", item->name, item->size);
+            if (item->budget > 0) {
+                printf(" (%.1f%% of %u byte budget)", 100.0 * item->size / item->budget, item->budget);
+            }
+            printf("\n");
+            if (region < MEMORY_REGION_COUNT) {
+                region_size[region++] = item->size;
+                total_static += item->size;
+            }
+        } else {
+            printf("    %-26s %8u bytes x %u\n", item->name, item->size, item->count);
+        }
+    }
     
-    size_t total_static = agreement_size + checkpoint_size + event_size + scratch_size;
-    size_t state_machine_size = 16384 + 64; // Application state + management overhead
+    size_t state_machine_size = sizeof(replicas[0].kv_store);
     size_t total_size = total_static + state_machine_size;
     
-    printf("TinyBFT memory regions:\n");
-    printf("- Agreement Region:            %7zu bytes\n", agreement_size);
-    printf("- Checkpoint Region:           %7zu bytes\n", checkpoint_size);
-    printf("- Event Region:                %7zu bytes\n", event_size);
-    printf("- Scratch Region:              %7zu bytes\n", scratch_size);
     printf("Total static memory:           %7zu bytes (%.1f KB)\n", 
            total_static, total_static / 1024.0);
     printf("Application state:             %7zu bytes (%.1f KB)\n", 
@@ -762,17 +530,23 @@ void display_memory_usage() {
     printf("   - All memory allocated at compile time\n");
     printf("   - No dynamic allocation (malloc/free) during operation\n");
     printf("   - Fixed memory footprint regardless of workload\n");
+    printf("   - Builds fail when a region outgrows its TINYBFT_*_BUDGET\n");
     
     printf("\n2. Four-Region Memory Layout\n");
-    printf("   - Agreement Region: Protocol certificates (%.1f KB)\n", agreement_size/1024.0);
-    printf("   - Checkpoint Region: Stable checkpoints (%.1f KB)\n", checkpoint_size/1024.0);
-    printf("   - Event Region: Messages with varied lifetimes (%.1f KB)\n", event_size/1024.0);
-    printf("   - Scratch Region: Temporary processing buffer (%.1f KB)\n", scratch_size/1024.0);
+    printf("   - Agreement Region: Protocol certificates (%.1f KB)\n", region_size[MEMORY_REGION_AGREEMENT]/1024.0);
+    printf("   - Checkpoint Region: Stable checkpoints (%.1f KB)\n", region_size[MEMORY_REGION_CHECKPOINT]/1024.0);
+    printf("   - Event Region: Messages with varied lifetimes (%.1f KB)\n", region_size[MEMORY_REGION_EVENT]/1024.0);
+    printf("   - Scratch Region: Temporary processing buffer (%.1f KB)\n", region_size[MEMORY_REGION_SCRATCH]/1024.0);
 }
 
 // Clear the screen
 void clear_screen() {
+#ifdef _WIN32
     system("cls");
+#else
+    printf("\033[2J\033[H");
+    fflush(stdout);
+#endif
 }
 
 // Print a header
@@ -783,5 +557,25 @@ void print_header(const char* title) {
 // Wait for key press
 void wait_for_key() {
     printf("\nPress any key to continue...");
-    _getch();
+    read_key();
+}
+
+// Read a single key press without waiting for Enter
+int read_key() {
+    fflush(stdout);
+#ifdef _WIN32
+    return _getch();
+#else
+    struct termios saved;
+    if (tcgetattr(STDIN_FILENO, &saved) != 0) {
+        return getchar();  // Not a terminal (e.g. piped input)
+    }
+
+    struct termios raw = saved;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    int c = getchar();
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    return c;
+#endif
 }
\ No newline at end of file
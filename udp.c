@@ -0,0 +1,670 @@
+#include "udp.h"
+#include "engine.h"
+#include "replica.h"
+#include "wire.h"
+#include "worker_pool.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SOCKET_BUFFER (4 * 1024 * 1024)  // Requested for both directions; absorbs a burst of broadcasts
+
+// In-memory framing of a received message
+typedef union {
+    uint64_t align;
+    uint8_t bytes[TINYBFT_MAX_MSG_SIZE + TINYBFT_AUTHENTICATOR_SIZE];
+} udp_frame_t;
+
+// Datagrams moved by one sendmmsg() or recvmmsg(), each in a static buffer
+typedef struct {
+    struct mmsghdr msgs[TINYBFT_UDP_BATCH];
+    struct iovec iov[TINYBFT_UDP_BATCH];
+    uint8_t bufs[TINYBFT_UDP_BATCH][TINYBFT_WIRE_MAX_SIZE];
+    uint32_t count;
+} udp_batch_t;
+
+typedef struct {
+    tinybft_msg_header_t hdr;
+    tinybft_request_t req;
+    char data[MAX_KEY_SIZE + MAX_VALUE_SIZE];
+} udp_request_t;
+
+typedef struct {
+    udp_request_t request;
+    uint32_t timestamp;
+    bool pending;
+    bool read_only;         // The current attempt is a read-only request
+    uint64_t deadline;
+    uint64_t read_deadline;
+    uint64_t resend_at;
+    uint32_t view;          // View of the last accepted reply
+    int reply_len[NUM_REPLICAS];
+    uint32_t reply_view[NUM_REPLICAS];
+    bool reply_tentative[NUM_REPLICAS];
+    char reply[NUM_REPLICAS][MAX_VALUE_SIZE];
+} udp_client_t;
+
+static struct sockaddr_in endpoints[TINYBFT_MAX_ENDPOINTS];
+static bool endpoint_set[TINYBFT_MAX_ENDPOINTS];
+static volatile sig_atomic_t stopping = 0;
+
+// Replica side; a process hosts one replica
+static tinybft_replica_t node;
+static tinybft_pool_t pool;  // Execution workers, with exec_threads
+static int replica_fd = -1;
+static udp_batch_t replica_out;
+static udp_batch_t replica_in;
+static udp_frame_t frames[TINYBFT_UDP_BATCH];
+static udp_frame_t backlog[TINYBFT_UDP_BACKLOG];  // Deferred messages in arrival order
+static uint32_t backlog_count;
+static uint64_t backlog_at;  // Replica position the backlog was last offered at
+static uint64_t backlog_pre_prepares;  // and the PRE-PREPAREs it had handled then
+static tinybft_udp_stats_t counters;
+
+// Client side
+static udp_client_t clients[TINYBFT_MAX_CLIENTS];
+static int client_fds[TINYBFT_MAX_CLIENTS];
+static int client_epfd = -1;
+static udp_batch_t client_out;
+static udp_batch_t client_in;
+static bool read_only_gets = true;
+static uint64_t client_syscalls;
+static uint64_t client_bytes;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+void tinybft_udp_default_config(tinybft_udp_config_t* cfg) {
+    cfg->batch_size = TINYBFT_MAX_BATCH;
+    cfg->pipeline_depth = TINYBFT_WINDOW_SIZE;
+    cfg->base_port = TINYBFT_UDP_PORT;
+    cfg->read_only_gets = true;
+    cfg->tentative = false;
+    cfg->exec_threads = 0;
+}
+
+bool tinybft_udp_set_endpoint(uint32_t endpoint, const char* ipv4, uint16_t port) {
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (endpoint >= TINYBFT_MAX_ENDPOINTS || inet_pton(AF_INET, ipv4, &addr.sin_addr) != 1) {
+        return false;
+    }
+    endpoints[endpoint] = addr;
+    endpoint_set[endpoint] = true;
+    return true;
+}
+
+// Endpoints nobody placed elsewhere are on the loopback interface
+static void default_endpoints(uint16_t base_port) {
+    for (uint32_t e = 0; e < TINYBFT_MAX_ENDPOINTS; e++) {
+        if (!endpoint_set[e]) {
+            memset(&endpoints[e], 0, sizeof(endpoints[e]));
+            endpoints[e].sin_family = AF_INET;
+            endpoints[e].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            endpoints[e].sin_port = htons((uint16_t)(base_port + e));
+        }
+    }
+}
+
+// Non-blocking socket bound to the endpoint's address
+static int open_socket(uint32_t endpoint) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int size = SOCKET_BUFFER;
+
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    if (bind(fd, (const struct sockaddr*)&endpoints[endpoint], sizeof(endpoints[endpoint])) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void batch_init(udp_batch_t* b) {
+    memset(b->msgs, 0, sizeof(b->msgs));
+    for (uint32_t i = 0; i < TINYBFT_UDP_BATCH; i++) {
+        b->iov[i].iov_base = b->bufs[i];
+        b->iov[i].iov_len = sizeof(b->bufs[i]);
+        b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+        b->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    b->count = 0;
+}
+
+// Encode a message for dest into the next datagram of the batch
+static bool batch_add(udp_batch_t* b, uint32_t dest, const tinybft_msg_header_t* hdr, const void* payload,
+                      const uint8_t* authenticator) {
+    uint32_t len = tinybft_wire_encode(hdr, payload, authenticator, b->bufs[b->count], TINYBFT_WIRE_MAX_SIZE);
+
+    if (len == 0) {
+        return false;
+    }
+    b->iov[b->count].iov_len = len;
+    b->msgs[b->count].msg_hdr.msg_name = &endpoints[dest];
+    b->msgs[b->count].msg_hdr.msg_namelen = sizeof(endpoints[dest]);
+    b->count++;
+    return true;
+}
+
+// Send the batch with as few sendmmsg() calls as the kernel takes; what it
+// refuses is lost like a datagram on the wire. Returns the datagrams sent.
+static uint32_t batch_send(udp_batch_t* b, int fd, uint64_t* calls, uint64_t* bytes) {
+    uint32_t sent = 0;
+
+    while (sent < b->count) {
+        int n = sendmmsg(fd, &b->msgs[sent], b->count - sent, 0);
+        (*calls)++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (uint32_t i = sent; i < sent + (uint32_t)n; i++) {
+            *bytes += b->iov[i].iov_len;
+        }
+        sent += (uint32_t)n;
+    }
+    b->count = 0;
+    return sent;
+}
+
+static void flush_replica(void) {
+    if (replica_out.count > 0) {
+        counters.datagrams_sent += batch_send(&replica_out, replica_fd, &counters.send_calls, &counters.bytes_sent);
+    }
+}
+
+// Send callback of the replica core: queued until the batch being handled is done
+static void udp_send(void* ctx, uint32_t dest, const tinybft_msg_header_t* hdr, const void* payload,
+                     const uint8_t* authenticator) {
+    (void)ctx;
+    if (dest >= TINYBFT_MAX_ENDPOINTS) {
+        return;
+    }
+    if (replica_out.count == TINYBFT_UDP_BATCH) {
+        flush_replica();
+    }
+    if (!batch_add(&replica_out, dest, hdr, payload, authenticator)) {
+        counters.dropped++;
+    }
+}
+
+static void udp_modify(void* ctx, const void* addr, uint32_t len) {
+    tinybft_replica_modify((tinybft_replica_t*)ctx, addr, len);
+}
+
+// Hand a verified message to the replica, received straight into its final
+// location if the replica keeps it; false if the replica defers it
+static bool offer(const tinybft_msg_header_t* hdr) {
+    uint8_t* dst = tinybft_replica_recv_buffer(&node, hdr);
+
+    if (dst != NULL) {
+        memcpy(dst, hdr, sizeof(*hdr) + hdr->data_len);
+        hdr = (const tinybft_msg_header_t*)dst;
+    }
+    return tinybft_replica_handle(&node, hdr);
+}
+
+// As in the simulator: deferred messages are offered again, in arrival
+// order, whenever the low watermark or the view has moved or another
+// PRE-PREPARE was handled
+static uint64_t backlog_position(void) {
+    return (uint64_t)node.view << 33 | (uint64_t)node.view_changing << 32 | node.memory.agreement_region.low_watermark;
+}
+
+static bool backlog_moved(void) {
+    return backlog_at != backlog_position() || backlog_pre_prepares != node.received[MSG_TYPE_PRE_PREPARE];
+}
+
+static void mark_backlog(void) {
+    backlog_at = backlog_position();
+    backlog_pre_prepares = node.received[MSG_TYPE_PRE_PREPARE];
+}
+
+static void offer_backlog(void) {
+    while (backlog_count > 0 && backlog_moved()) {
+        uint32_t kept = 0;
+
+        mark_backlog();
+        for (uint32_t i = 0; i < backlog_count; i++) {
+            const tinybft_msg_header_t* hdr = (const tinybft_msg_header_t*)backlog[i].bytes;
+            if (!offer(hdr)) {
+                if (kept != i) {
+                    memcpy(backlog[kept].bytes, hdr, sizeof(*hdr) + hdr->data_len);
+                }
+                kept++;
+            }
+        }
+        backlog_count = kept;
+    }
+}
+
+static void defer(const tinybft_msg_header_t* hdr) {
+    if (backlog_count == TINYBFT_UDP_BACKLOG) {
+        counters.dropped++;
+        return;
+    }
+    if (backlog_count == 0) {
+        mark_backlog();
+    }
+    memcpy(backlog[backlog_count++].bytes, hdr, sizeof(*hdr) + hdr->data_len);
+}
+
+// Parse the received datagrams in place, lay them out in the replica's
+// framing, check the authenticators of those from replicas in batches and
+// hand over the ones that verified in arrival order
+static void receive_batch(uint32_t count) {
+    const tinybft_msg_header_t* checks[TINYBFT_UDP_BATCH];
+    uint32_t checked[TINYBFT_UDP_BATCH];
+    bool valid[TINYBFT_UDP_BATCH];
+    bool usable[TINYBFT_UDP_BATCH];
+    uint32_t pending = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        tinybft_wire_msg_t msg;
+
+        // Messages between replicas, and only those, are authenticated
+        usable[i] = tinybft_wire_parse(replica_in.bufs[i], replica_in.msgs[i].msg_len, &msg) &&
+                    msg.hdr.sender_id < TINYBFT_MAX_ENDPOINTS &&
+                    (msg.authenticator != NULL) == (msg.hdr.sender_id < NUM_REPLICAS);
+        if (!usable[i]) {
+            counters.dropped++;
+            continue;
+        }
+        tinybft_wire_unpack(&msg, frames[i].bytes);
+        if (msg.authenticator != NULL) {
+            checks[pending] = (const tinybft_msg_header_t*)frames[i].bytes;
+            checked[pending++] = i;
+        }
+    }
+
+    for (uint32_t k = 0; k < pending; k += TINYBFT_AUTH_BATCH) {
+        uint32_t n = pending - k < TINYBFT_AUTH_BATCH ? pending - k : TINYBFT_AUTH_BATCH;
+        tinybft_replica_verify(&node, &checks[k], n, &valid[k]);
+    }
+    for (uint32_t k = 0; k < pending; k++) {
+        usable[checked[k]] = valid[k];
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const tinybft_msg_header_t* hdr = (const tinybft_msg_header_t*)frames[i].bytes;
+        if (!usable[i]) {
+            continue;
+        }
+        if (offer(hdr)) {
+            offer_backlog();
+        } else {
+            defer(hdr);
+        }
+    }
+}
+
+static void publish(tinybft_udp_stats_t* stats) {
+    counters.committed = node.committed;
+    counters.executed = node.executed;
+    counters.tentative = node.tentative;
+    counters.rollbacks = node.rollbacks;
+    counters.parallel_runs = node.parallel_runs;
+    counters.parallel_tasks = node.parallel_tasks;
+    counters.checkpoints = node.checkpoints;
+    counters.checkpoint_blocks = node.checkpoint_blocks;
+    counters.stable_checkpoints = node.stable_checkpoints;
+    counters.transfers = node.transfers;
+    counters.transfer_blocks = node.transfer_blocks;
+    counters.forged = node.forged;
+    counters.last_executed = node.last_executed;
+    counters.view = node.view;
+    counters.view_changes = node.view_changes;
+    counters.view_commit_ms = node.view_commit_ms;
+    counters.view_timeout = tinybft_view_timeout(&node);
+    counters.high_water = node.memory.high_water;
+    memcpy(counters.scratch_high_water, node.memory.scratch_region.high_water, sizeof(counters.scratch_high_water));
+    memcpy(counters.received, node.received, sizeof(counters.received));
+    memcpy(counters.copied_bytes, node.copied_bytes, sizeof(counters.copied_bytes));
+    if (stats != NULL) {
+        *stats = counters;
+    }
+}
+
+bool tinybft_udp_run_replica(uint32_t id, const tinybft_udp_config_t* cfg, tinybft_udp_stats_t* stats) {
+    tinybft_udp_config_t defaults;
+    struct epoll_event ev = { .events = EPOLLIN };
+
+    if (cfg == NULL) {
+        tinybft_udp_default_config(&defaults);
+        cfg = &defaults;
+    }
+    if (id >= NUM_REPLICAS) {
+        return false;
+    }
+
+    default_endpoints(cfg->base_port);
+    replica_fd = open_socket(id);
+    if (replica_fd < 0) {
+        return false;
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, replica_fd, &ev) != 0) {
+        if (epfd >= 0) {
+            close(epfd);
+        }
+        close(replica_fd);
+        return false;
+    }
+
+    tinybft_replica_init(&node, id, udp_send, &node, tinybft_engine_execute, &replicas[id]);
+    tinybft_replica_set_batch_size(&node, cfg->batch_size);
+    tinybft_replica_set_pipeline_depth(&node, cfg->pipeline_depth);
+    tinybft_replica_set_tentative(&node, cfg->tentative);
+    tinybft_engine_set_keys(&node);
+    if (cfg->exec_threads > 0) {
+        tinybft_pool_start(&pool, cfg->exec_threads);  // Runs with fewer threads if some fail to start
+        tinybft_replica_set_parallel(&node, tinybft_engine_access, tinybft_engine_parallel, &pool);
+    }
+    tinybft_replica_set_state(&node, &replicas[id].kv_store.state, sizeof(replicas[id].kv_store.state));
+    tinybft_kv_set_modify(&replicas[id].kv_store, udp_modify, &node);
+
+    batch_init(&replica_out);
+    batch_init(&replica_in);
+    memset(&counters, 0, sizeof(counters));
+    backlog_count = 0;
+
+    // Sleep in epoll until datagrams arrive or the next tick is due; a full
+    // recvmmsg() batch may have left more behind, so drain before waiting again
+    bool drain = false;
+    while (!stopping) {
+        if (!drain) {
+            counters.wait_calls++;
+            drain = epoll_wait(epfd, &ev, 1, 1) > 0;
+        }
+        if (drain) {
+            counters.recv_calls++;
+            int n = recvmmsg(replica_fd, replica_in.msgs, TINYBFT_UDP_BATCH, MSG_DONTWAIT, NULL);
+            if (n > 0) {
+                counters.datagrams_received += (uint32_t)n;
+                receive_batch((uint32_t)n);
+            }
+            drain = n == TINYBFT_UDP_BATCH;
+        }
+
+        tinybft_replica_tick(&node, now_ms());
+        offer_backlog();
+        flush_replica();
+        publish(stats);
+    }
+
+    if (cfg->exec_threads > 0) {
+        tinybft_pool_stop(&pool);
+    }
+    close(epfd);
+    close(replica_fd);
+    replica_fd = -1;
+    return true;
+}
+
+void tinybft_udp_stop(void) {
+    stopping = 1;
+}
+
+bool tinybft_udp_clients_open(const tinybft_udp_config_t* cfg) {
+    tinybft_udp_config_t defaults;
+
+    if (cfg == NULL) {
+        tinybft_udp_default_config(&defaults);
+        cfg = &defaults;
+    }
+    if (client_epfd >= 0) {
+        return false;
+    }
+
+    default_endpoints(cfg->base_port);
+    client_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (client_epfd < 0) {
+        return false;
+    }
+    for (uint32_t c = 0; c < TINYBFT_MAX_CLIENTS; c++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = c };
+        client_fds[c] = open_socket(TINYBFT_CLIENT_ENDPOINT(c));
+        if (client_fds[c] < 0 || epoll_ctl(client_epfd, EPOLL_CTL_ADD, client_fds[c], &ev) != 0) {
+            for (uint32_t j = 0; j <= c; j++) {
+                if (client_fds[j] >= 0) {
+                    close(client_fds[j]);
+                }
+            }
+            close(client_epfd);
+            client_epfd = -1;
+            return false;
+        }
+    }
+
+    memset(clients, 0, sizeof(clients));
+    batch_init(&client_out);
+    batch_init(&client_in);
+    read_only_gets = cfg->read_only_gets;
+    client_syscalls = 0;
+    client_bytes = 0;
+    return true;
+}
+
+void tinybft_udp_clients_close(void) {
+    if (client_epfd < 0) {
+        return;
+    }
+    for (uint32_t c = 0; c < TINYBFT_MAX_CLIENTS; c++) {
+        close(client_fds[c]);
+    }
+    close(client_epfd);
+    client_epfd = -1;
+}
+
+static void flush_clients(void) {
+    if (client_out.count > 0) {
+        batch_send(&client_out, client_fds[0], &client_syscalls, &client_bytes);
+    }
+}
+
+// Queue the client's request for dest; any client socket can carry it
+static void client_send(uint32_t client, uint32_t dest) {
+    udp_request_t* request = &clients[client].request;
+
+    if (client_out.count == TINYBFT_UDP_BATCH) {
+        flush_clients();
+    }
+    batch_add(&client_out, dest, &request->hdr, &request->req, NULL);
+}
+
+// Send the request under a fresh timestamp, as tinybft_engine_submit does
+static void send_request(uint32_t client, bool read_only) {
+    udp_client_t* cl = &clients[client];
+
+    cl->timestamp++;
+    cl->read_only = read_only;
+    cl->request.req.timestamp = cl->timestamp;
+    cl->request.req.flags = read_only ? TINYBFT_REQUEST_READ_ONLY : 0;
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        cl->reply_len[r] = -1;
+    }
+
+    if (read_only) {
+        cl->read_deadline = now_ms() + TINYBFT_ENGINE_READ_TIMEOUT_MS;
+        for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+            client_send(client, r);
+        }
+    } else {
+        cl->request.hdr.receiver_id = tinybft_primary(cl->view);
+        cl->request.hdr.view = cl->view;
+        cl->resend_at = now_ms() + TINYBFT_ENGINE_RESEND_MS;
+        client_send(client, cl->request.hdr.receiver_id);
+    }
+}
+
+bool tinybft_udp_submit(uint32_t client, tinybft_op_t op, const char* key, const char* value) {
+    if (client >= TINYBFT_MAX_CLIENTS || client_epfd < 0 || clients[client].pending) {
+        return false;
+    }
+
+    udp_request_t* msg = &clients[client].request;
+    size_t key_len = strnlen(key, MAX_KEY_SIZE - 1);
+    size_t value_len = (op == TINYBFT_OP_PUT && value != NULL) ? strnlen(value, MAX_VALUE_SIZE - 1) : 0;
+
+    msg->req.client_id = TINYBFT_CLIENT_ENDPOINT(client);
+    msg->req.op = (uint8_t)op;
+    msg->req.key_len = (uint8_t)key_len;
+    msg->req.value_len = (uint16_t)value_len;
+    memcpy(msg->data, key, key_len);
+    if (value_len > 0) {
+        memcpy(msg->data + key_len, value, value_len);
+    }
+
+    msg->hdr.type = MSG_TYPE_REQUEST;
+    msg->hdr.sender_id = msg->req.client_id;
+    msg->hdr.receiver_id = TINYBFT_ALL_REPLICAS;
+    msg->hdr.view = clients[client].view;
+    msg->hdr.seq_num = 0;
+    msg->hdr.data_len = tinybft_request_size(&msg->req);
+
+    clients[client].pending = true;
+    clients[client].deadline = now_ms() + TINYBFT_ENGINE_TIMEOUT_MS;
+    send_request(client, op == TINYBFT_OP_GET && read_only_gets);
+    return true;
+}
+
+// Replies count towards the client's current timestamp only. The reply is
+// read where it lies in the receive buffer, which need not be aligned.
+static void client_receive(uint32_t client, const tinybft_wire_msg_t* msg) {
+    udp_client_t* cl = &clients[client];
+    tinybft_reply_t reply;
+
+    if (msg->hdr.type != MSG_TYPE_REPLY || msg->hdr.sender_id >= NUM_REPLICAS || msg->authenticator != NULL ||
+        msg->hdr.data_len < sizeof(reply)) {
+        return;
+    }
+    memcpy(&reply, msg->payload, sizeof(reply));
+    if (reply.timestamp == cl->timestamp && reply.result_len <= MAX_VALUE_SIZE &&
+        reply.result_len <= msg->hdr.data_len - sizeof(reply)) {
+        memcpy(cl->reply[msg->hdr.sender_id], msg->payload + sizeof(reply), reply.result_len);
+        cl->reply_len[msg->hdr.sender_id] = (int)reply.result_len;
+        cl->reply_view[msg->hdr.sender_id] = msg->hdr.view;
+        cl->reply_tentative[msg->hdr.sender_id] = (reply.flags & TINYBFT_REPLY_TENTATIVE) != 0;
+    }
+}
+
+void tinybft_udp_clients_wait(uint32_t timeout_ms) {
+    struct epoll_event events[TINYBFT_MAX_CLIENTS];
+
+    if (client_epfd < 0) {
+        return;
+    }
+    flush_clients();
+
+    client_syscalls++;
+    int ready = epoll_wait(client_epfd, events, TINYBFT_MAX_CLIENTS, (int)timeout_ms);
+    for (int e = 0; e < ready; e++) {
+        uint32_t client = events[e].data.u32;
+        int n;
+
+        do {
+            client_syscalls++;
+            n = recvmmsg(client_fds[client], client_in.msgs, TINYBFT_UDP_BATCH, MSG_DONTWAIT, NULL);
+            for (int i = 0; i < n; i++) {
+                tinybft_wire_msg_t msg;
+                if (tinybft_wire_parse(client_in.bufs[i], client_in.msgs[i].msg_len, &msg)) {
+                    client_receive(client, &msg);
+                }
+            }
+        } while (n == TINYBFT_UDP_BATCH);
+    }
+}
+
+// Highest view that f+1 of the replicas that replied have reached, so at
+// least one correct replica vouches for it
+static uint32_t replied_view(const uint32_t views[NUM_REPLICAS], const int lengths[NUM_REPLICAS]) {
+    uint32_t view = 0;
+
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        uint32_t at_least = 0;
+        for (uint32_t q = 0; q < NUM_REPLICAS && lengths[r] >= 0; q++) {
+            at_least += lengths[q] >= 0 && views[q] >= views[r];
+        }
+        if (at_least >= TINYBFT_MAX_FAULTY + 1 && views[r] > view) {
+            view = views[r];
+        }
+    }
+    return view;
+}
+
+int tinybft_udp_poll(uint32_t client, char* result, uint32_t result_cap) {
+    if (client >= TINYBFT_MAX_CLIENTS || !clients[client].pending) {
+        return TINYBFT_ENGINE_TIMEOUT;
+    }
+
+    udp_client_t* cl = &clients[client];
+    uint32_t quorum = cl->read_only ? TINYBFT_QUORUM : TINYBFT_MAX_FAULTY + 1;
+    uint32_t best = 0;
+    uint32_t replied = 0;
+
+    for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+        if (cl->reply_len[r] < 0) {
+            continue;
+        }
+        replied++;
+
+        // f+1 committed replies, or 2f+1 that may be tentative
+        uint32_t matches = 0;
+        uint32_t committed = 0;
+        for (uint32_t q = 0; q < NUM_REPLICAS; q++) {
+            bool match = cl->reply_len[q] == cl->reply_len[r] &&
+                         memcmp(cl->reply[q], cl->reply[r], (size_t)cl->reply_len[r]) == 0;
+            matches += match;
+            committed += match && !cl->reply_tentative[q];
+        }
+        best = matches > best ? matches : best;
+        if (matches >= TINYBFT_QUORUM || (!cl->read_only && committed >= quorum)) {
+            cl->pending = false;
+            if (!cl->read_only && replied_view(cl->reply_view, cl->reply_len) > cl->view) {
+                cl->view = replied_view(cl->reply_view, cl->reply_len);
+            }
+            if (result != NULL) {
+                uint32_t copy = (uint32_t)cl->reply_len[r] < result_cap ? (uint32_t)cl->reply_len[r] : result_cap;
+                memcpy(result, cl->reply[r], copy);
+            }
+            return cl->reply_len[r];
+        }
+    }
+
+    uint64_t now = now_ms();
+    if (cl->read_only && (best + (NUM_REPLICAS - replied) < quorum || now > cl->read_deadline)) {
+        send_request(client, false);  // Conflicting or missing answers: order it after all
+    } else if (now > cl->deadline) {
+        cl->pending = false;
+        return TINYBFT_ENGINE_TIMEOUT;
+    } else if (!cl->read_only && now > cl->resend_at) {
+        // The primary may be faulty, or a datagram was lost: every replica
+        // gets the request under the same timestamp
+        cl->resend_at = now + TINYBFT_ENGINE_RESEND_MS;
+        for (uint32_t r = 0; r < NUM_REPLICAS; r++) {
+            client_send(client, r);
+        }
+    }
+    return TINYBFT_ENGINE_PENDING;
+}
+
+uint64_t tinybft_udp_client_syscalls(void) {
+    return client_syscalls;
+}
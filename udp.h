@@ -0,0 +1,98 @@
+#ifndef TINYBFT_UDP_H
+#define TINYBFT_UDP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pbft.h"
+
+// UDP transport: every replica runs its PBFT core in a process of its own
+// and endpoint e listens on its own UDP port, so the same code serves a
+// cluster on one host or across hosts. Messages travel in the wire format
+// of wire.h, one per datagram. A replica drains its socket with recvmmsg()
+// when epoll reports it readable, and the messages it sends while handling
+// that batch (a whole PREPARE or COMMIT broadcast among them) leave with one
+// sendmmsg().
+
+#ifndef TINYBFT_UDP_BATCH
+#define TINYBFT_UDP_BATCH 64  // Datagrams moved by one sendmmsg() or recvmmsg()
+#endif
+
+#ifndef TINYBFT_UDP_BACKLOG
+#define TINYBFT_UDP_BACKLOG 256  // Deferred messages a replica holds; more are dropped
+#endif
+
+#ifndef TINYBFT_UDP_PORT
+#define TINYBFT_UDP_PORT 47100  // Default port of endpoint 0
+#endif
+
+typedef struct {
+    uint32_t batch_size;      // Maximum client requests per PRE-PREPARE
+    uint32_t pipeline_depth;  // Agreement instances in flight (1..TINYBFT_WINDOW_SIZE)
+    uint16_t base_port;       // Endpoint e listens on base_port + e unless tinybft_udp_set_endpoint moved it
+    bool read_only_gets;      // As in tinybft_engine_config_t
+    bool tentative;           // As in tinybft_engine_config_t
+    uint32_t exec_threads;    // As in tinybft_engine_config_t
+} tinybft_udp_config_t;
+
+// Counters of one replica process. tinybft_udp_run_replica() keeps them up
+// to date, so they may live in memory shared with the process that started it.
+typedef struct {
+    uint64_t datagrams_sent;
+    uint64_t datagrams_received;
+    uint64_t bytes_sent;
+    uint64_t send_calls;   // sendmmsg()
+    uint64_t recv_calls;   // recvmmsg()
+    uint64_t wait_calls;   // epoll_wait()
+    uint64_t dropped;      // Malformed datagrams, and deferred messages beyond TINYBFT_UDP_BACKLOG
+    // The replica core's own counters (see tinybft_replica_t)
+    uint64_t committed;
+    uint64_t executed;
+    uint64_t tentative;
+    uint64_t rollbacks;
+    uint64_t parallel_runs;
+    uint64_t parallel_tasks;
+    uint64_t checkpoints;
+    uint64_t checkpoint_blocks;
+    uint64_t stable_checkpoints;
+    uint64_t transfers;
+    uint64_t transfer_blocks;
+    uint64_t forged;
+    uint32_t last_executed;
+    uint32_t view;
+    uint64_t view_changes;
+    uint64_t view_commit_ms;
+    uint32_t view_timeout;
+    tinybft_memory_usage_t high_water;
+    uint32_t scratch_high_water[TINYBFT_SCRATCH_CLASSES];
+    uint64_t received[TINYBFT_MSG_TYPES];
+    uint64_t copied_bytes[TINYBFT_MSG_TYPES];
+} tinybft_udp_stats_t;
+
+void tinybft_udp_default_config(tinybft_udp_config_t* cfg);
+
+// Address of an endpoint, instead of 127.0.0.1 and base_port + endpoint;
+// false for an unknown endpoint or an address that is not dotted IPv4
+bool tinybft_udp_set_endpoint(uint32_t endpoint, const char* ipv4, uint16_t port);
+
+// Run replica `id` of replicas[] in the calling process until
+// tinybft_udp_stop(); returns false if its socket cannot be set up
+bool tinybft_udp_run_replica(uint32_t id, const tinybft_udp_config_t* cfg, tinybft_udp_stats_t* stats);
+
+// Make tinybft_udp_run_replica() return; safe to call from a signal handler
+void tinybft_udp_stop(void);
+
+// Client side, as tinybft_engine_submit/poll: open the sockets of clients
+// 0..TINYBFT_MAX_CLIENTS-1 in the calling process
+bool tinybft_udp_clients_open(const tinybft_udp_config_t* cfg);
+void tinybft_udp_clients_close(void);
+bool tinybft_udp_submit(uint32_t client, tinybft_op_t op, const char* key, const char* value);
+int tinybft_udp_poll(uint32_t client, char* result, uint32_t result_cap);
+
+// Send the requests submitted since the last call in one sendmmsg(), then
+// wait up to timeout_ms for replies and collect them
+void tinybft_udp_clients_wait(uint32_t timeout_ms);
+
+// System calls the clients made (sendmmsg, recvmmsg and epoll_wait)
+uint64_t tinybft_udp_client_syscalls(void);
+
+#endif // TINYBFT_UDP_H
@@ -0,0 +1,115 @@
+#include "wire.h"
+#include <string.h>
+
+#define HEADER_SIZE ((uint32_t)sizeof(tinybft_msg_header_t))
+#define MAX_PAYLOAD (TINYBFT_MAX_MSG_SIZE - HEADER_SIZE)
+
+// Payloads go on the wire as laid out in memory
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The wire format assumes a little-endian host");
+_Static_assert(TINYBFT_MSG_TYPES <= TINYBFT_WIRE_TYPE_MASK + 1, "Message types fit in the type byte");
+
+static uint8_t* put_varint(uint8_t* p, uint32_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+// Decode a varint of at most 5 bytes ending before end; NULL if it runs
+// past end or does not fit in 32 bits
+static const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, uint32_t* value) {
+    uint32_t v = 0;
+
+    for (uint32_t shift = 0; shift < 35 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        if (shift == 28 && b > 0x0f) {
+            return NULL;
+        }
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            *value = v;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+uint32_t tinybft_wire_encode(const tinybft_msg_header_t* hdr, const void* payload, const uint8_t* authenticator,
+                             uint8_t* out, uint32_t cap) {
+    uint8_t header[TINYBFT_WIRE_MAX_HEADER];
+    bool digest = hdr->data_len == TINYBFT_DIGEST_SIZE;
+    uint32_t auth_len = authenticator != NULL ? TINYBFT_AUTHENTICATOR_SIZE : 0;
+
+    if ((uint32_t)hdr->type >= TINYBFT_MSG_TYPES || hdr->data_len > MAX_PAYLOAD) {
+        return 0;
+    }
+
+    uint8_t* p = header;
+    *p++ = (uint8_t)((uint32_t)hdr->type | (digest ? TINYBFT_WIRE_DIGEST : 0) | (auth_len > 0 ? TINYBFT_WIRE_AUTH : 0));
+    p = put_varint(p, hdr->sender_id);
+    p = put_varint(p, hdr->receiver_id + 1);
+    p = put_varint(p, hdr->view);
+    p = put_varint(p, hdr->seq_num);
+    if (!digest) {
+        p = put_varint(p, hdr->data_len);
+    }
+
+    uint32_t header_len = (uint32_t)(p - header);
+    uint32_t len = header_len + hdr->data_len + auth_len;
+    if (len > cap) {
+        return 0;
+    }
+    memcpy(out, header, header_len);
+    memcpy(out + header_len, payload, hdr->data_len);
+    if (auth_len > 0) {
+        memcpy(out + header_len + hdr->data_len, authenticator, auth_len);
+    }
+    return len;
+}
+
+bool tinybft_wire_parse(const uint8_t* buf, uint32_t len, tinybft_wire_msg_t* msg) {
+    const uint8_t* end = buf + len;
+    const uint8_t* p = buf;
+    uint32_t receiver;
+
+    if (len == 0 || (*p & ~(TINYBFT_WIRE_TYPE_MASK | TINYBFT_WIRE_DIGEST | TINYBFT_WIRE_AUTH)) != 0 ||
+        (*p & TINYBFT_WIRE_TYPE_MASK) >= TINYBFT_MSG_TYPES) {
+        return false;
+    }
+    uint8_t flags = *p++;
+    msg->hdr.type = (tinybft_msg_type_t)(flags & TINYBFT_WIRE_TYPE_MASK);
+
+    if ((p = get_varint(p, end, &msg->hdr.sender_id)) == NULL || (p = get_varint(p, end, &receiver)) == NULL ||
+        (p = get_varint(p, end, &msg->hdr.view)) == NULL || (p = get_varint(p, end, &msg->hdr.seq_num)) == NULL) {
+        return false;
+    }
+    msg->hdr.receiver_id = receiver - 1;
+    if (flags & TINYBFT_WIRE_DIGEST) {
+        msg->hdr.data_len = TINYBFT_DIGEST_SIZE;
+    } else if ((p = get_varint(p, end, &msg->hdr.data_len)) == NULL) {
+        return false;
+    }
+
+    // Exactly the payload and the authenticator are left
+    uint32_t auth_len = (flags & TINYBFT_WIRE_AUTH) ? TINYBFT_AUTHENTICATOR_SIZE : 0;
+    if (msg->hdr.data_len > MAX_PAYLOAD || (uint32_t)(end - p) != msg->hdr.data_len + auth_len) {
+        return false;
+    }
+    msg->payload = p;
+    msg->authenticator = auth_len > 0 ? p + msg->hdr.data_len : NULL;
+    return true;
+}
+
+uint32_t tinybft_wire_unpack(const tinybft_wire_msg_t* msg, uint8_t* dst) {
+    uint32_t len = HEADER_SIZE + msg->hdr.data_len;
+
+    memcpy(dst, &msg->hdr, HEADER_SIZE);
+    memcpy(dst + HEADER_SIZE, msg->payload, msg->hdr.data_len);
+    if (msg->authenticator != NULL) {
+        memcpy(dst + len, msg->authenticator, TINYBFT_AUTHENTICATOR_SIZE);
+        len += TINYBFT_AUTHENTICATOR_SIZE;
+    }
+    return len;
+}
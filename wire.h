@@ -0,0 +1,53 @@
+#ifndef TINYBFT_WIRE_H
+#define TINYBFT_WIRE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory_layout.h"
+#include "auth.h"
+
+// Wire format. tinybft_msg_header_t is the in-memory framing replicas work
+// on; between hosts a message travels as
+//
+//   type      1 byte: message type in bits 0-4, TINYBFT_WIRE_DIGEST, TINYBFT_WIRE_AUTH
+//   sender    varint
+//   receiver  varint, receiver_id + 1 (0 for TINYBFT_ALL_REPLICAS)
+//   view      varint
+//   seq_num   varint
+//   data_len  varint, then data_len payload bytes (absent with TINYBFT_WIRE_DIGEST)
+//   digest    TINYBFT_DIGEST_SIZE bytes if the payload is a single digest
+//   authenticator  TINYBFT_AUTHENTICATOR_SIZE bytes with TINYBFT_WIRE_AUTH
+//
+// Varints are little-endian base-128 (LEB128), at most 5 bytes. Payload
+// structures are little-endian with the layout declared in pbft.h. A vote
+// carries a header of 4 to 8 bytes instead of sizeof(tinybft_msg_header_t).
+
+#define TINYBFT_WIRE_TYPE_MASK 0x1fu
+#define TINYBFT_WIRE_DIGEST 0x20u  // Payload is one digest; its length is implied
+#define TINYBFT_WIRE_AUTH 0x40u    // An authenticator follows
+
+#define TINYBFT_WIRE_MAX_HEADER (1 + 5 * 5)
+#define TINYBFT_WIRE_MAX_SIZE \
+    (TINYBFT_WIRE_MAX_HEADER + TINYBFT_MAX_MSG_SIZE - (uint32_t)sizeof(tinybft_msg_header_t) + TINYBFT_AUTHENTICATOR_SIZE)
+
+// A parsed message: the decoded header and views into the receive buffer
+typedef struct {
+    tinybft_msg_header_t hdr;
+    const uint8_t* payload;        // hdr.data_len bytes
+    const uint8_t* authenticator;  // TINYBFT_AUTHENTICATOR_SIZE bytes, or NULL
+} tinybft_wire_msg_t;
+
+// Encode a message into out; returns its length, or 0 if it does not fit in
+// cap or its header is out of range
+uint32_t tinybft_wire_encode(const tinybft_msg_header_t* hdr, const void* payload, const uint8_t* authenticator,
+                             uint8_t* out, uint32_t cap);
+
+// Validate the len bytes at buf as exactly one message without copying any
+// of it; false for a truncated, overlong or malformed one
+bool tinybft_wire_parse(const uint8_t* buf, uint32_t len, tinybft_wire_msg_t* msg);
+
+// Lay a parsed message out in the in-memory framing at dst (header, payload,
+// then the authenticator if any); returns the bytes written
+uint32_t tinybft_wire_unpack(const tinybft_wire_msg_t* msg, uint8_t* dst);
+
+#endif // TINYBFT_WIRE_H
@@ -0,0 +1,187 @@
+#include "worker_pool.h"
+#include <sched.h>
+#include <string.h>
+
+#define DEQUE_MASK (TINYBFT_POOL_DEQUE_SIZE - 1)
+
+enum {
+    STEAL_EMPTY,
+    STEAL_LOST,   // Another thread took the task first
+    STEAL_TAKEN
+};
+
+// Owner only
+static void deque_push(tinybft_deque_t* d, uint32_t task) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->tasks[b & DEQUE_MASK], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+// Owner only: the newest task. The last one left goes to whoever of the
+// owner and a thief moves top first.
+static bool deque_pop(tinybft_deque_t* d, uint32_t* task) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    *task = __atomic_load_n(&d->tasks[b & DEQUE_MASK], __ATOMIC_RELAXED);
+    if (t < b) {
+        return true;
+    }
+    bool won = __atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+// Any thread: the oldest task
+static int deque_steal(tinybft_deque_t* d, uint32_t* task) {
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+
+    if (t >= b) {
+        return STEAL_EMPTY;
+    }
+    uint32_t stolen = __atomic_load_n(&d->tasks[t & DEQUE_MASK], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return STEAL_LOST;
+    }
+    *task = stolen;
+    return STEAL_TAKEN;
+}
+
+// Take a task from another thread's deque; false once all of them are empty
+static bool steal_any(tinybft_pool_t* pool, uint32_t self, uint32_t* task) {
+    uint32_t threads = pool->workers + 1;
+    bool lost;
+
+    do {
+        lost = false;
+        for (uint32_t k = 1; k < threads; k++) {
+            int outcome = deque_steal(&pool->deques[(self + k) % threads], task);
+            if (outcome == STEAL_TAKEN) {
+                __atomic_add_fetch(&pool->steals, 1, __ATOMIC_RELAXED);
+                return true;
+            }
+            lost = lost || outcome == STEAL_LOST;
+        }
+    } while (lost);
+    return false;
+}
+
+// Push thread self's share of the round: every (workers+1)-th task
+static void push_share(tinybft_pool_t* pool, uint32_t self, uint32_t first, uint32_t count) {
+    for (uint32_t i = self; i < count; i += pool->workers + 1) {
+        deque_push(&pool->deques[self], first + i);
+    }
+}
+
+// Run tasks until no deque has any left
+static void work(tinybft_pool_t* pool, uint32_t self) {
+    uint32_t task;
+
+    while (deque_pop(&pool->deques[self], &task) || steal_any(pool, self, &task)) {
+        pool->task(pool->arg, task);
+        __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void* worker_thread(void* arg) {
+    tinybft_pool_worker_t* ctx = (tinybft_pool_worker_t*)arg;
+    tinybft_pool_t* pool = ctx->pool;
+    uint32_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->stopping && pool->generation == seen) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stopping) {
+            break;
+        }
+        uint32_t first = pool->first;
+        uint32_t count = pool->count;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        push_share(pool, ctx->index, first, count);
+        work(pool, ctx->index);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+bool tinybft_pool_start(tinybft_pool_t* pool, uint32_t workers) {
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    if (workers > TINYBFT_POOL_MAX_WORKERS) {
+        return false;
+    }
+
+    for (uint32_t w = 0; w < workers; w++) {
+        pool->ctx[w].pool = pool;
+        pool->ctx[w].index = w;
+        if (pthread_create(&pool->threads[w], NULL, worker_thread, &pool->ctx[w]) != 0) {
+            return false;
+        }
+        pool->workers++;
+    }
+    return true;
+}
+
+// One round fills each deque at most TINYBFT_POOL_DEQUE_SIZE deep
+static void run_round(tinybft_pool_t* pool, uint32_t first, uint32_t count) {
+    uint32_t self = pool->workers;
+
+    __atomic_store_n(&pool->pending, count, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&pool->lock);
+    pool->first = first;
+    pool->count = count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    push_share(pool, self, first, count);
+    work(pool, self);
+    while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0) {
+        sched_yield();  // Workers still run their last tasks, or have not woken up to push their share
+        work(pool, self);
+    }
+}
+
+void tinybft_pool_run(tinybft_pool_t* pool, uint32_t count, tinybft_pool_task_fn task, void* arg) {
+    uint32_t round = (pool->workers + 1) * TINYBFT_POOL_DEQUE_SIZE;
+
+    pool->task = task;
+    pool->arg = arg;
+    pool->runs++;
+    if (pool->workers == 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            task(arg, i);
+        }
+        return;
+    }
+    for (uint32_t first = 0; first < count; first += round) {
+        run_round(pool, first, count - first < round ? count - first : round);
+    }
+}
+
+void tinybft_pool_stop(tinybft_pool_t* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t w = 0; w < pool->workers; w++) {
+        pthread_join(pool->threads[w], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pool->workers = 0;
+}
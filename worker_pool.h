@@ -0,0 +1,70 @@
+#ifndef TINYBFT_WORKER_POOL_H
+#define TINYBFT_WORKER_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Fixed pool of worker threads running the tasks of one call at a time,
+// together with the calling thread. Each thread owns a Chase-Lev
+// work-stealing deque: it pushes its share of the tasks and pops them from
+// the bottom, and once it runs dry it steals from the top of the others'.
+// Threads sleep on a condition variable between calls.
+
+#ifndef TINYBFT_POOL_MAX_WORKERS
+#define TINYBFT_POOL_MAX_WORKERS 8  // Threads a pool starts besides its caller
+#endif
+
+#ifndef TINYBFT_POOL_DEQUE_SIZE
+#define TINYBFT_POOL_DEQUE_SIZE 64  // Tasks a deque holds (must be a power of two)
+#endif
+
+_Static_assert((TINYBFT_POOL_DEQUE_SIZE & (TINYBFT_POOL_DEQUE_SIZE - 1)) == 0,
+               "TINYBFT_POOL_DEQUE_SIZE must be a power of two");
+
+typedef void (*tinybft_pool_task_fn)(void* arg, uint32_t task);
+
+typedef struct {
+    int64_t top;     // Thieves take from here
+    uint8_t pad_top[64 - sizeof(int64_t)];
+    int64_t bottom;  // The owner pushes and pops here
+    uint8_t pad_bottom[64 - sizeof(int64_t)];
+    uint32_t tasks[TINYBFT_POOL_DEQUE_SIZE];
+} tinybft_deque_t;
+
+struct tinybft_pool;
+
+typedef struct {
+    struct tinybft_pool* pool;
+    uint32_t index;
+} tinybft_pool_worker_t;
+
+typedef struct tinybft_pool {
+    uint32_t workers;
+    tinybft_deque_t deques[TINYBFT_POOL_MAX_WORKERS + 1];  // The caller owns the last one
+    tinybft_pool_task_fn task;
+    void* arg;
+    uint32_t first;       // Tasks first..first+count-1 make up the current round
+    uint32_t count;
+    uint32_t pending;     // Tasks of the round not finished yet
+    uint32_t generation;  // Rounds started
+    bool stopping;
+    uint64_t runs;        // Calls to tinybft_pool_run
+    uint64_t steals;      // Tasks run by a thread other than the one that pushed them
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t threads[TINYBFT_POOL_MAX_WORKERS];
+    tinybft_pool_worker_t ctx[TINYBFT_POOL_MAX_WORKERS];
+} tinybft_pool_t;
+
+// Start `workers` threads (at most TINYBFT_POOL_MAX_WORKERS); 0 makes
+// tinybft_pool_run() run everything on the caller. On failure the pool runs
+// with the threads it could start, and still needs tinybft_pool_stop().
+bool tinybft_pool_start(tinybft_pool_t* pool, uint32_t workers);
+
+// Run task(arg, i) for every i < count and return once all have finished
+void tinybft_pool_run(tinybft_pool_t* pool, uint32_t count, tinybft_pool_task_fn task, void* arg);
+
+void tinybft_pool_stop(tinybft_pool_t* pool);
+
+#endif // TINYBFT_WORKER_POOL_H